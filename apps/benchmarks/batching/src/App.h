@@ -0,0 +1,112 @@
+#pragma once
+#include "app/BaseApp.h"
+
+namespace limas {
+
+using namespace std;
+
+// Renderer のバッチ描画と 1 図形ずつの描画を比べる
+// b: バッチの切り替え / 上下: 図形の数
+class App : public BaseApp {
+ public:
+  using BaseApp::BaseApp;
+
+  void setup() {
+    setVerticalSync(false);
+    setGpuProfiling(true);
+    math::seedRandom(0);
+    makeShapes(10000);
+  }
+
+  void draw() {
+    gl::clearColor(0, 0, 0, 0);
+
+    gl::pushMatrix();
+    gl::setOrthoView(getWidth(), getHeight());
+
+    auto& batch = getRenderer()->getBatch();
+    batch.resetCounters();
+
+    gl::setBatching(b_batching_);
+    PreciseStopwatch stopwatch;
+    stopwatch.start();
+    for (const auto& s : shapes_) {
+      gl::setColor(s.color);
+      if (s.b_circle)
+        gl::drawCircle(s.position * getWindowSize(), s.size * 0.5f);
+      else
+        gl::drawRectangle(s.position * getWindowSize(), s.size, s.size);
+    }
+    gl::flush();
+    cpu_ms_ += stopwatch.getElapsedInMilliseconds();
+    gpu_ms_ += getGpuTime();
+    num_draws_ = b_batching_ ? batch.getNumDraws() : shapes_.size();
+    gl::setBatching(false);
+
+    if (++num_frames_ == NUM_AVERAGED_FRAMES) report();
+
+    gl::setColor(0, 0, 0, 0.7);
+    gl::drawRectangle(0, 0, 360, 70);
+    gl::setColor(1, 1, 1, 1);
+    gl::drawBitmapString("FPS:" + utils::toString(getFPS(), 2, 6, '0'), 5, 5);
+    gl::drawBitmapString(result_, 5, 15);
+    gl::drawBitmapString("[b] batching: " + string(b_batching_ ? "on" : "off"),
+                         5, 55);
+    gl::popMatrix();
+  }
+
+  void keyPressed(const KeyEventArgs &e) {
+    if (e.key == 'b') b_batching_ = !b_batching_;
+    if (e.key == GLFW_KEY_UP) makeShapes(shapes_.size() * 2);
+    if (e.key == GLFW_KEY_DOWN) makeShapes(max<size_t>(shapes_.size() / 2, 1));
+  }
+
+ private:
+  static constexpr int NUM_AVERAGED_FRAMES = 120;
+
+  struct Shape {
+    glm::vec2 position;
+    float size;
+    Color color;
+    bool b_circle;
+  };
+
+  void makeShapes(size_t n) {
+    shapes_.resize(n);
+    for (auto& s : shapes_) {
+      s.position = glm::vec2(math::randFloat(), math::randFloat());
+      s.size = math::randFloat(2, 12);
+      s.color = Color::fromHsv(math::randFloat(), 0.6, 1, 0.8);
+      s.b_circle = math::randFloat() < 0.25f;
+    }
+    resetAverage();
+  }
+
+  void resetAverage() {
+    cpu_ms_ = gpu_ms_ = 0;
+    num_frames_ = 0;
+  }
+
+  void report() {
+    std::stringstream ss;
+    ss << shapes_.size() << " shapes, " << num_draws_ << " draws\n"
+       << "cpu " << utils::toString(cpu_ms_ / num_frames_, 3, 7, ' ')
+       << " ms / gpu " << utils::toString(gpu_ms_ / num_frames_, 3, 7, ' ')
+       << " ms";
+    result_ = ss.str();
+    logger::info("batching") << (b_batching_ ? "on  " : "off ") << result_
+                             << logger::end();
+    resetAverage();
+  }
+
+  vector<Shape> shapes_;
+  bool b_batching_ = true;
+
+  double cpu_ms_ = 0;
+  double gpu_ms_ = 0;
+  int num_frames_ = 0;
+  size_t num_draws_ = 0;
+  string result_;
+};
+
+}  // namespace limas
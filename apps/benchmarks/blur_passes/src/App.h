@@ -0,0 +1,131 @@
+#pragma once
+#include "app/BaseApp.h"
+#include "pp/PostProcessing.h"
+#include "pp/filters/Bloom.h"
+#include "pp/filters/Blur.h"
+#include "pp/filters/DualKawase.h"
+#include "pp/filters/Gaussian.h"
+
+namespace limas {
+
+using namespace std;
+
+// ぼかしのパスを 1 つずつ有効にして、PostProcessing のパスごとの
+// GPU の時間を比べる
+// f: Blur / Gaussian / DualKawase / Bloom
+// w: 半径を広げる。Gaussian と Blur は広げるほど重くなる
+class App : public BaseApp {
+ public:
+  using BaseApp::BaseApp;
+
+  static constexpr int NUM_CIRCLES = 200;
+  static constexpr int NUM_AVERAGED_FRAMES = 120;
+
+  void setup() {
+    setVerticalSync(false);
+    setGpuProfiling(true);
+
+    pp_.setup(getWidth(), getHeight());
+    pp_.setProfiler(getGpuProfiler());
+    names_ = {"blur", "gaussian", "dual_kawase", "bloom"};
+    pp_.addPass<pp::Blur>(names_[0]);
+    pp_.addPass<pp::Gaussian>(names_[1]);
+    pp_.addPass<pp::DualKawase>(names_[2]);
+    pp_.addPass<pp::Bloom>(names_[3]);
+    setPass(0);
+    setWide(false);
+  }
+
+  void draw() {
+    gl::clearColor(0, 0, 0, 0);
+
+    gl::pushMatrix();
+    gl::setOrthoView(getWidth(), getHeight());
+
+    // 明るい所が残るように白に近い円を描く
+    pp_.bind();
+    gl::clearColor(0, 0, 0, 1);
+    const float t = getElapsedSeconds();
+    for (int i = 0; i < NUM_CIRCLES; i++) {
+      const float x = std::sin(t * 0.3f + i * 1.7f) * 0.5f + 0.5f;
+      const float y = std::cos(t * 0.2f + i * 2.3f) * 0.5f + 0.5f;
+      gl::setColor(Color::fromHsv(i / (float)NUM_CIRCLES, 0.3, 1.0));
+      gl::drawCircle(x * getWidth(), y * getHeight(), 4 + i % 5 * 4);
+    }
+    gl::flush();
+    pp_.unbind();
+
+    gl::setColor(1, 1, 1, 1);
+    gl::drawTexture(pp_.getTexture(), 0, 0, getWidth(), getHeight());
+
+    // 結果は数フレーム遅れて届く
+    for (const auto& timing : pp_.getTimings()) {
+      if (timing.name == names_[index_]) gpu_ms_ += timing.gpu_ms;
+    }
+    frame_ms_ += getGpuTime();
+    if (++num_frames_ == NUM_AVERAGED_FRAMES) report();
+
+    gl::setColor(0, 0, 0, 0.8);
+    gl::drawRectangle(0, 0, 460, 35);
+    gl::setColor(1, 1, 1, 1);
+    gl::drawBitmapString("FPS:" + utils::toString(getFPS(), 2, 6, '0') +
+                             " [f] " + names_[index_] + " [w] " +
+                             (b_wide_ ? "wide" : "default"),
+                         5, 5);
+    gl::drawBitmapString(result_, 5, 15);
+    gl::popMatrix();
+  }
+
+  void keyPressed(const KeyEventArgs &e) {
+    if (e.key == 'f') setPass((index_ + 1) % names_.size());
+    if (e.key == 'w') setWide(!b_wide_);
+    resetAverage();
+  }
+
+ private:
+  void setPass(size_t index) {
+    index_ = index;
+    for (size_t i = 0; i < names_.size(); i++)
+      pp_.getPass(names_[i])->setEnabled(i == index_);
+  }
+
+  void setWide(bool b_wide) {
+    b_wide_ = b_wide;
+    pp_.getPass("blur")->setParam<float>("scale", b_wide_ ? 2.0f : 0.5f);
+    pp_.getPass("gaussian")
+        ->setParam<int>("radius", b_wide_ ? 24 : 6)
+        ->setParam<float>("sigma", b_wide_ ? 12.0f : 3.0f);
+    pp_.getPass("dual_kawase")->setParam<int>("iterations", b_wide_ ? 6 : 4);
+    pp_.getPass("bloom")->setParam<float>("radius", b_wide_ ? 4.0f : 1.0f);
+  }
+
+  void resetAverage() {
+    gpu_ms_ = frame_ms_ = 0;
+    num_frames_ = 0;
+  }
+
+  void report() {
+    std::stringstream ss;
+    ss << getWidth() << "x" << getHeight() << ", pass gpu "
+       << utils::toString(gpu_ms_ / num_frames_, 3, 7, ' ')
+       << " ms, frame gpu "
+       << utils::toString(frame_ms_ / num_frames_, 3, 7, ' ') << " ms";
+    result_ = ss.str();
+    logger::info("blur_passes") << names_[index_]
+                                << (b_wide_ ? " wide " : " default ")
+                                << result_ << logger::end();
+    resetAverage();
+  }
+
+  PostProcessing pp_;
+  vector<string> names_;
+  size_t index_ = 0;
+  bool b_wide_ = false;
+
+  double gpu_ms_ = 0;
+  double frame_ms_ = 0;
+  int num_frames_ = 0;
+  string result_;
+};
+
+}  // namespace limas
@@ -0,0 +1,170 @@
+#pragma once
+#include "app/BaseApp.h"
+#include "3d/Bvh.h"
+#include "3d/cam/PerspectiveCamera.h"
+
+namespace limas {
+
+using namespace std;
+
+// 10 万個の箱を視錐台カリングする CPU の時間を方法ごとに比べる
+// カメラは中心で回り、見えた箱を上から見た点で描く
+// c: Frustum で 1 個ずつ / FrustumCuller で 4 個ずつ / Bvh
+// m: 毎フレーム 1% の箱を動かす
+class App : public BaseApp {
+ public:
+  using BaseApp::BaseApp;
+
+  static constexpr int NUM_BOXES = 100000;
+  static constexpr float RADIUS = 500;
+  static constexpr int NUM_AVERAGED_FRAMES = 120;
+
+  enum Method { SCALAR, SIMD, BVH, NUM_METHODS };
+
+  void setup() {
+    setVerticalSync(false);
+
+    mins_.resize(NUM_BOXES);
+    maxs_.resize(NUM_BOXES);
+    ids_.resize(NUM_BOXES);
+    for (int i = 0; i < NUM_BOXES; i++) {
+      const glm::vec3 center(math::randFloat(-RADIUS, RADIUS),
+                             math::randFloat(-RADIUS, RADIUS),
+                             math::randFloat(-RADIUS, RADIUS));
+      const glm::vec3 half(math::randFloat(0.5, 2));
+      mins_[i] = center - half;
+      maxs_[i] = center + half;
+      boxes_.add(mins_[i], maxs_[i]);
+      ids_[i] = bvh_.insert(mins_[i], maxs_[i], i);
+    }
+    camera_.setNearClip(0.1);
+    camera_.setFarClip(RADIUS * 2);
+  }
+
+  void update() {
+    if (b_moving_) {
+      const int count = NUM_BOXES / 100;
+      for (int k = 0; k < count; k++) {
+        const int i = math::randInt(NUM_BOXES);
+        const glm::vec3 offset(math::randFloat(-3, 3), math::randFloat(-3, 3),
+                               math::randFloat(-3, 3));
+        mins_[i] += offset;
+        maxs_[i] += offset;
+        boxes_.set(i, mins_[i], maxs_[i]);
+        bvh_.update(ids_[i], mins_[i], maxs_[i]);
+      }
+    }
+
+    const float t = getElapsedSeconds() * 0.2f;
+    camera_.setPosition(glm::vec3(0));
+    camera_.lookAt(glm::vec3(std::cos(t), 0.3f, std::sin(t)));
+  }
+
+  void draw() {
+    gl::clearColor(0, 0, 0, 0);
+
+    const Frustum frustum(
+        camera_.getModelViewProjectionMatrix(0, 0, getWidth(), getHeight()));
+    visible_.clear();
+    CullStats stats;
+    if (method_ == SCALAR) {
+      const auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < NUM_BOXES; i++) {
+        if (frustum.isBoundingBoxInside(mins_[i], maxs_[i]))
+          visible_.push_back(i);
+      }
+      stats.num_objects = stats.num_tested = NUM_BOXES;
+      stats.num_visible = visible_.size();
+      stats.elapsed_ms = std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+    } else if (method_ == SIMD) {
+      stats = FrustumCuller::cull(frustum, boxes_, flags_);
+      for (int i = 0; i < NUM_BOXES; i++) {
+        if (flags_[i]) visible_.push_back(i);
+      }
+    } else {
+      stats = bvh_.cull(frustum, [&](int i) { visible_.push_back(i); });
+    }
+    sum_.num_tested += stats.num_tested;
+    sum_.num_visible += stats.num_visible;
+    sum_.num_nodes_visited += stats.num_nodes_visited;
+    sum_.elapsed_ms += stats.elapsed_ms;
+
+    if (++num_frames_ == NUM_AVERAGED_FRAMES) report();
+
+    // 上から見た位置に点を打つ
+    points_.clearVertices();
+    const float scale = std::min(getWidth(), getHeight()) / (RADIUS * 2);
+    for (int i : visible_) {
+      const glm::vec3 c = (mins_[i] + maxs_[i]) * 0.5f;
+      points_.addVertex(glm::vec3(getWidth() * 0.5f + c.x * scale,
+                                  getHeight() * 0.5f + c.z * scale, 0));
+    }
+    points_.update();
+
+    gl::pushMatrix();
+    gl::setOrthoView(getWidth(), getHeight());
+    gl::setColor(1, 1, 1, 1);
+    if (points_.getNumVertices() > 0) gl::drawMesh(points_, GL_POINTS);
+    gl::setColor(0, 0, 0, 0.8);
+    gl::drawRectangle(0, 0, 460, 35);
+    gl::setColor(1, 1, 1, 1);
+    gl::drawBitmapString("FPS:" + utils::toString(getFPS(), 2, 6, '0') +
+                             " [c] " + getMethodName() + " [m] " +
+                             (b_moving_ ? "moving" : "static"),
+                         5, 5);
+    gl::drawBitmapString(result_, 5, 15);
+    gl::popMatrix();
+  }
+
+  void keyPressed(const KeyEventArgs &e) {
+    if (e.key == 'c') method_ = (Method)((method_ + 1) % NUM_METHODS);
+    if (e.key == 'm') b_moving_ = !b_moving_;
+    resetAverage();
+  }
+
+ private:
+  string getMethodName() const {
+    if (method_ == SCALAR) return "scalar";
+    if (method_ == SIMD) return "simd";
+    return "bvh";
+  }
+
+  void resetAverage() {
+    sum_ = CullStats();
+    num_frames_ = 0;
+  }
+
+  // Bvh の箱は太らせてあるので、見える数は他より少し多くなる
+  void report() {
+    std::stringstream ss;
+    ss << "cull " << utils::toString(sum_.elapsed_ms / num_frames_, 3, 7, ' ')
+       << " ms, visible " << sum_.num_visible / num_frames_ << "/"
+       << NUM_BOXES << "\ntested " << sum_.num_tested / num_frames_
+       << " nodes visited " << sum_.num_nodes_visited / num_frames_;
+    result_ = ss.str();
+    logger::info("culling") << getMethodName() << " " << result_
+                            << logger::end();
+    resetAverage();
+  }
+
+  vector<glm::vec3> mins_;
+  vector<glm::vec3> maxs_;
+  FrustumCuller::Boxes boxes_;
+  Bvh<int> bvh_;
+  vector<Bvh<int>::Id> ids_;
+  PerspectiveCamera camera_;
+  Method method_ = BVH;
+  bool b_moving_ = false;
+
+  vector<int> visible_;
+  vector<uint8_t> flags_;
+  gl::VboMesh points_;
+
+  CullStats sum_;
+  int num_frames_ = 0;
+  string result_;
+};
+
+}  // namespace limas
@@ -0,0 +1,164 @@
+#pragma once
+#include "app/BaseApp.h"
+#include "video/VideoExporter.h"
+
+namespace limas {
+
+using namespace std;
+
+// VideoExporter のコーデックとコンテナごとにエンコードの速さと大きさを測る
+// 同じアニメーションを NUM_FRAMES 枚ずつ書き出し、書き出したファイルは消す
+class App : public BaseApp {
+ public:
+  using BaseApp::BaseApp;
+
+  static constexpr int WIDTH = 1920;
+  static constexpr int HEIGHT = 1080;
+  static constexpr float FPS = 60;
+  static constexpr int NUM_FRAMES = 300;
+
+  struct Case {
+    string name;
+    VideoExporter::Codec codec;
+    VideoExporter::Container container;
+  };
+
+  struct Result {
+    string name;
+    bool b_ok = false;
+    double fps = 0;
+    double mb_per_frame = 0;
+    uint64_t dropped = 0;
+  };
+
+  void setup() {
+    using Codec = VideoExporter::Codec;
+    using Container = VideoExporter::Container;
+    cases_ = {
+        {"prores_422", Codec::PRORES_422, Container::MOV},
+        {"prores_4444", Codec::PRORES_4444, Container::MOV},
+        {"h264", Codec::H264, Container::MP4},
+        {"h265", Codec::H265, Container::MP4},
+        {"ffv1", Codec::FFV1, Container::MKV},
+        {"mjpeg", Codec::MJPEG, Container::MOV},
+        {"raw", Codec::RAW, Container::MKV},
+    };
+
+    // エンコードを待つので落とさない。描画は待たずに回す
+    exporter_.setQueuePolicy(VideoExporter::QueuePolicy::BLOCK);
+    setFPS(FPS);
+    setOfflineRendering(true);
+    startNext();
+  }
+
+  void draw() {
+    if (isRunning()) {
+      exporter_.bind();
+      drawScene(frame_ / FPS);
+      exporter_.unbind();
+      if (++frame_ == NUM_FRAMES) finishCase();
+    }
+
+    gl::clearColor(0, 0, 0, 0);
+    gl::pushMatrix();
+    gl::setOrthoView(getWidth(), getHeight());
+    gl::setColor(1, 1, 1, 1);
+    if (exporter_.isExporting()) {
+      gl::drawTexture(exporter_.getTexture(), 0, 0, getWidth(), getHeight(),
+                      true);
+    }
+    gl::drawBitmapString(getReport(), 5, 5);
+    gl::popMatrix();
+  }
+
+ private:
+  bool isRunning() const { return index_ < cases_.size(); }
+
+  void startNext() {
+    for (; isRunning(); index_++) {
+      const auto& c = cases_[index_];
+      VideoExporter::Settings settings;
+      settings.codec = c.codec;
+      settings.container = c.container;
+      if (exporter_.allocate(WIDTH, HEIGHT, FPS, settings)) {
+        path_ = fs::getAssetPath() + "bench_" + c.name +
+                VideoExporter::getExtension(c.container);
+        exporter_.start(path_);
+        if (exporter_.isExporting()) break;
+      }
+      results_.push_back({c.name});
+    }
+    frame_ = 0;
+    stopwatch_.reset();
+    stopwatch_.start();
+    if (!isRunning()) setOfflineRendering(false);
+  }
+
+  void finishCase() {
+    exporter_.stop();
+    const double seconds = stopwatch_.getElapsedInSeconds();
+    const auto counters = exporter_.getCounters();
+
+    Result result;
+    result.name = cases_[index_].name;
+    result.b_ok = true;
+    result.fps = counters.encoded_frames / seconds;
+    result.mb_per_frame = counters.encoded_frames
+                              ? counters.bytes_written / 1e6 /
+                                    counters.encoded_frames
+                              : 0;
+    result.dropped = counters.dropped_frames;
+    results_.push_back(result);
+    logger::info("exporter_codecs") << toString(result) << logger::end();
+
+    std::filesystem::remove(path_);
+    index_++;
+    startNext();
+  }
+
+  // 圧縮のしやすさが極端にならないよう、動くグラデーションと図形を描く
+  void drawScene(float t) {
+    gl::clearColor(0, 0, 0, 1);
+    gl::pushMatrix();
+    gl::setOrthoView(WIDTH, HEIGHT);
+    for (int i = 0; i < 64; i++) {
+      float x = (0.5f + 0.45f * sin(t * 0.7f + i * 0.37f)) * WIDTH;
+      float y = (0.5f + 0.45f * cos(t * 0.5f + i * 0.91f)) * HEIGHT;
+      gl::setColorHsv(fmod(i / 64.0f + t * 0.1f, 1.0f), 0.7, 1, 0.6);
+      gl::drawCircle(x, y, 40 + 30 * sin(t + i));
+    }
+    gl::popMatrix();
+  }
+
+  static string toString(const Result& r) {
+    std::stringstream ss;
+    ss << std::left << std::setw(12) << r.name;
+    if (!r.b_ok) {
+      ss << "unsupported";
+    } else {
+      ss << utils::toString(r.fps, 1, 7, ' ') << " fps "
+         << utils::toString(r.mb_per_frame, 3, 7, ' ') << " MB/frame "
+         << r.dropped << " dropped";
+    }
+    return ss.str();
+  }
+
+  string getReport() const {
+    std::stringstream ss;
+    ss << WIDTH << "x" << HEIGHT << ", " << NUM_FRAMES << " frames\n";
+    for (const auto& r : results_) ss << toString(r) << "\n";
+    if (isRunning())
+      ss << cases_[index_].name << " " << frame_ << "/" << NUM_FRAMES;
+    return ss.str();
+  }
+
+  VideoExporter exporter_;
+  vector<Case> cases_;
+  vector<Result> results_;
+  size_t index_ = 0;
+  int frame_ = 0;
+  string path_;
+  PreciseStopwatch stopwatch_;
+};
+
+}  // namespace limas
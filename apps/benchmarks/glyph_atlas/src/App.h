@@ -0,0 +1,153 @@
+#pragma once
+#include "app/BaseApp.h"
+
+namespace limas {
+
+using namespace std;
+
+// GlyphAtlas で CJK の文章を並べて描く時間を測る
+// assets/font.otf か、ドロップした CJK のフォントを使う
+// 読み込んだ時に空のアトラスと文字が揃ったアトラスで layout() を測り、
+// その後は描画の時間を平均する
+// s: SDF の切り替え
+class App : public BaseApp {
+ public:
+  using BaseApp::BaseApp;
+
+  // U+4E00 から順に使う文字の数
+  static constexpr int NUM_CHARS = 2000;
+  static constexpr int NUM_COLUMNS = 50;
+  static constexpr float FONT_SIZE = 20;
+  static constexpr int NUM_AVERAGED_FRAMES = 120;
+
+  void setup() {
+    setVerticalSync(false);
+    setGpuProfiling(true);
+    // 全ての文字が追い出されずに入る大きさにする
+    settings_.pixel_size = 32;
+    settings_.width = settings_.height = 4096;
+
+    for (int i = 0; i < NUM_CHARS; i++) {
+      text_ += toUtf8(0x4E00 + i);
+      if (i % NUM_COLUMNS == NUM_COLUMNS - 1) text_ += "\n";
+    }
+    load(fs::getAssetPath("font.otf"));
+  }
+
+  void draw() {
+    gl::clearColor(0, 0, 0, 0);
+
+    gl::pushMatrix();
+    gl::setOrthoView(getWidth(), getHeight());
+    gl::setColor(1, 1, 1, 1);
+
+    if (atlas_.isLoaded()) {
+      PreciseStopwatch stopwatch;
+      stopwatch.start();
+      gl::drawFontString(atlas_, text_, 5, 60, FONT_SIZE);
+      gl::flush();
+      cpu_ms_ += stopwatch.getElapsedInMilliseconds();
+      gpu_ms_ += getGpuTime();
+      if (++num_frames_ == NUM_AVERAGED_FRAMES) report();
+    }
+
+    gl::setColor(0, 0, 0, 0.8);
+    gl::drawRectangle(0, 0, 480, 55);
+    gl::setColor(1, 1, 1, 1);
+    gl::drawBitmapString("FPS:" + utils::toString(getFPS(), 2, 6, '0') +
+                             " [s] sdf " + (settings_.b_sdf ? "on" : "off"),
+                         5, 5);
+    gl::drawBitmapString(layout_result_ + "\n" + draw_result_, 5, 15);
+    gl::popMatrix();
+  }
+
+  void keyPressed(const KeyEventArgs &e) {
+    if (e.key == 's') {
+      settings_.b_sdf = !settings_.b_sdf;
+      load(path_);
+    }
+  }
+
+  void fileDropped(const FileDropEventArgs &e) {
+    if (!e.paths.empty()) load(e.paths[0]);
+  }
+
+ private:
+  static string toUtf8(char32_t c) {
+    string s;
+    if (c < 0x80) {
+      s += (char)c;
+    } else if (c < 0x800) {
+      s += (char)(0xC0 | (c >> 6));
+      s += (char)(0x80 | (c & 0x3F));
+    } else {
+      s += (char)(0xE0 | (c >> 12));
+      s += (char)(0x80 | ((c >> 6) & 0x3F));
+      s += (char)(0x80 | (c & 0x3F));
+    }
+    return s;
+  }
+
+  void load(const string& path) {
+    path_ = path;
+    draw_result_ = "";
+    if (!atlas_.load(path_, settings_)) {
+      layout_result_ = "Couldn't load " + path_;
+      return;
+    }
+
+    // 空のアトラスではすべての文字をラスタライズする
+    const size_t num_rasterized = atlas_.getNumRasterized();
+    const size_t num_evictions = atlas_.getNumEvictions();
+    TextLayout quads;
+    PreciseStopwatch cold;
+    cold.start();
+    atlas_.layout(text_, quads);
+    const double cold_ms = cold.getElapsedInMilliseconds();
+
+    quads.clear();
+    PreciseStopwatch warm;
+    warm.start();
+    atlas_.layout(text_, quads);
+    const double warm_ms = warm.getElapsedInMilliseconds();
+
+    std::stringstream ss;
+    ss << NUM_CHARS << " glyphs, layout cold "
+       << utils::toString(cold_ms, 2, 8, ' ') << " ms, warm "
+       << utils::toString(warm_ms, 3, 6, ' ') << " ms\n"
+       << "rasterized " << atlas_.getNumRasterized() - num_rasterized
+       << " evicted " << atlas_.getNumEvictions() - num_evictions;
+    layout_result_ = ss.str();
+    logger::info("glyph_atlas") << (settings_.b_sdf ? "sdf    " : "bitmap ")
+                                << layout_result_ << logger::end();
+    resetAverage();
+  }
+
+  void resetAverage() {
+    cpu_ms_ = gpu_ms_ = 0;
+    num_frames_ = 0;
+  }
+
+  void report() {
+    std::stringstream ss;
+    ss << "draw cpu " << utils::toString(cpu_ms_ / num_frames_, 3, 7, ' ')
+       << " ms, gpu " << utils::toString(gpu_ms_ / num_frames_, 3, 7, ' ')
+       << " ms";
+    draw_result_ = ss.str();
+    logger::info("glyph_atlas") << draw_result_ << logger::end();
+    resetAverage();
+  }
+
+  GlyphAtlas atlas_;
+  GlyphAtlas::Settings settings_;
+  string path_;
+  string text_;
+
+  double cpu_ms_ = 0;
+  double gpu_ms_ = 0;
+  int num_frames_ = 0;
+  string layout_result_;
+  string draw_result_;
+};
+
+}  // namespace limas
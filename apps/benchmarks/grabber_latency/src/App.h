@@ -0,0 +1,117 @@
+#pragma once
+#include "app/BaseApp.h"
+#include "video/VideoGrabber.h"
+
+namespace limas {
+
+using namespace std;
+
+// VideoGrabber のパケットの受け取りからテクスチャへの転送までの時間を測る
+// 既定では lavfi のテストパターンを使う。'd' でカメラに切り替える
+class App : public BaseApp {
+ public:
+  using BaseApp::BaseApp;
+
+  // これだけの間のフレームをまとめる (秒)
+  static constexpr double REPORT_INTERVAL = 5.0;
+
+  void setup() {
+    setVerticalSync(true);
+    setupTestSource();
+  }
+
+  void update() {
+    grabber_.update();
+    if (grabber_.isFrameNew()) {
+      const double ms = grabber_.getLatency() * 1e3;
+      sum_ms_ += ms;
+      min_ms_ = std::min(min_ms_, ms);
+      max_ms_ = std::max(max_ms_, ms);
+      num_frames_++;
+    }
+    if (getElapsedSeconds() - report_time_ >= REPORT_INTERVAL) report();
+  }
+
+  void draw() {
+    gl::clearColor(0, 0, 0, 0);
+
+    gl::pushMatrix();
+    gl::setOrthoView(getWidth(), getHeight());
+    gl::setColor(1, 1, 1, 1);
+    if (grabber_.getTexture().isAllocated()) {
+      gl::drawTexture(grabber_.getTexture(), 0, 0, getWidth(), getHeight());
+    }
+    gl::setColor(0, 0, 0, 0.7);
+    gl::drawRectangle(0, 0, 420, 50);
+    gl::setColor(1, 1, 1, 1);
+    gl::drawBitmapString("FPS:" + utils::toString(getFPS(), 2, 6, '0'), 5, 5);
+    gl::drawBitmapString(source_ + "\n" + result_, 5, 15);
+    gl::popMatrix();
+  }
+
+  void keyPressed(const KeyEventArgs &e) {
+    if (e.key == 'd') setupDevice();
+    if (e.key == 't') setupTestSource();
+  }
+
+ private:
+  void setupTestSource() {
+    VideoGrabber::Settings settings;
+    settings.format = "lavfi";
+    settings.b_realtime = true;
+    source_ = "testsrc=size=1920x1080:rate=60";
+    grabber_.setup(source_, settings);
+    resetCounters();
+  }
+
+  void setupDevice() {
+    VideoGrabber::Settings settings;
+#if defined(__APPLE__)
+    source_ = "0";
+#else
+    auto devices = VideoGrabber::listDevices(settings.format);
+    source_ = devices.empty() ? "/dev/video0" : devices[0];
+#endif
+    grabber_.setup(source_, settings);
+    resetCounters();
+  }
+
+  void resetCounters() {
+    grabber_.resetCounters();
+    sum_ms_ = 0;
+    min_ms_ = std::numeric_limits<double>::infinity();
+    max_ms_ = 0;
+    num_frames_ = 0;
+    report_time_ = getElapsedSeconds();
+  }
+
+  void report() {
+    if (num_frames_ == 0) {
+      result_ = "no frames";
+    } else {
+      const auto c = grabber_.getCounters();
+      std::stringstream ss;
+      ss << grabber_.getWidth() << "x" << grabber_.getHeight() << " @ "
+         << grabber_.getFrameRate() << " fps, " << num_frames_ << " frames\n"
+         << "latency avg " << utils::toString(sum_ms_ / num_frames_, 2, 6, ' ')
+         << " min " << utils::toString(min_ms_, 2, 6, ' ') << " max "
+         << utils::toString(max_ms_, 2, 6, ' ') << " ms, dropped "
+         << c.dropped << " late " << c.late;
+      result_ = ss.str();
+    }
+    logger::info("grabber_latency") << result_ << logger::end();
+    resetCounters();
+  }
+
+  VideoGrabber grabber_;
+  string source_;
+
+  double sum_ms_ = 0;
+  double min_ms_ = 0;
+  double max_ms_ = 0;
+  size_t num_frames_ = 0;
+  double report_time_ = 0;
+  string result_;
+};
+
+}  // namespace limas
@@ -0,0 +1,102 @@
+#pragma once
+#include "app/BaseApp.h"
+#include "graphics/DxtCompressor.h"
+
+namespace limas {
+
+using namespace std;
+
+// Hap の書き出しで使う DxtCompressor の速さを形式とスレッド数ごとに測る
+// 1 フレームに 1 つずつ測り、結果を画面とログに出す
+class App : public BaseApp {
+ public:
+  using BaseApp::BaseApp;
+
+  static constexpr int WIDTH = 1920;
+  static constexpr int HEIGHT = 1080;
+  static constexpr int NUM_ITERATIONS = 20;
+
+  struct Case {
+    string name;
+    DxtCompressor::Format format;
+    ThreadPool* pool;
+  };
+
+  void setup() {
+    setVerticalSync(true);
+    pool_ = std::make_unique<ThreadPool>(
+        std::max(1u, std::thread::hardware_concurrency()));
+
+    // 滑らかなグラデーションに細かい模様を重ねる
+    pixels_.resize(WIDTH * HEIGHT * 4);
+    for (int y = 0; y < HEIGHT; y++) {
+      for (int x = 0; x < WIDTH; x++) {
+        unsigned char* p = &pixels_[(y * WIDTH + x) * 4];
+        const uint32_t h = (x * 73856093u) ^ (y * 19349663u);
+        p[0] = x * 255 / WIDTH;
+        p[1] = y * 255 / HEIGHT;
+        p[2] = 128 + 64 * std::sin(x * 0.05f) * std::cos(y * 0.03f);
+        p[3] = (h >> 8) & 0xff;
+      }
+    }
+
+    using Format = DxtCompressor::Format;
+    const vector<pair<string, Format>> formats = {
+        {"hap (dxt1)", Format::DXT1},
+        {"hap alpha (dxt5)", Format::DXT5},
+        {"hap q (ycocg)", Format::YCOCG_DXT5},
+        {"alpha (rgtc1)", Format::RGTC1_ALPHA},
+    };
+    for (const auto& f : formats) {
+      cases_.push_back({f.first, f.second, nullptr});
+      cases_.push_back({f.first, f.second, pool_.get()});
+    }
+  }
+
+  void update() {
+    if (index_ < cases_.size()) measure(cases_[index_++]);
+  }
+
+  void draw() {
+    gl::clearColor(0, 0, 0, 0);
+
+    gl::pushMatrix();
+    gl::setOrthoView(getWidth(), getHeight());
+    gl::setColor(1, 1, 1, 1);
+    gl::drawBitmapString(report_.str(), 5, 5);
+    gl::popMatrix();
+  }
+
+ private:
+  void measure(const Case& c) {
+    vector<unsigned char> dst(
+        DxtCompressor::getCompressedSize(c.format, WIDTH, HEIGHT));
+    // 書き出しと同じく下の行から読む
+    const unsigned char* src = &pixels_[(HEIGHT - 1) * WIDTH * 4];
+    const ptrdiff_t stride = -(ptrdiff_t)WIDTH * 4;
+
+    PreciseStopwatch stopwatch;
+    stopwatch.start();
+    for (int i = 0; i < NUM_ITERATIONS; i++) {
+      DxtCompressor::compress(src, WIDTH, HEIGHT, stride, c.format,
+                              dst.data(), c.pool);
+    }
+    const double ms = stopwatch.getElapsedInMilliseconds() / NUM_ITERATIONS;
+
+    std::stringstream ss;
+    ss << std::left << std::setw(18) << c.name << std::right << std::setw(3)
+       << (c.pool ? c.pool->getNumThreads() : 1) << " threads "
+       << utils::toString(ms, 2, 7, ' ') << " ms "
+       << utils::toString(1000.0 / ms, 1, 7, ' ') << " fps";
+    report_ << ss.str() << "\n";
+    logger::info("hap_compress") << ss.str() << logger::end();
+  }
+
+  vector<unsigned char> pixels_;
+  unique_ptr<ThreadPool> pool_;
+  vector<Case> cases_;
+  size_t index_ = 0;
+  std::stringstream report_;
+};
+
+}  // namespace limas
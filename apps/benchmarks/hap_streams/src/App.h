@@ -0,0 +1,130 @@
+#pragma once
+#include "app/BaseApp.h"
+#include "video/HapVideoPlayer.h"
+
+namespace limas {
+
+using namespace std;
+
+// 同じ Hap の動画を何本も同時に再生して、取りこぼしと update() の時間を見る
+// assets/hap.mov か、ドロップしたファイルを使う
+// 上下: 本数
+class App : public BaseApp {
+ public:
+  using BaseApp::BaseApp;
+
+  static constexpr int MAX_STREAMS = 16;
+  // これだけの間の表示と取りこぼしを数える (秒)
+  static constexpr double REPORT_INTERVAL = 5.0;
+
+  void setup() {
+    setVerticalSync(true);
+    load(fs::getAssetPath("hap.mov"), 4);
+  }
+
+  void update() {
+    PreciseStopwatch stopwatch;
+    stopwatch.start();
+    for (auto& player : players_) player->update();
+    update_ms_ += stopwatch.getElapsedInMilliseconds();
+    num_frames_++;
+
+    if (getElapsedSeconds() - report_time_ >= REPORT_INTERVAL) report();
+  }
+
+  void draw() {
+    gl::clearColor(0, 0, 0, 0);
+
+    gl::pushMatrix();
+    gl::setOrthoView(getWidth(), getHeight());
+    gl::setColor(1, 1, 1, 1);
+    if (!players_.empty()) {
+      const int cols = std::ceil(std::sqrt((double)players_.size()));
+      const float w = getWidth() / (float)cols;
+      const float h = w * players_[0]->getHeight() / players_[0]->getWidth();
+      for (size_t i = 0; i < players_.size(); i++) {
+        gl::drawTexture(players_[i]->getTexture(), (i % cols) * w,
+                        (i / cols) * h, w, h);
+      }
+    }
+    gl::setColor(0, 0, 0, 0.7);
+    gl::drawRectangle(0, 0, 420, 50);
+    gl::setColor(1, 1, 1, 1);
+    gl::drawBitmapString("FPS:" + utils::toString(getFPS(), 2, 6, '0'), 5, 5);
+    gl::drawBitmapString(result_, 5, 15);
+    gl::popMatrix();
+  }
+
+  void keyPressed(const KeyEventArgs &e) {
+    if (e.key == GLFW_KEY_UP && players_.size() < MAX_STREAMS)
+      load(path_, players_.size() * 2);
+    if (e.key == GLFW_KEY_DOWN && players_.size() > 1)
+      load(path_, players_.size() / 2);
+  }
+
+  void fileDropped(const FileDropEventArgs &e) {
+    if (!e.paths.empty()) load(e.paths[0], max<size_t>(players_.size(), 1));
+  }
+
+ private:
+  void load(const string& path, size_t n) {
+    players_.clear();
+    path_ = path;
+    n = std::min<size_t>(n, MAX_STREAMS);
+    for (size_t i = 0; i < n; i++) {
+      auto player = std::make_unique<HapVideoPlayer>();
+      if (!player->load(path_)) {
+        players_.clear();
+        result_ = "Couldn't load " + path_;
+        return;
+      }
+      // 最初のプレイヤーの時計に揃える
+      if (!players_.empty()) player->setClock(players_[0]->getClock());
+      player->setLoop(true);
+      player->play();
+      players_.push_back(std::move(player));
+    }
+    result_ = "";
+    resetCounters();
+  }
+
+  void resetCounters() {
+    for (auto& player : players_) player->resetCounters();
+    update_ms_ = 0;
+    num_frames_ = 0;
+    report_time_ = getElapsedSeconds();
+  }
+
+  void report() {
+    if (players_.empty()) return;
+    PlaybackStats::Counters sum;
+    for (auto& player : players_) {
+      const auto c = player->getCounters();
+      sum.presented += c.presented;
+      sum.late += c.late;
+      sum.dropped += c.dropped;
+      sum.duplicated += c.duplicated;
+    }
+    const auto& p = players_[0];
+    std::stringstream ss;
+    ss << players_.size() << " x " << p->getWidth() << "x" << p->getHeight()
+       << " @ " << p->getFrameRate() << " fps\n"
+       << "presented " << sum.presented << " late " << sum.late
+       << " dropped " << sum.dropped << " duplicated " << sum.duplicated
+       << "\nupdate " << utils::toString(update_ms_ / num_frames_, 3, 7, ' ')
+       << " ms";
+    result_ = ss.str();
+    logger::info("hap_streams") << result_ << logger::end();
+    resetCounters();
+  }
+
+  vector<unique_ptr<HapVideoPlayer>> players_;
+  string path_;
+
+  double update_ms_ = 0;
+  int num_frames_ = 0;
+  double report_time_ = 0;
+  string result_;
+};
+
+}  // namespace limas
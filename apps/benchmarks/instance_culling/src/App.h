@@ -0,0 +1,147 @@
+#pragma once
+#include "app/BaseApp.h"
+#include "3d/cam/PerspectiveCamera.h"
+#include "gl/PackedInstancedVboMesh.h"
+
+namespace limas {
+
+using namespace std;
+
+// PackedInstancedVboMesh で箱を周りに散らし、コンピュートシェーダーで
+// 視錐台カリングした時としない時の GPU の時間を比べる
+// カメラは中心で回るので、見えるのは一部だけになる
+// 毎フレーム 1% のインスタンスを回して、書き換えた範囲だけを送る
+// c: カリングの切り替え
+// 上下キー: インスタンスの数を 2 倍、半分にする
+class App : public BaseApp {
+ public:
+  using BaseApp::BaseApp;
+
+  static constexpr float RADIUS = 500;
+  static constexpr int NUM_AVERAGED_FRAMES = 120;
+
+  void setup() {
+    setVerticalSync(false);
+    setGpuProfiling(true);
+
+    makeBox(2);
+    camera_.setNearClip(0.1);
+    camera_.setFarClip(RADIUS * 2);
+    makeInstances(100000);
+  }
+
+  void draw() {
+    gl::clearColor(0, 0, 0, 0);
+    gl::clearDepth();
+
+    // 送る前に CPU で書き換える時間は測らない
+    const size_t n = mesh_.getNumInstances();
+    const size_t count = std::max<size_t>(1, n / 100);
+    const size_t first = (getFrameNumber() * count) % (n - count + 1);
+    const float t = getElapsedSeconds();
+    for (size_t i = first; i < first + count; i++) {
+      mesh_.setRotation(i, glm::angleAxis(t + i, glm::vec3(0, 1, 0)));
+    }
+
+    camera_.setPosition(glm::vec3(0));
+    camera_.lookAt(glm::vec3(std::cos(t * 0.2f), 0, std::sin(t * 0.2f)));
+
+    gl::pushMatrix();
+    gl::multMatrix(camera_.getModelViewProjectionMatrix(0, 0, getWidth(),
+                                                        getHeight()));
+    gl::enableDepth();
+    PreciseStopwatch stopwatch;
+    stopwatch.start();
+    mesh_.resetCounters();
+    mesh_.updateDirtyInstances();
+    mesh_.cull(gl::getCurrentMatrix());
+    gl::drawMeshInstanced(mesh_, GL_TRIANGLES);
+    cpu_ms_ += stopwatch.getElapsedInMilliseconds();
+    gpu_ms_ += getGpuTime();
+    num_bytes_ += mesh_.getNumBytesUploaded();
+    gl::disableDepth();
+    gl::popMatrix();
+
+    if (++num_frames_ == NUM_AVERAGED_FRAMES) report();
+
+    gl::pushMatrix();
+    gl::setOrthoView(getWidth(), getHeight());
+    gl::setColor(0, 0, 0, 0.8);
+    gl::drawRectangle(0, 0, 460, 35);
+    gl::setColor(1, 1, 1, 1);
+    gl::drawBitmapString("FPS:" + utils::toString(getFPS(), 2, 6, '0') +
+                             " [c] culling " +
+                             (mesh_.isCulling() ? "on" : "off") +
+                             " [up/down] " + to_string(n) + " instances",
+                         5, 5);
+    gl::drawBitmapString(result_, 5, 15);
+    gl::popMatrix();
+  }
+
+  void keyPressed(const KeyEventArgs &e) {
+    if (e.key == 'c') mesh_.setCulling(!mesh_.isCulling());
+    if (e.key == GLFW_KEY_UP) makeInstances(mesh_.getNumInstances() * 2);
+    if (e.key == GLFW_KEY_DOWN)
+      makeInstances(std::max<size_t>(1000, mesh_.getNumInstances() / 2));
+    resetAverage();
+  }
+
+ private:
+  // 一辺 size の立方体。面ごとに頂点を分けずに 8 頂点で作る
+  void makeBox(float size) {
+    const float h = size * 0.5f;
+    for (int i = 0; i < 8; i++) {
+      mesh_.addVertex(
+          glm::vec3(i & 1 ? h : -h, i & 2 ? h : -h, i & 4 ? h : -h));
+    }
+    mesh_.addIndices({0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+                      2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5});
+    mesh_.update();
+    mesh_.computeBounds();
+  }
+
+  void makeInstances(size_t num_instances) {
+    vector<gl::PackedInstance> instances(num_instances);
+    for (auto& instance : instances) {
+      instance.translation =
+          glm::vec3(math::randFloat(-RADIUS, RADIUS),
+                    math::randFloat(-RADIUS, RADIUS),
+                    math::randFloat(-RADIUS, RADIUS));
+      instance.color = Color::fromHsv(math::randFloat(), 0.6, 1.0).toVec();
+    }
+    mesh_.setInstances(instances);
+    mesh_.updateInstances();
+  }
+
+  void resetAverage() {
+    cpu_ms_ = gpu_ms_ = 0;
+    num_bytes_ = 0;
+    num_frames_ = 0;
+  }
+
+  // getNumVisible() は GPU を待つので集計の時だけ呼ぶ
+  void report() {
+    std::stringstream ss;
+    ss << "visible " << mesh_.getNumVisible() << "/"
+       << mesh_.getNumInstances() << ", cpu "
+       << utils::toString(cpu_ms_ / num_frames_, 3, 7, ' ') << " ms, gpu "
+       << utils::toString(gpu_ms_ / num_frames_, 3, 7, ' ') << " ms\n"
+       << num_bytes_ / num_frames_ / 1024 << " KB uploaded per frame";
+    result_ = ss.str();
+    logger::info("instance_culling")
+        << (mesh_.isCulling() ? "culling " : "all     ") << result_
+        << logger::end();
+    resetAverage();
+  }
+
+  gl::PackedInstancedVboMesh mesh_;
+  PerspectiveCamera camera_;
+
+  double cpu_ms_ = 0;
+  double gpu_ms_ = 0;
+  size_t num_bytes_ = 0;
+  int num_frames_ = 0;
+  string result_;
+};
+
+}  // namespace limas
@@ -0,0 +1,178 @@
+#pragma once
+#include "app/BaseApp.h"
+#include "3d/cam/PerspectiveCamera.h"
+
+namespace limas {
+
+using namespace std;
+
+// 1 万個の箱を MeshBatch でまとめて描く時と、1 個ずつ drawMesh() で描く時の
+// CPU と GPU の時間を比べる
+// 形は NUM_SHAPES 種類で、1 個ずつ描く時は同じ形の VboMesh を使い回す
+// b: MeshBatch と 1 個ずつの切り替え
+// a: 毎フレーム全ての行列を書き換えるか
+class App : public BaseApp {
+ public:
+  using BaseApp::BaseApp;
+
+  static constexpr int NUM_MESHES = 10000;
+  static constexpr int NUM_SHAPES = 8;
+  static constexpr float RADIUS = 100;
+  static constexpr int NUM_AVERAGED_FRAMES = 120;
+
+  struct Item {
+    int shape;
+    glm::vec3 position;
+    glm::vec3 axis;
+    glm::vec4 color;
+    gl::MeshBatch::Id id;
+  };
+
+  void setup() {
+    setVerticalSync(false);
+    setGpuProfiling(true);
+
+    for (int i = 0; i < NUM_SHAPES; i++) {
+      shapes_.push_back(makeBox(glm::vec3(1 + i % 2, 1 + i / 2 % 2,
+                                          1 + i / 4 % 2)));
+      vbo_meshes_.emplace_back(shapes_.back());
+    }
+    items_.resize(NUM_MESHES);
+    for (auto& item : items_) {
+      item.shape = math::randInt(NUM_SHAPES);
+      item.position = glm::vec3(math::randFloat(-RADIUS, RADIUS),
+                                math::randFloat(-RADIUS, RADIUS),
+                                math::randFloat(-RADIUS, RADIUS));
+      item.axis = glm::normalize(glm::vec3(math::randFloat(-1, 1),
+                                           math::randFloat(-1, 1), 1));
+      item.color = Color::fromHsv(math::randFloat(), 0.6, 1.0).toVec();
+      item.id = batch_.add(shapes_[item.shape], getModelMatrix(item, 0),
+                           item.color);
+    }
+    camera_.setFarClip(RADIUS * 4);
+  }
+
+  void draw() {
+    gl::clearColor(0, 0, 0, 0);
+    gl::clearDepth();
+
+    const float t = getElapsedSeconds();
+    camera_.setPosition(glm::vec3(std::cos(t * 0.1f), 0.3f,
+                                  std::sin(t * 0.1f)) *
+                        RADIUS * 2.5f);
+    camera_.lookAt(glm::vec3(0));
+
+    gl::pushMatrix();
+    gl::multMatrix(camera_.getModelViewProjectionMatrix(0, 0, getWidth(),
+                                                        getHeight()));
+    gl::enableDepth();
+    PreciseStopwatch stopwatch;
+    stopwatch.start();
+    if (b_batch_) {
+      batch_.resetCounters();
+      if (b_animating_) {
+        for (const auto& item : items_)
+          batch_.setTransform(item.id, getModelMatrix(item, t));
+      }
+      gl::drawMeshBatch(batch_);
+      num_draws_ += batch_.getNumDraws();
+      num_meshes_drawn_ += batch_.getNumMeshesDrawn();
+    } else {
+      for (const auto& item : items_) {
+        gl::pushMatrix();
+        gl::multMatrix(getModelMatrix(item, b_animating_ ? t : 0));
+        gl::setColor(item.color);
+        gl::drawMesh(vbo_meshes_[item.shape], GL_TRIANGLES);
+        gl::popMatrix();
+      }
+      num_draws_ += items_.size();
+      num_meshes_drawn_ += items_.size();
+    }
+    cpu_ms_ += stopwatch.getElapsedInMilliseconds();
+    gpu_ms_ += getGpuTime();
+    gl::disableDepth();
+    gl::popMatrix();
+
+    if (++num_frames_ == NUM_AVERAGED_FRAMES) report();
+
+    gl::pushMatrix();
+    gl::setOrthoView(getWidth(), getHeight());
+    gl::setColor(0, 0, 0, 0.8);
+    gl::drawRectangle(0, 0, 460, 35);
+    gl::setColor(1, 1, 1, 1);
+    gl::drawBitmapString("FPS:" + utils::toString(getFPS(), 2, 6, '0') +
+                             " [b] " + getModeName() + " [a] " +
+                             (b_animating_ ? "animating" : "static"),
+                         5, 5);
+    gl::drawBitmapString(result_, 5, 15);
+    gl::popMatrix();
+  }
+
+  void keyPressed(const KeyEventArgs &e) {
+    if (e.key == 'b') b_batch_ = !b_batch_;
+    if (e.key == 'a') b_animating_ = !b_animating_;
+    resetAverage();
+  }
+
+ private:
+  // size の大きさの箱。8 頂点と 12 枚の三角形で作る
+  static geom::Mesh makeBox(const glm::vec3& size) {
+    geom::Mesh mesh;
+    const glm::vec3 h = size * 0.5f;
+    for (int i = 0; i < 8; i++) {
+      mesh.addVertex(glm::vec3(i & 1 ? h.x : -h.x, i & 2 ? h.y : -h.y,
+                               i & 4 ? h.z : -h.z));
+    }
+    mesh.addIndices({0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+                     2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5});
+    return mesh;
+  }
+
+  static glm::mat4 getModelMatrix(const Item& item, float t) {
+    return glm::translate(glm::mat4(1), item.position) *
+           glm::rotate(glm::mat4(1), t, item.axis);
+  }
+
+  string getModeName() const {
+    if (!b_batch_) return "individual";
+    return gl::MeshBatch::isMultiDrawIndirectSupported()
+               ? "mesh batch (indirect)"
+               : "mesh batch (base vertex)";
+  }
+
+  void resetAverage() {
+    cpu_ms_ = gpu_ms_ = 0;
+    num_draws_ = num_meshes_drawn_ = 0;
+    num_frames_ = 0;
+  }
+
+  void report() {
+    std::stringstream ss;
+    ss << num_meshes_drawn_ / num_frames_ << " meshes in "
+       << num_draws_ / num_frames_ << " draws, cpu "
+       << utils::toString(cpu_ms_ / num_frames_, 3, 7, ' ') << " ms, gpu "
+       << utils::toString(gpu_ms_ / num_frames_, 3, 7, ' ') << " ms";
+    result_ = ss.str();
+    logger::info("mesh_batch") << getModeName() << " "
+                               << (b_animating_ ? "animating " : "static ")
+                               << result_ << logger::end();
+    resetAverage();
+  }
+
+  vector<geom::Mesh> shapes_;
+  vector<gl::VboMesh> vbo_meshes_;
+  vector<Item> items_;
+  gl::MeshBatch batch_;
+  PerspectiveCamera camera_;
+  bool b_batch_ = true;
+  bool b_animating_ = false;
+
+  double cpu_ms_ = 0;
+  double gpu_ms_ = 0;
+  size_t num_draws_ = 0;
+  size_t num_meshes_drawn_ = 0;
+  int num_frames_ = 0;
+  string result_;
+};
+
+}  // namespace limas
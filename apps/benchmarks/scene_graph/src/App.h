@@ -0,0 +1,149 @@
+#pragma once
+#include "app/BaseApp.h"
+#include "3d/SceneGraph.h"
+
+namespace limas {
+
+using namespace std;
+
+// 10 万個の変換の親子関係を SceneGraph と Node で持ち、位置を変えてから
+// 全てのワールド行列を読むまでの CPU の時間を比べる
+// 4 分の 1 は根で、残りはそれより前の変換のどれかを親にする
+// g: SceneGraph と Node の切り替え
+// d: 毎フレーム 1% を動かすか全てを動かすか
+// p: SceneGraph を ThreadPool で更新するか
+class App : public BaseApp {
+ public:
+  using BaseApp::BaseApp;
+
+  static constexpr int NUM_TRANSFORMS = 100000;
+  static constexpr int NUM_AVERAGED_FRAMES = 120;
+
+  void setup() {
+    setVerticalSync(false);
+
+    pool_ = std::make_unique<ThreadPool>(
+        std::max(1u, std::thread::hardware_concurrency()));
+
+    parents_.resize(NUM_TRANSFORMS);
+    bases_.resize(NUM_TRANSFORMS);
+    for (int i = 0; i < NUM_TRANSFORMS; i++) {
+      const bool b_root = i == 0 || math::randInt(4) == 0;
+      parents_[i] = b_root ? -1 : math::randInt(i);
+      bases_[i] = b_root ? glm::vec3(math::randFloat(getWidth()),
+                                     math::randFloat(getHeight()), 0)
+                         : glm::vec3(math::randFloat(-20, 20),
+                                     math::randFloat(-20, 20), 0);
+
+      const int p = parents_[i];
+      ids_.push_back(graph_.create(p < 0 ? SceneGraph::NULL_ID : ids_[p]));
+      graph_.setPosition(ids_[i], bases_[i]);
+
+      nodes_.push_back(std::make_unique<Node>());
+      if (p >= 0) nodes_[i]->setParent(nodes_[p].get());
+      nodes_[i]->setPosition(bases_[i]);
+    }
+    points_.allocateVertices(NUM_TRANSFORMS);
+  }
+
+  void draw() {
+    gl::clearColor(0, 0, 0, 0);
+
+    const float t = getElapsedSeconds();
+    const int count = b_all_dirty_ ? NUM_TRANSFORMS : NUM_TRANSFORMS / 100;
+    const int first =
+        b_all_dirty_ ? 0 : (getFrameNumber() * count) % NUM_TRANSFORMS;
+    auto& vertices = points_.getVertices();
+
+    PreciseStopwatch stopwatch;
+    stopwatch.start();
+    for (int k = 0; k < count; k++) {
+      const int i = (first + k) % NUM_TRANSFORMS;
+      const glm::vec3 p = bases_[i] + glm::vec3(std::sin(t + i), 0, 0) * 5.0f;
+      if (b_scene_graph_)
+        graph_.setPosition(ids_[i], p);
+      else
+        nodes_[i]->setPosition(p);
+    }
+    if (b_scene_graph_) {
+      graph_.update(b_pool_ ? pool_.get() : nullptr);
+      num_updated_ += graph_.getNumUpdated();
+      for (int i = 0; i < NUM_TRANSFORMS; i++)
+        vertices[i] = glm::vec3(graph_.getWorldMatrix(ids_[i])[3]);
+    } else {
+      for (int i = 0; i < NUM_TRANSFORMS; i++)
+        vertices[i] = glm::vec3(nodes_[i]->getGlobalTransformMatrix()[3]);
+    }
+    cpu_ms_ += stopwatch.getElapsedInMilliseconds();
+    points_.updateVertices();
+
+    if (++num_frames_ == NUM_AVERAGED_FRAMES) report();
+
+    gl::pushMatrix();
+    gl::setOrthoView(getWidth(), getHeight());
+    gl::setColor(1, 1, 1, 0.5);
+    gl::drawMesh(points_, GL_POINTS);
+    gl::setColor(0, 0, 0, 0.8);
+    gl::drawRectangle(0, 0, 460, 35);
+    gl::setColor(1, 1, 1, 1);
+    gl::drawBitmapString("FPS:" + utils::toString(getFPS(), 2, 6, '0') +
+                             " " + getModeName(),
+                         5, 5);
+    gl::drawBitmapString(result_, 5, 15);
+    gl::popMatrix();
+  }
+
+  void keyPressed(const KeyEventArgs &e) {
+    if (e.key == 'g') b_scene_graph_ = !b_scene_graph_;
+    if (e.key == 'd') b_all_dirty_ = !b_all_dirty_;
+    if (e.key == 'p') b_pool_ = !b_pool_;
+    resetAverage();
+  }
+
+ private:
+  string getModeName() const {
+    string name = b_scene_graph_ ? "[g] scene graph" : "[g] node";
+    name += b_all_dirty_ ? " [d] all dirty" : " [d] 1% dirty";
+    if (b_scene_graph_) name += b_pool_ ? " [p] pool" : " [p] 1 thread";
+    return name;
+  }
+
+  void resetAverage() {
+    cpu_ms_ = 0;
+    num_updated_ = 0;
+    num_frames_ = 0;
+  }
+
+  // Node は読んだ時に計算するので、計算し直した数は数えない
+  void report() {
+    std::stringstream ss;
+    ss << NUM_TRANSFORMS << " transforms, cpu "
+       << utils::toString(cpu_ms_ / num_frames_, 3, 7, ' ') << " ms";
+    if (b_scene_graph_) {
+      ss << ", " << graph_.getNumLevels() << " levels, "
+         << num_updated_ / num_frames_ << " updated";
+    }
+    result_ = ss.str();
+    logger::info("scene_graph") << getModeName() << " " << result_
+                                << logger::end();
+    resetAverage();
+  }
+
+  vector<int> parents_;
+  vector<glm::vec3> bases_;
+  SceneGraph graph_;
+  vector<SceneGraph::Id> ids_;
+  vector<std::unique_ptr<Node>> nodes_;
+  std::unique_ptr<ThreadPool> pool_;
+  bool b_scene_graph_ = true;
+  bool b_all_dirty_ = false;
+  bool b_pool_ = false;
+
+  gl::VboMesh points_;
+  double cpu_ms_ = 0;
+  size_t num_updated_ = 0;
+  int num_frames_ = 0;
+  string result_;
+};
+
+}  // namespace limas
@@ -0,0 +1,156 @@
+#pragma once
+#include "app/BaseApp.h"
+#include "gl/StreamBuffer.h"
+
+namespace limas {
+
+using namespace std;
+
+// 毎フレーム書き換える頂点を GPU に送る方法ごとの時間を測る
+// NUM_POINTS 個の点を CPU で動かして送り、点として描く
+// m: StreamBuffer / glBufferSubData / 毎回 glBufferData で確保し直す
+class App : public BaseApp {
+ public:
+  using BaseApp::BaseApp;
+
+  static constexpr int NUM_POINTS = 200000;
+  static constexpr int NUM_AVERAGED_FRAMES = 120;
+
+  enum Mode { STREAM, SUB_DATA, ORPHAN, NUM_MODES };
+
+  struct Vertex {
+    glm::vec3 position;
+    glm::vec4 color;
+  };
+
+  void setup() {
+    setVerticalSync(false);
+    setGpuProfiling(true);
+
+    vertices_.resize(NUM_POINTS);
+    seeds_.resize(NUM_POINTS);
+    for (int i = 0; i < NUM_POINTS; i++) {
+      seeds_[i] = glm::vec2(math::randFloat(), math::randFloat());
+      vertices_[i].color = Color::fromHsv(seeds_[i].x, 0.8, 1.0).toVec();
+    }
+
+    const GLsizeiptr size = NUM_POINTS * sizeof(Vertex);
+    stream_ = std::make_unique<gl::StreamBuffer>(size);
+    vbo_.allocate(vertices_, GL_DYNAMIC_DRAW);
+    setMode(STREAM);
+  }
+
+  void draw() {
+    gl::clearColor(0, 0, 0, 0);
+
+    gl::pushMatrix();
+    gl::setOrthoView(getWidth(), getHeight());
+
+    // 送る前に CPU で動かす時間は測らない
+    const float t = getElapsedSeconds();
+    for (int i = 0; i < NUM_POINTS; i++) {
+      const auto& s = seeds_[i];
+      const float r = s.y * getHeight() * 0.5f;
+      const float a = s.x * glm::two_pi<float>() + t * (0.2f + s.y);
+      vertices_[i].position = glm::vec3(getWidth() * 0.5f + std::cos(a) * r,
+                                        getHeight() * 0.5f + std::sin(a) * r,
+                                        0);
+    }
+
+    const GLsizeiptr size = NUM_POINTS * sizeof(Vertex);
+    PreciseStopwatch stopwatch;
+    stopwatch.start();
+    if (mode_ == STREAM) {
+      const auto range = stream_->write(vertices_.data(), size);
+      // 書いた位置に合わせて頂点の参照先を付け替える
+      if (range.isValid()) bindAttributes(stream_->getId(), range.offset);
+    } else if (mode_ == SUB_DATA) {
+      vbo_.update(vertices_);
+    } else {
+      vbo_.allocate(vertices_, GL_DYNAMIC_DRAW);
+    }
+    gl::setColor(1, 1, 1, 1);
+    gl::drawArrays(vao_, GL_POINTS, NUM_POINTS);
+    // 描画を積んでからフェンスを置く
+    if (mode_ == STREAM) stream_->endFrame();
+    cpu_ms_ += stopwatch.getElapsedInMilliseconds();
+    gpu_ms_ += getGpuTime();
+
+    if (++num_frames_ == NUM_AVERAGED_FRAMES) report();
+
+    gl::setColor(0, 0, 0, 0.8);
+    gl::drawRectangle(0, 0, 460, 35);
+    gl::setColor(1, 1, 1, 1);
+    gl::drawBitmapString("FPS:" + utils::toString(getFPS(), 2, 6, '0') +
+                             " [m] " + getModeName(),
+                         5, 5);
+    gl::drawBitmapString(result_, 5, 15);
+    gl::popMatrix();
+  }
+
+  void keyPressed(const KeyEventArgs &e) {
+    if (e.key == 'm') setMode((Mode)((mode_ + 1) % NUM_MODES));
+  }
+
+ private:
+  void setMode(Mode mode) {
+    mode_ = mode;
+    if (mode_ == STREAM)
+      bindAttributes(stream_->getId(), 0);
+    else
+      bindAttributes(vbo_.getId(), 0);
+    resetAverage();
+  }
+
+  void bindAttributes(GLuint id, GLintptr offset) {
+    const GLsizei stride = sizeof(Vertex);
+    const auto* base = reinterpret_cast<const char*>(offset);
+    vao_.bindVbo(id, POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, stride,
+                 base + offsetof(Vertex, position));
+    vao_.bindVbo(id, COLOR_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, stride,
+                 base + offsetof(Vertex, color));
+  }
+
+  string getModeName() const {
+    if (mode_ == STREAM)
+      return stream_->isPersistent() ? "stream (persistent)"
+                                     : "stream (unsynchronized map)";
+    if (mode_ == SUB_DATA) return "glBufferSubData";
+    return "orphan";
+  }
+
+  void resetAverage() {
+    stream_->resetCounters();
+    cpu_ms_ = gpu_ms_ = 0;
+    num_frames_ = 0;
+  }
+
+  // 待った回数は StreamBuffer の時だけ数える
+  void report() {
+    std::stringstream ss;
+    ss << NUM_POINTS << " points, cpu "
+       << utils::toString(cpu_ms_ / num_frames_, 3, 7, ' ') << " ms, gpu "
+       << utils::toString(gpu_ms_ / num_frames_, 3, 7, ' ') << " ms\n"
+       << "stalls " << stream_->getNumStalls() << ", "
+       << stream_->getNumBytesAllocated() / num_frames_ / 1024
+       << " KB streamed per frame";
+    result_ = ss.str();
+    logger::info("stream_buffer") << getModeName() << " " << result_
+                                  << logger::end();
+    resetAverage();
+  }
+
+  vector<Vertex> vertices_;
+  vector<glm::vec2> seeds_;
+  std::unique_ptr<gl::StreamBuffer> stream_;
+  gl::Vbo<Vertex> vbo_;
+  gl::Vao vao_;
+  Mode mode_ = STREAM;
+
+  double cpu_ms_ = 0;
+  double gpu_ms_ = 0;
+  int num_frames_ = 0;
+  string result_;
+};
+
+}  // namespace limas
@@ -0,0 +1,120 @@
+#pragma once
+#include "app/BaseApp.h"
+
+namespace limas {
+
+using namespace std;
+
+// 1 万文字を描く時間を測る
+// l: 1 行ずつ描くか全体を 1 回で描くか
+// c: 毎フレーム文字を変えてレイアウトのキャッシュを外す
+class App : public BaseApp {
+ public:
+  using BaseApp::BaseApp;
+
+  static constexpr int NUM_LINES = 100;
+  static constexpr int NUM_COLUMNS = 100;
+  static constexpr int NUM_AVERAGED_FRAMES = 120;
+
+  void setup() {
+    setVerticalSync(false);
+    setGpuProfiling(true);
+    makeLines(0);
+  }
+
+  void draw() {
+    gl::clearColor(0, 0, 0, 0);
+
+    gl::pushMatrix();
+    gl::setOrthoView(getWidth(), getHeight());
+    gl::setColor(1, 1, 1, 1);
+
+    if (b_changing_) makeLines(getFrameNumber());
+
+    auto& text_batch = getRenderer()->getTextBatch();
+    text_batch.resetCounters();
+
+    PreciseStopwatch stopwatch;
+    stopwatch.start();
+    if (b_lines_) {
+      for (int i = 0; i < NUM_LINES; i++)
+        gl::drawBitmapString(lines_[i], 5, 40 + i * 10);
+    } else {
+      gl::drawBitmapString(page_, 5, 40);
+    }
+    gl::flush();
+    cpu_ms_ += stopwatch.getElapsedInMilliseconds();
+    gpu_ms_ += getGpuTime();
+    num_hits_ += text_batch.getNumHits();
+    num_misses_ += text_batch.getNumMisses();
+
+    if (++num_frames_ == NUM_AVERAGED_FRAMES) report();
+
+    gl::setColor(0, 0, 0, 0.8);
+    gl::drawRectangle(0, 0, 460, 35);
+    gl::setColor(1, 1, 1, 1);
+    gl::drawBitmapString(
+        "FPS:" + utils::toString(getFPS(), 2, 6, '0') + " [l] " +
+            (b_lines_ ? "per line" : "one string") + " [c] " +
+            (b_changing_ ? "changing" : "static"),
+        5, 5);
+    gl::drawBitmapString(result_, 5, 15);
+    gl::popMatrix();
+  }
+
+  void keyPressed(const KeyEventArgs &e) {
+    if (e.key == 'l') b_lines_ = !b_lines_;
+    if (e.key == 'c') {
+      b_changing_ = !b_changing_;
+      if (!b_changing_) makeLines(0);
+    }
+    resetAverage();
+  }
+
+ private:
+  void makeLines(int seed) {
+    lines_.resize(NUM_LINES);
+    page_.clear();
+    for (int i = 0; i < NUM_LINES; i++) {
+      auto& line = lines_[i];
+      line.resize(NUM_COLUMNS);
+      for (int j = 0; j < NUM_COLUMNS; j++)
+        line[j] = '!' + (i * 31 + j * 7 + seed) % 94;
+      page_ += line + "\n";
+    }
+  }
+
+  void resetAverage() {
+    cpu_ms_ = gpu_ms_ = 0;
+    num_hits_ = num_misses_ = 0;
+    num_frames_ = 0;
+  }
+
+  void report() {
+    std::stringstream ss;
+    ss << NUM_LINES * NUM_COLUMNS << " chars, cpu "
+       << utils::toString(cpu_ms_ / num_frames_, 3, 7, ' ') << " ms, gpu "
+       << utils::toString(gpu_ms_ / num_frames_, 3, 7, ' ') << " ms\n"
+       << "layouts hit " << num_hits_ / num_frames_ << " miss "
+       << num_misses_ / num_frames_ << " per frame";
+    result_ = ss.str();
+    logger::info("text") << (b_lines_ ? "lines " : "page  ")
+                         << (b_changing_ ? "changing " : "static   ")
+                         << result_ << logger::end();
+    resetAverage();
+  }
+
+  vector<string> lines_;
+  string page_;
+  bool b_lines_ = true;
+  bool b_changing_ = false;
+
+  double cpu_ms_ = 0;
+  double gpu_ms_ = 0;
+  size_t num_hits_ = 0;
+  size_t num_misses_ = 0;
+  int num_frames_ = 0;
+  string result_;
+};
+
+}  // namespace limas
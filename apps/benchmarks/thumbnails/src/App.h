@@ -0,0 +1,106 @@
+#pragma once
+#include "app/BaseApp.h"
+#include "video/VideoThumbnailer.h"
+
+namespace limas {
+
+using namespace std;
+
+// VideoThumbnailer で 1 秒に何ファイル処理できるかを測る
+// assets の中か、ドロップしたフォルダの動画を使う
+// スレッド数とキーフレームだけにするかを変えて 1 フレームに 1 つずつ測る
+class App : public BaseApp {
+ public:
+  using BaseApp::BaseApp;
+
+  static constexpr int NUM_THUMBNAILS = 8;
+
+  struct Case {
+    size_t num_threads;
+    bool b_keyframes_only;
+  };
+
+  void setup() {
+    setVerticalSync(true);
+    const size_t n = std::max(1u, std::thread::hardware_concurrency());
+    cases_ = {{1, true}, {n, true}, {1, false}, {n, false}};
+    load(fs::getAssetPath());
+  }
+
+  void update() {
+    if (index_ < cases_.size()) measure(cases_[index_++]);
+  }
+
+  void draw() {
+    gl::clearColor(0, 0, 0, 0);
+
+    gl::pushMatrix();
+    gl::setOrthoView(getWidth(), getHeight());
+    gl::setColor(1, 1, 1, 1);
+    if (tex_.isAllocated()) {
+      const float w = std::min<float>(getWidth(), tex_.getWidth());
+      gl::drawTexture(tex_, 0, 80, w, w * tex_.getHeight() / tex_.getWidth());
+    }
+    gl::drawBitmapString(report_.str(), 5, 5);
+    gl::popMatrix();
+  }
+
+  void fileDropped(const FileDropEventArgs &e) {
+    if (!e.paths.empty()) load(e.paths[0]);
+  }
+
+ private:
+  void load(const string& dir) {
+    static const set<string> extensions = {".mov", ".mp4", ".mkv", ".avi",
+                                           ".webm"};
+    filepaths_.clear();
+    if (std::filesystem::is_directory(dir)) {
+      for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        if (extensions.count(entry.path().extension().string()))
+          filepaths_.push_back(entry.path().string());
+      }
+    }
+    std::sort(filepaths_.begin(), filepaths_.end());
+
+    report_.str("");
+    report_ << filepaths_.size() << " files in " << dir << "\n";
+    index_ = filepaths_.empty() ? cases_.size() : 0;
+  }
+
+  void measure(const Case& c) {
+    VideoThumbnailer thumbnailer(c.num_threads);
+    VideoThumbnailer::Settings settings;
+    settings.num_thumbnails = NUM_THUMBNAILS;
+    settings.b_keyframes_only = c.b_keyframes_only;
+
+    PreciseStopwatch stopwatch;
+    stopwatch.start();
+    auto results = thumbnailer.generate(filepaths_, settings);
+    const double seconds = stopwatch.getElapsedInSeconds();
+
+    size_t num_thumbnails = 0;
+    for (const auto& r : results) num_thumbnails += r.size();
+
+    std::stringstream ss;
+    ss << std::setw(3) << c.num_threads << " threads "
+       << (c.b_keyframes_only ? "keyframes " : "exact     ")
+       << utils::toString(filepaths_.size() / seconds, 2, 7, ' ')
+       << " files/s " << utils::toString(num_thumbnails / seconds, 1, 7, ' ')
+       << " thumbnails/s";
+    report_ << ss.str() << "\n";
+    logger::info("thumbnails") << ss.str() << logger::end();
+
+    if (!results.empty()) {
+      auto sheet = VideoThumbnailer::makeContactSheet(results[0], 4, 2);
+      VideoThumbnailer::loadTexture(tex_, sheet);
+    }
+  }
+
+  vector<string> filepaths_;
+  vector<Case> cases_;
+  size_t index_ = 0;
+  std::stringstream report_;
+  gl::Texture2D tex_;
+};
+
+}  // namespace limas
@@ -0,0 +1,21 @@
+#version 400
+#resource "uniforms.glsl"
+
+layout(location = 0) in vec3 position;
+
+uniform vec4 u_p0;
+uniform vec4 u_p1;
+uniform vec4 u_p2;
+uniform vec4 u_p3;
+uniform vec4 u_p4;
+uniform vec4 u_p5;
+uniform vec4 u_p6;
+uniform vec4 u_p7;
+
+out vec4 v_color;
+
+void main() {
+    vec4 sum = u_p0 + u_p1 + u_p2 + u_p3 + u_p4 + u_p5 + u_p6 + u_p7;
+    v_color = COLOR * vec4(fract(sum.rgb), 1);
+    gl_Position = MVP_MAT * vec4(position, 1);
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include "app/BaseApp.h"
+
+namespace limas {
+
+using namespace std;
+
+// uniform を名前で設定する時とハンドルで設定する時の CPU の時間を比べる
+// 1 フレームに NUM_DRAWS 回、8 個の vec4 を設定して描く
+// h: 名前とハンドルの切り替え
+// v: 毎回値を変えるか、同じ値を送って省かせるか
+class App : public BaseApp {
+ public:
+  using BaseApp::BaseApp;
+
+  static constexpr int NUM_DRAWS = 2000;
+  static constexpr int NUM_UNIFORMS = 8;
+  static constexpr int NUM_AVERAGED_FRAMES = 120;
+
+  void setup() {
+    setVerticalSync(false);
+    shader_.load(fs::getAssetPath("shader/uniforms.vert"),
+                 fs::getAssetPath("shader/uniforms.frag"));
+    for (int i = 0; i < NUM_UNIFORMS; i++)
+      names_.push_back("u_p" + to_string(i));
+    handles_.resize(NUM_UNIFORMS);
+  }
+
+  void draw() {
+    gl::clearColor(0, 0, 0, 0);
+
+    gl::pushMatrix();
+    gl::setOrthoView(getWidth(), getHeight());
+
+    // ハンドルはリンクし直すと無効になる
+    if (shader_.getLinkId() != link_id_) {
+      for (int i = 0; i < NUM_UNIFORMS; i++)
+        handles_[i] = shader_.getUniform<glm::vec4>(names_[i]);
+      link_id_ = shader_.getLinkId();
+    }
+
+    const int cols = 50;
+    const float size = getWidth() / (float)cols;
+    gl::ShaderBase::resetUniformCounters();
+    PreciseStopwatch stopwatch;
+    stopwatch.start();
+    shader_.bind();
+    for (int i = 0; i < NUM_DRAWS; i++) {
+      for (int j = 0; j < NUM_UNIFORMS; j++) {
+        const glm::vec4 v = b_changing_ ? glm::vec4(i * 0.01f, j * 0.1f, 0, 0)
+                                        : glm::vec4(j * 0.1f);
+        if (b_handles_)
+          shader_.setUniform(handles_[j], v);
+        else
+          shader_.setUniform4f(names_[j], v);
+      }
+      gl::drawRectangle((i % cols) * size, (i / cols) * size, size, size);
+    }
+    shader_.unbind();
+    cpu_ms_ += stopwatch.getElapsedInMilliseconds();
+    num_updates_ += gl::ShaderBase::getNumUniformUpdates();
+    num_skips_ += gl::ShaderBase::getNumUniformSkips();
+
+    if (++num_frames_ == NUM_AVERAGED_FRAMES) report();
+
+    gl::setColor(0, 0, 0, 0.8);
+    gl::drawRectangle(0, 0, 460, 35);
+    gl::setColor(1, 1, 1, 1);
+    gl::drawBitmapString("FPS:" + utils::toString(getFPS(), 2, 6, '0') +
+                             " [h] " + (b_handles_ ? "handles" : "names") +
+                             " [v] " + (b_changing_ ? "changing" : "same"),
+                         5, 5);
+    gl::drawBitmapString(result_, 5, 15);
+    gl::popMatrix();
+  }
+
+  void keyPressed(const KeyEventArgs &e) {
+    if (e.key == 'h') b_handles_ = !b_handles_;
+    if (e.key == 'v') b_changing_ = !b_changing_;
+    resetAverage();
+  }
+
+ private:
+  void resetAverage() {
+    cpu_ms_ = 0;
+    num_updates_ = num_skips_ = 0;
+    num_frames_ = 0;
+  }
+
+  // 更新と省略の数は Renderer が描画ごとに送る既定の uniform も含む
+  void report() {
+    std::stringstream ss;
+    ss << "cpu " << utils::toString(cpu_ms_ / num_frames_, 3, 7, ' ')
+       << " ms, uniforms sent " << num_updates_ / num_frames_ << " skipped "
+       << num_skips_ / num_frames_ << " per frame";
+    result_ = ss.str();
+    logger::info("uniforms") << (b_handles_ ? "handles " : "names   ")
+                             << (b_changing_ ? "changing " : "same     ")
+                             << result_ << logger::end();
+    resetAverage();
+  }
+
+  gl::Shader shader_;
+  vector<string> names_;
+  vector<gl::Shader::Uniform<glm::vec4>> handles_;
+  uint64_t link_id_ = 0;
+  bool b_handles_ = true;
+  bool b_changing_ = true;
+
+  double cpu_ms_ = 0;
+  size_t num_updates_ = 0;
+  size_t num_skips_ = 0;
+  int num_frames_ = 0;
+  string result_;
+};
+
+}  // namespace limas
@@ -0,0 +1,139 @@
+#pragma once
+#include "app/BaseApp.h"
+
+namespace limas {
+
+using namespace std;
+
+// 100 万頂点の VboMesh の一部だけを毎フレーム動かし、送る量と時間を測る
+// 動かすのは連続した帯なので、書き換えた範囲は 1 つにまとまる
+// u: 書き換えた範囲だけ / 頂点全体 / インターリーブで範囲だけ
+// 上下キー: 動かす割合を 2 倍、半分にする
+class App : public BaseApp {
+ public:
+  using BaseApp::BaseApp;
+
+  static constexpr int GRID_SIZE = 1000;
+  static constexpr int NUM_AVERAGED_FRAMES = 120;
+
+  enum Mode { DIRTY, FULL, INTERLEAVED, NUM_MODES };
+
+  void setup() {
+    setVerticalSync(false);
+    setGpuProfiling(true);
+
+    for (int y = 0; y < GRID_SIZE; y++) {
+      for (int x = 0; x < GRID_SIZE; x++) {
+        mesh_.addVertex(glm::vec3(x, y, 0));
+        mesh_.addColor(Color::fromHsv((float)x / GRID_SIZE, 0.6, 1.0).toVec());
+      }
+    }
+    mesh_.setUsage(GL_DYNAMIC_DRAW);
+    setMode(DIRTY);
+  }
+
+  void draw() {
+    gl::clearColor(0, 0, 0, 0);
+
+    gl::pushMatrix();
+    gl::setOrthoView(getWidth(), getHeight());
+
+    // 帯を少しずつずらしながら縦に揺らす
+    const size_t n = mesh_.getNumVertices();
+    const size_t count = std::max<size_t>(1, n * fraction_);
+    const size_t first = (getFrameNumber() * count) % (n - count + 1);
+    const float t = getElapsedSeconds();
+    auto& vertices = mesh_.getVertices();
+
+    PreciseStopwatch stopwatch;
+    stopwatch.start();
+    mesh_.resetCounters();
+    for (size_t i = first; i < first + count; i++) {
+      glm::vec3 v = vertices[i];
+      v.y = i / GRID_SIZE + std::sin(t * 4.0f + v.x * 0.05f) * 3.0f;
+      if (mode_ == FULL)
+        vertices[i] = v;
+      else
+        mesh_.setVertex(i, v);
+    }
+    if (mode_ == FULL)
+      mesh_.updateVertices();
+    else
+      mesh_.updateDirty();
+    num_bytes_ += mesh_.getNumBytesUploaded();
+
+    gl::pushMatrix();
+    gl::scale(getWidth() / (float)GRID_SIZE, getHeight() / (float)GRID_SIZE,
+              1);
+    gl::setColor(1, 1, 1, 1);
+    gl::drawMesh(mesh_, GL_POINTS);
+    gl::popMatrix();
+    cpu_ms_ += stopwatch.getElapsedInMilliseconds();
+    gpu_ms_ += getGpuTime();
+
+    if (++num_frames_ == NUM_AVERAGED_FRAMES) report();
+
+    gl::setColor(0, 0, 0, 0.8);
+    gl::drawRectangle(0, 0, 460, 35);
+    gl::setColor(1, 1, 1, 1);
+    gl::drawBitmapString("FPS:" + utils::toString(getFPS(), 2, 6, '0') +
+                             " [u] " + getModeName() + " [up/down] " +
+                             utils::toString(fraction_ * 100, 3, 7, ' ') + "%",
+                         5, 5);
+    gl::drawBitmapString(result_, 5, 15);
+    gl::popMatrix();
+  }
+
+  void keyPressed(const KeyEventArgs &e) {
+    if (e.key == 'u') setMode((Mode)((mode_ + 1) % NUM_MODES));
+    if (e.key == GLFW_KEY_UP) fraction_ = std::min(fraction_ * 2.0, 1.0);
+    if (e.key == GLFW_KEY_DOWN) fraction_ = std::max(fraction_ * 0.5, 1e-5);
+    resetAverage();
+  }
+
+ private:
+  // レイアウトを変えたら全体を送り直す
+  void setMode(Mode mode) {
+    mode_ = mode;
+    mesh_.setInterleaved(mode_ == INTERLEAVED);
+    mesh_.update();
+    resetAverage();
+  }
+
+  string getModeName() const {
+    if (mode_ == DIRTY) return "dirty range";
+    if (mode_ == FULL) return "full";
+    return "interleaved dirty range";
+  }
+
+  void resetAverage() {
+    cpu_ms_ = gpu_ms_ = 0;
+    num_bytes_ = 0;
+    num_frames_ = 0;
+  }
+
+  void report() {
+    std::stringstream ss;
+    ss << mesh_.getNumVertices() << " vertices, cpu "
+       << utils::toString(cpu_ms_ / num_frames_, 3, 7, ' ') << " ms, gpu "
+       << utils::toString(gpu_ms_ / num_frames_, 3, 7, ' ') << " ms\n"
+       << num_bytes_ / num_frames_ / 1024 << " KB uploaded per frame";
+    result_ = ss.str();
+    logger::info("vbo_dirty")
+        << getModeName() << " " << utils::toString(fraction_ * 100, 3, 7, ' ')
+        << "% " << result_ << logger::end();
+    resetAverage();
+  }
+
+  gl::VboMesh mesh_;
+  Mode mode_ = DIRTY;
+  double fraction_ = 0.01;
+
+  double cpu_ms_ = 0;
+  double gpu_ms_ = 0;
+  size_t num_bytes_ = 0;
+  int num_frames_ = 0;
+  string result_;
+};
+
+}  // namespace limas
@@ -0,0 +1,321 @@
+#pragma once
+#include "3d/FrustumCuller.h"
+#include "3d/Node.h"
+
+namespace limas {
+
+// 物体の境界箱を葉に持つ動的な BVH
+// 少し太らせた箱で持ち、はみ出した時だけ木を組み直す
+// 挿入は表面積の増え方が小さい位置を選び、高さは回転で揃える
+// cull() は部分木ごとに視錐台と比べ、完全に内側の平面は子で検査しない
+// 葉ごとに最後に外と判定した平面を覚えて次のフレームで最初に検査する
+template <typename T>
+class Bvh {
+ public:
+  using Id = int;
+  static constexpr Id NULL_ID = -1;
+
+  explicit Bvh(float margin = 0.1f)
+      : root_(NULL_ID), free_list_(NULL_ID), num_leaves_(0), margin_(margin) {}
+
+  Id insert(const glm::vec3& min, const glm::vec3& max, const T& data) {
+    const Id id = allocateNode();
+    TreeNode& node = nodes_[id];
+    node.min = min - glm::vec3(margin_);
+    node.max = max + glm::vec3(margin_);
+    node.data = data;
+    node.height = 0;
+    insertLeaf(id);
+    num_leaves_++;
+    return id;
+  }
+
+  void remove(Id id) {
+    removeLeaf(id);
+    freeNode(id);
+    num_leaves_--;
+  }
+
+  // 太らせた箱の中に収まっていれば何もしない。組み直したら true
+  bool update(Id id, const glm::vec3& min, const glm::vec3& max) {
+    TreeNode& node = nodes_[id];
+    if (glm::all(glm::lessThanEqual(node.min, min)) &&
+        glm::all(glm::greaterThanEqual(node.max, max))) {
+      return false;
+    }
+    removeLeaf(id);
+    nodes_[id].min = min - glm::vec3(margin_);
+    nodes_[id].max = max + glm::vec3(margin_);
+    insertLeaf(id);
+    return true;
+  }
+
+  // Node の境界箱で登録する
+  Id insert(const Node& node, const T& data) {
+    glm::vec3 min, max;
+    node.getWorldBounds(min, max);
+    return insert(min, max, data);
+  }
+
+  bool update(Id id, const Node& node) {
+    glm::vec3 min, max;
+    node.getWorldBounds(min, max);
+    return update(id, min, max);
+  }
+
+  const T& getData(Id id) const { return nodes_[id].data; }
+  T& getData(Id id) { return nodes_[id].data; }
+
+  // 見える葉ごとに f(data) を呼ぶ
+  template <class F>
+  CullStats cull(const Frustum& frustum, F&& f) {
+    const auto start = std::chrono::steady_clock::now();
+    CullStats stats;
+    stats.num_objects = num_leaves_;
+    if (root_ == NULL_ID) return stats;
+
+    stack_.clear();
+    stack_.push_back({root_, Frustum::ALL_PLANES});
+    while (!stack_.empty()) {
+      auto [id, mask] = stack_.back();
+      stack_.pop_back();
+      TreeNode& node = nodes_[id];
+      stats.num_nodes_visited++;
+
+      // 親が完全に内側なら mask は 0 で、葉も検査しない
+      if (mask != 0) {
+        if (node.isLeaf()) stats.num_tested++;
+        const auto result =
+            frustum.classifyBoundingBox(node.min, node.max, mask,
+                                        node.last_plane);
+        if (result == Frustum::OUTSIDE) continue;
+      }
+
+      if (node.isLeaf()) {
+        f(node.data);
+        stats.num_visible++;
+      } else {
+        stack_.push_back({node.left, mask});
+        stack_.push_back({node.right, mask});
+      }
+    }
+
+    stats.elapsed_ms = std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+    return stats;
+  }
+
+  void clear() {
+    nodes_.clear();
+    root_ = NULL_ID;
+    free_list_ = NULL_ID;
+    num_leaves_ = 0;
+  }
+
+  size_t size() const { return num_leaves_; }
+  int getHeight() const {
+    return root_ == NULL_ID ? 0 : nodes_[root_].height;
+  }
+  float getMargin() const { return margin_; }
+
+ private:
+  struct TreeNode {
+    glm::vec3 min, max;
+    Id parent = NULL_ID;  // 空いているノードでは次の空き
+    Id left = NULL_ID;
+    Id right = NULL_ID;
+    int height = -1;  // 葉は 0、空きは -1
+    int last_plane = 0;
+    T data = T();
+
+    bool isLeaf() const { return left == NULL_ID; }
+  };
+
+  static float getSurfaceArea(const glm::vec3& min, const glm::vec3& max) {
+    const glm::vec3 d = max - min;
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+  }
+
+  Id allocateNode() {
+    if (free_list_ == NULL_ID) {
+      nodes_.emplace_back();
+      return nodes_.size() - 1;
+    }
+    const Id id = free_list_;
+    free_list_ = nodes_[id].parent;
+    nodes_[id] = TreeNode();
+    return id;
+  }
+
+  void freeNode(Id id) {
+    nodes_[id] = TreeNode();
+    nodes_[id].parent = free_list_;
+    free_list_ = id;
+  }
+
+  void insertLeaf(Id leaf) {
+    nodes_[leaf].left = NULL_ID;
+    nodes_[leaf].right = NULL_ID;
+    if (root_ == NULL_ID) {
+      root_ = leaf;
+      nodes_[leaf].parent = NULL_ID;
+      return;
+    }
+
+    // 親を足した時の表面積の増え方が一番小さい兄弟を探す
+    const glm::vec3 leaf_min = nodes_[leaf].min;
+    const glm::vec3 leaf_max = nodes_[leaf].max;
+    Id index = root_;
+    while (!nodes_[index].isLeaf()) {
+      const TreeNode& node = nodes_[index];
+      const float area = getSurfaceArea(node.min, node.max);
+      const float combined_area = getSurfaceArea(glm::min(node.min, leaf_min),
+                                                 glm::max(node.max, leaf_max));
+      const float cost = 2.0f * combined_area;
+      const float inheritance_cost = 2.0f * (combined_area - area);
+
+      auto getChildCost = [&](Id child) {
+        const TreeNode& c = nodes_[child];
+        const float new_area = getSurfaceArea(glm::min(c.min, leaf_min),
+                                              glm::max(c.max, leaf_max));
+        const float old_area = c.isLeaf() ? 0 : getSurfaceArea(c.min, c.max);
+        return new_area - old_area + inheritance_cost;
+      };
+      const float cost_left = getChildCost(node.left);
+      const float cost_right = getChildCost(node.right);
+
+      if (cost < cost_left && cost < cost_right) break;
+      index = cost_left < cost_right ? node.left : node.right;
+    }
+
+    const Id sibling = index;
+    const Id old_parent = nodes_[sibling].parent;
+    const Id new_parent = allocateNode();
+    nodes_[new_parent].parent = old_parent;
+    nodes_[new_parent].min = glm::min(nodes_[sibling].min, leaf_min);
+    nodes_[new_parent].max = glm::max(nodes_[sibling].max, leaf_max);
+    nodes_[new_parent].height = nodes_[sibling].height + 1;
+    nodes_[new_parent].left = sibling;
+    nodes_[new_parent].right = leaf;
+    nodes_[sibling].parent = new_parent;
+    nodes_[leaf].parent = new_parent;
+
+    if (old_parent == NULL_ID) {
+      root_ = new_parent;
+    } else if (nodes_[old_parent].left == sibling) {
+      nodes_[old_parent].left = new_parent;
+    } else {
+      nodes_[old_parent].right = new_parent;
+    }
+
+    refit(nodes_[leaf].parent);
+  }
+
+  void removeLeaf(Id leaf) {
+    if (leaf == root_) {
+      root_ = NULL_ID;
+      return;
+    }
+
+    const Id parent = nodes_[leaf].parent;
+    const Id grand_parent = nodes_[parent].parent;
+    const Id sibling = nodes_[parent].left == leaf ? nodes_[parent].right
+                                                   : nodes_[parent].left;
+
+    if (grand_parent == NULL_ID) {
+      root_ = sibling;
+      nodes_[sibling].parent = NULL_ID;
+      freeNode(parent);
+      return;
+    }
+
+    if (nodes_[grand_parent].left == parent) {
+      nodes_[grand_parent].left = sibling;
+    } else {
+      nodes_[grand_parent].right = sibling;
+    }
+    nodes_[sibling].parent = grand_parent;
+    freeNode(parent);
+
+    refit(grand_parent);
+  }
+
+  // index から根まで箱と高さを直しながら回転で釣り合いを取る
+  void refit(Id index) {
+    while (index != NULL_ID) {
+      index = balance(index);
+      TreeNode& node = nodes_[index];
+      const TreeNode& left = nodes_[node.left];
+      const TreeNode& right = nodes_[node.right];
+      node.height = 1 + std::max(left.height, right.height);
+      node.min = glm::min(left.min, right.min);
+      node.max = glm::max(left.max, right.max);
+      index = node.parent;
+    }
+  }
+
+  // a の子の高さが 2 以上違えば高い方の子を a の位置に上げる
+  // 上がったノードを返す
+  Id balance(Id a) {
+    if (nodes_[a].isLeaf() || nodes_[a].height < 2) return a;
+
+    const Id b = nodes_[a].left;
+    const Id c = nodes_[a].right;
+    const int diff = nodes_[c].height - nodes_[b].height;
+    if (diff > 1) return rotate(a, c, b);
+    if (diff < -1) return rotate(a, b, c);
+    return a;
+  }
+
+  // high を a の位置に上げ、high の子のうち低い方を a に渡す
+  Id rotate(Id a, Id high, Id low) {
+    const Id f = nodes_[high].left;
+    const Id g = nodes_[high].right;
+
+    nodes_[high].left = a;
+    nodes_[high].parent = nodes_[a].parent;
+    nodes_[a].parent = high;
+
+    const Id high_parent = nodes_[high].parent;
+    if (high_parent == NULL_ID) {
+      root_ = high;
+    } else if (nodes_[high_parent].left == a) {
+      nodes_[high_parent].left = high;
+    } else {
+      nodes_[high_parent].right = high;
+    }
+
+    const bool b_keep_f = nodes_[f].height > nodes_[g].height;
+    const Id keep = b_keep_f ? f : g;
+    const Id give = b_keep_f ? g : f;
+    nodes_[high].right = keep;
+    if (nodes_[a].left == high) {
+      nodes_[a].left = give;
+    } else {
+      nodes_[a].right = give;
+    }
+    nodes_[give].parent = a;
+
+    TreeNode& na = nodes_[a];
+    na.min = glm::min(nodes_[low].min, nodes_[give].min);
+    na.max = glm::max(nodes_[low].max, nodes_[give].max);
+    na.height = 1 + std::max(nodes_[low].height, nodes_[give].height);
+
+    TreeNode& nh = nodes_[high];
+    nh.min = glm::min(na.min, nodes_[keep].min);
+    nh.max = glm::max(na.max, nodes_[keep].max);
+    nh.height = 1 + std::max(na.height, nodes_[keep].height);
+    return high;
+  }
+
+  std::vector<TreeNode> nodes_;
+  Id root_;
+  Id free_list_;
+  size_t num_leaves_;
+  float margin_;
+
+  std::vector<std::pair<Id, uint8_t>> stack_;
+};
+
+}  // namespace limas
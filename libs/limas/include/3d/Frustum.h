@@ -60,27 +60,49 @@ class Frustum {
     return true;
   }
 
-  bool isBoundingBoxInside(const glm::vec3& min, const glm::vec3& max) const {
-    glm::vec3 vertices[8] = {{min.x, min.y, min.z}, {max.x, min.y, min.z},
-                             {max.x, max.y, min.z}, {min.x, max.y, min.z},
-                             {min.x, max.y, max.z}, {max.x, max.y, max.z},
-                             {max.x, min.y, max.z}, {min.x, min.y, max.z}};
+  enum Result { OUTSIDE, INTERSECT, INSIDE };
+
+  // 全ての平面を検査する時のマスク
+  static constexpr uint8_t ALL_PLANES = 0x3f;
 
+  // 法線の向きに一番遠い角 (p-vertex) が外なら箱は外
+  // 一番近い角 (n-vertex) も内側ならその平面については完全に内側
+  bool isBoundingBoxInside(const glm::vec3& min, const glm::vec3& max) const {
     for (int i = 0; i < 6; i++) {
-      int num_outside = 0;
-      for (int j = 0; j < 8; j++) {
-        if (glm::dot(glm::vec3(planes_[i]), vertices[j]) + planes_[i].w <
-            0.0f) {
-          num_outside++;
-        }
-      }
-      if (num_outside == 8) {
+      if (getPlaneDistance(i, getPositiveVertex(i, min, max)) < 0.0f) {
         return false;
       }
     }
     return true;
   }
 
+  // plane_mask のビットが立っている平面だけを検査し、完全に内側だった平面の
+  // ビットを落とす。子はこのマスクを引き継げば同じ平面を検査しなくてよい
+  // last_plane は前回外と判定した平面で、最初に検査して結果を更新する
+  Result classifyBoundingBox(const glm::vec3& min, const glm::vec3& max,
+                             uint8_t& plane_mask, int& last_plane) const {
+    if ((plane_mask & (1 << last_plane)) &&
+        getPlaneDistance(last_plane,
+                         getPositiveVertex(last_plane, min, max)) < 0.0f) {
+      return OUTSIDE;
+    }
+
+    Result result = INSIDE;
+    for (int i = 0; i < 6; i++) {
+      if (!(plane_mask & (1 << i))) continue;
+      if (getPlaneDistance(i, getPositiveVertex(i, min, max)) < 0.0f) {
+        last_plane = i;
+        return OUTSIDE;
+      }
+      if (getPlaneDistance(i, getPositiveVertex(i, max, min)) < 0.0f) {
+        result = INTERSECT;
+      } else {
+        plane_mask &= ~(1 << i);
+      }
+    }
+    return result;
+  }
+
   bool isBoundingSphereInside(const glm::vec3& center, float radius) const {
     for (int i = 0; i < 6; i++) {
       float distance = glm::dot(glm::vec3(planes_[i]), center) + planes_[i].w;
@@ -91,6 +113,9 @@ class Frustum {
     return true;
   }
 
+  const glm::vec4& getPlane(int i) const { return planes_[i]; }
+  const std::vector<glm::vec4>& getPlanes() const { return planes_; }
+
   geom::Mesh toMesh() const {
     static const std::vector<int> indices({
         0, 1, 1, 2, 2, 3, 3, 0,  // Near plane
@@ -107,6 +132,18 @@ class Frustum {
   }
 
  protected:
+  float getPlaneDistance(int i, const glm::vec3& p) const {
+    return glm::dot(glm::vec3(planes_[i]), p) + planes_[i].w;
+  }
+
+  // min と max を入れ替えると n-vertex になる
+  glm::vec3 getPositiveVertex(int i, const glm::vec3& min,
+                              const glm::vec3& max) const {
+    return glm::vec3(planes_[i].x >= 0 ? max.x : min.x,
+                     planes_[i].y >= 0 ? max.y : min.y,
+                     planes_[i].z >= 0 ? max.z : min.z);
+  }
+
   std::vector<glm::vec4> planes_;
   std::vector<glm::vec3> vertices_;
 };
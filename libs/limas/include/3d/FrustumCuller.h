@@ -0,0 +1,240 @@
+#pragma once
+#include "3d/Frustum.h"
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace limas {
+
+struct CullStats {
+  size_t num_objects = 0;  // 対象の物体の数
+  size_t num_tested = 0;   // 境界を 1 つずつ検査した物体の数
+  size_t num_visible = 0;  // 見えると判定した数
+  size_t num_nodes_visited = 0;
+  double elapsed_ms = 0;
+
+  size_t getNumCulled() const { return num_objects - num_visible; }
+};
+
+namespace culling {
+
+// 4 レーンの float。SSE か NEON があれば使う
+#if defined(__SSE__) || defined(_M_X64)
+struct Float4 {
+  __m128 v;
+  static Float4 load(const float* p) { return {_mm_loadu_ps(p)}; }
+  static Float4 set(float f) { return {_mm_set1_ps(f)}; }
+  friend Float4 operator+(Float4 a, Float4 b) { return {_mm_add_ps(a.v, b.v)}; }
+  friend Float4 operator-(Float4 a, Float4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+  friend Float4 operator*(Float4 a, Float4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+  // a < b のレーンのビットを立てる
+  static int lessMask(Float4 a, Float4 b) {
+    return _mm_movemask_ps(_mm_cmplt_ps(a.v, b.v));
+  }
+};
+#elif defined(__ARM_NEON)
+struct Float4 {
+  float32x4_t v;
+  static Float4 load(const float* p) { return {vld1q_f32(p)}; }
+  static Float4 set(float f) { return {vdupq_n_f32(f)}; }
+  friend Float4 operator+(Float4 a, Float4 b) { return {vaddq_f32(a.v, b.v)}; }
+  friend Float4 operator-(Float4 a, Float4 b) { return {vsubq_f32(a.v, b.v)}; }
+  friend Float4 operator*(Float4 a, Float4 b) { return {vmulq_f32(a.v, b.v)}; }
+  static int lessMask(Float4 a, Float4 b) {
+    static const uint32_t bits[4] = {1, 2, 4, 8};
+    const uint32x4_t m = vandq_u32(vcltq_f32(a.v, b.v), vld1q_u32(bits));
+    // vaddvq_u32 は AArch64 にしかないので 32bit の ARM でも使える vpadd で足す
+    const uint32x2_t sum = vpadd_u32(vget_low_u32(m), vget_high_u32(m));
+    return vget_lane_u32(vpadd_u32(sum, sum), 0);
+  }
+};
+#else
+struct Float4 {
+  float v[4];
+  static Float4 load(const float* p) { return {{p[0], p[1], p[2], p[3]}}; }
+  static Float4 set(float f) { return {{f, f, f, f}}; }
+  friend Float4 operator+(Float4 a, Float4 b) {
+    return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2],
+             a.v[3] + b.v[3]}};
+  }
+  friend Float4 operator-(Float4 a, Float4 b) {
+    return {{a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2],
+             a.v[3] - b.v[3]}};
+  }
+  friend Float4 operator*(Float4 a, Float4 b) {
+    return {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2],
+             a.v[3] * b.v[3]}};
+  }
+  static int lessMask(Float4 a, Float4 b) {
+    int mask = 0;
+    for (int i = 0; i < 4; i++) mask |= (a.v[i] < b.v[i]) << i;
+    return mask;
+  }
+};
+#endif
+
+}  // namespace culling
+
+// AABB や境界球を SoA で並べ、4 個ずつまとめて視錐台と比べる
+// AABB は平面ごとに p-vertex だけを検査する
+class FrustumCuller {
+ public:
+  struct Boxes {
+    std::vector<float> min_x, min_y, min_z;
+    std::vector<float> max_x, max_y, max_z;
+
+    void add(const glm::vec3& min, const glm::vec3& max) {
+      min_x.push_back(min.x);
+      min_y.push_back(min.y);
+      min_z.push_back(min.z);
+      max_x.push_back(max.x);
+      max_y.push_back(max.y);
+      max_z.push_back(max.z);
+    }
+    void set(size_t i, const glm::vec3& min, const glm::vec3& max) {
+      min_x[i] = min.x;
+      min_y[i] = min.y;
+      min_z[i] = min.z;
+      max_x[i] = max.x;
+      max_y[i] = max.y;
+      max_z[i] = max.z;
+    }
+    glm::vec3 getMin(size_t i) const {
+      return glm::vec3(min_x[i], min_y[i], min_z[i]);
+    }
+    glm::vec3 getMax(size_t i) const {
+      return glm::vec3(max_x[i], max_y[i], max_z[i]);
+    }
+    size_t size() const { return min_x.size(); }
+    void clear() { *this = Boxes(); }
+  };
+
+  struct Spheres {
+    std::vector<float> x, y, z, radius;
+
+    void add(const glm::vec3& center, float r) {
+      x.push_back(center.x);
+      y.push_back(center.y);
+      z.push_back(center.z);
+      radius.push_back(r);
+    }
+    void set(size_t i, const glm::vec3& center, float r) {
+      x[i] = center.x;
+      y[i] = center.y;
+      z[i] = center.z;
+      radius[i] = r;
+    }
+    size_t size() const { return x.size(); }
+    void clear() { *this = Spheres(); }
+  };
+
+  // visible[i] に見えるかどうかを書く
+  static CullStats cull(const Frustum& frustum, const Boxes& boxes,
+                        std::vector<uint8_t>& visible) {
+    using culling::Float4;
+    const auto start = std::chrono::steady_clock::now();
+    const size_t n = boxes.size();
+    visible.resize(n);
+
+    // 平面ごとに p-vertex になる側の配列を選んでおく
+    const float* xs[6];
+    const float* ys[6];
+    const float* zs[6];
+    Float4 px[6], py[6], pz[6], pw[6];
+    for (int p = 0; p < 6; p++) {
+      const glm::vec4& plane = frustum.getPlane(p);
+      xs[p] = plane.x >= 0 ? boxes.max_x.data() : boxes.min_x.data();
+      ys[p] = plane.y >= 0 ? boxes.max_y.data() : boxes.min_y.data();
+      zs[p] = plane.z >= 0 ? boxes.max_z.data() : boxes.min_z.data();
+      px[p] = Float4::set(plane.x);
+      py[p] = Float4::set(plane.y);
+      pz[p] = Float4::set(plane.z);
+      pw[p] = Float4::set(plane.w);
+    }
+
+    const Float4 zero = Float4::set(0);
+    size_t num_visible = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      int outside = 0;
+      for (int p = 0; p < 6 && outside != 0xf; p++) {
+        const Float4 d = Float4::load(xs[p] + i) * px[p] +
+                         Float4::load(ys[p] + i) * py[p] +
+                         Float4::load(zs[p] + i) * pz[p] + pw[p];
+        outside |= Float4::lessMask(d, zero);
+      }
+      for (int k = 0; k < 4; k++) {
+        visible[i + k] = !((outside >> k) & 1);
+        num_visible += visible[i + k];
+      }
+    }
+    for (; i < n; i++) {
+      visible[i] =
+          frustum.isBoundingBoxInside(boxes.getMin(i), boxes.getMax(i));
+      num_visible += visible[i];
+    }
+
+    return makeStats(n, num_visible, start);
+  }
+
+  static CullStats cull(const Frustum& frustum, const Spheres& spheres,
+                        std::vector<uint8_t>& visible) {
+    using culling::Float4;
+    const auto start = std::chrono::steady_clock::now();
+    const size_t n = spheres.size();
+    visible.resize(n);
+
+    Float4 px[6], py[6], pz[6], pw[6];
+    for (int p = 0; p < 6; p++) {
+      const glm::vec4& plane = frustum.getPlane(p);
+      px[p] = Float4::set(plane.x);
+      py[p] = Float4::set(plane.y);
+      pz[p] = Float4::set(plane.z);
+      pw[p] = Float4::set(plane.w);
+    }
+
+    const Float4 zero = Float4::set(0);
+    size_t num_visible = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      const Float4 x = Float4::load(spheres.x.data() + i);
+      const Float4 y = Float4::load(spheres.y.data() + i);
+      const Float4 z = Float4::load(spheres.z.data() + i);
+      const Float4 neg_r = zero - Float4::load(spheres.radius.data() + i);
+      int outside = 0;
+      for (int p = 0; p < 6 && outside != 0xf; p++) {
+        const Float4 d = x * px[p] + y * py[p] + z * pz[p] + pw[p];
+        outside |= Float4::lessMask(d, neg_r);
+      }
+      for (int k = 0; k < 4; k++) {
+        visible[i + k] = !((outside >> k) & 1);
+        num_visible += visible[i + k];
+      }
+    }
+    for (; i < n; i++) {
+      const glm::vec3 center(spheres.x[i], spheres.y[i], spheres.z[i]);
+      visible[i] = frustum.isBoundingSphereInside(center, spheres.radius[i]);
+      num_visible += visible[i];
+    }
+
+    return makeStats(n, num_visible, start);
+  }
+
+ private:
+  static CullStats makeStats(size_t num_tested, size_t num_visible,
+                             std::chrono::steady_clock::time_point start) {
+    CullStats stats;
+    stats.num_objects = num_tested;
+    stats.num_tested = num_tested;
+    stats.num_visible = num_visible;
+    stats.elapsed_ms = std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+    return stats;
+  }
+};
+
+}  // namespace limas
@@ -1,12 +1,31 @@
 #pragma once
 #include "glm/gtx/matrix_decompose.hpp"
 #include "glm/gtx/quaternion.hpp"
+#include "system/Logger.h"
 
 namespace limas {
 
+// 親子関係を持つ変換
+// 行列は読まれた時に計算し、変更は子孫のワールド行列にだけ伝える
 class Node {
  public:
-  Node() { reset(); }
+  Node() : parent_(nullptr) { reset(); }
+
+  // 変換と境界箱だけを写し、親子関係は写さない
+  Node(const Node& rhs) : parent_(nullptr) { copyTransform(rhs); }
+
+  Node& operator=(const Node& rhs) {
+    if (this != &rhs) copyTransform(rhs);
+    return *this;
+  }
+
+  virtual ~Node() {
+    setParent(nullptr);
+    for (auto child : children_) {
+      child->parent_ = nullptr;
+      child->markGlobalDirty();
+    }
+  }
 
   void reset() {
     setPosition({0.f, 0.f, 0.f});
@@ -53,7 +72,6 @@ class Node {
   void setOrientation(const glm::vec3& euler) {
     glm::quat q(glm::radians(euler));
     setOrientation(q);
-    update();
   }
 
   void setScale(const glm::vec3& s) {
@@ -61,8 +79,10 @@ class Node {
     update();
   }
 
-  const void setTransformMatrix(const glm::mat4& m) {
+  void setTransformMatrix(const glm::mat4& m) {
     transform_ = m;
+    b_local_dirty_ = false;
+    markGlobalDirty();
 
     glm::vec3 scale;
     glm::quat orientation;
@@ -76,7 +96,67 @@ class Node {
     this->scale_ = scale;
   }
 
-  const glm::mat4& getTransformMatrix() const { return transform_; }
+  // 親から見た行列
+  const glm::mat4& getTransformMatrix() const {
+    if (b_local_dirty_) {
+      transform_ = glm::translate(glm::mat4(1.0), position_);
+      transform_ = transform_ * glm::toMat4(orientation_);
+      transform_ = glm::scale(transform_, scale_);
+      b_local_dirty_ = false;
+    }
+    return transform_;
+  }
+
+  // 親の行列を掛けたワールドの行列
+  const glm::mat4& getGlobalTransformMatrix() const {
+    if (b_global_dirty_) {
+      global_transform_ =
+          parent_ ? parent_->getGlobalTransformMatrix() * getTransformMatrix()
+                  : getTransformMatrix();
+      b_global_dirty_ = false;
+    }
+    return global_transform_;
+  }
+
+  glm::vec3 getGlobalPosition() const {
+    return glm::vec3(getGlobalTransformMatrix()[3]);
+  }
+
+  // b_keep_global なら今のワールドの位置を保つように変換を直す
+  // 自分の子孫は親にできない
+  void setParent(Node* parent, bool b_keep_global = false) {
+    if (parent == parent_) return;
+    for (auto p = parent; p; p = p->parent_) {
+      if (p == this) {
+        logger::error("Node") << "Cannot parent to a descendant"
+                              << logger::end();
+        return;
+      }
+    }
+
+    const glm::mat4 global = getGlobalTransformMatrix();
+    if (parent_) {
+      auto& siblings = parent_->children_;
+      siblings.erase(std::remove(siblings.begin(), siblings.end(), this),
+                     siblings.end());
+    }
+    parent_ = parent;
+    if (parent_) parent_->children_.push_back(this);
+
+    if (b_keep_global) {
+      setTransformMatrix(
+          parent_ ? glm::inverse(parent_->getGlobalTransformMatrix()) * global
+                  : global);
+    } else {
+      markGlobalDirty();
+    }
+  }
+  void clearParent(bool b_keep_global = false) {
+    setParent(nullptr, b_keep_global);
+  }
+
+  Node* getParent() const { return parent_; }
+  const std::vector<Node*>& getChildren() const { return children_; }
 
   glm::vec3 getPosition() const { return glm::vec3(getTransformMatrix()[3]); }
 
@@ -137,16 +217,61 @@ class Node {
 
   void roll(float deg) { rotate(deg, getZAxis()); }
 
+  // 自身の座標系での境界箱。Bvh で視錐台カリングに使う
+  void setLocalBounds(const glm::vec3& min, const glm::vec3& max) {
+    bounds_min_ = min;
+    bounds_max_ = max;
+  }
+  const glm::vec3& getLocalBoundsMin() const { return bounds_min_; }
+  const glm::vec3& getLocalBoundsMax() const { return bounds_max_; }
+
+  // 境界箱をワールドに変換して、それを囲む軸に沿った箱を求める
+  void getWorldBounds(glm::vec3& min, glm::vec3& max) const {
+    const glm::mat4& m = getGlobalTransformMatrix();
+    const glm::vec3 center = glm::vec3(
+        m * glm::vec4((bounds_min_ + bounds_max_) * 0.5f, 1.0f));
+    const glm::vec3 extent = (bounds_max_ - bounds_min_) * 0.5f;
+    glm::vec3 world_extent(0);
+    for (int i = 0; i < 3; i++) {
+      world_extent += glm::abs(glm::vec3(m[i])) * extent[i];
+    }
+    min = center - world_extent;
+    max = center + world_extent;
+  }
+
  protected:
-  glm::mat4 transform_;
+  mutable glm::mat4 transform_;
+  mutable glm::mat4 global_transform_;
+  mutable bool b_local_dirty_ = true;
+  mutable bool b_global_dirty_ = true;
   glm::vec3 position_;
   glm::quat orientation_;
   glm::vec3 scale_;
+  glm::vec3 bounds_min_ = glm::vec3(0);
+  glm::vec3 bounds_max_ = glm::vec3(0);
+
+  Node* parent_;
+  std::vector<Node*> children_;
 
   void update() {
-    transform_ = glm::translate(glm::mat4(1.0), position_);
-    transform_ = transform_ * glm::toMat4(orientation_);
-    transform_ = glm::scale(transform_, scale_);
+    b_local_dirty_ = true;
+    markGlobalDirty();
+  }
+
+  // 既に汚れていれば子孫も汚れているのでそこで止める
+  void markGlobalDirty() {
+    if (b_global_dirty_) return;
+    b_global_dirty_ = true;
+    for (auto child : children_) child->markGlobalDirty();
+  }
+
+  void copyTransform(const Node& rhs) {
+    position_ = rhs.position_;
+    orientation_ = rhs.orientation_;
+    scale_ = rhs.scale_;
+    bounds_min_ = rhs.bounds_min_;
+    bounds_max_ = rhs.bounds_max_;
+    update();
   }
 };
 
@@ -0,0 +1,355 @@
+#pragma once
+#include "3d/Node.h"
+#include "system/Logger.h"
+#include "system/ThreadPool.h"
+
+namespace limas {
+
+// 大量の変換を SoA で持つシーングラフ
+// 親が必ず子より前に来るよう深さ順に並べ、update() の 1 回の走査で
+// 変更された変換とその子孫のワールド行列だけを計算し直す
+// ThreadPool を渡すと同じ深さの変換を分けて並列に計算する
+class SceneGraph {
+ public:
+  using Id = uint32_t;
+  static constexpr Id NULL_ID = std::numeric_limits<Id>::max();
+
+  SceneGraph()
+      : b_order_dirty_(false), b_levels_dirty_(false), num_updated_(0) {}
+
+  Id create(Id parent = NULL_ID) {
+    int parent_index = -1;
+    int depth = 0;
+    if (parent != NULL_ID) {
+      if (isValid(parent)) {
+        parent_index = indices_[parent];
+        depth = depths_[parent_index] + 1;
+      } else {
+        logger::error("SceneGraph")
+            << "Invalid parent " << parent << logger::end();
+      }
+    }
+
+    const Id id = allocateId();
+    const uint32_t index = ids_.size();
+    indices_[id] = index;
+    ids_.push_back(id);
+    positions_.emplace_back(0);
+    orientations_.emplace_back(1, 0, 0, 0);
+    scales_.emplace_back(1);
+    locals_.emplace_back(1);
+    worlds_.emplace_back(1);
+    parents_.push_back(parent_index);
+    depths_.push_back(depth);
+    flags_.push_back(LOCAL_DIRTY);
+
+    // 末尾に足すだけなら親は前にあるが、深さの順は崩れることがある
+    if (index > 0 && depths_[index - 1] > depth) b_order_dirty_ = true;
+    b_levels_dirty_ = true;
+    return id;
+  }
+
+  // Node の位置・回転・スケールで作る
+  Id create(const Node& node, Id parent = NULL_ID) {
+    const Id id = create(parent);
+    const uint32_t i = indices_[id];
+    positions_[i] = node.getPosition();
+    orientations_[i] = node.getOrientation();
+    scales_[i] = node.getScale();
+    return id;
+  }
+
+  // 子孫も消える。子孫の Id は次の update() で無効になる
+  void destroy(Id id) {
+    if (!isValid(id)) return;
+    flags_[indices_[id]] |= REMOVED;
+    indices_[id] = NULL_ID;
+    free_ids_.push_back(id);
+    b_order_dirty_ = true;
+  }
+
+  bool isValid(Id id) const {
+    return id < indices_.size() && indices_[id] != NULL_ID;
+  }
+
+  // 自分の子孫は親にできない
+  void setParent(Id id, Id parent) {
+    if (!isValid(id)) return;
+    const uint32_t i = indices_[id];
+    int parent_index = -1;
+    if (parent != NULL_ID) {
+      if (!isValid(parent)) {
+        logger::error("SceneGraph")
+            << "Invalid parent " << parent << logger::end();
+        return;
+      }
+      parent_index = indices_[parent];
+      for (int p = parent_index; p >= 0; p = parents_[p]) {
+        if (p == static_cast<int>(i)) {
+          logger::error("SceneGraph")
+              << "Cannot parent to a descendant" << logger::end();
+          return;
+        }
+      }
+    }
+    if (parents_[i] == parent_index) return;
+    parents_[i] = parent_index;
+    flags_[i] |= WORLD_DIRTY;
+    b_order_dirty_ = true;
+  }
+
+  Id getParent(Id id) const {
+    const int p = parents_[indices_[id]];
+    return p < 0 ? NULL_ID : ids_[p];
+  }
+
+  void setPosition(Id id, const glm::vec3& p) {
+    const uint32_t i = indices_[id];
+    positions_[i] = p;
+    flags_[i] |= LOCAL_DIRTY;
+  }
+  void setOrientation(Id id, const glm::quat& q) {
+    const uint32_t i = indices_[id];
+    orientations_[i] = q;
+    flags_[i] |= LOCAL_DIRTY;
+  }
+  void setScale(Id id, const glm::vec3& s) {
+    const uint32_t i = indices_[id];
+    scales_[i] = s;
+    flags_[i] |= LOCAL_DIRTY;
+  }
+  void setTransform(Id id, const glm::vec3& p, const glm::quat& q,
+                    const glm::vec3& s) {
+    const uint32_t i = indices_[id];
+    positions_[i] = p;
+    orientations_[i] = q;
+    scales_[i] = s;
+    flags_[i] |= LOCAL_DIRTY;
+  }
+
+  const glm::vec3& getPosition(Id id) const {
+    return positions_[indices_[id]];
+  }
+  const glm::quat& getOrientation(Id id) const {
+    return orientations_[indices_[id]];
+  }
+  const glm::vec3& getScale(Id id) const { return scales_[indices_[id]]; }
+
+  // 行列は update() の後に読む
+  const glm::mat4& getLocalMatrix(Id id) const {
+    return locals_[indices_[id]];
+  }
+  const glm::mat4& getWorldMatrix(Id id) const {
+    return worlds_[indices_[id]];
+  }
+
+  // 深さ順に並んだ配列。まとめて GPU に送る時に使う
+  // 並びは親子関係を変えた後の update() で変わる
+  const std::vector<glm::mat4>& getWorldMatrices() const { return worlds_; }
+  const std::vector<Id>& getIds() const { return ids_; }
+  uint32_t getIndex(Id id) const { return indices_[id]; }
+
+  // 変更された変換とその子孫のワールド行列を計算する
+  void update(ThreadPool* pool = nullptr) {
+    if (b_order_dirty_) rebuildOrder();
+    if (!pool) {
+      num_updated_ = updateRange(0, ids_.size());
+      return;
+    }
+
+    if (b_levels_dirty_) rebuildLevels();
+    num_updated_ = 0;
+    for (size_t l = 0; l + 1 < level_offsets_.size(); l++) {
+      const size_t begin = level_offsets_[l];
+      const size_t end = level_offsets_[l + 1];
+      if (end - begin < CHUNK_SIZE * 2) {
+        num_updated_ += updateRange(begin, end);
+        continue;
+      }
+      std::atomic<size_t> num_updated(0);
+      const size_t num_chunks = (end - begin + CHUNK_SIZE - 1) / CHUNK_SIZE;
+      pool->parallelFor(num_chunks, [&](size_t c) {
+        const size_t first = begin + c * CHUNK_SIZE;
+        num_updated += updateRange(first, std::min(first + CHUNK_SIZE, end));
+      });
+      num_updated_ += num_updated;
+    }
+  }
+
+  void clear() { *this = SceneGraph(); }
+
+  size_t size() const { return ids_.size(); }
+  size_t getNumLevels() const {
+    return level_offsets_.empty() ? 0 : level_offsets_.size() - 1;
+  }
+
+  // 最後の update() でワールド行列を計算し直した数
+  size_t getNumUpdated() const { return num_updated_; }
+
+ private:
+  static constexpr size_t CHUNK_SIZE = 1024;
+  static constexpr int REMOVED_DEPTH = -2;
+  enum Flag : uint8_t {
+    LOCAL_DIRTY = 1,
+    WORLD_DIRTY = 1 << 1,
+    CHANGED = 1 << 2,  // 今回の update() でワールド行列が変わった
+    REMOVED = 1 << 3,
+  };
+
+  static glm::mat4 compose(const glm::vec3& p, const glm::quat& q,
+                           const glm::vec3& s) {
+    glm::mat4 m = glm::toMat4(q);
+    m[0] *= s.x;
+    m[1] *= s.y;
+    m[2] *= s.z;
+    m[3] = glm::vec4(p, 1);
+    return m;
+  }
+
+  // 親は先に処理されているので、親の CHANGED は今回の結果になっている
+  size_t updateRange(size_t begin, size_t end) {
+    size_t count = 0;
+    for (size_t i = begin; i < end; i++) {
+      uint8_t flag = flags_[i];
+      const int p = parents_[i];
+      if (p >= 0 && (flags_[p] & CHANGED)) flag |= WORLD_DIRTY;
+      if (flag & LOCAL_DIRTY) {
+        locals_[i] = compose(positions_[i], orientations_[i], scales_[i]);
+        flag |= WORLD_DIRTY;
+      }
+      if (flag & WORLD_DIRTY) {
+        worlds_[i] = p < 0 ? locals_[i] : worlds_[p] * locals_[i];
+        flags_[i] = CHANGED;
+        count++;
+      } else {
+        flags_[i] = 0;
+      }
+    }
+    return count;
+  }
+
+  Id allocateId() {
+    if (free_ids_.empty()) {
+      indices_.push_back(NULL_ID);
+      return indices_.size() - 1;
+    }
+    const Id id = free_ids_.back();
+    free_ids_.pop_back();
+    return id;
+  }
+
+  // 消した変換とその子孫を除き、深さ順に並べ直す
+  void rebuildOrder() {
+    const size_t n = ids_.size();
+    std::vector<int> depths(n, -1);
+    std::vector<uint32_t> chain;
+    int max_depth = -1;
+    for (uint32_t i = 0; i < n; i++) {
+      // 深さの分かっている祖先までたどる
+      uint32_t j = i;
+      chain.clear();
+      while (depths[j] == -1) {
+        chain.push_back(j);
+        if ((flags_[j] & REMOVED) || parents_[j] < 0) break;
+        j = parents_[j];
+      }
+      int d;
+      if (depths[j] != -1) {
+        d = depths[j];
+      } else {
+        d = (flags_[j] & REMOVED) ? REMOVED_DEPTH : 0;
+        depths[j] = d;
+        chain.pop_back();
+      }
+      for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        const bool b_removed = d == REMOVED_DEPTH || (flags_[*it] & REMOVED);
+        d = b_removed ? REMOVED_DEPTH : d + 1;
+        depths[*it] = d;
+      }
+      max_depth = std::max(max_depth, depths[i]);
+    }
+
+    // 深さごとの数を数えて元の順を保ったまま並べる
+    level_offsets_.assign(max_depth + 2, 0);
+    for (uint32_t i = 0; i < n; i++) {
+      if (depths[i] >= 0) {
+        level_offsets_[depths[i] + 1]++;
+      } else if (indices_[ids_[i]] == i) {
+        // 消した変換の子孫。消した変換自身の Id は destroy() で解放済み
+        indices_[ids_[i]] = NULL_ID;
+        free_ids_.push_back(ids_[i]);
+      }
+    }
+    for (size_t l = 1; l < level_offsets_.size(); l++) {
+      level_offsets_[l] += level_offsets_[l - 1];
+    }
+    std::vector<uint32_t> order(level_offsets_.back());
+    std::vector<int> new_indices(n, -1);
+    {
+      std::vector<uint32_t> heads(level_offsets_.begin(),
+                                  level_offsets_.end() - 1);
+      for (uint32_t i = 0; i < n; i++) {
+        if (depths[i] < 0) continue;
+        const uint32_t k = heads[depths[i]]++;
+        order[k] = i;
+        new_indices[i] = k;
+      }
+    }
+
+    auto permute = [&order](auto& v) {
+      std::remove_reference_t<decltype(v)> dst(order.size());
+      for (size_t k = 0; k < order.size(); k++) dst[k] = v[order[k]];
+      v.swap(dst);
+    };
+    permute(ids_);
+    permute(positions_);
+    permute(orientations_);
+    permute(scales_);
+    permute(locals_);
+    permute(worlds_);
+    permute(flags_);
+    permute(parents_);
+    depths_.resize(order.size());
+    for (size_t k = 0; k < order.size(); k++) {
+      const int p = parents_[k];
+      parents_[k] = p < 0 ? -1 : new_indices[p];
+      depths_[k] = depths[order[k]];
+      indices_[ids_[k]] = k;
+    }
+
+    b_order_dirty_ = false;
+    b_levels_dirty_ = false;
+  }
+
+  // 深さ順に並んでいる前提で深さごとの範囲を求める
+  void rebuildLevels() {
+    level_offsets_.clear();
+    for (uint32_t i = 0; i < depths_.size(); i++) {
+      while (static_cast<int>(level_offsets_.size()) <= depths_[i]) {
+        level_offsets_.push_back(i);
+      }
+    }
+    level_offsets_.push_back(depths_.size());
+    b_levels_dirty_ = false;
+  }
+
+  // 以下は深さ順に並んだ SoA
+  std::vector<Id> ids_;
+  std::vector<glm::vec3> positions_;
+  std::vector<glm::quat> orientations_;
+  std::vector<glm::vec3> scales_;
+  std::vector<glm::mat4> locals_;
+  std::vector<glm::mat4> worlds_;
+  std::vector<int> parents_;  // 親の位置。根は -1
+  std::vector<int> depths_;
+  std::vector<uint8_t> flags_;
+
+  std::vector<uint32_t> indices_;  // Id から配列の位置
+  std::vector<Id> free_ids_;
+  std::vector<size_t> level_offsets_;
+  bool b_order_dirty_;
+  bool b_levels_dirty_;
+  size_t num_updated_;
+};
+
+}  // namespace limas
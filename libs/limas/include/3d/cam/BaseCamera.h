@@ -27,8 +27,9 @@ class BaseCamera : public Node {
     return sp;
   }
 
+  // 親ノードに付けたカメラでもワールドでの姿勢から求める
   glm::mat4 getModelViewMatrix() const {
-    return glm::inverse(getTransformMatrix());
+    return glm::inverse(getGlobalTransformMatrix());
   }
 
   glm::mat4 getModelViewProjectionMatrix(float x, float y, float w,
@@ -17,6 +17,7 @@ std::shared_ptr<Window>& getMainWindow() { return getPtr()->getMainWindow(); }
 
 std::shared_ptr<gl::Renderer>& getRenderer() { return getPtr()->getRenderer(); }
 gl::Context* getContext() { return getPtr()->getContext(); }
+gl::GpuProfiler* getGpuProfiler() { return getPtr()->getGpuProfiler(); }
 
 int getFrameNumber() { return getPtr()->getFrameNumber(); }
 double getElapsedSeconds() { return getPtr()->getElapsedSeconds(); }
@@ -5,6 +5,7 @@ namespace limas {
 namespace gl {
 class Renderer;
 class Context;
+class GpuProfiler;
 }  // namespace gl
 
 class BaseApp;
@@ -20,6 +21,7 @@ std::shared_ptr<gl::Renderer>& getRenderer();
 std::shared_ptr<Window>& getMainWindow();
 
 gl::Context* getContext();
+gl::GpuProfiler* getGpuProfiler();
 
 int getFrameNumber();
 double getElapsedTimeInSeconds();
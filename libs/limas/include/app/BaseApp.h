@@ -4,6 +4,7 @@
 #include "math/Math.h"
 #include "system/Logger.h"
 #include "utils/FileSystem.h"
+#include "utils/FrameClock.h"
 #include "utils/Stats.h"
 
 namespace limas {
@@ -64,7 +65,7 @@ class BaseApp {
       return;
     }
 
-    glfwSwapInterval(1);
+    glfwSwapInterval(b_offline_ ? 0 : b_vsync_);
     glfwSetTime(0);
 
     for_each(begin(windows_), end(windows_), [&](Window::Ptr& w) {
@@ -79,6 +80,7 @@ class BaseApp {
     elapsed_seconds_ = 0;
     frame_number = 0;
     base_time_ = glfwGetTime();
+    if (b_offline_) beginOfflineSegment();
 
     double last_frame_time = 0;
     while (std::all_of(begin(windows_), end(windows_), [](Window::Ptr& w) {
@@ -87,25 +89,38 @@ class BaseApp {
       double now = glfwGetTime();
       // glfwPollEvents();
 
-      if ((now - last_frame_time) >= (1.0 / target_fps_)) {
+      if (b_offline_ || (now - last_frame_time) >= (1.0 / target_fps_)) {
         glfwPollEvents();
 
         stats_.begin();
         for_each(begin(windows_), end(windows_), [&](Window::Ptr& w) {
           current_window_ = w;
           w->bind();
+          // クエリはコンテキスト間で共有できないのでメインウィンドウだけ測る
+          const bool b_profile = b_gpu_profiling_ && w == main_window_;
+          if (b_profile) gpu_profiler_.beginFrame();
+          renderer_->setFrameUniforms(
+              {w->getSize() * w->getPixelScale(), (float)elapsed_seconds_,
+               (GLint)frame_number});
           w->draw();
+          renderer_->flush();
+          if (b_profile) gpu_profiler_.endFrame();
           w->unbind();
         });
+        renderer_->endFrame();
+        if (b_gpu_profiling_)
+          stats_.setGpuTimeInMs(gpu_profiler_.getFrameTimeInMs());
         stats_.end();
 
         frame_number++;
-        current_fps_ = 1.0 / (now - last_frame_time);
+        if (now > last_frame_time) current_fps_ = 1.0 / (now - last_frame_time);
         last_frame_time = now;
+
+        if (b_offline_) advanceOfflineClock();
       }
 
       current_window_ = main_window_;
-      elapsed_seconds_ = now - base_time_;
+      if (!b_offline_) elapsed_seconds_ = now - base_time_;
     }
 
     glfwTerminate();
@@ -116,8 +131,27 @@ class BaseApp {
   Window::Ptr& getMainWindow() { return main_window_; }
   Window::Ptr& getCurrentWindow() { return current_window_; }
 
-  void setVerticalSync(bool vsync) { glfwSwapInterval(vsync); }
-  void setFPS(float fps) { this->target_fps_ = fps; }
+  void setVerticalSync(bool vsync) {
+    b_vsync_ = vsync;
+    if (!b_offline_) glfwSwapInterval(vsync);
+  }
+  void setFPS(float fps) {
+    this->target_fps_ = fps;
+    if (b_offline_) beginOfflineSegment();
+  }
+
+  // vsync もフレームレートの待ちもなしに、1/fps 刻みの仮想時間で描画する
+  void setOfflineRendering(bool b_offline) {
+    if (b_offline == b_offline_) return;
+    b_offline_ = b_offline;
+    FrameClock::setVirtual(b_offline);
+    glfwSwapInterval(b_offline ? 0 : b_vsync_);
+    if (b_offline)
+      beginOfflineSegment();
+    else
+      base_time_ = glfwGetTime() - elapsed_seconds_;
+  }
+  bool isOfflineRendering() const { return b_offline_; }
   double getFPS() const { return current_fps_; }
 
   double getWallTime() const { return stats_.getWallTimeInMs(); }
@@ -126,8 +160,21 @@ class BaseApp {
   double getCpuTime() const { return stats_.getCpuTimeInMs(); }
   double getMemoryUsage() const { return stats_.getMemoryUsageInMb(); }
   double getCpuUsage() const { return stats_.getCpuUsageInPerc(); }
+  double getGpuTime() const { return stats_.getGpuTimeInMs(); }
+
+  // 有効にすると毎フレーム GPU の時間を測り、getGpuTime() で返す
+  // 無効の間はクエリを発行しない
+  void setGpuProfiling(bool b_gpu_profiling) {
+    b_gpu_profiling_ = b_gpu_profiling;
+    if (!b_gpu_profiling) stats_.setGpuTimeInMs(0);
+  }
+  bool isGpuProfiling() const { return b_gpu_profiling_; }
 
-  void resetElapsedTime() { base_time_ = glfwGetTime(); }
+  void resetElapsedTime() {
+    base_time_ = glfwGetTime();
+    offline_base_seconds_ = -(offline_frames_ / target_fps_);
+    elapsed_seconds_ = 0;
+  }
   double getElapsedSeconds() const { return elapsed_seconds_; }
   uint32_t getFrameNumber() const { return frame_number; }
 
@@ -170,6 +217,7 @@ class BaseApp {
 
   gl::Renderer::Ptr& getRenderer() { return renderer_; }
   gl::Context* getContext() { return &context_; }
+  gl::GpuProfiler* getGpuProfiler() { return &gpu_profiler_; }
 
  private:
   gl::Renderer::Ptr renderer_;
@@ -178,12 +226,35 @@ class BaseApp {
   Window::Ptr main_window_;
   Window::Ptr current_window_;
   Stats stats_;
+  gl::GpuProfiler gpu_profiler_;
 
   double target_fps_ = 60;
   float current_fps_ = 60;
   double elapsed_seconds_ = 0;
   double base_time_ = 0.0;
   uint32_t frame_number = 0;
+  bool b_vsync_ = true;
+  bool b_gpu_profiling_ = false;
+
+  bool b_offline_ = false;
+  uint64_t offline_frames_ = 0;
+  double offline_base_seconds_ = 0;
+  FrameClock::time_point offline_origin_;
+
+  void beginOfflineSegment() {
+    offline_frames_ = 0;
+    offline_base_seconds_ = elapsed_seconds_;
+    offline_origin_ = FrameClock::now();
+  }
+
+  // 誤差が積もらないように毎フレーム起点から計算し直す
+  void advanceOfflineClock() {
+    offline_frames_++;
+    double seconds = offline_frames_ / target_fps_;
+    elapsed_seconds_ = offline_base_seconds_ + seconds;
+    FrameClock::setTime(offline_origin_ +
+                        std::chrono::nanoseconds(std::llround(seconds * 1e9)));
+  }
 
   static void errorCallback(int code, const char* description) {
     logger::error("BaseApp") << code << ": " << description << logger::end();
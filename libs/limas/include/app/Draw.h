@@ -5,6 +5,7 @@
 #include "gl/GLUtils.h"
 #include "gl/Renderer.h"
 #include "graphics/Font.h"
+#include "graphics/GlyphAtlas.h"
 
 namespace limas {
 
@@ -31,6 +32,11 @@ inline void setShader(gl::Shader* shader) {
   app::getRenderer()->setShader(shader);
 }
 
+inline void setBatching(bool b_batching) {
+  app::getRenderer()->setBatching(b_batching);
+}
+inline void flush() { app::getRenderer()->flush(); }
+
 #pragma mark DEFAULT UNIFORMS
 inline void setColor(const Color& c) { app::getRenderer()->setColor(c); }
 inline void setColor(float r, float g, float b, float a) {
@@ -94,6 +100,7 @@ inline glm::mat4 getCurrentMatrix() {
 
 inline MatrixStack& setOrthoView(float left, float right, float bottom,
                                  float top, float near, float far) {
+  app::getRenderer()->flush();
   app::getContext()->setViewport(0, 0, abs(left - right), abs(bottom - top));
   auto proj_mat = glm::ortho(left, right, bottom, top, near, far);
   return app::getRenderer()->multMatrix(proj_mat);
@@ -101,6 +108,7 @@ inline MatrixStack& setOrthoView(float left, float right, float bottom,
 
 inline MatrixStack& setOrthoView(float width, float height,
                                  float near = -INT_MAX, float far = INT_MAX) {
+  app::getRenderer()->flush();
   app::getContext()->setViewport(0, 0, width, height);
   auto proj_mat = glm::ortho(0.0f, width, height, 0.0f, near, far);
   return app::getRenderer()->multMatrix(proj_mat);
@@ -139,6 +147,18 @@ inline void drawMeshInstanced(const BaseInstancedVboMesh<V, N, C, T>& mesh,
   app::getRenderer()->drawMeshInstanced(mesh, mode, count);
 }
 
+template <class V, class N, class C, class T>
+inline void drawMeshInstanced(
+    const BasePackedInstancedVboMesh<V, N, C, T>& mesh, GLenum mode) {
+  app::getRenderer()->drawMeshInstanced(mesh, mode);
+}
+
+template <class V, class N, class C, class T>
+inline void drawMeshBatch(BaseMeshBatch<V, N, C, T>& batch,
+                          GLenum mode = GL_TRIANGLES) {
+  app::getRenderer()->drawMeshBatch(batch, mode);
+}
+
 template <class V>
 inline void drawPolyline(const BaseVboPolyline<V>& poly, GLenum mode) {
   app::getRenderer()->drawPolyline(poly, mode);
@@ -332,10 +352,14 @@ inline void drawTexture(const TextureBase& tex, float x, float y, float w = 0,
 
 inline void drawFontString(const Font& font, const std::string& text, float x,
                            float y) {
-  bindTexture(font.getTexture());
-  gl::VboMesh mesh = font.getMesh(text, x, y);
-  drawMesh(mesh, GL_TRIANGLES);
-  unbindTexture();
+  app::getRenderer()->drawString(font, text, glm::vec3(x, y, 0));
+}
+
+// size は文字の大きさ (px)
+inline void drawFontString(GlyphAtlas& atlas, const std::string& text, float x,
+                           float y, float size) {
+  app::getRenderer()->drawString(atlas, text, glm::vec3(x, y, 0),
+                                 atlas.getScale(size));
 }
 
 inline void drawBitmapString(const std::string& text, float x, float y) {
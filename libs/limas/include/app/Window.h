@@ -1,5 +1,6 @@
 #pragma once
 #include "gl/GLUtils.h"
+#include "gl/Pbo.h"
 #include "system/Logger.h"
 #include "system/Observable.h"
 
@@ -153,11 +154,25 @@ class Window {
     return nullptr;
   }
 
-  void readToPixels(std::vector<unsigned char>* pixels, int x, int y, int width,
-                    int height) const {
-    pixels->resize(width * height * 4);
-    glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE,
-                 pixels->data());
+  // RGBA で読み出す。b_async なら PBO に積み、前に積んだ読み出しのうち
+  // 終わっているものを返すので GPU を待たない。まだ何もなければ false
+  bool readToPixels(std::vector<unsigned char>* pixels, int x, int y, int width,
+                    int height, bool b_async = false) const {
+    const size_t size = width * height * 4;
+    pixels->resize(size);
+    if (readback_.getSize() != size) readback_.allocate(size);
+    if (!b_async) readback_.clear();
+    if (!readback_.readPixels(0, 0, x, y, width, height, GL_RGBA,
+                              GL_UNSIGNED_BYTE)) {
+      return false;
+    }
+
+    auto copy = [pixels](const gl::PboReader::View& view) {
+      std::memcpy(pixels->data(), view.data,
+                  std::min(view.size, pixels->size()));
+    };
+    if (!b_async || readback_.isFull()) return readback_.read(copy);
+    return readback_.tryRead(copy);
   }
 
   void setClipboard(const std::string& text) const {
@@ -202,8 +217,12 @@ class Window {
   void focus() const { glfwFocusWindow(window_); }
 
   void bind() {
-    glfwMakeContextCurrent(window_);
-    glViewport(0, 0, getWidth(), getHeight());
+    // コンテキストが変わったら覚えている GL の状態は使えない
+    if (glfwGetCurrentContext() != window_) {
+      glfwMakeContextCurrent(window_);
+      gl::StateCache::invalidate();
+    }
+    gl::setViewport(0, 0, getWidth(), getHeight());
     EventArgs e;
     observables_.loop_begin.notify(e);
   }
@@ -328,6 +347,8 @@ class Window {
   std::function<void(void)> draw_call_;
   const bool b_doublebuffering_;
   CoreObservable observables_;
+  // readToPixels() で使う。使うまで確保しない
+  mutable gl::PboReader readback_;
 
   struct State {
     glm::vec2 pos;
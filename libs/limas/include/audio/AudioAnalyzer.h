@@ -0,0 +1,295 @@
+#pragma once
+#include <deque>
+
+#include "audio/FFT.h"
+#include "system/RingBuffer.h"
+#include "system/Thread.h"
+#include "system/TripleBuffer.h"
+
+namespace limas {
+
+// リングバッファから読んだ音声をワーカースレッドで解析する
+// 結果は TripleBuffer でロックせずに描画スレッドに渡す
+class AudioAnalyzer : public Thread {
+ public:
+  struct Settings {
+    size_t fft_size = 1024;
+    size_t hop_size = 512;
+    // min_frequency (Hz) からナイキストまでを対数で分割する
+    size_t num_bands = 8;
+    float min_frequency = 40.0f;
+    // スペクトルフラックスが直近 onset_history ホップの平均の
+    // onset_threshold 倍を超えたらオンセットとみなす
+    float onset_threshold = 1.5f;
+    size_t onset_history = 16;
+    float onset_min_interval = 0.1f;  // 秒
+  };
+
+  struct Features {
+    std::vector<float> spectrum;  // 振幅 (fft_size / 2 + 1)
+    std::vector<float> bands;     // 帯域ごとのエネルギー
+    float rms = 0;
+    float peak = 0;
+    float flux = 0;
+    uint64_t num_onsets = 0;  // 検出したオンセットの累計
+    double time = 0;          // 解析したサンプルの先頭からの秒数
+  };
+
+  AudioAnalyzer()
+      : source_(nullptr),
+        sample_rate_(0),
+        num_channels_(1),
+        spectrum_scale_(1),
+        consumed_frames_(0),
+        last_onset_time_(0),
+        last_num_onsets_(0),
+        b_onset_(false) {}
+  virtual ~AudioAnalyzer() { stop(); }
+
+  void setup(RingBuffer<float> *source, int sample_rate,
+             int num_channels = 1) {
+    setup(source, sample_rate, num_channels, Settings());
+  }
+
+  void setup(RingBuffer<float> *source, int sample_rate, int num_channels,
+             const Settings &settings) {
+    stop();
+
+    source_ = source;
+    sample_rate_ = sample_rate;
+    num_channels_ = std::max(num_channels, 1);
+    settings_ = settings;
+    settings_.hop_size =
+        std::clamp<size_t>(settings_.hop_size, 1, settings_.fft_size);
+
+    fft_.setup(settings_.fft_size);
+    settings_.fft_size = fft_.getSize();
+    FFT::makeHannWindow(window_, settings_.fft_size);
+    float window_sum = 0;
+    for (auto w : window_) window_sum += w;
+    spectrum_scale_ = 2.0f / window_sum;
+
+    setupBands();
+
+    samples_.assign(settings_.fft_size, 0);
+    windowed_.assign(settings_.fft_size, 0);
+    interleaved_.resize(settings_.hop_size * num_channels_);
+    prev_spectrum_.assign(fft_.getNumBins(), 0);
+    flux_history_.clear();
+
+    Features features;
+    features.spectrum.assign(fft_.getNumBins(), 0);
+    features.bands.assign(band_edges_.size() - 1, 0);
+    results_.fill(features);
+    features_ = features;
+
+    pending_ = 0;
+    consumed_frames_ = 0;
+    onsets_ = 0;
+    last_onset_time_ = -settings_.onset_min_interval;
+    last_num_onsets_ = 0;
+    b_onset_ = false;
+  }
+
+  void start() {
+    if (!source_) {
+      logger::error("AudioAnalyzer") << "Source is not set" << logger::end();
+      return;
+    }
+    startThread([this]() { this->threadedFunction(); });
+  }
+
+  void stop() { stopThread(); }
+
+  // ワーカースレッドを使わずに解析する (オフライン処理など)
+  // 解析したホップ数を返す
+  size_t process(const float *interleaved, size_t num_frames) {
+    size_t hops = 0;
+    while (num_frames > 0) {
+      size_t frames = std::min(num_frames, settings_.hop_size - pending_);
+      push(interleaved, frames);
+      interleaved += frames * num_channels_;
+      num_frames -= frames;
+      if (pending_ == settings_.hop_size) {
+        analyze();
+        hops++;
+      }
+    }
+    return hops;
+  }
+
+  // 描画スレッドから毎フレーム呼ぶ。新しい結果があれば true
+  bool update() {
+    if (!results_.update()) {
+      b_onset_ = false;
+      return false;
+    }
+    features_ = results_.getReadBuffer();
+    b_onset_ = features_.num_onsets != last_num_onsets_;
+    last_num_onsets_ = features_.num_onsets;
+    return true;
+  }
+
+  const Features &getFeatures() const { return features_; }
+  const std::vector<float> &getSpectrum() const { return features_.spectrum; }
+  const std::vector<float> &getBands() const { return features_.bands; }
+  float getBand(size_t index) const { return features_.bands.at(index); }
+  float getRms() const { return features_.rms; }
+  float getPeak() const { return features_.peak; }
+  // 前回の update() 以降にオンセットがあったか
+  bool isOnset() const { return b_onset_; }
+
+  size_t getNumBands() const { return features_.bands.size(); }
+  // index 番目の帯域の下端の周波数 (Hz)
+  float getBandFrequency(size_t index) const {
+    return band_edges_.at(index) * (float)sample_rate_ / settings_.fft_size;
+  }
+  const Settings &getSettings() const { return settings_; }
+
+ private:
+  void setupBands() {
+    const size_t num_bins = fft_.getNumBins();
+    const float bin_hz = (float)sample_rate_ / settings_.fft_size;
+    const float nyquist = sample_rate_ * 0.5f;
+    const float min_hz = std::clamp(settings_.min_frequency, bin_hz, nyquist);
+    const size_t num_bands = std::max<size_t>(settings_.num_bands, 1);
+
+    band_edges_.clear();
+    for (size_t i = 0; i <= num_bands; i++) {
+      float hz = min_hz * std::pow(nyquist / min_hz, (float)i / num_bands);
+      size_t bin = std::min<size_t>(std::lround(hz / bin_hz), num_bins);
+      // 低域で帯域が潰れないように最低 1 ビンは確保する
+      if (!band_edges_.empty()) bin = std::max(bin, band_edges_.back() + 1);
+      band_edges_.push_back(std::min(bin, num_bins));
+    }
+  }
+
+  void push(const float *interleaved, size_t frames) {
+    float *dst = samples_.data() + settings_.fft_size - settings_.hop_size;
+    for (size_t i = 0; i < frames; i++) {
+      float sum = 0;
+      for (int c = 0; c < num_channels_; c++)
+        sum += interleaved[i * num_channels_ + c];
+      dst[pending_ + i] = sum / num_channels_;
+    }
+    pending_ += frames;
+  }
+
+  void analyze() {
+    const size_t fft_size = settings_.fft_size;
+    const size_t hop = settings_.hop_size;
+    auto &features = results_.getWriteBuffer();
+
+    // 新しいホップだけで RMS とピークを求める
+    const float *hop_samples = samples_.data() + fft_size - hop;
+    float sum = 0, peak = 0;
+    for (size_t i = 0; i < hop; i++) {
+      sum += hop_samples[i] * hop_samples[i];
+      peak = std::max(peak, std::abs(hop_samples[i]));
+    }
+    features.rms = std::sqrt(sum / hop);
+    features.peak = peak;
+
+    for (size_t i = 0; i < fft_size; i++)
+      windowed_[i] = samples_[i] * window_[i];
+    fft_.getMagnitudes(windowed_.data(), features.spectrum.data());
+
+    const size_t num_bins = features.spectrum.size();
+    float flux = 0, total = 0;
+    for (size_t k = 0; k < num_bins; k++) {
+      float mag = features.spectrum[k] * spectrum_scale_;
+      features.spectrum[k] = mag;
+      total += mag;
+      flux += std::max(0.0f, mag - prev_spectrum_[k]);
+      prev_spectrum_[k] = mag;
+    }
+    features.flux = flux;
+
+    for (size_t b = 0; b + 1 < band_edges_.size(); b++) {
+      float energy = 0;
+      for (size_t k = band_edges_[b]; k < band_edges_[b + 1]; k++)
+        energy += features.spectrum[k] * features.spectrum[k];
+      features.bands[b] = energy;
+    }
+
+    consumed_frames_ += hop;
+    features.time = (double)consumed_frames_ / sample_rate_;
+
+    // 直近の平均を大きく超えたらオンセットとみなす
+    // 定常音の揺らぎを拾わないように、スペクトル全体に対する変化量も見る
+    float mean = 0;
+    for (auto f : flux_history_) mean += f;
+    if (!flux_history_.empty()) mean /= flux_history_.size();
+    if (flux_history_.size() == settings_.onset_history &&
+        flux > mean * settings_.onset_threshold &&
+        flux > total * ONSET_MIN_RATIO &&
+        features.time - last_onset_time_ >= settings_.onset_min_interval) {
+      onsets_++;
+      last_onset_time_ = features.time;
+    }
+    features.num_onsets = onsets_;
+    flux_history_.push_back(flux);
+    if (flux_history_.size() > settings_.onset_history)
+      flux_history_.pop_front();
+
+    results_.publish();
+
+    // 次のホップのためにずらす
+    std::copy(samples_.begin() + hop, samples_.end(), samples_.begin());
+    pending_ = 0;
+  }
+
+  void threadedFunction() {
+    const size_t hop_samples = settings_.hop_size * num_channels_;
+    while (isThreadRunning()) {
+      if (source_->getReadAvailable() < hop_samples) {
+        sleepFor(1);
+        continue;
+      }
+
+      // 遅れている時は古いサンプルを読み飛ばして最新に追いつく
+      size_t available = source_->getReadAvailable();
+      size_t backlog = available / hop_samples;
+      if (backlog > MAX_BACKLOG_HOPS) {
+        size_t skip = (backlog - MAX_BACKLOG_HOPS) * hop_samples;
+        source_->skip(skip);
+        consumed_frames_ += skip / num_channels_;
+      }
+
+      source_->read(interleaved_.data(), hop_samples);
+      process(interleaved_.data(), settings_.hop_size);
+    }
+  }
+
+  static constexpr size_t MAX_BACKLOG_HOPS = 4;
+  static constexpr float ONSET_MIN_RATIO = 0.05f;
+
+  RingBuffer<float> *source_;
+  int sample_rate_;
+  int num_channels_;
+  Settings settings_;
+
+  // 以下はワーカースレッドのみ
+  FFT fft_;
+  std::vector<float> window_;
+  float spectrum_scale_;
+  std::vector<size_t> band_edges_;
+  std::vector<float> samples_;
+  std::vector<float> windowed_;
+  std::vector<float> interleaved_;
+  std::vector<float> prev_spectrum_;
+  std::deque<float> flux_history_;
+  size_t pending_ = 0;
+  uint64_t consumed_frames_;
+  uint64_t onsets_ = 0;
+  double last_onset_time_;
+
+  TripleBuffer<Features> results_;
+
+  // 以下は描画スレッドのみ
+  Features features_;
+  uint64_t last_num_onsets_;
+  bool b_onset_;
+};
+
+}  // namespace limas
@@ -0,0 +1,427 @@
+#pragma once
+
+extern "C" {
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+#include "libavutil/channel_layout.h"
+#include "libavutil/opt.h"
+#include "libswresample/swresample.h"
+}
+
+#include "system/Logger.h"
+#include "system/RingBuffer.h"
+#include "system/Thread.h"
+#include "utils/FrameClock.h"
+#include "video/PlaybackClock.h"
+
+namespace limas {
+
+// 音声ファイル (動画の音声トラックも可) を float にデコードして
+// リングバッファに流す
+// 時計の時刻に合わせて書き込むので、VideoPlayer と時計を共有すると映像と揃う
+// 例: audio.setClock(video.getClock());
+class AudioDecoder : public Thread {
+  struct Context {
+    AVFormatContext *format_context = nullptr;
+    AVCodecContext *codec_context = nullptr;
+    SwrContext *swr_context = nullptr;
+
+    int stream_index = -1;
+    double time_base = 0.0;
+    double duration = 0.0;
+    int sample_rate = 0;
+    int num_channels = 0;
+  } context_;
+
+  struct AudioState {
+    bool b_loaded = false;
+    bool b_playing = false;
+    bool b_loop = true;
+    bool b_eof = false;
+    bool b_request_seek = false;
+    double seek_time = 0.0;
+  } state_;
+
+  RingBuffer<float> ring_;
+
+  // デコード済みでまだリングに書いていないサンプル (デコードスレッドのみ)
+  std::vector<float> pending_;
+  size_t pending_offset_;
+  double pending_time_;
+  double seek_target_;
+
+  PlaybackClock::Ptr clock_;
+  bool b_own_clock_;
+  std::atomic<double> release_time_;
+  double last_time_;
+  std::atomic<uint64_t> overruns_;
+
+  static constexpr double MAX_CLOCK_JUMP = 1.0;
+  static constexpr double SEEK_TOLERANCE = 0.01;
+  // 時計を確認する間隔 (ミリ秒)
+  static constexpr int POLL_INTERVAL_MS = 2;
+
+ public:
+  AudioDecoder()
+      : pending_offset_(0),
+        pending_time_(0),
+        seek_target_(0),
+        clock_(SystemClock::create()),
+        b_own_clock_(true),
+        release_time_(0),
+        last_time_(0),
+        overruns_(0) {}
+  virtual ~AudioDecoder() { close(); }
+
+  void close() {
+    stopThread();
+
+    if (context_.swr_context) swr_free(&context_.swr_context);
+    if (context_.codec_context) avcodec_free_context(&context_.codec_context);
+    if (context_.format_context)
+      avformat_close_input(&context_.format_context);
+    context_ = Context();
+
+    state_ = AudioState();
+    ring_.clear();
+    pending_.clear();
+    pending_offset_ = 0;
+    pending_time_ = 0;
+    seek_target_ = 0;
+    if (b_own_clock_) {
+      clock_->stop();
+      clock_->seek(0);
+    }
+    release_time_ = 0;
+    last_time_ = 0;
+    overruns_ = 0;
+  }
+
+  // sample_rate: 0 なら元のまま
+  // num_channels: 出力のチャンネル数 (1 ならモノラルにミックス)
+  // buffer_seconds: リングバッファの長さ
+  bool load(const std::string &filepath, int sample_rate = 0,
+            int num_channels = 1, double buffer_seconds = 1.0) {
+    close();
+
+    do {
+      if (avformat_open_input(&context_.format_context, filepath.c_str(),
+                              nullptr, nullptr) != 0) {
+        logger::error("AudioDecoder")
+            << "Couldn't open " << filepath << logger::end();
+        break;
+      }
+
+      if (avformat_find_stream_info(context_.format_context, nullptr) < 0) {
+        logger::error("AudioDecoder")
+            << "Couldn't retrieve stream info" << logger::end();
+        break;
+      }
+
+      const AVCodec *codec = nullptr;
+      int index = av_find_best_stream(context_.format_context,
+                                      AVMEDIA_TYPE_AUDIO, -1, -1, &codec, 0);
+      if (index < 0 || !codec) {
+        logger::error("AudioDecoder")
+            << "Couldn't find audio stream" << logger::end();
+        break;
+      }
+
+      AVStream *stream = context_.format_context->streams[index];
+      context_.stream_index = index;
+      context_.time_base = av_q2d(stream->time_base);
+      context_.duration =
+          context_.format_context->duration / (double)AV_TIME_BASE;
+
+      if (!(context_.codec_context = avcodec_alloc_context3(codec))) {
+        logger::error("AudioDecoder")
+            << "Couldn't create AVCodecContext" << logger::end();
+        break;
+      }
+
+      if (avcodec_parameters_to_context(context_.codec_context,
+                                        stream->codecpar) < 0) {
+        logger::error("AudioDecoder")
+            << "Couldn't initialize AVCodecContext" << logger::end();
+        break;
+      }
+
+      if (avcodec_open2(context_.codec_context, codec, nullptr) < 0) {
+        logger::error("AudioDecoder") << "Couldn't open codec" << logger::end();
+        break;
+      }
+
+      context_.sample_rate =
+          sample_rate > 0 ? sample_rate : context_.codec_context->sample_rate;
+      context_.num_channels = std::max(num_channels, 1);
+
+      AVChannelLayout out_layout;
+      av_channel_layout_default(&out_layout, context_.num_channels);
+      int ret = swr_alloc_set_opts2(
+          &context_.swr_context, &out_layout, AV_SAMPLE_FMT_FLT,
+          context_.sample_rate, &context_.codec_context->ch_layout,
+          context_.codec_context->sample_fmt,
+          context_.codec_context->sample_rate, 0, nullptr);
+      av_channel_layout_uninit(&out_layout);
+      if (ret < 0 || swr_init(context_.swr_context) < 0) {
+        logger::error("AudioDecoder")
+            << "Couldn't initialize resampler" << logger::end();
+        break;
+      }
+
+      ring_.allocate(static_cast<size_t>(buffer_seconds *
+                                         context_.sample_rate) *
+                     context_.num_channels);
+
+      state_.b_loaded = true;
+
+      startThread([this]() { this->threadedFunction(); });
+
+      return true;
+    } while (false);
+
+    close();
+    return false;
+  }
+
+  // 毎フレーム呼ぶ
+  void update() {
+    if (!state_.b_loaded) return;
+
+    const double time = getTime();
+
+    // ループ・時計のジャンプに追従する
+    if (time < last_time_ - SEEK_TOLERANCE ||
+        time > last_time_ + MAX_CLOCK_JUMP) {
+      requestSeek(time);
+    }
+    last_time_ = time;
+    release_time_ = time;
+
+    auto locker = getLock();
+    if (!state_.b_loop && state_.b_eof && time >= getDuration()) {
+      state_.b_playing = false;
+      clock_->stop();
+    }
+  }
+
+  void play() {
+    clock_->start();
+    {
+      auto locker = getLock();
+      state_.b_playing = true;
+      notify();
+    }
+  }
+
+  void pause() {
+    clock_->stop();
+    {
+      auto locker = getLock();
+      state_.b_playing = false;
+    }
+  }
+
+  void setLoop(bool loop) { state_.b_loop = loop; }
+  bool isLoop() const { return state_.b_loop; }
+
+  void seekTime(double seconds) {
+    clock_->seek(seconds);
+    last_time_ = seconds;
+    requestSeek(seconds);
+  }
+
+  void setClock(const PlaybackClock::Ptr &clock) {
+    clock_ = clock ? clock : SystemClock::create();
+    b_own_clock_ = !clock;
+    last_time_ = getTime();
+    requestSeek(last_time_);
+  }
+  const PlaybackClock::Ptr &getClock() const { return clock_; }
+
+  // 読み出しは 1 スレッドから (AudioAnalyzer など)
+  RingBuffer<float> &getRingBuffer() { return ring_; }
+
+  bool isLoaded() const { return state_.b_loaded; }
+  bool isPlaying() {
+    auto locker = getLock();
+    return state_.b_playing;
+  }
+  int getSampleRate() const { return context_.sample_rate; }
+  int getNumChannels() const { return context_.num_channels; }
+  double getDuration() const { return context_.duration; }
+  // リングが一杯で捨てたサンプル数
+  uint64_t getOverruns() const { return overruns_.load(); }
+
+  double getTime() const {
+    double time = clock_->getTime();
+    if (state_.b_loop && getDuration() > 0) {
+      time = std::fmod(time, getDuration());
+      if (time < 0) time += getDuration();
+    }
+    return time;
+  }
+
+ private:
+  void requestSeek(double seconds) {
+    auto locker = getLock();
+    state_.b_request_seek = true;
+    state_.seek_time = seconds;
+    notify();
+  }
+
+  void waitForPlaying() {
+    auto locker = getLock();
+    waitFor(locker, [this] {
+      return (state_.b_playing && !state_.b_eof) || state_.b_request_seek;
+    });
+  }
+
+  void waitForSeek() {
+    auto locker = getLock();
+    if (!state_.b_request_seek) return;
+    state_.b_request_seek = false;
+    state_.b_eof = false;
+
+    int64_t pts = state_.seek_time / context_.time_base;
+    int ret = av_seek_frame(context_.format_context, context_.stream_index,
+                            pts, AVSEEK_FLAG_BACKWARD);
+    if (ret < 0)
+      logger::error("av_seek_frame") << av_err2str(ret) << logger::end();
+    avcodec_flush_buffers(context_.codec_context);
+
+    // 変換器に残っている分も捨てる
+    swr_init(context_.swr_context);
+    pending_.clear();
+    pending_offset_ = 0;
+    pending_time_ = state_.seek_time;
+    seek_target_ = state_.seek_time;
+  }
+
+  // 時計に追いついた分だけリングに書く
+  // 全部書けたら true
+  bool release() {
+    const size_t channels = context_.num_channels;
+    const double now = release_time_.load();
+
+    size_t available = (pending_.size() - pending_offset_) / channels;
+    if (available == 0) return true;
+
+    double ahead = (now - pending_time_) * context_.sample_rate;
+    if (ahead <= 0) return false;
+    size_t frames = std::min<size_t>(available, std::ceil(ahead));
+
+    size_t samples = frames * channels;
+    size_t written = ring_.write(pending_.data() + pending_offset_, samples);
+    if (written < samples) overruns_ += samples - written;
+
+    pending_offset_ += samples;
+    pending_time_ += (double)frames / context_.sample_rate;
+    return frames == available;
+  }
+
+  void convert(const AVFrame *frame) {
+    if (pending_offset_ == pending_.size()) {
+      pending_.clear();
+      pending_offset_ = 0;
+    }
+
+    double frame_time = frame->best_effort_timestamp != AV_NOPTS_VALUE
+                            ? frame->best_effort_timestamp * context_.time_base
+                            : pending_time_;
+    if (pending_.empty()) pending_time_ = frame_time;
+
+    const int channels = context_.num_channels;
+    int max_out = swr_get_out_samples(context_.swr_context, frame->nb_samples);
+    if (max_out <= 0) return;
+
+    size_t begin = pending_.size();
+    pending_.resize(begin + (size_t)max_out * channels);
+    uint8_t *out = reinterpret_cast<uint8_t *>(pending_.data() + begin);
+    int converted =
+        swr_convert(context_.swr_context, &out, max_out,
+                    const_cast<const uint8_t **>(frame->extended_data),
+                    frame->nb_samples);
+    pending_.resize(begin + (size_t)std::max(converted, 0) * channels);
+
+    // シーク先より前のサンプルは捨てる
+    if (seek_target_ > pending_time_) {
+      size_t skip = (seek_target_ - pending_time_) * context_.sample_rate;
+      skip = std::min(skip, (pending_.size() - pending_offset_) / channels);
+      pending_offset_ += skip * channels;
+      pending_time_ += (double)skip / context_.sample_rate;
+    }
+  }
+
+  bool receiveFrames(AVFrame *frame) {
+    while (true) {
+      int ret = avcodec_receive_frame(context_.codec_context, frame);
+      if (ret == AVERROR(EAGAIN)) return true;
+      if (ret == AVERROR_EOF) return false;
+      if (ret < 0) {
+        logger::error("avcodec_receive_frame")
+            << av_err2str(ret) << logger::end();
+        return true;
+      }
+      convert(frame);
+      av_frame_unref(frame);
+    }
+  }
+
+  void threadedFunction() {
+    AVPacket *packet = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    if (!packet || !frame) {
+      logger::error("AudioDecoder")
+          << "Couldn't allocate packet" << logger::end();
+      av_packet_free(&packet);
+      av_frame_free(&frame);
+      return;
+    }
+
+    while (isThreadRunning()) {
+      waitForPlaying();
+      if (!isThreadRunning()) break;
+      waitForSeek();
+
+      // 時計より先のサンプルがある間は待つ
+      if (!release()) {
+        sleepFor(POLL_INTERVAL_MS);
+        continue;
+      }
+
+      int ret = av_read_frame(context_.format_context, packet);
+      if (ret < 0) {
+        avcodec_send_packet(context_.codec_context, nullptr);
+        receiveFrames(frame);
+        while (!release() && isThreadRunning()) {
+          {
+            auto locker = getLock();
+            if (state_.b_request_seek) break;
+          }
+          sleepFor(POLL_INTERVAL_MS);
+        }
+
+        auto locker = getLock();
+        if (!state_.b_request_seek) state_.b_eof = true;
+        continue;
+      }
+
+      if (packet->stream_index == context_.stream_index) {
+        ret = avcodec_send_packet(context_.codec_context, packet);
+        if (ret < 0) {
+          logger::error("avcodec_send_packet")
+              << av_err2str(ret) << logger::end();
+        } else {
+          receiveFrames(frame);
+        }
+      }
+      av_packet_unref(packet);
+    }
+
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+  }
+};
+
+}  // namespace limas
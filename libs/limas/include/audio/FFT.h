@@ -0,0 +1,129 @@
+#pragma once
+#include <cmath>
+#include <vector>
+
+namespace limas {
+
+// 実数入力の FFT (サイズは 2 のべき乗)
+// N 点の実数列を N/2 点の複素数列として変換してから分離する
+// 実部と虚部を別々の配列に持ち、バタフライの内側のループが
+// ベクトル化されるようにしている
+class FFT {
+ public:
+  FFT() : size_(0) {}
+  explicit FFT(size_t size) { setup(size); }
+
+  void setup(size_t size) {
+    size_ = 2;
+    while (size_ < size) size_ <<= 1;
+    const size_t half = size_ / 2;
+
+    re_.assign(half, 0);
+    im_.assign(half, 0);
+
+    size_t bits = 0;
+    while ((size_t(1) << bits) < half) bits++;
+    bit_reverse_.resize(half);
+    for (size_t i = 0; i < half; i++) {
+      size_t r = 0;
+      for (size_t b = 0; b < bits; b++)
+        if (i & (size_t(1) << b)) r |= size_t(1) << (bits - 1 - b);
+      bit_reverse_[i] = r;
+    }
+
+    // 段ごとの回転因子を連続して並べる (長さ len の段は offset len/2 - 1)
+    twiddle_re_.assign(half, 0);
+    twiddle_im_.assign(half, 0);
+    for (size_t len = 2; len <= half; len <<= 1) {
+      for (size_t j = 0; j < len / 2; j++) {
+        double angle = -2.0 * M_PI * j / len;
+        twiddle_re_[len / 2 - 1 + j] = std::cos(angle);
+        twiddle_im_[len / 2 - 1 + j] = std::sin(angle);
+      }
+    }
+
+    split_re_.resize(half + 1);
+    split_im_.resize(half + 1);
+    for (size_t k = 0; k <= half; k++) {
+      double angle = -2.0 * M_PI * k / size_;
+      split_re_[k] = std::cos(angle);
+      split_im_[k] = std::sin(angle);
+    }
+  }
+
+  size_t getSize() const { return size_; }
+  size_t getNumBins() const { return size_ / 2 + 1; }
+
+  // input: size 個, out_re / out_im: size / 2 + 1 個
+  void forward(const float* input, float* out_re, float* out_im) {
+    const size_t half = size_ / 2;
+
+    for (size_t i = 0; i < half; i++) {
+      size_t r = bit_reverse_[i];
+      re_[r] = input[2 * i];
+      im_[r] = input[2 * i + 1];
+    }
+
+    float* __restrict re = re_.data();
+    float* __restrict im = im_.data();
+    for (size_t len = 2; len <= half; len <<= 1) {
+      const size_t h = len / 2;
+      const float* __restrict wr = twiddle_re_.data() + h - 1;
+      const float* __restrict wi = twiddle_im_.data() + h - 1;
+      for (size_t i = 0; i < half; i += len) {
+        float* __restrict ar = re + i;
+        float* __restrict ai = im + i;
+        float* __restrict br = re + i + h;
+        float* __restrict bi = im + i + h;
+        for (size_t j = 0; j < h; j++) {
+          float tr = br[j] * wr[j] - bi[j] * wi[j];
+          float ti = br[j] * wi[j] + bi[j] * wr[j];
+          br[j] = ar[j] - tr;
+          bi[j] = ai[j] - ti;
+          ar[j] += tr;
+          ai[j] += ti;
+        }
+      }
+    }
+
+    // Z[k] = E[k] + i O[k] から X[k] = E[k] + W^k O[k] を取り出す
+    for (size_t k = 0; k <= half; k++) {
+      const size_t k0 = k % half;
+      const size_t k1 = (half - k) % half;
+      float er = 0.5f * (re[k0] + re[k1]);
+      float ei = 0.5f * (im[k0] - im[k1]);
+      float orr = 0.5f * (im[k0] + im[k1]);
+      float oi = -0.5f * (re[k0] - re[k1]);
+      out_re[k] = er + orr * split_re_[k] - oi * split_im_[k];
+      out_im[k] = ei + orr * split_im_[k] + oi * split_re_[k];
+    }
+  }
+
+  // 振幅スペクトル (size / 2 + 1 個)
+  void getMagnitudes(const float* input, float* magnitudes) {
+    const size_t bins = getNumBins();
+    mag_re_.resize(bins);
+    mag_im_.resize(bins);
+    forward(input, mag_re_.data(), mag_im_.data());
+    for (size_t k = 0; k < bins; k++) {
+      magnitudes[k] =
+          std::sqrt(mag_re_[k] * mag_re_[k] + mag_im_[k] * mag_im_[k]);
+    }
+  }
+
+  static void makeHannWindow(std::vector<float>& window, size_t size) {
+    window.resize(size);
+    for (size_t i = 0; i < size; i++)
+      window[i] = 0.5f - 0.5f * std::cos(2.0 * M_PI * i / size);
+  }
+
+ private:
+  size_t size_;
+  std::vector<float> re_, im_;
+  std::vector<size_t> bit_reverse_;
+  std::vector<float> twiddle_re_, twiddle_im_;
+  std::vector<float> split_re_, split_im_;
+  std::vector<float> mag_re_, mag_im_;
+};
+
+}  // namespace limas
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "gl/Pbo.h"
 #include "graphics/Pixels.h"
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/opencv.hpp"
@@ -16,6 +17,12 @@ inline cv::Mat toCv(const BasePixels2D<PixelType>& pix) {
   return mat;
 }
 
+// PboReader でマップしたメモリをコピーせずに包む。unmap() までしか使えない
+inline cv::Mat toCv(const gl::PboReader::View& view, int width, int height,
+                    int type = CV_8UC4) {
+  return cv::Mat(height, width, type, const_cast<void*>(view.data));
+}
+
 template <typename PixelType>
 inline void toPixels(const cv::Mat& mat, BasePixels2D<PixelType>& pixels) {
   if (pixels.getWidth() != mat.cols || pixels.getHeight() != mat.rows ||
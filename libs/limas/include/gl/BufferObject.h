@@ -1,4 +1,5 @@
 #pragma once
+#include "gl/Context.h"
 #include "system/Logger.h"
 
 namespace limas {
@@ -16,19 +17,22 @@ class BufferObject {
     BufferData(GLenum target) : target_(target), stride_(sizeof(T)), count_(0) {
       glGenBuffers(1, &id_);
     }
-    ~BufferData() { glDeleteBuffers(1, &id_); }
+    ~BufferData() {
+      glDeleteBuffers(1, &id_);
+      forgetBuffer(id_);
+    }
 
     void allocate(const void* data, GLsizei count, GLenum usage) {
       count_ = count;
-      glBindBuffer(target_, id_);
+      bindBuffer(target_, id_);
       glBufferData(target_, stride_ * count, data, usage);
-      glBindBuffer(target_, 0);
+      bindBuffer(target_, 0);
     }
 
     void update(const void* data, GLsizei count, GLsizei offset) const {
-      glBindBuffer(target_, id_);
-      glBufferSubData(target_, offset, stride_ * count, data);
-      glBindBuffer(target_, 0);
+      bindBuffer(target_, id_);
+      glBufferSubData(target_, stride_ * offset, stride_ * count, data);
+      bindBuffer(target_, 0);
     }
   };
   std::shared_ptr<BufferData> data_;
@@ -37,15 +41,17 @@ class BufferObject {
   BufferObject() = delete;
   virtual ~BufferObject() {}
 
+  // usage は GL_STATIC_DRAW, GL_DYNAMIC_DRAW, GL_STREAM_DRAW など
   void allocate(const void* data, GLsizei count,
                 GLenum usage = GL_DYNAMIC_DRAW) {
-    data_->allocate(data, count, GL_DYNAMIC_DRAW);
+    data_->allocate(data, count, usage);
   }
 
   void allocate(const std::vector<T>& data, GLenum usage = GL_DYNAMIC_DRAW) {
     allocate(data.data(), data.size(), usage);
   }
 
+  // offset は要素単位
   void update(const void* data, GLsizei count, GLsizei offset = 0) const {
     data_->update(data, count, offset);
   }
@@ -54,8 +60,8 @@ class BufferObject {
     update(data.data(), data.size(), offset);
   }
 
-  void bind() const { glBindBuffer(getTarget(), getId()); }
-  void unbind() const { glBindBuffer(getTarget(), 0); }
+  void bind() const { bindBuffer(getTarget(), getId()); }
+  void unbind() const { bindBuffer(getTarget(), 0); }
 
   std::vector<T> getData(GLsizei offset, GLsizei count) {
     std::vector<T> data(count);
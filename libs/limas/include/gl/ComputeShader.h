@@ -8,10 +8,15 @@ namespace gl {
 class ComputeShader : public ShaderBase {
  public:
   ComputeShader() {}
-  virtual ~ComputeShader();
+  virtual ~ComputeShader() {}
 
   bool load(const std::string& filepath) {
-    return load(filepath, GL_COMPUTE_SHADER) && link();
+    return ShaderBase::load(filepath, GL_COMPUTE_SHADER) && link();
+  }
+
+  // GL 4.3 以降か ARB_compute_shader があれば使える
+  static bool isSupported() {
+    return GLEW_VERSION_4_3 || GLEW_ARB_compute_shader;
   }
 
   void dispatch(int x = 1, int y = 1, int z = 1, bool block = true) {
@@ -31,7 +36,7 @@ class ComputeShader : public ShaderBase {
     int max_work_size;
     glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 0, &max_work_size);
 
-    log::info("ComputeShader")
+    logger::info("ComputeShader")
         << "Max SSBO: " << getInt(GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS) << "\n"
         << "Max SSBO Block-Size: " << getInt(GL_MAX_SHADER_STORAGE_BLOCK_SIZE)
         << "\n"
@@ -39,8 +44,8 @@ class ComputeShader : public ShaderBase {
         << getInt(GL_MAX_COMPUTE_SHADER_STORAGE_BLOCKS) << "\n"
         << "Max Shared Storage Size: "
         << getInt(GL_MAX_COMPUTE_SHARED_MEMORY_SIZE) << "\n"
-        << "Max Work Groups: " << m << "\n"
-        << "Max Local Size: " << m << log::end();
+        << "Max Work Groups: " << max_work_groups << "\n"
+        << "Max Local Size: " << max_work_size << logger::end();
   }
 };
 
@@ -1,18 +1,42 @@
 #pragma once
 #include "math/Math.h"
+#include "system/Logger.h"
 
 namespace limas {
 namespace gl {
 
-template <typename StateType>
-class State {
+// GL の状態をコンテキスト全体で 1 つ覚えておき、同じ値の設定は GL に送らない
+// GL を直接変えた後は invalidate() を呼ぶと、次に使う時に GL から読み直す
+class StateCache {
  public:
-  using Ptr = std::unique_ptr<State>;
+  static void invalidate() { epoch_++; }
 
-  void push() {
-    StateType state = get();
-    states_.push(state);
+  // 有効にすると使うたびに glGet で実際の状態と比べる
+  static void setValidation(bool b_validation) {
+    b_validation_ = b_validation;
   }
+  static bool isValidation() { return b_validation_; }
+
+  // resetCounters() から GL に送った回数と省いた回数
+  static size_t getNumCalls() { return num_calls_; }
+  static size_t getNumSkips() { return num_skips_; }
+  static void resetCounters() {
+    num_calls_ = 0;
+    num_skips_ = 0;
+  }
+
+ protected:
+  static inline uint64_t epoch_ = 1;
+  static inline bool b_validation_ = false;
+  static inline size_t num_calls_ = 0;
+  static inline size_t num_skips_ = 0;
+};
+
+// Derived は static な query() と apply() を持つ
+template <class Derived, typename StateType>
+class State : public StateCache {
+ public:
+  void push() { states_.push(get()); }
   void push(StateType state) { states_.push(state); }
 
   void pop() {
@@ -22,18 +46,68 @@ class State {
     set(state);
   }
 
-  virtual StateType get() = 0;
-  virtual void set(StateType state) = 0;
+  static StateType get() {
+    if (!isCached()) {
+      cache(Derived::query());
+    } else if (b_validation_) {
+      validate();
+    }
+    return *cached_;
+  }
+
+  static void set(StateType state) {
+    if (isCached()) {
+      if (b_validation_) validate();
+      if (*cached_ == state) {
+        num_skips_++;
+        return;
+      }
+    }
+    Derived::apply(state);
+    num_calls_++;
+    cache(state);
+  }
+
+  // 他の関数で GL に送った値を覚える
+  static void assume(StateType state) { cache(state); }
+
+  // 削除された名前などで GL 側の値が変わった時に合わせる
+  static void replace(StateType from, StateType to) {
+    if (isCached() && *cached_ == from) cached_ = to;
+  }
+
+  static bool isCached(StateType state) {
+    return isCached() && *cached_ == state;
+  }
 
  private:
+  static bool isCached() { return cached_epoch_ == epoch_ && cached_; }
+
+  static void cache(StateType state) {
+    cached_ = state;
+    cached_epoch_ = epoch_;
+  }
+
+  static void validate() {
+    StateType actual = Derived::query();
+    if (actual == *cached_) return;
+    logger::warn("Context") << typeid(Derived).name()
+                            << " was changed outside of Context"
+                            << logger::end();
+    cached_ = actual;
+  }
+
+  static inline std::optional<StateType> cached_;
+  static inline uint64_t cached_epoch_ = 0;
+
   std::stack<StateType> states_;
 };
 
 template <GLenum cap>
-class TestState : public State<GLboolean> {
+class TestState : public State<TestState<cap>, GLboolean> {
  public:
-  GLboolean get() override { return glIsEnabled(cap); }
-  void set(GLboolean state) override {
+  static GLboolean query() { return glIsEnabled(cap); }
+  static void apply(GLboolean state) {
     if (state)
       glEnable(cap);
     else
@@ -48,43 +122,47 @@ using StencilTestState = TestState<GL_STENCIL_TEST>;
 using ScissorTestState = TestState<GL_SCISSOR_TEST>;
 
 #pragma mark DEPTH
-class DepthFuncState : public State<GLenum> {
+class DepthFuncState : public State<DepthFuncState, GLenum> {
  public:
-  GLenum get() override {
+  static GLenum query() {
     GLenum mode;
     glGetIntegerv(GL_DEPTH_FUNC, (GLint*)&mode);
     return mode;
   }
-  void set(GLenum state) override { glDepthFunc(state); }
+  static void apply(GLenum state) { glDepthFunc(state); }
 };
 
-class DepthMaskState : public State<GLboolean> {
+class DepthMaskState : public State<DepthMaskState, GLboolean> {
  public:
-  GLboolean get() override {
+  static GLboolean query() {
     GLboolean mode;
     glGetBooleanv(GL_DEPTH_WRITEMASK, &mode);
     return mode;
   }
-  void set(GLboolean state) override { glDepthMask(state); }
+  static void apply(GLboolean state) { glDepthMask(state); }
 };
 
-class DepthRangeState : public State<std::array<GLdouble, 2>> {
+class DepthRangeState
+    : public State<DepthRangeState, std::array<GLdouble, 2>> {
  public:
-  std::array<GLdouble, 2> get() override {
+  static std::array<GLdouble, 2> query() {
     std::array<GLdouble, 2> state;
     glGetDoublev(GL_DEPTH_RANGE, state.data());
     return state;
   }
-  void set(std::array<GLdouble, 2> state) override {
+  static void apply(std::array<GLdouble, 2> state) {
     glDepthRange(state[0], state[1]);
   }
 };
 
 #pragma mark BLEND
 
-class BlendFuncSeparateState : public State<std::array<GLenum, 4>> {
+class BlendFuncSeparateState
+    : public State<BlendFuncSeparateState, std::array<GLenum, 4>> {
  public:
-  std::array<GLenum, 4> get() override {
+  using State::set;
+
+  static std::array<GLenum, 4> query() {
     std::array<GLenum, 4> state;
     glGetIntegerv(GL_BLEND_SRC_RGB, (GLint*)&state[0]);
     glGetIntegerv(GL_BLEND_DST_RGB, (GLint*)&state[1]);
@@ -92,118 +170,343 @@ class BlendFuncSeparateState : public State<std::array<GLenum, 4>> {
     glGetIntegerv(GL_BLEND_DST_ALPHA, (GLint*)&state[3]);
     return state;
   }
-  void set(std::array<GLenum, 4> state) override {
+  static void apply(std::array<GLenum, 4> state) {
     glBlendFuncSeparate(state[0], state[1], state[2], state[3]);
   }
 
-  void set(GLenum src, GLenum dst, GLenum src_alpha, GLenum dst_alpha) {
+  static void set(GLenum src, GLenum dst, GLenum src_alpha, GLenum dst_alpha) {
     set({src, dst, src_alpha, dst_alpha});
   }
 
-  void set(GLenum src, GLenum dst) { set({src, dst, src, dst}); }
+  static void set(GLenum src, GLenum dst) { set({src, dst, src, dst}); }
 
-  void setBlendAlpha() { set(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); }
-  void setBlendAdd() { set(GL_SRC_ALPHA, GL_ONE); }
-  void setBlendMulti() { set(GL_ZERO, GL_SRC_COLOR); }
-  void setBlendScreen() { set(GL_ONE_MINUS_DST_COLOR, GL_ONE); }
-  void setBlendReverse() { set(GL_ONE_MINUS_DST_COLOR, GL_ZERO); }
-  void setBlendReverse2() {
+  static void setBlendAlpha() { set(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); }
+  static void setBlendAdd() { set(GL_SRC_ALPHA, GL_ONE); }
+  static void setBlendMulti() { set(GL_ZERO, GL_SRC_COLOR); }
+  static void setBlendScreen() { set(GL_ONE_MINUS_DST_COLOR, GL_ONE); }
+  static void setBlendReverse() { set(GL_ONE_MINUS_DST_COLOR, GL_ZERO); }
+  static void setBlendReverse2() {
     set(GL_ONE_MINUS_DST_COLOR, GL_ONE_MINUS_SRC_COLOR);
   }
-  void setBlendSeparatedAlpha() {
+  static void setBlendSeparatedAlpha() {
     set(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA, GL_ONE);
   }
 };
 
 #pragma mark CULLING
-class CullFaceModeState : public State<GLenum> {
+class CullFaceModeState : public State<CullFaceModeState, GLenum> {
  public:
-  GLenum get() override {
+  static GLenum query() {
     GLenum mode;
     glGetIntegerv(GL_CULL_FACE_MODE, (GLint*)&mode);
     return mode;
   }
-  void set(GLenum state) override { glCullFace(state); }
+  static void apply(GLenum state) { glCullFace(state); }
 };
 
-class FrontFaceState : public State<GLenum> {
+class FrontFaceState : public State<FrontFaceState, GLenum> {
  public:
-  GLenum get() override {
+  static GLenum query() {
     GLenum mode;
     glGetIntegerv(GL_FRONT_FACE, (GLint*)&mode);
     return mode;
   }
-  void set(GLenum state) override { glFrontFace(state); }
+  static void apply(GLenum state) { glFrontFace(state); }
 };
 
-class StencilFuncState : public State<std::tuple<GLenum, GLint, GLuint>> {
+class StencilFuncState
+    : public State<StencilFuncState, std::tuple<GLenum, GLint, GLuint>> {
  public:
-  std::tuple<GLenum, GLint, GLuint> get() override {
+  using State::set;
+
+  static std::tuple<GLenum, GLint, GLuint> query() {
     std::tuple<GLenum, GLint, GLuint> state;
     glGetIntegerv(GL_STENCIL_FUNC, (GLint*)&std::get<0>(state));
-    glGetIntegerv(GL_STENCIL_FAIL, (GLint*)&std::get<1>(state));
-    glGetIntegerv(GL_STENCIL_WRITEMASK, (GLint*)&std::get<2>(state));
+    glGetIntegerv(GL_STENCIL_REF, (GLint*)&std::get<1>(state));
+    glGetIntegerv(GL_STENCIL_VALUE_MASK, (GLint*)&std::get<2>(state));
     return state;
   }
-  void set(std::tuple<GLenum, GLint, GLuint> state) override {
+  static void apply(std::tuple<GLenum, GLint, GLuint> state) {
     glStencilFunc(std::get<0>(state), std::get<1>(state), std::get<2>(state));
   }
 
-  void set(GLenum func, GLint ref, GLuint mask) { set({func, ref, mask}); }
+  static void set(GLenum func, GLint ref, GLuint mask) {
+    set({func, ref, mask});
+  }
 };
 
-class StencilOpState : public State<std::tuple<GLenum, GLenum, GLenum>> {
+class StencilOpState
+    : public State<StencilOpState, std::tuple<GLenum, GLenum, GLenum>> {
  public:
-  std::tuple<GLenum, GLenum, GLenum> get() override {
+  using State::set;
+
+  static std::tuple<GLenum, GLenum, GLenum> query() {
     std::tuple<GLenum, GLenum, GLenum> state;
     glGetIntegerv(GL_STENCIL_FAIL, (GLint*)&std::get<0>(state));
     glGetIntegerv(GL_STENCIL_PASS_DEPTH_FAIL, (GLint*)&std::get<1>(state));
     glGetIntegerv(GL_STENCIL_PASS_DEPTH_PASS, (GLint*)&std::get<2>(state));
     return state;
   }
-  void set(std::tuple<GLenum, GLenum, GLenum> state) override {
+  static void apply(std::tuple<GLenum, GLenum, GLenum> state) {
     glStencilOp(std::get<0>(state), std::get<1>(state), std::get<2>(state));
   }
 
-  void set(GLenum sfail, GLenum dpfail, GLenum dppass) {
+  static void set(GLenum sfail, GLenum dpfail, GLenum dppass) {
     set({sfail, dpfail, dppass});
   }
 };
 
-class ViewportState : public State<std::array<GLint, 4>> {
+class ViewportState : public State<ViewportState, std::array<GLint, 4>> {
  public:
-  std::array<GLint, 4> get() override {
+  using State::set;
+
+  static std::array<GLint, 4> query() {
     std::array<GLint, 4> state;
     glGetIntegerv(GL_VIEWPORT, state.data());
     return state;
   }
 
-  void set(std::array<GLint, 4> state) override {
+  static void apply(std::array<GLint, 4> state) {
     glViewport(state[0], state[1], state[2], state[3]);
   }
 
-  void set(GLint x, GLint y, GLsizei width, GLsizei height) {
+  static void set(GLint x, GLint y, GLsizei width, GLsizei height) {
     set({x, y, width, height});
   }
 };
 
-class ScissorBoxState : public State<std::array<GLint, 4>> {
+class ScissorBoxState : public State<ScissorBoxState, std::array<GLint, 4>> {
  public:
-  std::array<GLint, 4> get() override {
+  using State::set;
+
+  static std::array<GLint, 4> query() {
     std::array<GLint, 4> state;
     glGetIntegerv(GL_SCISSOR_BOX, state.data());
     return state;
   }
 
-  void set(std::array<GLint, 4> state) override {
+  static void apply(std::array<GLint, 4> state) {
     glScissor(state[0], state[1], state[2], state[3]);
   }
 
-  void set(GLint x, GLint y, GLsizei width, GLsizei height) {
+  static void set(GLint x, GLint y, GLsizei width, GLsizei height) {
     set({x, y, width, height});
   }
 };
 
+#pragma mark BINDING
+class ProgramState : public State<ProgramState, GLuint> {
+ public:
+  static GLuint query() {
+    GLint id;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &id);
+    return id;
+  }
+  static void apply(GLuint id) { glUseProgram(id); }
+};
+
+class VertexArrayState : public State<VertexArrayState, GLuint> {
+ public:
+  static GLuint query() {
+    GLint id;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &id);
+    return id;
+  }
+  static void apply(GLuint id) { glBindVertexArray(id); }
+};
+
+// GL_ELEMENT_ARRAY_BUFFER は VAO の状態なので扱わない
+template <GLenum target, GLenum binding>
+class BufferBindingState
+    : public State<BufferBindingState<target, binding>, GLuint> {
+ public:
+  static GLuint query() {
+    GLint id;
+    glGetIntegerv(binding, &id);
+    return id;
+  }
+  static void apply(GLuint id) { glBindBuffer(target, id); }
+};
+
+using ArrayBufferState =
+    BufferBindingState<GL_ARRAY_BUFFER, GL_ARRAY_BUFFER_BINDING>;
+using UniformBufferState =
+    BufferBindingState<GL_UNIFORM_BUFFER, GL_UNIFORM_BUFFER_BINDING>;
+
+template <GLenum target, GLenum binding>
+class FramebufferBindingState
+    : public State<FramebufferBindingState<target, binding>, GLuint> {
+ public:
+  static GLuint query() {
+    GLint id;
+    glGetIntegerv(binding, &id);
+    return id;
+  }
+  static void apply(GLuint id) { glBindFramebuffer(target, id); }
+};
+
+using DrawFramebufferState =
+    FramebufferBindingState<GL_DRAW_FRAMEBUFFER, GL_DRAW_FRAMEBUFFER_BINDING>;
+using ReadFramebufferState =
+    FramebufferBindingState<GL_READ_FRAMEBUFFER, GL_READ_FRAMEBUFFER_BINDING>;
+
+class ActiveTextureState : public State<ActiveTextureState, GLenum> {
+ public:
+  static GLenum query() {
+    GLint unit;
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &unit);
+    return unit;
+  }
+  static void apply(GLenum unit) { glActiveTexture(unit); }
+};
+
+// ユニットとターゲットごとにバインドされているテクスチャ
+class TextureBindingState : public StateCache {
+ public:
+  static void bind(GLenum target, GLuint id) {
+    auto& bindings = getBindings();
+    const uint64_t key = getKey(target);
+    auto it = bindings.find(key);
+    if (it != bindings.end()) {
+      if (b_validation_) validate(target, it->second);
+      if (it->second == id) {
+        num_skips_++;
+        return;
+      }
+    }
+    glBindTexture(target, id);
+    num_calls_++;
+    bindings[key] = id;
+  }
+
+  // 削除されたテクスチャは全てのユニットで 0 に戻る
+  static void forget(GLuint id) {
+    for (auto& binding : getBindings()) {
+      if (binding.second == id) binding.second = 0;
+    }
+  }
+
+ private:
+  static std::unordered_map<uint64_t, GLuint>& getBindings() {
+    if (epoch_ != bindings_epoch_) {
+      bindings_.clear();
+      bindings_epoch_ = epoch_;
+    }
+    return bindings_;
+  }
+
+  static uint64_t getKey(GLenum target) {
+    return (uint64_t(ActiveTextureState::get()) << 32) | target;
+  }
+
+  static void validate(GLenum target, GLuint& cached) {
+    GLenum binding = 0;
+    switch (target) {
+      case GL_TEXTURE_1D:
+        binding = GL_TEXTURE_BINDING_1D;
+        break;
+      case GL_TEXTURE_2D:
+        binding = GL_TEXTURE_BINDING_2D;
+        break;
+      case GL_TEXTURE_3D:
+        binding = GL_TEXTURE_BINDING_3D;
+        break;
+      case GL_TEXTURE_RECTANGLE:
+        binding = GL_TEXTURE_BINDING_RECTANGLE;
+        break;
+      case GL_TEXTURE_CUBE_MAP:
+        binding = GL_TEXTURE_BINDING_CUBE_MAP;
+        break;
+      case GL_TEXTURE_2D_ARRAY:
+        binding = GL_TEXTURE_BINDING_2D_ARRAY;
+        break;
+      default:
+        return;
+    }
+    GLint actual;
+    glGetIntegerv(binding, &actual);
+    if (GLuint(actual) == cached) return;
+    logger::warn("Context") << "Texture binding was changed outside of Context"
+                            << logger::end();
+    cached = actual;
+  }
+
+  static inline std::unordered_map<uint64_t, GLuint> bindings_;
+  static inline uint64_t bindings_epoch_ = 0;
+};
+
+#pragma mark HELPERS
+// gl 以下のクラスはバインドをここから行い、重複した呼び出しを省く
+inline void useProgram(GLuint id) { ProgramState::set(id); }
+inline void bindVertexArray(GLuint id) { VertexArrayState::set(id); }
+
+inline void bindBuffer(GLenum target, GLuint id) {
+  if (target == GL_ARRAY_BUFFER) {
+    ArrayBufferState::set(id);
+  } else if (target == GL_UNIFORM_BUFFER) {
+    UniformBufferState::set(id);
+  } else {
+    glBindBuffer(target, id);
+  }
+}
+
+inline void bindFramebuffer(GLenum target, GLuint id) {
+  if (target == GL_DRAW_FRAMEBUFFER) {
+    DrawFramebufferState::set(id);
+  } else if (target == GL_READ_FRAMEBUFFER) {
+    ReadFramebufferState::set(id);
+  } else if (DrawFramebufferState::isCached(id) &&
+             ReadFramebufferState::isCached(id)) {
+    DrawFramebufferState::set(id);  // 省いた回数に数える
+  } else {
+    glBindFramebuffer(GL_FRAMEBUFFER, id);
+    DrawFramebufferState::assume(id);
+    ReadFramebufferState::assume(id);
+  }
+}
+
+// unit は GL_TEXTURE0 + n
+inline void activeTexture(GLenum unit) { ActiveTextureState::set(unit); }
+inline void bindTexture(GLenum target, GLuint id) {
+  TextureBindingState::bind(target, id);
+}
+
+// 削除した名前を覚えている状態から外す
+inline void forgetTexture(GLuint id) { TextureBindingState::forget(id); }
+inline void forgetBuffer(GLuint id) {
+  ArrayBufferState::replace(id, 0);
+  UniformBufferState::replace(id, 0);
+}
+inline void forgetVertexArray(GLuint id) { VertexArrayState::replace(id, 0); }
+inline void forgetFramebuffer(GLuint id) {
+  DrawFramebufferState::replace(id, 0);
+  ReadFramebufferState::replace(id, 0);
+}
+
+inline void setCapability(GLenum cap, GLboolean value) {
+  switch (cap) {
+    case GL_DEPTH_TEST:
+      DepthTestState::set(value);
+      break;
+    case GL_BLEND:
+      BlendState::set(value);
+      break;
+    case GL_CULL_FACE:
+      CullFaceState::set(value);
+      break;
+    case GL_STENCIL_TEST:
+      StencilTestState::set(value);
+      break;
+    case GL_SCISSOR_TEST:
+      ScissorTestState::set(value);
+      break;
+    default:
+      value ? glEnable(cap) : glDisable(cap);
+  }
+}
+
+// push/pop で状態を戻す。値はコンテキスト全体で共有するキャッシュを通して
+// 設定するので、同じ値なら GL は呼ばれない
 class Context {
  public:
   Context() {
@@ -303,7 +606,7 @@ class Context {
   void pushCullFaceMode() { cull_face_mode_state_.push(); }
   void popCullFaceMode() { cull_face_mode_state_.pop(); }
   void setCullFaceMode(GLenum mode) { cull_face_mode_state_.set(mode); }
-  GLenum getCullFaceMode() { return front_face_state_.get(); }
+  GLenum getCullFaceMode() { return cull_face_mode_state_.get(); }
 
   void pushFrontFace() { front_face_state_.push(); }
   void popFrontFace() { front_face_state_.pop(); }
@@ -357,6 +660,16 @@ class Context {
   }
   std::array<GLint, 4> getScissorBox() { return scissor_box_state_.get(); }
 
+#pragma mark CACHE
+  // GL を直接変えた後に呼ぶ
+  void invalidate() { StateCache::invalidate(); }
+  void setValidation(bool b_validation) {
+    StateCache::setValidation(b_validation);
+  }
+  size_t getNumCalls() const { return StateCache::getNumCalls(); }
+  size_t getNumSkips() const { return StateCache::getNumSkips(); }
+  void resetCounters() { StateCache::resetCounters(); }
+
  private:
   DepthTestState depth_test_state_;
   BlendState blend_state_;
@@ -20,8 +20,9 @@ class AttributeBase {
   GLuint getDim() const { return dim_; }
   GLenum getType() const { return type_; }
 
-  virtual void allocate(const void *data, size_t size) = 0;
-  virtual void update(const void *data, size_t size) = 0;
+  virtual void allocate(const void *data, size_t size, GLenum usage) = 0;
+  // offset は要素単位
+  virtual void update(const void *data, size_t size, size_t offset = 0) = 0;
   virtual void bind() const = 0;
   virtual void unbind() const = 0;
   virtual GLuint getId() const = 0;
@@ -37,23 +38,24 @@ class AttributeBase {
 template <typename T>
 class Attribute : public AttributeBase {
  public:
-  Attribute(GLuint index, const vector<T> &data, GLuint size, GLenum type)
+  Attribute(GLuint index, const vector<T> &data, GLuint size, GLenum type,
+            GLenum usage = GL_DYNAMIC_DRAW)
       : AttributeBase(index, size, type) {
-    allocate(data);
+    allocate(data, usage);
   }
 
-  void allocate(const std::vector<T> &data) {
-    allocate(data.data(), data.size());
+  void allocate(const std::vector<T> &data, GLenum usage = GL_DYNAMIC_DRAW) {
+    allocate(data.data(), data.size(), usage);
   }
 
-  void allocate(const void *data, size_t size) override {
-    vbo_.allocate(data, size);
+  void allocate(const void *data, size_t size, GLenum usage) override {
+    vbo_.allocate(data, size, usage);
   }
 
   void update(const std::vector<T> &data) { update(data.data(), data.size()); }
 
-  void update(const void *data, size_t size) override {
-    vbo_.update(data, size);
+  void update(const void *data, size_t size, size_t offset = 0) override {
+    vbo_.update(data, size, offset);
   }
 
   void bind() const override { vbo_.bind(); }
@@ -66,17 +68,50 @@ class Attribute : public AttributeBase {
   gl::Vbo<T> vbo_;
 };
 
+// 書き換えた要素の範囲 [first, last)。何度足しても 1 つの範囲にまとめる
+struct DirtyRange {
+  size_t first = std::numeric_limits<size_t>::max();
+  size_t last = 0;
+
+  void add(size_t index, size_t count = 1) {
+    first = std::min(first, index);
+    last = std::max(last, index + count);
+  }
+  void add(const DirtyRange &rhs) {
+    if (!rhs.isEmpty()) add(rhs.first, rhs.getCount());
+  }
+  bool isEmpty() const { return first >= last; }
+  size_t getCount() const { return isEmpty() ? 0 : last - first; }
+};
+
+// 1 つのバッファに頂点ごとに並べた属性の 1 つ分
+struct InterleavedAttribute {
+  GLuint location;
+  GLuint dim;
+  GLenum type;
+  GLsizei offset;  // 頂点の先頭からのバイト数
+};
+
 class Drawable {
  protected:
  public:
-  Drawable() {}
+  Drawable()
+      : usage_(GL_DYNAMIC_DRAW),
+        interleaved_stride_(0),
+        num_bytes_uploaded_(0) {}
+
+  // これから確保するバッファの使い方
+  // GL_STATIC_DRAW, GL_DYNAMIC_DRAW, GL_STREAM_DRAW など
+  void setUsage(GLenum usage) { usage_ = usage; }
+  GLenum getUsage() const { return usage_; }
 
   template <typename T>
   void addAttribute(GLuint location, const std::vector<T> &data, GLuint dim,
                     GLenum type) {
     std::shared_ptr<Attribute<T>> attr =
-        std::make_shared<Attribute<T>>(location, data, dim, type);
+        std::make_shared<Attribute<T>>(location, data, dim, type, usage_);
     attributes_[location] = attr;
+    num_bytes_uploaded_ += data.size() * sizeof(T);
 
     vao_.bindVbo(attr->getId(), location, dim, attr->getType(), GL_FALSE,
                  attr->getStride());
@@ -98,16 +133,106 @@ class Drawable {
     auto it = attributes_.find(location);
     if (it != attributes_.end()) {
       auto &attr = it->second;
-      attr->update(data.data(), data.size());
+      if (attr->getSize() != data.size()) {
+        attr->allocate(data.data(), data.size(), usage_);
+      } else {
+        attr->update(data.data(), data.size());
+      }
+      num_bytes_uploaded_ += data.size() * sizeof(T);
     } else {
       logger::warn("updateAttribute()")
           << "attribute " << location << " not found" << logger::end();
     }
   }
 
+  // data[first, first + count) だけを送る
+  template <typename T>
+  void updateAttribute(GLuint location, const std::vector<T> &data,
+                       size_t first, size_t count) {
+    auto it = attributes_.find(location);
+    if (it == attributes_.end() || it->second->getSize() != data.size()) {
+      updateAttribute(location, data);
+      return;
+    }
+    count = std::min(count, data.size() - std::min(first, data.size()));
+    if (count == 0) return;
+    it->second->update(data.data() + first, count, first);
+    num_bytes_uploaded_ += count * sizeof(T);
+  }
+
+  // 書き換えた要素を覚えておき、takeDirtyRange() でまとめて送る
+  void markDirty(GLuint location, size_t first, size_t count = 1) {
+    dirty_ranges_[location].add(first, count);
+  }
+
+  DirtyRange takeDirtyRange(GLuint location) {
+    DirtyRange range;
+    auto it = dirty_ranges_.find(location);
+    if (it != dirty_ranges_.end()) {
+      range = it->second;
+      dirty_ranges_.erase(it);
+    }
+    return range;
+  }
+
+  // 全ての属性の範囲をまとめて取り出す
+  DirtyRange takeDirtyRange() {
+    DirtyRange range;
+    for (const auto &[location, r] : dirty_ranges_) range.add(r);
+    dirty_ranges_.clear();
+    return range;
+  }
+
+  bool isDirty() const { return !dirty_ranges_.empty(); }
+  void clearDirty() { dirty_ranges_.clear(); }
+
+  // 属性を 1 つのバッファにまとめて確保する
+  // data は頂点ごとに stride バイトずつ並べておく
+  void setInterleavedAttributes(const std::vector<InterleavedAttribute> &layout,
+                                GLsizei stride, const void *data,
+                                size_t num_vertices) {
+    clearInterleavedAttributes();
+    for (const auto &a : layout) {
+      if (attributes_.erase(a.location)) vao_.unbindVbo(a.location);
+    }
+
+    interleaved_layout_ = layout;
+    interleaved_stride_ = stride;
+    interleaved_vbo_.allocate(data, stride * num_vertices, usage_);
+    num_bytes_uploaded_ += stride * num_vertices;
+    for (const auto &a : interleaved_layout_) {
+      vao_.bindVbo(interleaved_vbo_.getId(), a.location, a.dim, a.type,
+                   GL_FALSE, stride, (void *)(intptr_t)a.offset);
+    }
+  }
+
+  // data は頂点 first から count 個分
+  void updateInterleavedAttributes(const void *data, size_t first,
+                                   size_t count) {
+    if (interleaved_layout_.empty() || count == 0) return;
+    interleaved_vbo_.update(data, interleaved_stride_ * count,
+                            interleaved_stride_ * first);
+    num_bytes_uploaded_ += interleaved_stride_ * count;
+  }
+
+  void clearInterleavedAttributes() {
+    for (const auto &a : interleaved_layout_) vao_.unbindVbo(a.location);
+    interleaved_layout_.clear();
+    interleaved_stride_ = 0;
+  }
+
+  const std::vector<InterleavedAttribute> &getInterleavedAttributes() const {
+    return interleaved_layout_;
+  }
+  GLsizei getInterleavedStride() const { return interleaved_stride_; }
+  size_t getNumInterleavedVertices() const {
+    if (interleaved_stride_ == 0) return 0;
+    return interleaved_vbo_.getSize() / interleaved_stride_;
+  }
+
   void updateIndices(const std::vector<GLuint> &data) {
     if (ibo_.getSize() != data.size()) {
-      ibo_.allocate(data);
+      ibo_.allocate(data, usage_);
       vao_.bindIbo(ibo_);
     } else {
       ibo_.update(data);
@@ -116,10 +241,15 @@ class Drawable {
 
   void enableAttribute(GLuint location) {
     auto it = attributes_.find(location);
+    auto interleaved = findInterleavedAttribute(location);
     if (it != attributes_.end()) {
       auto &attr = it->second;
       vao_.bindVbo(attr->getId(), location, attr->getDim(), attr->getType(),
                    GL_FALSE, attr->getStride());
+    } else if (interleaved != interleaved_layout_.end()) {
+      vao_.bindVbo(interleaved_vbo_.getId(), location, interleaved->dim,
+                   interleaved->type, GL_FALSE, interleaved_stride_,
+                   (void *)(intptr_t)interleaved->offset);
     } else {
       logger::warn("enableAttribute()")
           << "attribute " << location << " not found" << logger::end();
@@ -127,7 +257,7 @@ class Drawable {
   }
 
   void disableAttribute(GLuint location) {
-    if (attributes_.find(location) != attributes_.end()) {
+    if (hasAttribute(location)) {
       vao_.unbindVbo(location);
     } else {
       logger::warn("disableAttribute()")
@@ -136,7 +266,7 @@ class Drawable {
   }
 
   void draw(GLenum mode, GLsizei count, GLsizei start = 0) const {
-    if (attributes_.size() == 0) return;
+    if (attributes_.empty() && interleaved_layout_.empty()) return;
 
     if (ibo_.getSize()) {
       vao_.drawElements(mode, count);
@@ -147,7 +277,7 @@ class Drawable {
 
   void drawInstanced(GLenum mode, GLsizei instance_count, GLsizei count,
                      GLsizei start = 0) const {
-    if (attributes_.size() == 0) return;
+    if (attributes_.empty() && interleaved_layout_.empty()) return;
 
     if (ibo_.getSize()) {
       vao_.drawElementsInstanced(mode, count, instance_count);
@@ -160,7 +290,8 @@ class Drawable {
   const Vao &getVao() const { return vao_; };
 
   bool hasAttribute(GLuint index) const {
-    return attributes_.find(index) != attributes_.end();
+    return attributes_.find(index) != attributes_.end() ||
+           findInterleavedAttribute(index) != interleaved_layout_.end();
   }
 
   bool isAttributeEnabled(GLuint index) const {
@@ -169,10 +300,30 @@ class Drawable {
 
   bool isIndexEnabled() const { return vao_.isIboEnabled(); }
 
+  // resetCounters() から GPU に送ったバイト数
+  size_t getNumBytesUploaded() const { return num_bytes_uploaded_; }
+  void resetCounters() { num_bytes_uploaded_ = 0; }
+
  protected:
+  std::vector<InterleavedAttribute>::const_iterator findInterleavedAttribute(
+      GLuint location) const {
+    return std::find_if(
+        interleaved_layout_.begin(), interleaved_layout_.end(),
+        [&](const InterleavedAttribute &a) { return a.location == location; });
+  }
+
   gl::Vao vao_;
   std::map<GLuint, AttributeBase::Ptr> attributes_;
   gl::Ibo<GLuint> ibo_;
+  GLenum usage_;
+
+  std::map<GLuint, DirtyRange> dirty_ranges_;
+
+  gl::Vbo<unsigned char> interleaved_vbo_;
+  std::vector<InterleavedAttribute> interleaved_layout_;
+  GLsizei interleaved_stride_;
+
+  size_t num_bytes_uploaded_;
 };
 
 }  // namespace gl
@@ -16,7 +16,10 @@ class Fbo {
     BufferData(GLsizei width, GLsizei height) : width_(width), height_(height) {
       glGenFramebuffers(1, &id_);
     }
-    ~BufferData() { glDeleteFramebuffers(1, &id_); }
+    ~BufferData() {
+      glDeleteFramebuffers(1, &id_);
+      forgetFramebuffer(id_);
+    }
   };
   std::shared_ptr<BufferData> data_;
 
@@ -104,7 +107,7 @@ class Fbo {
   }
 
   void bind() {
-    glBindFramebuffer(GL_FRAMEBUFFER, getId());
+    bindFramebuffer(GL_FRAMEBUFFER, getId());
     glDrawBuffers(attachments_.size(), &attachments_[0]);
 
     viewport.push();
@@ -112,7 +115,7 @@ class Fbo {
   }
 
   void unbind() {
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    bindFramebuffer(GL_FRAMEBUFFER, 0);
     viewport.pop();
   }
 
@@ -4,8 +4,11 @@
 #include "gl/Drawable.h"
 #include "gl/Fbo.h"
 #include "gl/GLUtils.h"
+#include "gl/GpuProfiler.h"
 #include "gl/Ibo.h"
 #include "gl/InstancedVboMesh.h"
+#include "gl/MeshBatch.h"
+#include "gl/PackedInstancedVboMesh.h"
 #include "gl/Pbo.h"
 #include "gl/Rbo.h"
 #include "gl/Shader.h"
@@ -1,4 +1,5 @@
 #pragma once
+#include "gl/Context.h"
 #include "system/Logger.h"
 
 namespace limas {
@@ -51,37 +52,32 @@ inline void clearStencil(GLint stencil = 0) {
   glClear(GL_STENCIL_BUFFER_BIT);
 }
 
-inline void enableDepth() { glEnable(GL_DEPTH_TEST); }
-inline void disableDepth() { glDisable(GL_DEPTH_TEST); }
+inline void enableDepth() { setCapability(GL_DEPTH_TEST, true); }
+inline void disableDepth() { setCapability(GL_DEPTH_TEST, false); }
 
-inline void enableStencil() { glEnable(GL_STENCIL_TEST); }
-inline void disableStencil() { glDisable(GL_STENCIL_TEST); }
+inline void enableStencil() { setCapability(GL_STENCIL_TEST, true); }
+inline void disableStencil() { setCapability(GL_STENCIL_TEST, false); }
 
-inline void enableFaceCulling() { glEnable(GL_CULL_FACE); }
-inline void disableFaceCulling() { glDisable(GL_CULL_FACE); }
+inline void enableFaceCulling() { setCapability(GL_CULL_FACE, true); }
+inline void disableFaceCulling() { setCapability(GL_CULL_FACE, false); }
 
-inline void setCullFaceBack() { glCullFace(GL_BACK); }
-inline void setCullFaceFront() { glCullFace(GL_FRONT); }
+inline void setCullFaceBack() { CullFaceModeState::set(GL_BACK); }
+inline void setCullFaceFront() { CullFaceModeState::set(GL_FRONT); }
 
-inline void enableBlend() { glEnable(GL_BLEND); }
-inline void disableBlend() { glDisable(GL_BLEND); }
-inline void setBlendModeAlpha() {
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-}
-inline void setBlendModeAdd() { glBlendFunc(GL_SRC_ALPHA, GL_ONE); }
-inline void setBlendModeMulti() { glBlendFunc(GL_ZERO, GL_SRC_COLOR); }
-inline void setBlendModeScreen() {
-  glBlendFunc(GL_ONE_MINUS_DST_COLOR, GL_ONE);
-}
+inline void enableBlend() { setCapability(GL_BLEND, true); }
+inline void disableBlend() { setCapability(GL_BLEND, false); }
+inline void setBlendModeAlpha() { BlendFuncSeparateState::setBlendAlpha(); }
+inline void setBlendModeAdd() { BlendFuncSeparateState::setBlendAdd(); }
+inline void setBlendModeMulti() { BlendFuncSeparateState::setBlendMulti(); }
+inline void setBlendModeScreen() { BlendFuncSeparateState::setBlendScreen(); }
 inline void setBlendModeReverse() {
-  glBlendFunc(GL_ONE_MINUS_DST_COLOR, GL_ZERO);
+  BlendFuncSeparateState::setBlendReverse();
 }
 inline void setBlendModeReverse2() {
-  glBlendFunc(GL_ONE_MINUS_DST_COLOR, GL_ONE_MINUS_SRC_COLOR);
+  BlendFuncSeparateState::setBlendReverse2();
 }
 inline void setBlendModeSeparatedAlpha() {
-  glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA,
-                      GL_ONE);
+  BlendFuncSeparateState::setBlendSeparatedAlpha();
 }
 
 enum BlendMode {
@@ -113,7 +109,7 @@ inline void setBlendMode(BlendMode mode) {
 }
 
 inline void setViewport(GLsizei x, GLsizei y, GLsizei width, GLsizei height) {
-  glViewport(x, y, width, height);
+  ViewportState::set(x, y, width, height);
 }
 
 inline std::vector<GLint> getViewport() {
@@ -326,6 +322,20 @@ static GLenum getGLFormatFromInternal(GLenum internal_format) {
     case GL_STENCIL_INDEX8:
       return GL_STENCIL_INDEX;
 
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+      return GL_RGB;
+
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+      return GL_RGBA;
+
+    case GL_COMPRESSED_RED_RGTC1:
+      return GL_RED;
+
+    case GL_COMPRESSED_RG_RGTC2:
+      return GL_RG;
+
     default:
       logger::warn("GetGLFormatFromInternal()")
           << "unknown internal format " << internal_format
@@ -400,6 +410,14 @@ static GLenum getGLTypeFromInternal(GLenum internal_format) {
     case GL_STENCIL_INDEX8:
       return GL_UNSIGNED_BYTE;
 
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+    case GL_COMPRESSED_RED_RGTC1:
+    case GL_COMPRESSED_RG_RGTC2:
+      return GL_UNSIGNED_BYTE;
+
     default:
       logger::warn("GetGlTypeFromInternal()")
           << "unknown internal format " << internal_format
@@ -481,6 +499,32 @@ static size_t getByteOfType(GLenum internal_format) {
   return byte;
 }
 
+// 4x4 ブロック 1 つあたりのバイト数 (非圧縮フォーマットは 0)
+static size_t getBlockSizeOfCompressed(GLenum internal_format) {
+  switch (internal_format) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RED_RGTC1:
+      return 8;
+    case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+    case GL_COMPRESSED_RG_RGTC2:
+      return 16;
+    default:
+      return 0;
+  }
+}
+
+static bool isCompressedFormat(GLenum internal_format) {
+  return getBlockSizeOfCompressed(internal_format) > 0;
+}
+
+static size_t getCompressedImageSize(GLenum internal_format, size_t width,
+                                     size_t height) {
+  return ((width + 3) / 4) * ((height + 3) / 4) *
+         getBlockSizeOfCompressed(internal_format);
+}
+
 static std::string getStringFromInternal(GLenum format) {
   static std::map<GLenum, std::string> formats_map = {
       {GL_RGBA8, "GL_RGBA8"},     {GL_RGBA16, "GL_RGBA16"},
@@ -0,0 +1,309 @@
+#pragma once
+#include <deque>
+
+#include "system/Logger.h"
+#include "system/Noncopyable.h"
+#include "utils/Json.h"
+
+namespace limas {
+namespace gl {
+
+// フレームの中の区間ごとに GPU の時間を測る
+// beginFrame() と endFrame() の間で beginZone() と endZone() を呼ぶか、Scope で
+// 囲む。区間は入れ子にできる
+// 区間の両端に GL_TIMESTAMP を記録し、フレームごとのクエリを latency + 1 個の
+// リングで回す。結果は数フレーム遅れて届き、待たずに読む
+// 結果が届く前にリングが一周したフレームは捨てる
+class GpuProfiler : private Noncopyable {
+ public:
+  struct Zone {
+    std::string name;
+    int depth = 0;
+    double begin_ms = 0;  // フレームの始まりから
+    double gpu_ms = 0;
+  };
+
+  struct Frame {
+    uint64_t number = 0;
+    GLuint64 begin_ns = 0;
+    double gpu_ms = 0;
+    std::vector<Zone> zones;
+  };
+
+  // 区間をスコープで閉じる。profiler が nullptr なら何もしない
+  class Scope : private Noncopyable {
+   public:
+    Scope(GpuProfiler* profiler, const std::string& name)
+        : profiler_(profiler) {
+      if (profiler_) profiler_->beginZone(name);
+    }
+    Scope(GpuProfiler& profiler, const std::string& name)
+        : Scope(&profiler, name) {}
+    ~Scope() {
+      if (profiler_) profiler_->endZone();
+    }
+
+   private:
+    GpuProfiler* profiler_;
+  };
+
+  // GL のコンテキストを作る前に作ってもよい。クエリは使う時に作る
+  explicit GpuProfiler(size_t latency = DEFAULT_LATENCY)
+      : slots_(latency + 1),
+        current_(0),
+        frame_number_(0),
+        num_dropped_(0),
+        max_captured_frames_(0),
+        b_in_frame_(false),
+        b_enabled_(true),
+        b_capturing_(false) {}
+  virtual ~GpuProfiler() {
+    for (auto& slot : slots_) {
+      if (!slot.queries.empty())
+        glDeleteQueries(slot.queries.size(), slot.queries.data());
+    }
+  }
+
+  static bool isSupported() {
+    return GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+  }
+
+  void setEnabled(bool b_enabled) { b_enabled_ = b_enabled; }
+  bool isEnabled() const { return b_enabled_; }
+
+  void beginFrame() {
+    if (!b_enabled_ || b_in_frame_) return;
+    if (!isSupported()) {
+      logger::warn("GpuProfiler")
+          << "timer query is not supported" << logger::end();
+      b_enabled_ = false;
+      return;
+    }
+    collect();
+
+    Slot& slot = slots_[current_];
+    if (slot.b_pending) {
+      pending_.pop_front();
+      num_dropped_++;
+    }
+    slot.number = frame_number_;
+    slot.num_queries = 0;
+    slot.zones.clear();
+    slot.b_pending = false;
+    glQueryCounter(addQuery(slot), GL_TIMESTAMP);
+    b_in_frame_ = true;
+  }
+
+  void endFrame() {
+    if (!b_in_frame_) return;
+    if (!stack_.empty()) {
+      logger::warn("GpuProfiler")
+          << stack_.size() << " zones are not ended" << logger::end();
+      while (!stack_.empty()) endZone();
+    }
+    Slot& slot = slots_[current_];
+    slot.end_query = addQuery(slot);
+    glQueryCounter(slot.end_query, GL_TIMESTAMP);
+    slot.b_pending = true;
+    pending_.push_back(current_);
+
+    current_ = (current_ + 1) % slots_.size();
+    frame_number_++;
+    b_in_frame_ = false;
+  }
+
+  void beginZone(const std::string& name) {
+    if (!b_in_frame_) return;
+    Slot& slot = slots_[current_];
+    PendingZone zone;
+    zone.name = name;
+    zone.depth = stack_.size();
+    zone.begin_query = slot.num_queries;
+    glQueryCounter(addQuery(slot), GL_TIMESTAMP);
+    stack_.push_back(slot.zones.size());
+    slot.zones.push_back(zone);
+  }
+
+  void endZone() {
+    if (!b_in_frame_) return;
+    if (stack_.empty()) {
+      logger::warn("GpuProfiler") << "no zone to end" << logger::end();
+      return;
+    }
+    Slot& slot = slots_[current_];
+    slot.zones[stack_.back()].end_query = slot.num_queries;
+    glQueryCounter(addQuery(slot), GL_TIMESTAMP);
+    stack_.pop_back();
+  }
+
+  // 届いているフレームを古い順に読む。新しい結果があれば true
+  // beginFrame() でも呼ぶ
+  bool collect() {
+    bool b_updated = false;
+    while (!pending_.empty()) {
+      Slot& slot = slots_[pending_.front()];
+      // クエリは順に終わるので、フレームの最後が届いていれば全て読める
+      GLint available = 0;
+      glGetQueryObjectiv(slot.end_query, GL_QUERY_RESULT_AVAILABLE,
+                         &available);
+      if (!available) break;
+
+      std::vector<GLuint64> ns(slot.num_queries);
+      for (size_t i = 0; i < slot.num_queries; i++) {
+        glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &ns[i]);
+      }
+
+      Frame& frame = last_frame_;
+      frame.number = slot.number;
+      frame.begin_ns = ns.front();
+      frame.gpu_ms = toMs(ns.front(), ns.back());
+      frame.zones.resize(slot.zones.size());
+      for (size_t i = 0; i < slot.zones.size(); i++) {
+        const auto& src = slot.zones[i];
+        auto& dst = frame.zones[i];
+        dst.name = src.name;
+        dst.depth = src.depth;
+        dst.begin_ms = toMs(ns.front(), ns[src.begin_query]);
+        dst.gpu_ms = toMs(ns[src.begin_query], ns[src.end_query]);
+      }
+      if (b_capturing_) capture(frame);
+
+      slot.b_pending = false;
+      pending_.pop_front();
+      b_updated = true;
+    }
+    return b_updated;
+  }
+
+  // 最後に届いたフレーム
+  const Frame& getLastFrame() const { return last_frame_; }
+  double getFrameTimeInMs() const { return last_frame_.gpu_ms; }
+
+  // 最後に届いたフレームで同じ名前の区間を足した時間
+  double getZoneTimeInMs(const std::string& name) const {
+    double ms = 0;
+    for (const auto& zone : last_frame_.zones) {
+      if (zone.name == name) ms += zone.gpu_ms;
+    }
+    return ms;
+  }
+
+  size_t getLatency() const { return slots_.size() - 1; }
+  size_t getNumPending() const { return pending_.size(); }
+  size_t getNumDropped() const { return num_dropped_; }
+  void resetCounters() { num_dropped_ = 0; }
+
+#pragma mark CAPTURE
+  // 届いたフレームを max_frames まで溜める。古いものから捨てる
+  void startCapture(size_t max_frames = DEFAULT_MAX_CAPTURED_FRAMES) {
+    max_captured_frames_ = std::max<size_t>(max_frames, 1);
+    captured_.clear();
+    b_capturing_ = true;
+  }
+  void stopCapture() { b_capturing_ = false; }
+  bool isCapturing() const { return b_capturing_; }
+  const std::deque<Frame>& getCapturedFrames() const { return captured_; }
+
+  // chrome://tracing や Perfetto で開ける形式
+  json toChromeTrace() const {
+    json events = json::array();
+    const GLuint64 origin =
+        captured_.empty() ? 0 : captured_.front().begin_ns;
+    for (const auto& frame : captured_) {
+      const double frame_us = (frame.begin_ns - origin) * 1e-3;
+      events.push_back(toTraceEvent("frame", frame_us, frame.gpu_ms * 1e3,
+                                    frame.number));
+      for (const auto& zone : frame.zones) {
+        events.push_back(toTraceEvent(zone.name,
+                                      frame_us + zone.begin_ms * 1e3,
+                                      zone.gpu_ms * 1e3, frame.number));
+      }
+    }
+    json metadata;
+    metadata["name"] = "thread_name";
+    metadata["ph"] = "M";
+    metadata["pid"] = 0;
+    metadata["tid"] = 0;
+    metadata["args"]["name"] = "GPU";
+    events.push_back(metadata);
+
+    json trace;
+    trace["traceEvents"] = events;
+    trace["displayTimeUnit"] = "ms";
+    return trace;
+  }
+
+  void saveChromeTrace(const std::string& path) const {
+    utils::saveJson(path, toChromeTrace());
+  }
+
+ private:
+  static constexpr size_t DEFAULT_LATENCY = 3;
+  static constexpr size_t DEFAULT_MAX_CAPTURED_FRAMES = 600;
+
+  struct PendingZone {
+    std::string name;
+    int depth = 0;
+    size_t begin_query = 0;
+    size_t end_query = 0;
+  };
+
+  // 1 フレーム分のクエリ。足りなくなった時だけ作り、次の周回で使い回す
+  struct Slot {
+    std::vector<GLuint> queries;
+    size_t num_queries = 0;
+    GLuint end_query = 0;
+    std::vector<PendingZone> zones;
+    uint64_t number = 0;
+    bool b_pending = false;
+  };
+
+  static GLuint addQuery(Slot& slot) {
+    if (slot.num_queries == slot.queries.size()) {
+      GLuint id;
+      glGenQueries(1, &id);
+      slot.queries.push_back(id);
+    }
+    return slot.queries[slot.num_queries++];
+  }
+
+  static double toMs(GLuint64 begin_ns, GLuint64 end_ns) {
+    return end_ns > begin_ns ? (end_ns - begin_ns) * 1e-6 : 0.0;
+  }
+
+  static json toTraceEvent(const std::string& name, double ts_us,
+                           double dur_us, uint64_t frame) {
+    json event;
+    event["name"] = name;
+    event["ph"] = "X";
+    event["ts"] = ts_us;
+    event["dur"] = dur_us;
+    event["pid"] = 0;
+    event["tid"] = 0;
+    event["args"]["frame"] = frame;
+    return event;
+  }
+
+  void capture(const Frame& frame) {
+    captured_.push_back(frame);
+    while (captured_.size() > max_captured_frames_) captured_.pop_front();
+  }
+
+  std::vector<Slot> slots_;
+  size_t current_;
+  std::deque<size_t> pending_;
+  std::vector<size_t> stack_;
+  uint64_t frame_number_;
+  size_t num_dropped_;
+
+  Frame last_frame_;
+  std::deque<Frame> captured_;
+  size_t max_captured_frames_;
+
+  bool b_in_frame_;
+  bool b_enabled_;
+  bool b_capturing_;
+};
+
+}  // namespace gl
+}  // namespace limas
@@ -0,0 +1,350 @@
+#pragma once
+#include "geom/Mesh.h"
+#include "gl/Drawable.h"
+#include "gl/ShaderBase.h"
+#include "gl/TextureBuffer.h"
+#include "gl/Vao.h"
+#include "system/Noncopyable.h"
+
+namespace limas {
+namespace gl {
+
+// 多数のメッシュを共有の頂点・インデックスバッファに詰めて 1 回で描画する
+// GL 4.3 以降は glMultiDrawElementsIndirect、それより前は
+// glMultiDrawElementsBaseVertex を使う
+// メッシュごとの行列と色はテクスチャバッファに置き、頂点の draw_id で引く
+// shaders/mesh_batch.vert と一緒に使う (Renderer::drawMeshBatch())
+template <class V, class N, class C, class T>
+class BaseMeshBatch : private Noncopyable {
+ public:
+  using Id = size_t;
+
+  struct Vertex {
+    V position;
+    N normal;
+    C color;
+    T texcoord;
+    float draw_id;
+  };
+
+  // DrawElementsIndirectCommand と同じ並び
+  struct Command {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+  };
+
+  BaseMeshBatch()
+      : usage_(GL_DYNAMIC_DRAW),
+        b_geometry_resized_(false),
+        b_draw_data_resized_(false),
+        b_commands_dirty_(false),
+        num_draws_(0),
+        num_meshes_drawn_(0) {
+    const GLsizei stride = sizeof(Vertex);
+    const GLuint id = vbo_.getId();
+    vao_.bindVbo(id, POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, stride,
+                 (void*)offsetof(Vertex, position));
+    vao_.bindVbo(id, NORMAL_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, stride,
+                 (void*)offsetof(Vertex, normal));
+    vao_.bindVbo(id, COLOR_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, stride,
+                 (void*)offsetof(Vertex, color));
+    vao_.bindVbo(id, TEXCOORD_ATTRIBUTE, 2, GL_FLOAT, GL_FALSE, stride,
+                 (void*)offsetof(Vertex, texcoord));
+    vao_.bindVbo(id, DRAW_ID_ATTRIBUTE, 1, GL_FLOAT, GL_FALSE, stride,
+                 (void*)offsetof(Vertex, draw_id));
+    vao_.bindIbo(ibo_);
+  }
+
+  // mesh をバッファに詰める。インデックスがなければ頂点の順に作る
+  // 返した Id で行列や色を変える
+  Id add(const geom::BaseMesh<V, N, C, T>& mesh,
+         const glm::mat4& model_mat = glm::mat4(1),
+         const glm::vec4& color = glm::vec4(1)) {
+    Id id;
+    if (free_ids_.empty()) {
+      id = entries_.size();
+      entries_.emplace_back();
+      draw_data_.resize(draw_data_.size() + DRAW_DATA_TEXELS);
+      b_draw_data_resized_ = true;
+    } else {
+      id = free_ids_.back();
+      free_ids_.pop_back();
+    }
+
+    Entry& e = entries_[id];
+    e.b_alive = true;
+    e.b_visible = true;
+    e.num_vertices = mesh.getNumVertices();
+    e.num_indices = mesh.getNumIndices() ? mesh.getNumIndices()
+                                         : mesh.getNumVertices();
+    e.first_vertex = allocate(free_vertices_, vertices_, e.num_vertices);
+    e.first_index = allocate(free_indices_, indices_, e.num_indices);
+
+    for (size_t i = 0; i < e.num_vertices; i++) {
+      Vertex& v = vertices_[e.first_vertex + i];
+      v.position = mesh.getVertices()[i];
+      v.normal = i < mesh.getNumNormals() ? mesh.getNormals()[i] : N(0);
+      v.color = i < mesh.getNumColors() ? mesh.getColors()[i] : C(1);
+      v.texcoord = i < mesh.getNumTexCoords() ? mesh.getTexCoords()[i] : T(0);
+      v.draw_id = id;
+    }
+    for (size_t i = 0; i < e.num_indices; i++) {
+      indices_[e.first_index + i] =
+          mesh.getNumIndices() ? mesh.getIndices()[i] : GLuint(i);
+    }
+    dirty_vertices_.add(e.first_vertex, e.num_vertices);
+    dirty_indices_.add(e.first_index, e.num_indices);
+
+    setTransform(id, model_mat);
+    setColor(id, color);
+    b_commands_dirty_ = true;
+    return id;
+  }
+
+  // 空いた範囲は次の add() で使い回す
+  void remove(Id id) {
+    if (!isValid(id)) return;
+    Entry& e = entries_[id];
+    e.b_alive = false;
+    release(free_vertices_, e.first_vertex, e.num_vertices);
+    release(free_indices_, e.first_index, e.num_indices);
+    free_ids_.push_back(id);
+    b_commands_dirty_ = true;
+  }
+
+  void clear() {
+    entries_.clear();
+    vertices_.clear();
+    indices_.clear();
+    draw_data_.clear();
+    free_ids_.clear();
+    free_vertices_.clear();
+    free_indices_.clear();
+    dirty_vertices_ = DirtyRange();
+    dirty_indices_ = DirtyRange();
+    dirty_draw_data_ = DirtyRange();
+    b_commands_dirty_ = true;
+  }
+
+  void setTransform(Id id, const glm::mat4& model_mat) {
+    if (!isValid(id)) return;
+    glm::vec4* texels = draw_data_.data() + id * DRAW_DATA_TEXELS;
+    for (int i = 0; i < 4; i++) texels[i] = model_mat[i];
+    dirty_draw_data_.add(id * DRAW_DATA_TEXELS, DRAW_DATA_TEXELS);
+  }
+
+  void setColor(Id id, const glm::vec4& color) {
+    if (!isValid(id)) return;
+    draw_data_[id * DRAW_DATA_TEXELS + 4] = color;
+    dirty_draw_data_.add(id * DRAW_DATA_TEXELS + 4);
+  }
+
+  void setVisible(Id id, bool b_visible) {
+    if (!isValid(id) || entries_[id].b_visible == b_visible) return;
+    entries_[id].b_visible = b_visible;
+    b_commands_dirty_ = true;
+  }
+
+  bool isValid(Id id) const {
+    return id < entries_.size() && entries_[id].b_alive;
+  }
+
+  // 頂点とインデックスのバッファの usage。次の update() で確保し直す
+  // 行列と色は毎フレーム変わるものとして常に GL_DYNAMIC_DRAW
+  void setUsage(GLenum usage) {
+    if (usage_ == usage) return;
+    usage_ = usage;
+    b_geometry_resized_ = true;
+  }
+  GLenum getUsage() const { return usage_; }
+
+  // 変わった範囲だけを GPU に送る。draw() からも呼ばれる
+  void update() {
+    uploadRange(vbo_, vertices_, dirty_vertices_, b_geometry_resized_, usage_);
+    uploadRange(ibo_, indices_, dirty_indices_, b_geometry_resized_, usage_);
+    b_geometry_resized_ = false;
+
+    if (uploadRange(draw_data_tbo_, draw_data_, dirty_draw_data_,
+                    b_draw_data_resized_, GL_DYNAMIC_DRAW) ||
+        !draw_data_tex_.isAllocated()) {
+      draw_data_tex_.bindTbo(draw_data_tbo_, GL_RGBA32F);
+    }
+    b_draw_data_resized_ = false;
+
+    if (b_commands_dirty_) buildCommands();
+  }
+
+  // シェーダーは呼び出し側でバインドしておく
+  void draw(ShaderBase& shader, GLenum mode = GL_TRIANGLES) {
+    update();
+    if (commands_.empty()) return;
+
+    shader.setUniformTexture("DRAW_DATA", GL_TEXTURE_BUFFER,
+                             draw_data_tex_.getId(), DRAW_DATA_UNIT);
+
+    vao_.bind();
+    if (isMultiDrawIndirectSupported()) {
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer_.getId());
+      glMultiDrawElementsIndirect(mode, GL_UNSIGNED_INT, nullptr,
+                                  commands_.size(), 0);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    } else {
+      glMultiDrawElementsBaseVertex(mode, counts_.data(), GL_UNSIGNED_INT,
+                                    offsets_.data(), commands_.size(),
+                                    base_vertices_.data());
+    }
+    vao_.unbind();
+
+    num_draws_++;
+    num_meshes_drawn_ += commands_.size();
+  }
+
+  static bool isMultiDrawIndirectSupported() {
+    return GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+  }
+
+  size_t getNumMeshes() const { return entries_.size() - free_ids_.size(); }
+  size_t getNumVertices() const { return vertices_.size(); }
+  size_t getNumIndices() const { return indices_.size(); }
+
+  // resetCounters() からの描画回数とまとめて描いたメッシュの数
+  size_t getNumDraws() const { return num_draws_; }
+  size_t getNumMeshesDrawn() const { return num_meshes_drawn_; }
+  void resetCounters() {
+    num_draws_ = 0;
+    num_meshes_drawn_ = 0;
+  }
+
+ private:
+  static constexpr size_t DRAW_DATA_TEXELS = 5;
+  static constexpr GLuint DRAW_DATA_UNIT = 1;
+
+  struct Entry {
+    size_t first_vertex = 0;
+    size_t num_vertices = 0;
+    size_t first_index = 0;
+    size_t num_indices = 0;
+    bool b_alive = false;
+    bool b_visible = false;
+  };
+
+  // (先頭, 個数)
+  using FreeList = std::vector<std::pair<size_t, size_t>>;
+
+  // 空きから最初に入る範囲を使い、なければ末尾に足す
+  template <typename Type>
+  size_t allocate(FreeList& free_list, std::vector<Type>& data, size_t count) {
+    for (auto it = free_list.begin(); it != free_list.end(); ++it) {
+      if (it->second < count) continue;
+      const size_t first = it->first;
+      it->first += count;
+      it->second -= count;
+      if (it->second == 0) free_list.erase(it);
+      return first;
+    }
+    const size_t first = data.size();
+    data.resize(first + count);
+    b_geometry_resized_ = true;
+    return first;
+  }
+
+  // 隣り合う空きはまとめる
+  static void release(FreeList& free_list, size_t first, size_t count) {
+    if (count == 0) return;
+    auto it = std::lower_bound(free_list.begin(), free_list.end(),
+                               std::make_pair(first, size_t(0)));
+    it = free_list.insert(it, {first, count});
+    if (std::next(it) != free_list.end() &&
+        it->first + it->second == std::next(it)->first) {
+      it->second += std::next(it)->second;
+      free_list.erase(std::next(it));
+    }
+    if (it != free_list.begin() &&
+        std::prev(it)->first + std::prev(it)->second == it->first) {
+      std::prev(it)->second += it->second;
+      free_list.erase(it);
+    }
+  }
+
+  // 大きさが変わった時は全体を確保し直し、それ以外は変わった範囲だけを送る
+  // 確保し直したら true
+  template <typename Buffer, typename Type>
+  static bool uploadRange(Buffer& buffer, const std::vector<Type>& data,
+                          DirtyRange& range, bool b_resized, GLenum usage) {
+    if (data.empty()) {
+      range = DirtyRange();
+      return false;
+    }
+    if (b_resized || buffer.getSize() != data.size()) {
+      buffer.allocate(data, usage);
+      range = DirtyRange();
+      return true;
+    }
+    if (!range.isEmpty()) {
+      const size_t last = std::min(range.last, data.size());
+      buffer.update(data.data() + range.first, last - range.first,
+                    range.first);
+      range = DirtyRange();
+    }
+    return false;
+  }
+
+  void buildCommands() {
+    b_commands_dirty_ = false;
+    commands_.clear();
+    counts_.clear();
+    offsets_.clear();
+    base_vertices_.clear();
+    for (const auto& e : entries_) {
+      if (!e.b_alive || !e.b_visible || e.num_indices == 0) continue;
+      commands_.push_back({GLuint(e.num_indices), 1, GLuint(e.first_index),
+                           GLint(e.first_vertex), 0});
+      counts_.push_back(e.num_indices);
+      offsets_.push_back((void*)(e.first_index * sizeof(GLuint)));
+      base_vertices_.push_back(e.first_vertex);
+    }
+    if (!commands_.empty() && isMultiDrawIndirectSupported()) {
+      indirect_buffer_.allocate(commands_, GL_DYNAMIC_DRAW);
+    }
+  }
+
+  std::vector<Entry> entries_;
+  std::vector<Id> free_ids_;
+
+  std::vector<Vertex> vertices_;
+  std::vector<GLuint> indices_;
+  FreeList free_vertices_;
+  FreeList free_indices_;
+  DirtyRange dirty_vertices_;
+  DirtyRange dirty_indices_;
+  GLenum usage_;
+  bool b_geometry_resized_;
+
+  std::vector<glm::vec4> draw_data_;
+  DirtyRange dirty_draw_data_;
+  bool b_draw_data_resized_;
+
+  std::vector<Command> commands_;
+  std::vector<GLsizei> counts_;
+  std::vector<void*> offsets_;
+  std::vector<GLint> base_vertices_;
+  bool b_commands_dirty_;
+
+  Vao vao_;
+  Vbo<Vertex> vbo_;
+  Ibo<GLuint> ibo_;
+  Tbo<glm::vec4> draw_data_tbo_;
+  TextureBuffer draw_data_tex_;
+  Vbo<Command> indirect_buffer_;
+
+  size_t num_draws_;
+  size_t num_meshes_drawn_;
+};
+
+using MeshBatch = BaseMeshBatch<glm::vec3, glm::vec3, glm::vec4, glm::vec2>;
+
+}  // namespace gl
+}  // namespace limas
@@ -0,0 +1,285 @@
+#pragma once
+#include "gl/ComputeShader.h"
+#include "gl/VboMesh.h"
+#include "utils/FileSystem.h"
+
+namespace limas {
+namespace gl {
+
+// 1 インスタンス分。std430 の vec4 4 つと同じ並びで、
+// shaders/default.vert のインスタンス属性にそのまま渡せる
+struct PackedInstance {
+  glm::vec3 translation = glm::vec3(0);
+  float padding0 = 0;
+  glm::quat rotation = glm::quat(1, 0, 0, 0);
+  glm::vec3 scale = glm::vec3(1);
+  float padding1 = 0;
+  glm::vec4 color = glm::vec4(1);
+};
+static_assert(sizeof(PackedInstance) == 64);
+
+// インスタンスの属性を 1 つのバッファにまとめ、書き換えた範囲だけを送る
+// setCulling(true) にして毎フレーム cull() を呼ぶと、コンピュートシェーダーで
+// 視錐台に掛かるインスタンスだけを詰めて間接描画する
+// コンピュートシェーダーが使えない環境では全てのインスタンスを描画する
+template <class V, class N, class C, class T>
+class BasePackedInstancedVboMesh : public BaseVboMesh<V, N, C, T> {
+ public:
+  using Instance = PackedInstance;
+
+  BasePackedInstancedVboMesh()
+      : BaseVboMesh<V, N, C, T>(),
+        bounds_(0, 0, 0, -1),
+        b_culling_(false),
+        b_culled_(false) {}
+
+  BasePackedInstancedVboMesh(const geom::BaseMesh<V, N, C, T>& mesh)
+      : BaseVboMesh<V, N, C, T>(mesh),
+        bounds_(0, 0, 0, -1),
+        b_culling_(false),
+        b_culled_(false) {}
+
+  inline BasePackedInstancedVboMesh<V, N, C, T>& operator=(
+      const geom::BaseMesh<V, N, C, T>& rhs) {
+    if (this != &rhs) {
+      gl::BaseVboMesh<V, N, C, T>::copyFromMesh(rhs);
+      bounds_.w = -1;
+    }
+    return *this;
+  }
+
+  void allocateInstances(size_t num_instances) {
+    instances_.resize(num_instances);
+    updateInstances();
+  }
+
+  // 1 インスタンス分を書き換えて updateDirtyInstances() で送る範囲に加える
+  void setInstance(size_t i, const Instance& instance) {
+    instances_[i] = instance;
+    dirty_instances_.add(i);
+  }
+  void setTranslation(size_t i, const glm::vec3& translation) {
+    instances_[i].translation = translation;
+    dirty_instances_.add(i);
+  }
+  void setRotation(size_t i, const glm::quat& rotation) {
+    instances_[i].rotation = rotation;
+    dirty_instances_.add(i);
+  }
+  void setScale(size_t i, const glm::vec3& scale) {
+    instances_[i].scale = scale;
+    dirty_instances_.add(i);
+  }
+  void setInstanceColor(size_t i, const glm::vec4& color) {
+    instances_[i].color = color;
+    dirty_instances_.add(i);
+  }
+
+  // getInstances() から直接書き換えた時に範囲を伝える
+  void markInstancesDirty(size_t first, size_t count = 1) {
+    dirty_instances_.add(first, count);
+  }
+
+  void setInstances(const std::vector<Instance>& instances) {
+    instances_ = instances;
+  }
+  const std::vector<Instance>& getInstances() const { return instances_; }
+  std::vector<Instance>& getInstances() { return instances_; }
+  const Instance& getInstance(size_t i) const { return instances_[i]; }
+  size_t getNumInstances() const { return instances_.size(); }
+
+  // 全てのインスタンスを送る。数が変わった時はバッファを確保し直す
+  void updateInstances() {
+    dirty_instances_ = DirtyRange();
+    if (instances_.empty()) return;
+
+    if (instance_vbo_.getSize() != instances_.size()) {
+      instance_vbo_.allocate(instances_, this->usage_);
+      if (!b_culled_) bindInstanceAttributes(instance_vbo_.getId());
+    } else {
+      instance_vbo_.update(instances_);
+    }
+    this->num_bytes_uploaded_ += instances_.size() * sizeof(Instance);
+  }
+
+  // setInstance() などで書き換えた範囲だけを 1 回で送る
+  void updateDirtyInstances() {
+    const DirtyRange range = dirty_instances_;
+    dirty_instances_ = DirtyRange();
+    if (range.isEmpty() || range.first >= instances_.size()) return;
+
+    if (instance_vbo_.getSize() != instances_.size()) {
+      updateInstances();
+      return;
+    }
+    const size_t count = std::min(range.last, instances_.size()) - range.first;
+    instance_vbo_.update(instances_.data() + range.first, count, range.first);
+    this->num_bytes_uploaded_ += count * sizeof(Instance);
+  }
+
+  void setCulling(bool b_culling) {
+    b_culling_ = b_culling;
+    if (!b_culling_ && b_culled_) {
+      bindInstanceAttributes(instance_vbo_.getId());
+      b_culled_ = false;
+    }
+  }
+  bool isCulling() const { return b_culling_; }
+
+  // 境界球 (中心, 半径)。頂点を変えたら computeBounds() か setBounds() する
+  void setBounds(const glm::vec3& center, float radius) {
+    bounds_ = glm::vec4(center, radius);
+  }
+  const glm::vec4& getBounds() const { return bounds_; }
+
+  void computeBounds() {
+    if (this->vertices_.empty()) {
+      bounds_ = glm::vec4(0);
+      return;
+    }
+    glm::vec3 min_p(std::numeric_limits<float>::max());
+    glm::vec3 max_p(std::numeric_limits<float>::lowest());
+    for (const auto& v : this->vertices_) {
+      min_p = glm::min(min_p, glm::vec3(v));
+      max_p = glm::max(max_p, glm::vec3(v));
+    }
+    const glm::vec3 center = (min_p + max_p) * 0.5f;
+    float radius = 0;
+    for (const auto& v : this->vertices_) {
+      radius = std::max(radius, glm::distance(center, glm::vec3(v)));
+    }
+    bounds_ = glm::vec4(center, radius);
+  }
+
+  // mvp は描画に使う行列 (Renderer::getCurrentMatrix())
+  // インスタンスを送った後、描画の前に呼ぶ
+  void cull(const glm::mat4& mvp) {
+    if (!b_culling_ || instances_.empty() || !ComputeShader::isSupported()) {
+      return;
+    }
+    auto& shader = getCullShader();
+    if (!shader.isLinked()) return;
+    if (bounds_.w < 0) computeBounds();
+
+    const GLuint num_instances = instances_.size();
+    if (visible_vbo_.getSize() != num_instances) {
+      visible_vbo_.allocate(nullptr, num_instances, GL_DYNAMIC_COPY);
+    }
+    if (!b_culled_) {
+      bindInstanceAttributes(visible_vbo_.getId());
+      b_culled_ = true;
+    }
+
+    const GLuint count = this->isIndexEnabled() ? this->getNumIndices()
+                                                : this->getNumVertices();
+    const GLuint command[5] = {count, 0, 0, 0, 0};
+    if (command_buffer_.getSize() != 5) {
+      command_buffer_.allocate(command, 5, GL_DYNAMIC_COPY);
+    } else {
+      command_buffer_.update(command, 5);
+    }
+
+    glm::vec4 planes[6];
+    getFrustumPlanes(mvp, planes);
+
+    shader.bind();
+    shader.setUniform4fv("PLANES", planes, 6);
+    shader.setUniform4f("BOUNDS", bounds_);
+    shader.setUniform1ui("NUM_INSTANCES", num_instances);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instance_vbo_.getId());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, visible_vbo_.getId());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, command_buffer_.getId());
+    shader.dispatch((num_instances + 255) / 256, 1, 1, false);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT |
+                    GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    shader.unbind();
+  }
+
+  // cull() していれば間接描画、していなければ全てのインスタンスを描画する
+  void drawInstances(GLenum mode) const {
+    if (!b_culled_) {
+      this->drawInstanced(mode, instances_.size());
+      return;
+    }
+
+    this->vao_.bind();
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer_.getId());
+    if (this->isIndexEnabled()) {
+      glDrawElementsIndirect(mode, GL_UNSIGNED_INT, nullptr);
+    } else {
+      glDrawArraysIndirect(mode, nullptr);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    this->vao_.unbind();
+  }
+
+  // 最後の cull() で残ったインスタンスの数
+  // GPU の結果を読み戻して待つので確認用に使う
+  size_t getNumVisible() {
+    if (!b_culled_) return instances_.size();
+    return command_buffer_.getData(1, 1)[0];
+  }
+
+ private:
+  // 最初の cull() で読み込み、メッシュと一緒に捨てる
+  // static にするとコンテキストを破棄した後に解放されてしまう
+  ComputeShader& getCullShader() {
+    if (!cull_shader_) {
+      cull_shader_ = std::make_shared<ComputeShader>();
+      cull_shader_->load(
+          fs::getCommonResourcePath("shaders/cull_instances.comp"));
+    }
+    return *cull_shader_;
+  }
+
+  // 行列の行から視錐台の 6 平面を取り出す。法線は内向き
+  static void getFrustumPlanes(const glm::mat4& m, glm::vec4* planes) {
+    const glm::vec4 r0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    const glm::vec4 r1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    const glm::vec4 r2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    const glm::vec4 r3(m[0][3], m[1][3], m[2][3], m[3][3]);
+    planes[0] = r3 + r0;
+    planes[1] = r3 - r0;
+    planes[2] = r3 + r1;
+    planes[3] = r3 - r1;
+    planes[4] = r3 + r2;
+    planes[5] = r3 - r2;
+    for (int i = 0; i < 6; i++) {
+      const float len = glm::length(glm::vec3(planes[i]));
+      if (len > 0) planes[i] /= len;
+    }
+  }
+
+  void bindInstanceAttributes(GLuint id) {
+    const GLsizei stride = sizeof(Instance);
+    this->vao_.bindVbo(id, TRANSLATION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, stride,
+                       (void*)offsetof(Instance, translation));
+    this->vao_.bindVbo(id, ROTATION_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, stride,
+                       (void*)offsetof(Instance, rotation));
+    this->vao_.bindVbo(id, SCALE_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, stride,
+                       (void*)offsetof(Instance, scale));
+    this->vao_.bindVbo(id, INSTANCE_COLOR_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE,
+                       stride, (void*)offsetof(Instance, color));
+    this->vao_.setVertexAttribDivisor(TRANSLATION_ATTRIBUTE, 1);
+    this->vao_.setVertexAttribDivisor(ROTATION_ATTRIBUTE, 1);
+    this->vao_.setVertexAttribDivisor(SCALE_ATTRIBUTE, 1);
+    this->vao_.setVertexAttribDivisor(INSTANCE_COLOR_ATTRIBUTE, 1);
+  }
+
+  std::vector<Instance> instances_;
+  DirtyRange dirty_instances_;
+  Vbo<Instance> instance_vbo_;
+
+  glm::vec4 bounds_;
+  bool b_culling_;
+  bool b_culled_;
+  Vbo<Instance> visible_vbo_;
+  Vbo<GLuint> command_buffer_;
+  std::shared_ptr<ComputeShader> cull_shader_;
+};
+
+using PackedInstancedVboMesh =
+    BasePackedInstancedVboMesh<glm::vec3, glm::vec3, glm::vec4, glm::vec2>;
+
+}  // namespace gl
+}  // namespace limas
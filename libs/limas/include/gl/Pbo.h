@@ -1,68 +1,271 @@
 #pragma once
+#include "gl/Context.h"
 #include "gl/Fbo.h"
 #include "gl/GLUtils.h"
 #include "graphics/Pixels.h"
 #include "system/Logger.h"
+#include "system/Noncopyable.h"
 
 namespace limas {
 namespace gl {
 
-class PboPacker {
+// GPU からの読み出しを N 個の PBO に順番に積むリング
+// 読み出しごとにフェンスを置き、tryMap() は終わっているものだけを返すので
+// 待たずに済む。結果は積んでから最大 getDepth() - 1 回分遅れて届く
+// マップしたメモリはそのまま渡すので、コピーするかどうかは使う側が決める
+class PboReader : private Noncopyable {
+ public:
+  struct View {
+    const void* data = nullptr;
+    size_t size = 0;
+    uint64_t frame = 0;   // 何回目に積んだ読み出しか
+    uint64_t latency = 0;  // その後に積んだ読み出しの数
+    bool isValid() const { return data != nullptr; }
+  };
+
+  PboReader()
+      : size_(0),
+        head_(0),
+        num_pending_(0),
+        num_submitted_(0),
+        mapped_id_(0),
+        num_stalls_(0),
+        num_dropped_(0) {}
+  virtual ~PboReader() { release(); }
+
+  void allocate(size_t size, size_t depth = DEFAULT_DEPTH) {
+    release();
+    size_ = size;
+    slots_.resize(std::max<size_t>(depth, 1));
+    for (auto& slot : slots_) {
+      glGenBuffers(1, &slot.id);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.id);
+      glBufferData(GL_PIXEL_PACK_BUFFER, size_, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+
+  void release() {
+    unmap();
+    for (auto& slot : slots_) {
+      if (slot.fence) glDeleteSync(slot.fence);
+      glDeleteBuffers(1, &slot.id);
+    }
+    slots_.clear();
+    head_ = 0;
+    num_pending_ = 0;
+    num_submitted_ = 0;
+  }
+
+  bool isAllocated() const { return !slots_.empty(); }
+
+  // fbo の色を読み出して積む。リングが埋まっていたら一番古いものを捨てる
+  // fbo_id が 0 ならウィンドウの今の読み出し先を読む
+  bool readPixels(GLuint fbo_id, int attachment, GLint x, GLint y,
+                  GLsizei width, GLsizei height, GLenum format, GLenum type) {
+    Slot* slot = beginSubmit();
+    if (!slot) return false;
+    bindFramebuffer(GL_READ_FRAMEBUFFER, fbo_id);
+    if (fbo_id) glReadBuffer(GL_COLOR_ATTACHMENT0 + attachment);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->id);
+    glReadPixels(x, y, width, height, format, type, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    bindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    endSubmit(*slot);
+    return true;
+  }
+
+  bool readTexture(GLenum target, GLuint texture_id, GLenum format,
+                   GLenum type, GLint level = 0) {
+    Slot* slot = beginSubmit();
+    if (!slot) return false;
+    bindTexture(target, texture_id);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->id);
+    glGetTexImage(target, level, format, type, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    bindTexture(target, 0);
+    endSubmit(*slot);
+    return true;
+  }
+
+  // 一番古い読み出しが終わっていればマップして返す。終わっていなければ無効
+  // 使い終わったら次に積む前に unmap() する
+  View tryMap() { return mapOldest(false); }
+
+  // 一番古い読み出しが終わるまで待ってマップする
+  View map() { return mapOldest(true); }
+
+  void unmap() {
+    if (!mapped_id_) return;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, mapped_id_);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    mapped_id_ = 0;
+  }
+
+  // 終わっていれば f(view) にマップしたメモリを渡す。待たない
+  template <class F>
+  bool tryRead(F&& f) {
+    const View view = tryMap();
+    if (!view.isValid()) return false;
+    f(view);
+    unmap();
+    return true;
+  }
+
+  template <class F>
+  bool read(F&& f) {
+    const View view = map();
+    if (!view.isValid()) return false;
+    f(view);
+    unmap();
+    return true;
+  }
+
+  // 積んだままの読み出しを捨てる
+  void clear() {
+    unmap();
+    while (num_pending_ > 0) popOldest();
+  }
+
+  size_t getSize() const { return size_; }
+  size_t getDepth() const { return slots_.size(); }
+  size_t getNumPending() const { return num_pending_; }
+  bool isFull() const { return num_pending_ == slots_.size(); }
+
+  // map() で GPU を待った回数と、埋まっていて捨てた読み出しの数
+  size_t getNumStalls() const { return num_stalls_; }
+  size_t getNumDropped() const { return num_dropped_; }
+  void resetCounters() {
+    num_stalls_ = 0;
+    num_dropped_ = 0;
+  }
+
  private:
-  struct BufferData {
-    std::array<GLuint, 2> ids_;
-    const size_t width_;
-    const size_t height_;
-    const GLenum internal_format_;
-    GLenum format_;
-    GLenum type_;
-    size_t channels_;
-
-    BufferData(size_t width, size_t height, GLenum internal_format)
-        : width_(width), height_(height), internal_format_(internal_format) {
-      format_ = getGLFormatFromInternal(internal_format_);
-      type_ = getGLTypeFromInternal(internal_format_);
-      channels_ = getNumChannelsFromFormat(format_);
-
-      glGenBuffers(2, ids_.data());
-      for (int i = 0; i < 2; i++) {
-        glBindBuffer(GL_PIXEL_PACK_BUFFER, ids_[i]);
-        glBufferData(GL_PIXEL_PACK_BUFFER,
-                     width_ * height_ * getByteOfPixel(internal_format_), 0,
-                     GL_STREAM_READ);
-      }
-      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
-    }
-
-    ~BufferData() { glDeleteBuffers(2, ids_.data()); }
+  static constexpr size_t DEFAULT_DEPTH = 3;
+  static constexpr GLuint64 WAIT_TIMEOUT = 1000000;  // 1ms
+
+  struct Slot {
+    GLuint id = 0;
+    GLsync fence = nullptr;
+    uint64_t frame = 0;
   };
 
+  Slot* beginSubmit() {
+    if (slots_.empty()) {
+      logger::error("PboReader") << "Not allocated" << logger::end();
+      return nullptr;
+    }
+    unmap();
+    if (isFull()) {
+      popOldest();
+      num_dropped_++;
+    }
+    return &slots_[(head_ + num_pending_) % slots_.size()];
+  }
+
+  void endSubmit(Slot& slot) {
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.frame = num_submitted_++;
+    num_pending_++;
+  }
+
+  void popOldest() {
+    Slot& slot = slots_[head_];
+    if (slot.fence) glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+    head_ = (head_ + 1) % slots_.size();
+    num_pending_--;
+  }
+
+  View mapOldest(bool b_wait) {
+    unmap();
+    if (num_pending_ == 0) return View();
+
+    Slot& slot = slots_[head_];
+    GLenum result =
+        glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+      if (!b_wait) return View();
+      num_stalls_++;
+      do {
+        result = glClientWaitSync(slot.fence, 0, WAIT_TIMEOUT);
+      } while (result == GL_TIMEOUT_EXPIRED);
+    }
+
+    const GLuint id = slot.id;
+    const uint64_t frame = slot.frame;
+    popOldest();
+    if (result == GL_WAIT_FAILED) {
+      logger::error("PboReader")
+          << "Failed to wait for the readback" << logger::end();
+      return View();
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, id);
+    const void* ptr =
+        glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size_, GL_MAP_READ_BIT);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!ptr) {
+      logger::error("PboReader")
+          << "Failed to map the readback buffer" << logger::end();
+      return View();
+    }
+    mapped_id_ = id;
+
+    View view;
+    view.data = ptr;
+    view.size = size_;
+    view.frame = frame;
+    view.latency = num_submitted_ - 1 - frame;
+    return view;
+  }
+
+  size_t size_;
+  std::vector<Slot> slots_;
+  size_t head_;
+  size_t num_pending_;
+  uint64_t num_submitted_;
+  GLuint mapped_id_;
+  size_t num_stalls_;
+  size_t num_dropped_;
+};
+
+// テクスチャや FBO を std::vector に読み出す
+// 非同期にすると積んだ読み出しのうち終わっているものを返すので、
+// 結果は最大 getDepth() - 1 フレーム遅れる。何も返せない時は false
+class PboPacker {
  public:
-  PboPacker() : flag_(0), b_async_(false) {}
+  PboPacker()
+      : width_(0),
+        height_(0),
+        format_(GL_RGBA),
+        type_(GL_UNSIGNED_BYTE),
+        b_async_(false) {}
   virtual ~PboPacker() {}
 
-  void allocate(size_t width, size_t height, GLenum internal_format) {
-    data_ = std::make_shared<BufferData>(width, height, internal_format);
+  void allocate(size_t width, size_t height, GLenum internal_format,
+                size_t depth = 3) {
+    width_ = width;
+    height_ = height;
+    format_ = getGLFormatFromInternal(internal_format);
+    type_ = getGLTypeFromInternal(internal_format);
+    reader_.allocate(width * height * getByteOfPixel(internal_format), depth);
   }
 
   void enableAsync() { b_async_ = true; }
-  void disableAsync() { b_async_ = false; }
+  void disableAsync() {
+    b_async_ = false;
+    reader_.clear();
+  }
   bool isAsync() const { return b_async_; }
 
   template <typename T>
   bool readToPixelsFromTexture(std::vector<T>* data, GLuint target,
                                GLuint texture_id) {
-    glBindTexture(target, texture_id);
-    glBindBuffer(GL_PIXEL_PACK_BUFFER, data_->ids_[flag_]);
-
-    glGetTexImage(target, 0, data_->format_, data_->type_, nullptr);
-
-    bool res = readTo(data);
-
-    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
-    glBindTexture(target, 0);
-
-    return res;
+    if (!b_async_) reader_.clear();
+    if (!reader_.readTexture(target, texture_id, format_, type_)) return false;
+    return readTo(data);
   }
 
   template <typename T>
@@ -73,19 +276,12 @@ class PboPacker {
   template <typename T>
   bool readToPixelsFromFbo(std::vector<T>* data, GLuint fbo_id,
                            int attachment_id = 0) {
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo_id);
-    glReadBuffer(GL_COLOR_ATTACHMENT0 + attachment_id);
-
-    glBindBuffer(GL_PIXEL_PACK_BUFFER, data_->ids_[flag_]);
-    glReadPixels(0, 0, data_->width_, data_->height_, data_->format_,
-                 data_->type_, nullptr);
-
-    bool res = readTo(data);
-
-    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    return res;
+    if (!b_async_) reader_.clear();
+    if (!reader_.readPixels(fbo_id, attachment_id, 0, 0, width_, height_,
+                            format_, type_)) {
+      return false;
+    }
+    return readTo(data);
   }
 
   template <typename T>
@@ -94,104 +290,192 @@ class PboPacker {
     return readToPixelsFromFbo(data, fbo.getId(), attachment_id);
   }
 
+  PboReader& getReader() { return reader_; }
+
  private:
+  // 同期なら今積んだものを待つ。非同期ならリングが埋まった時だけ待つ
   template <typename T>
   bool readTo(std::vector<T>* data) {
-    if (b_async_)
-      flag_ = (flag_ + 1) % 2;
-    else
-      flag_ = 0;
+    auto copy = [data](const PboReader::View& view) {
+      const size_t size = std::min(view.size, data->size() * sizeof(T));
+      std::memcpy(data->data(), view.data, size);
+    };
+    if (!b_async_ || reader_.isFull()) return reader_.read(copy);
+    return reader_.tryRead(copy);
+  }
+
+  PboReader reader_;
+  size_t width_;
+  size_t height_;
+  GLenum format_;
+  GLenum type_;
+  bool b_async_;
+};
 
-    glBindBuffer(GL_PIXEL_PACK_BUFFER, data_->ids_[flag_]);
+// PBO を通してテクスチャに書き込む
+// 既定では毎回バッファを orphan して GPU の使用中を待たずに書く
+// setOrphaning(false) では N 個の PBO をフェンスで守りながら順に使う
+class PboUnpacker : private Noncopyable {
+ public:
+  PboUnpacker()
+      : format_(GL_RGBA),
+        type_(GL_UNSIGNED_BYTE),
+        channels_(4),
+        size_(0),
+        index_(0),
+        b_orphaning_(true),
+        num_stalls_(0) {}
+  virtual ~PboUnpacker() { release(); }
+
+  void allocate(size_t width, size_t height, GLenum internal_format,
+                size_t depth = 3) {
+    format_ = getGLFormatFromInternal(internal_format);
+    type_ = getGLTypeFromInternal(internal_format);
+    channels_ = getNumChannelsFromFormat(format_);
+    allocateBytes(width * height * getByteOfPixel(internal_format), depth);
+  }
 
-    T* ptr = (T*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
-    if (ptr != nullptr) {
-      std::copy(ptr, ptr + data->size(), data->begin());
-      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  // 圧縮テクスチャなど、大きさをバイトで決める時に使う
+  void allocateBytes(size_t size, size_t depth = 3) {
+    release();
+    size_ = size;
+    slots_.resize(std::max<size_t>(depth, 1));
+    for (auto& slot : slots_) {
+      glGenBuffers(1, &slot.id);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.id);
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, size_, nullptr, GL_STREAM_DRAW);
     }
-
-    return (ptr != nullptr);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
   }
 
-  std::shared_ptr<BufferData> data_;
-  uint flag_;
-  bool b_async_;
-};
+  void release() {
+    for (auto& slot : slots_) {
+      if (slot.fence) glDeleteSync(slot.fence);
+      glDeleteBuffers(1, &slot.id);
+    }
+    slots_.clear();
+    index_ = 0;
+  }
 
-class PboUnpacker {
- private:
-  struct BufferData {
-    std::array<GLuint, 2> ids_;
-    const size_t width_;
-    const size_t height_;
-    const GLenum internal_format_;
-    GLenum format_;
-    GLenum type_;
-    size_t channels_;
-
-    BufferData(size_t width, size_t height, GLenum internal_format)
-        : width_(width), height_(height), internal_format_(internal_format) {
-      format_ = getGLFormatFromInternal(internal_format_);
-      type_ = getGLTypeFromInternal(internal_format_);
-      channels_ = getNumChannelsFromFormat(format_);
-
-      glGenBuffers(2, ids_.data());
-      for (int i = 0; i < 2; i++) {
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ids_[i]);
-        glBufferData(GL_PIXEL_UNPACK_BUFFER,
-                     width_ * height_ * getByteOfPixel(internal_format_), 0,
-                     GL_STREAM_DRAW);
-      }
-      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
-    }
-
-    ~BufferData() { glDeleteBuffers(2, ids_.data()); }
-  };
+  void setOrphaning(bool b_orphaning) { b_orphaning_ = b_orphaning; }
+  bool isOrphaning() const { return b_orphaning_; }
 
- public:
-  PboUnpacker() : flag_(0), b_async_(false) {}
-  virtual ~PboUnpacker() {}
+  // 以前の 2 枚のピンポンは setOrphaning(false) のリングに置き換えた
+  [[deprecated("use setOrphaning(false)")]] void enableAsync() {
+    setOrphaning(false);
+  }
+  [[deprecated("use setOrphaning(true)")]] void disableAsync() {
+    setOrphaning(true);
+  }
+  [[deprecated("use isOrphaning()")]] bool isAsync() const {
+    return !b_orphaning_;
+  }
 
-  void allocate(size_t width, size_t height, GLenum internal_format) {
-    data_ = std::make_shared<BufferData>(width, height, internal_format);
+  // fill(ptr) でマップしたメモリに直接書いてもらい、テクスチャに送る
+  template <class F>
+  bool write(GLuint tex_id, GLsizei width, GLsizei height, GLsizei offset_x,
+             GLsizei offset_y, F&& fill) {
+    return write(size_, fill, [&] {
+      bindTexture(GL_TEXTURE_2D, tex_id);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, offset_x, offset_y, width, height,
+                      format_, type_, nullptr);
+      bindTexture(GL_TEXTURE_2D, 0);
+    });
   }
 
-  void enableAsync() { b_async_ = true; }
-  void disableAsync() { b_async_ = false; }
-  bool isAsync() const { return b_async_; }
+  // fill(ptr) で size バイトを書き、PBO をバインドしたまま submit() を呼ぶ
+  // 圧縮テクスチャのように glTexSubImage2D 以外で送る時に使う
+  template <class F, class S>
+  bool write(size_t size, F&& fill, S&& submit) {
+    if (slots_.empty()) {
+      logger::error("PboUnpacker") << "Not allocated" << logger::end();
+      return false;
+    }
+    if (size > size_) {
+      logger::error("PboUnpacker")
+          << "Data exceed the buffer size" << logger::end();
+      return false;
+    }
+
+    Slot& slot = b_orphaning_ ? slots_[0] : slots_[index_];
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.id);
+    GLbitfield access = GL_MAP_WRITE_BIT;
+    if (b_orphaning_) {
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, size_, nullptr, GL_STREAM_DRAW);
+      access |= GL_MAP_INVALIDATE_BUFFER_BIT;
+    } else {
+      waitForSlot(slot);
+      access |= GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+    }
+
+    void* ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, access);
+    if (!ptr) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      return false;
+    }
+    fill(ptr);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    submit();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (!b_orphaning_) {
+      slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      index_ = (index_ + 1) % slots_.size();
+    }
+    return true;
+  }
 
   template <typename T>
   bool setFromPixels(GLuint tex_id, std::vector<T>& data, GLsizei width,
                      GLsizei height, GLsizei offset_x = 0,
                      GLsizei offset_y = 0) {
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, data_->ids_[flag_]);
+    const size_t count =
+        std::min<size_t>(width * height * channels_, data.size());
+    if (count * sizeof(T) > size_) {
+      logger::error("PboUnpacker")
+          << "Pixels exceed the buffer size" << logger::end();
+      return false;
+    }
+    return write(tex_id, width, height, offset_x, offset_y, [&](void* ptr) {
+      std::memcpy(ptr, data.data(), count * sizeof(T));
+    });
+  }
 
-    T* ptr = (T*)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
-    if (!ptr) return false;
-    T* front = &data[0];
-    std::copy(front, front + width * height * data_->channels_, ptr);
-    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  size_t getNumStalls() const { return num_stalls_; }
+  void resetCounters() { num_stalls_ = 0; }
 
-    if (b_async_)
-      flag_ = (flag_ + 1) % 2;
-    else
-      flag_ = 0;
+ private:
+  static constexpr GLuint64 WAIT_TIMEOUT = 1000000;  // 1ms
 
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, data_->ids_[flag_]);
-    glBindTexture(GL_TEXTURE_2D, tex_id);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, offset_x, offset_y, width, height,
-                    data_->format_, data_->type_, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  struct Slot {
+    GLuint id = 0;
+    GLsync fence = nullptr;
+  };
 
-    return true;
+  void waitForSlot(Slot& slot) {
+    if (!slot.fence) return;
+    GLenum result = glClientWaitSync(slot.fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+      num_stalls_++;
+      do {
+        result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                  WAIT_TIMEOUT);
+      } while (result == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
   }
 
- private:
-  std::shared_ptr<BufferData> data_;
-  uint flag_;
-  bool b_async_;
+  std::vector<Slot> slots_;
+  GLenum format_;
+  GLenum type_;
+  size_t channels_;
+  size_t size_;
+  size_t index_;
+  bool b_orphaning_;
+  size_t num_stalls_;
 };
 
 }  // namespace gl
-}  // namespace limas
\ No newline at end of file
+}  // namespace limas
@@ -0,0 +1,117 @@
+#pragma once
+#include "gl/ShaderBase.h"
+#include "gl/StreamBuffer.h"
+#include "gl/Vao.h"
+
+namespace limas {
+namespace gl {
+
+// 変換済みの頂点を溜めて 1 回の描画にまとめる
+// モード・テクスチャ・シェーダーが同じ間だけ追加でき、違えば先に draw() する
+class PrimitiveBatch {
+ public:
+  struct Vertex {
+    glm::vec3 position;
+    glm::vec4 color;
+    glm::vec2 texcoord;
+  };
+
+  struct Key {
+    GLenum mode = GL_TRIANGLES;
+    GLuint tex_id = 0;
+    ShaderBase* shader = nullptr;
+
+    bool operator==(const Key& rhs) const {
+      return mode == rhs.mode && tex_id == rhs.tex_id && shader == rhs.shader;
+    }
+    bool operator!=(const Key& rhs) const { return !(*this == rhs); }
+  };
+
+  explicit PrimitiveBatch(size_t capacity = DEFAULT_CAPACITY)
+      : capacity_(0), num_draws_(0), num_vertices_drawn_(0) {
+    reserve(capacity);
+  }
+
+  // 同じ状態のまま count 頂点を追加できるか
+  bool canAppend(const Key& key, size_t count) const {
+    return vertices_.empty() ||
+           (key == key_ && vertices_.size() + count <= capacity_);
+  }
+
+  // canAppend() が false なら先に draw() しておく
+  Vertex* append(const Key& key, size_t count) {
+    if (vertices_.empty()) key_ = key;
+    if (count > capacity_) reserve(count);
+    size_t offset = vertices_.size();
+    vertices_.resize(offset + count);
+    return vertices_.data() + offset;
+  }
+
+  // シェーダーと uniform は呼び出し側で設定しておく
+  void draw() {
+    if (vertices_.empty()) return;
+
+    // 頂点の大きさで揃えて、書いた位置を first として描画する
+    const GLsizeiptr stride = sizeof(Vertex);
+    const auto range = stream_->write(vertices_.data(),
+                                      vertices_.size() * stride, stride);
+    if (range.isValid()) {
+      vao_.drawArrays(key_.mode, range.offset / stride, vertices_.size());
+    }
+
+    num_draws_++;
+    num_vertices_drawn_ += vertices_.size();
+    vertices_.clear();
+  }
+
+  void clear() { vertices_.clear(); }
+
+  // フレームの終わりに呼ぶ
+  void endFrame() { stream_->endFrame(); }
+
+  bool isEmpty() const { return vertices_.empty(); }
+  const StreamBuffer& getStreamBuffer() const { return *stream_; }
+  const Key& getKey() const { return key_; }
+  size_t getNumVertices() const { return vertices_.size(); }
+
+  // resetCounters() からの描画回数と頂点数
+  size_t getNumDraws() const { return num_draws_; }
+  size_t getNumVerticesDrawn() const { return num_vertices_drawn_; }
+  void resetCounters() {
+    num_draws_ = 0;
+    num_vertices_drawn_ = 0;
+  }
+
+ private:
+  static constexpr size_t DEFAULT_CAPACITY = 1 << 16;
+
+  void reserve(size_t capacity) {
+    if (stream_ && capacity <= capacity_) return;
+    capacity_ = std::max(capacity_, capacity);
+    vertices_.reserve(capacity_);
+
+    // 古いバッファは GPU が使い終わってから GL が消す
+    stream_ = std::make_unique<StreamBuffer>(capacity_ * sizeof(Vertex));
+    const GLuint id = stream_->getId();
+    const GLsizei stride = sizeof(Vertex);
+    vao_.bindVbo(id, POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, stride,
+                 (void*)offsetof(Vertex, position));
+    vao_.bindVbo(id, COLOR_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, stride,
+                 (void*)offsetof(Vertex, color));
+    vao_.bindVbo(id, TEXCOORD_ATTRIBUTE, 2, GL_FLOAT, GL_FALSE, stride,
+                 (void*)offsetof(Vertex, texcoord));
+  }
+
+  Key key_;
+  std::vector<Vertex> vertices_;
+  size_t capacity_;
+
+  Vao vao_;
+  std::unique_ptr<StreamBuffer> stream_;
+
+  size_t num_draws_;
+  size_t num_vertices_drawn_;
+};
+
+}  // namespace gl
+}  // namespace limas
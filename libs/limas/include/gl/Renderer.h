@@ -1,5 +1,9 @@
 #pragma once
 #include "gl/GL.h"
+#include "gl/PrimitiveBatch.h"
+#include "gl/TextBatch.h"
+#include "gl/Ubo.h"
+#include "gl/UniformRing.h"
 #include "graphics/BitmapFont.h"
 #include "graphics/BitmapFontLarge.h"
 #include "graphics/Color.h"
@@ -21,8 +25,45 @@ struct DefaultUniforms {
   bool b_instanced = false;
 };
 
+// shaders/uniforms.glsl の std140 のブロックと同じ並び
+struct FrameUniforms {
+  glm::vec2 resolution = glm::vec2(0);
+  float time = 0;
+  GLint frame = 0;
+};
+
+struct DrawUniforms {
+  glm::mat4 mvp_mat;
+  glm::mat4 tex_mat;
+  glm::vec4 color;
+  GLint use_tex;
+  GLint has_color;
+  GLint has_normal;
+  GLint has_texcoord;
+  GLint instanced;
+  GLint padding[3];
+};
+static_assert(sizeof(FrameUniforms) == 16);
+static_assert(sizeof(DrawUniforms) == 176);
+
+struct DefaultUniformHandles {
+  uint64_t link_id = 0;
+  bool b_draw_block = false;  // DrawUniforms を使うシェーダーか
+  ShaderBase::Uniform<glm::mat4> mvp_mat;
+  ShaderBase::Uniform<glm::mat4> tex_mat;
+  ShaderBase::Uniform<glm::vec4> color;
+  ShaderBase::Uniform<GLint> use_tex;
+  ShaderBase::Uniform<GLint> tex;
+  ShaderBase::Uniform<GLint> has_color;
+  ShaderBase::Uniform<GLint> has_normal;
+  ShaderBase::Uniform<GLint> has_texcoord;
+  ShaderBase::Uniform<GLint> instanced;
+};
+
 class Renderer : private Noncopyable {
   Shader def_shader_;
+  Shader sdf_shader_;
+  Shader mesh_batch_shader_;
   ShaderBase* current_shader_;
   bool b_should_unbind_;
 
@@ -42,11 +83,29 @@ class Renderer : private Noncopyable {
 
   BitmapFont font_;
   BitmapFontLarge font_large_;
+  TextBatch text_batch_;
 
   Stack<DefaultUniforms> uniforms_stack_;
+  std::unordered_map<GLuint, DefaultUniformHandles> uniform_handles_;
+
+  // FrameUniforms はリングに置くと領域ごと使い回されて上書きされるので分ける
+  Ubo<FrameUniforms> frame_ubo_;
+  UniformRing draw_ring_;
+  DrawUniforms last_draw_uniforms_;
+  bool b_draw_uniforms_bound_;
 
   MatrixStack matrix_stack_;
 
+  PrimitiveBatch batch_;
+  bool b_batching_;
+  std::vector<glm::vec3> unit_circle_;
+  // appendBatch() で追加する頂点に使う状態
+  glm::mat4 batch_matrix_;
+  glm::vec4 batch_color_;
+  glm::mat4 batch_tex_mat_;
+
+  GpuProfiler* profiler_;
+
  public:
   using Ptr = std::shared_ptr<Renderer>;
   static Ptr create() {
@@ -67,23 +126,106 @@ class Renderer : private Noncopyable {
     cylinder_ = prim::Cylinder(1, 1, 32, 2);
     cone_ = prim::Cone(1, 1, 32, 2);
 
+    prim::Circle circle(glm::vec3(0), 1, 256);
+    unit_circle_ = circle.getVertices();
+
     // box_wire
     font_.load();
     font_large_.load();
 
     def_shader_.load(fs::getCommonResourcePath("shaders/default.vert"),
                      fs::getCommonResourcePath("shaders/default.frag"));
+    sdf_shader_.load(fs::getCommonResourcePath("shaders/default.vert"),
+                     fs::getCommonResourcePath("shaders/sdf.frag"));
+    mesh_batch_shader_.load(
+        fs::getCommonResourcePath("shaders/mesh_batch.vert"),
+        fs::getCommonResourcePath("shaders/default.frag"));
     current_shader_ = &def_shader_;
     b_should_unbind_ = true;
+    b_batching_ = false;
+    b_draw_uniforms_bound_ = false;
+    profiler_ = nullptr;
+
+    const FrameUniforms frame_uniforms;
+    frame_ubo_.allocate(&frame_uniforms, 1, GL_DYNAMIC_DRAW);
+    setFrameUniforms(frame_uniforms);
 
     uniforms_stack_.push(DefaultUniforms());
   }
 
+  // フレームの最初に一度だけ送り、全てのシェーダーで共有する
+  void setFrameUniforms(const FrameUniforms& uniforms) {
+    frame_ubo_.update(&uniforms, 1);
+    frame_ubo_.bindBufferBase(FRAME_UNIFORMS_BINDING);
+    // 他のコードにバインディングポイントを変えられていても戻す
+    b_draw_uniforms_bound_ = false;
+  }
+
+  const UniformRing& getDrawUniformRing() const { return draw_ring_; }
+
+  // 全てのウィンドウを描き終えたら呼ぶ
+  // 今フレームに書いたストリーミングバッファの領域にフェンスを置く
+  void endFrame() {
+    flush();
+    batch_.endFrame();
+    draw_ring_.endFrame();
+  }
+
+  // 有効にすると 2D の図形を CPU で変換して溜め、状態が変わった時か
+  // flush() でまとめて描画する
+  // FBO やブレンドなどの GL の状態、シェーダーの uniform を直接変える前には
+  // flush() を呼ぶ
+  void setBatching(bool b_batching) {
+    if (!b_batching) flush();
+    b_batching_ = b_batching;
+  }
+  bool isBatching() const { return b_batching_; }
+
+  // 設定するとまとめた描画の GPU の時間を区間として記録する
+  void setProfiler(GpuProfiler* profiler) { profiler_ = profiler; }
+  GpuProfiler* getProfiler() const { return profiler_; }
+
+  void flush() {
+    if (batch_.isEmpty()) return;
+
+    const auto key = batch_.getKey();
+    ShaderBase* bound_shader = ShaderBase::getCurrentShader();
+    ShaderBase* current_shader = current_shader_;
+    current_shader_ = key.shader;
+    if (bound_shader != key.shader) key.shader->bind();
+
+    DefaultUniforms uniforms;
+    uniforms.tex_id = key.tex_id;
+    uniforms.has_color = true;
+    uniforms.has_texcoord = true;
+    uniforms_stack_.push(uniforms);
+    pushMatrix();
+    loadIdentity();
+    setUniforms();
+    {
+      GpuProfiler::Scope scope(profiler_, "batch");
+      batch_.draw();
+    }
+    popMatrix();
+    uniforms_stack_.pop();
+
+    if (bound_shader != key.shader) {
+      key.shader->unbind();
+      if (bound_shader) bound_shader->bind();
+    }
+    current_shader_ = current_shader;
+  }
+
+  const PrimitiveBatch& getBatch() const { return batch_; }
+  PrimitiveBatch& getBatch() { return batch_; }
+
   void drawArrays(GLenum type, GLsizei first, GLsizei count) {
+    flush();
     vao_.drawArrays(type, first, count);
   }
 
   void drawArrays(const Vao& vao, GLenum mode, GLint count) {
+    flush();
     auto& uniforms = uniforms_stack_.push().get();
     uniforms.has_color = vao.isAttributeEnabled(COLOR_ATTRIBUTE);
     uniforms.has_normal = vao.isAttributeEnabled(NORMAL_ATTRIBUTE);
@@ -95,6 +237,7 @@ class Renderer : private Noncopyable {
   }
 
   void drawElements(const Vao& vao, GLenum mode, GLint count) {
+    flush();
     auto& uniforms = uniforms_stack_.push().get();
     uniforms.has_color = vao.isAttributeEnabled(COLOR_ATTRIBUTE);
     uniforms.has_normal = vao.isAttributeEnabled(NORMAL_ATTRIBUTE);
@@ -107,6 +250,7 @@ class Renderer : private Noncopyable {
 
   void drawArraysInstanced(const Vao& vao, GLenum mode, GLint count,
                            GLint instance_count) {
+    flush();
     auto& uniforms = uniforms_stack_.push().get();
     uniforms.has_color = vao.isAttributeEnabled(COLOR_ATTRIBUTE);
     uniforms.has_normal = vao.isAttributeEnabled(NORMAL_ATTRIBUTE);
@@ -120,6 +264,7 @@ class Renderer : private Noncopyable {
 
   void drawElementsInstanced(const Vao& vao, GLenum mode, GLint count,
                              GLint instance_count) {
+    flush();
     auto& uniforms = uniforms_stack_.push().get();
     uniforms.has_color = vao.isAttributeEnabled(COLOR_ATTRIBUTE);
     uniforms.has_normal = vao.isAttributeEnabled(NORMAL_ATTRIBUTE);
@@ -165,37 +310,86 @@ class Renderer : private Noncopyable {
     drawInstanced(mesh, mode, count, instance_count);
   }
 
+  // cull() していれば見えるインスタンスだけを間接描画する
+  template <class V, class N, class C, class T>
+  void drawMeshInstanced(const BasePackedInstancedVboMesh<V, N, C, T>& mesh,
+                         GLenum mode) {
+    flush();
+    auto& vao = mesh.getVao();
+    auto& uniforms = uniforms_stack_.push().get();
+    uniforms.has_color = vao.isAttributeEnabled(COLOR_ATTRIBUTE);
+    uniforms.has_normal = vao.isAttributeEnabled(NORMAL_ATTRIBUTE);
+    uniforms.has_texcoord = vao.isAttributeEnabled(TEXCOORD_ATTRIBUTE);
+    uniforms.b_instanced = true;
+    bindShader();
+    mesh.drawInstances(mode);
+    unbindShader();
+    uniforms_stack_.pop();
+  }
+
+  // まとめたメッシュを 1 回で描画する
+  // シェーダーを指定していなければ shaders/mesh_batch.vert を使う
+  template <class V, class N, class C, class T>
+  void drawMeshBatch(BaseMeshBatch<V, N, C, T>& batch,
+                     GLenum mode = GL_TRIANGLES) {
+    flush();
+    ShaderBase* current_shader = current_shader_;
+    if (current_shader_ == &def_shader_) current_shader_ = &mesh_batch_shader_;
+
+    auto& uniforms = uniforms_stack_.push().get();
+    uniforms.has_color = true;
+    uniforms.has_normal = true;
+    uniforms.has_texcoord = true;
+    bindShader();
+    {
+      GpuProfiler::Scope scope(profiler_, "mesh_batch");
+      batch.draw(*current_shader_, mode);
+    }
+    unbindShader();
+    uniforms_stack_.pop();
+    current_shader_ = current_shader;
+  }
+
   template <class V>
   void drawPolyline(const BaseVboPolyline<V>& poly, GLenum mode) {
     draw(poly, mode, poly.getNumVertices());
   }
 
-  void drawBitmapString(const std::string& text, const glm::vec3& p) {
-    auto meshes = font_.getMeshes(text);
-    bindTexture(font_.getTexture().getId());
-    for (int i = 0; i < meshes.size(); i++) {
-      pushMatrix();
-      translate(
-          p + glm::vec3(i * (font_.getCharacterWidth() + font_.getSpaceWidth()),
-                        0, 0));
-      drawMesh(*meshes[i], GL_TRIANGLE_FAN);
-      popMatrix();
+  // 文字列全体を 1 回で描画する。同じ文字列のレイアウトは使い回す
+  // SDF のフォントはシェーダーを指定していなければ輪郭用のシェーダーで描く
+  template <class FontType>
+  void drawString(FontType& font, const std::string& text, const glm::vec3& p,
+                  float scale_factor = 1) {
+    const auto& layout = text_batch_.getLayout(font, text);
+    if (layout.num_vertices == 0) return;
+
+    ShaderBase* current_shader = current_shader_;
+    if constexpr (requires { font.isSdf(); }) {
+      if (font.isSdf() && current_shader_ == &def_shader_) {
+        current_shader_ = &sdf_shader_;
+      }
     }
+
+    pushMatrix();
+    translate(p);
+    if (scale_factor != 1) scale(glm::vec3(scale_factor, scale_factor, 1));
+    bindTexture(font.getTexture().getId());
+    drawArrays(layout.vao, GL_TRIANGLES, layout.num_vertices);
     unbindTexture();
+    popMatrix();
+    current_shader_ = current_shader;
+  }
+
+  void drawBitmapString(const std::string& text, const glm::vec3& p) {
+    drawString(font_, text, p);
   }
 
   void drawLargeBitmapString(const std::string& text, const glm::vec3& p) {
-    auto meshes = font_large_.getMeshes(text);
-    bindTexture(font_large_.getTexture().getId());
-    for (int i = 0; i < meshes.size(); i++) {
-      pushMatrix();
-      translate(p + glm::vec3(i * font_large_.getCharacterWidth(), 0, 0));
-      drawMesh(*meshes[i], GL_TRIANGLE_FAN);
-      popMatrix();
-    }
-    unbindTexture();
+    drawString(font_large_, text, p);
   }
 
+  TextBatch& getTextBatch() { return text_batch_; }
+
   size_t getBitmapStringWidth(const std::string& text) const {
     return font_.getSize(text);
   }
@@ -203,6 +397,10 @@ class Renderer : private Noncopyable {
   size_t getBitmapStringHeight() const { return font_.getCharacterWidth(); }
 
   void drawDot(const glm::vec3& p) {
+    if (auto v = appendBatch(GL_POINTS, 1)) {
+      setBatchVertex(v[0], p);
+      return;
+    }
     pushMatrix();
     translate(p);
     drawMesh(dot, GL_POINTS);
@@ -210,6 +408,11 @@ class Renderer : private Noncopyable {
   }
 
   void drawSegment(const glm::vec3& p0, const glm::vec3& p1) {
+    if (auto v = appendBatch(GL_LINES, 2)) {
+      setBatchVertex(v[0], p0);
+      setBatchVertex(v[1], p1);
+      return;
+    }
     glm::vec3 src_dir = glm::vec3(0.57735);
     glm::vec3 dst_dir = glm::normalize(p1 - p0);
     float cos_theta = glm::dot(src_dir, dst_dir);
@@ -226,6 +429,14 @@ class Renderer : private Noncopyable {
   }
 
   void drawRectangle(const glm::vec3& p, float w, float h) {
+    if (auto v = appendBatch(GL_TRIANGLES, 6)) {
+      const int order[] = {0, 1, 2, 0, 2, 3};
+      for (int i = 0; i < 6; i++) {
+        glm::vec2 t = RECTANGLE_CORNERS[order[i]];
+        setBatchVertex(v[i], p + glm::vec3(t.x * w, t.y * h, 0), t);
+      }
+      return;
+    }
     pushMatrix();
     translate(p);
     scale(glm::vec3(w, h, 1));
@@ -234,6 +445,13 @@ class Renderer : private Noncopyable {
   }
 
   void drawWireRectangle(const glm::vec3& p, float w, float h) {
+    if (auto v = appendBatch(GL_LINES, 8)) {
+      for (int i = 0; i < 8; i++) {
+        glm::vec2 t = RECTANGLE_CORNERS[((i + 1) / 2) % 4];
+        setBatchVertex(v[i], p + glm::vec3(t.x * w, t.y * h, 0), t);
+      }
+      return;
+    }
     pushMatrix();
     translate(p);
     scale(glm::vec3(w, h, 1));
@@ -242,6 +460,7 @@ class Renderer : private Noncopyable {
   }
 
   void drawEllipse(const glm::vec3& p, float a, float b) {
+    if (b_batching_ && appendEllipse(p, a, b)) return;
     pushMatrix();
     translate(p);
     scale(glm::vec3(a, b, 1));
@@ -250,6 +469,7 @@ class Renderer : private Noncopyable {
   }
 
   void drawWireEllipse(const glm::vec3& p, float a, float b) {
+    if (b_batching_ && appendWireEllipse(p, a, b)) return;
     pushMatrix();
     translate(p);
     scale(glm::vec3(a, b, 1));
@@ -258,6 +478,7 @@ class Renderer : private Noncopyable {
   }
 
   void drawCircle(const glm::vec3& p, float r) {
+    if (b_batching_ && appendEllipse(p, r, r)) return;
     pushMatrix();
     translate(p);
     scale(glm::vec3(r, r, 1));
@@ -266,6 +487,7 @@ class Renderer : private Noncopyable {
   }
 
   void drawWireCircle(const glm::vec3& p, float r) {
+    if (b_batching_ && appendWireEllipse(p, r, r)) return;
     pushMatrix();
     translate(p);
     scale(glm::vec3(r, r, 1));
@@ -322,13 +544,9 @@ class Renderer : private Noncopyable {
   }
 
   void drawTexture(GLuint tex, const glm::vec3& p, float w, float h) {
-    pushMatrix();
-    translate(p);
-    scale(glm::vec3(w, h, 1));
     bindTexture(tex);
-    drawMesh(rectangle_, GL_TRIANGLE_FAN);
+    drawRectangle(p, w, h);
     unbindTexture();
-    popMatrix();
   }
 
   MatrixStack& pushMatrix() { return matrix_stack_.push(); }
@@ -393,29 +611,33 @@ class Renderer : private Noncopyable {
 
   void setUniforms() {
     auto& uniforms = uniforms_stack_.get();
-    current_shader_->setUniformMatrix4f("MVP_MAT", matrix_stack_.top());
-    current_shader_->setUniform4f("COLOR", uniforms.color);
+    const auto& h = getUniformHandles(*current_shader_);
+    if (h.b_draw_block) {
+      setDrawUniforms(uniforms);
+      current_shader_->setUniformTexture(h.tex, GL_TEXTURE_2D, uniforms.tex_id,
+                                         0);
+      return;
+    }
+
+    current_shader_->setUniform(h.mvp_mat, matrix_stack_.top());
+    current_shader_->setUniform(h.color, uniforms.color);
 
     if (uniforms.tex_id > 0) {
-      current_shader_->setUniform1i("USE_TEX", true);
-      current_shader_->setUniformTexture("TEX", GL_TEXTURE_2D, uniforms.tex_id,
+      current_shader_->setUniform(h.use_tex, GLint(true));
+      current_shader_->setUniformTexture(h.tex, GL_TEXTURE_2D, uniforms.tex_id,
                                          0);
 
     } else {
-      current_shader_->setUniform1i("USE_TEX", false);
-      current_shader_->setUniformTexture("TEX", GL_TEXTURE_2D, 0, 0);
+      current_shader_->setUniform(h.use_tex, GLint(false));
+      current_shader_->setUniformTexture(h.tex, GL_TEXTURE_2D, 0, 0);
     }
 
-    current_shader_->setUniformMatrix4f("TEX_MAT", uniforms.tex_mat);
+    current_shader_->setUniform(h.tex_mat, uniforms.tex_mat);
 
-    current_shader_->setUniform1i("HAS_COLOR", uniforms.has_color);
-    current_shader_->setUniform1i("HAS_NORMAL", uniforms.has_normal);
-    current_shader_->setUniform1i("HAS_TEXCOORD", uniforms.has_texcoord);
-    if (uniforms.b_instanced) {
-      current_shader_->setUniform1i("INSTANCED", true);
-    } else {
-      current_shader_->setUniform1i("INSTANCED", false);
-    }
+    current_shader_->setUniform(h.has_color, GLint(uniforms.has_color));
+    current_shader_->setUniform(h.has_normal, GLint(uniforms.has_normal));
+    current_shader_->setUniform(h.has_texcoord, GLint(uniforms.has_texcoord));
+    current_shader_->setUniform(h.instanced, GLint(uniforms.b_instanced));
   }
 
   void bindTexture(GLuint tex_id) {
@@ -471,6 +693,114 @@ class Renderer : private Noncopyable {
   void addIndex(int i) { legacy_params_.indices.push_back(i); }
 
  private:
+  static inline const glm::vec2 RECTANGLE_CORNERS[4] = {
+      {0, 0}, {1, 0}, {1, 1}, {0, 1}};
+
+  // 前の描画と同じ値ならバッファに書かず、バインドされている範囲を使う
+  void setDrawUniforms(const DefaultUniforms& uniforms) {
+    DrawUniforms block = {};
+    block.mvp_mat = matrix_stack_.top();
+    block.tex_mat = uniforms.tex_mat;
+    block.color = glm::vec4(uniforms.color[0], uniforms.color[1],
+                            uniforms.color[2], uniforms.color[3]);
+    block.use_tex = uniforms.tex_id > 0;
+    block.has_color = uniforms.has_color;
+    block.has_normal = uniforms.has_normal;
+    block.has_texcoord = uniforms.has_texcoord;
+    block.instanced = uniforms.b_instanced;
+
+    if (b_draw_uniforms_bound_ &&
+        std::memcmp(&block, &last_draw_uniforms_, sizeof(block)) == 0) {
+      return;
+    }
+    draw_ring_.push(DRAW_UNIFORMS_BINDING, &block, sizeof(block));
+    last_draw_uniforms_ = block;
+    b_draw_uniforms_bound_ = true;
+  }
+
+  // シェーダーごとに既定の uniform のハンドルを引いておき、名前で探さない
+  const DefaultUniformHandles& getUniformHandles(const ShaderBase& shader) {
+    auto& h = uniform_handles_[shader.getProgram()];
+    if (h.link_id == shader.getLinkId()) return h;
+
+    h.link_id = shader.getLinkId();
+    h.b_draw_block = shader.hasUniformBlock("DrawUniforms");
+    h.mvp_mat = shader.getUniform<glm::mat4>("MVP_MAT");
+    h.tex_mat = shader.getUniform<glm::mat4>("TEX_MAT");
+    h.color = shader.getUniform<glm::vec4>("COLOR");
+    h.use_tex = shader.getUniform<GLint>("USE_TEX");
+    h.tex = shader.getUniform<GLint>("TEX");
+    h.has_color = shader.getUniform<GLint>("HAS_COLOR");
+    h.has_normal = shader.getUniform<GLint>("HAS_NORMAL");
+    h.has_texcoord = shader.getUniform<GLint>("HAS_TEXCOORD");
+    h.instanced = shader.getUniform<GLint>("INSTANCED");
+    return h;
+  }
+
+  ShaderBase* getActiveShader() const {
+    auto shader = ShaderBase::getCurrentShader();
+    return shader ? shader : current_shader_;
+  }
+
+  // 現在の行列がアフィン変換の時だけ CPU で変換できるのでバッチに積む
+  // 積めない時は nullptr を返し、呼び出し側は通常の描画をする
+  PrimitiveBatch::Vertex* appendBatch(GLenum mode, size_t count) {
+    if (!b_batching_) return nullptr;
+
+    const auto& m = matrix_stack_.top();
+    if (m[0][3] != 0 || m[1][3] != 0 || m[2][3] != 0 || m[3][3] != 1) {
+      flush();
+      return nullptr;
+    }
+
+    const auto& uniforms = uniforms_stack_.get();
+    PrimitiveBatch::Key key;
+    key.mode = mode;
+    key.tex_id = uniforms.tex_id;
+    key.shader = getActiveShader();
+    if (!batch_.canAppend(key, count)) flush();
+
+    batch_matrix_ = m;
+    batch_color_ = glm::vec4(uniforms.color[0], uniforms.color[1],
+                             uniforms.color[2], uniforms.color[3]);
+    batch_tex_mat_ = uniforms.tex_mat;
+    return batch_.append(key, count);
+  }
+
+  void setBatchVertex(PrimitiveBatch::Vertex& v, const glm::vec3& p,
+                      const glm::vec2& t = glm::vec2(0)) {
+    v.position = glm::vec3(batch_matrix_ * glm::vec4(p, 1));
+    v.color = batch_color_;
+    v.texcoord = glm::vec2(batch_tex_mat_ * glm::vec4(t, 0, 1));
+  }
+
+  bool appendEllipse(const glm::vec3& p, float a, float b) {
+    const size_t n = unit_circle_.size();
+    auto v = appendBatch(GL_TRIANGLES, (n - 2) * 3);
+    if (!v) return false;
+
+    const glm::vec3 radius(a, b, 1);
+    const glm::vec3 pivot = p + unit_circle_[0] * radius;
+    for (size_t i = 1; i + 1 < n; i++) {
+      setBatchVertex(*v++, pivot);
+      setBatchVertex(*v++, p + unit_circle_[i] * radius);
+      setBatchVertex(*v++, p + unit_circle_[i + 1] * radius);
+    }
+    return true;
+  }
+
+  bool appendWireEllipse(const glm::vec3& p, float a, float b) {
+    const size_t n = unit_circle_.size();
+    auto v = appendBatch(GL_LINES, n * 2);
+    if (!v) return false;
+
+    const glm::vec3 radius(a, b, 1);
+    for (size_t i = 0; i < n; i++) {
+      setBatchVertex(*v++, p + unit_circle_[i] * radius);
+      setBatchVertex(*v++, p + unit_circle_[(i + 1) % n] * radius);
+    }
+    return true;
+  }
 };
 
 }  // namespace gl
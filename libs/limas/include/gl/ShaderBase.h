@@ -1,4 +1,5 @@
 #pragma once
+#include "gl/Context.h"
 #include "gl/TextureBase.h"
 #include "graphics/Color.h"
 #include "system/Logger.h"
@@ -13,13 +14,31 @@
 #define SCALE_ATTRIBUTE 6
 #define INSTANCE_COLOR_ATTRIBUTE 7
 
+#define DRAW_ID_ATTRIBUTE 8
+
+#define FRAME_UNIFORMS_BINDING 0
+#define DRAW_UNIFORMS_BINDING 1
+
 namespace limas {
 namespace gl {
 
 class ShaderBase {
  protected:
+  // uniform の場所と最後に設定した値
+  struct UniformSlot {
+    GLint location = -1;
+    size_t offset = 0;
+    size_t size = 0;  // 0 なら値を覚えない
+    bool b_set = false;
+  };
+
   struct ShaderProgram {
     GLuint id_;
+    uint64_t link_id_ = 0;
+    // 0 番は見つからなかった uniform
+    std::vector<UniformSlot> slots_ = {UniformSlot()};
+    std::unordered_map<std::string, int> slot_indices_;
+    std::vector<unsigned char> values_;
     ShaderProgram() { id_ = glCreateProgram(); }
     ~ShaderProgram() { glDeleteProgram(id_); }
   };
@@ -70,19 +89,22 @@ class ShaderBase {
       glDetachShader(getProgram(), shader.second->id_);
     }
 
-    if (isLinked()) return true;
+    if (isLinked()) {
+      buildUniformCache();
+      return true;
+    }
 
     printLinkErrors();
     return false;
   }
 
   void bind() {
-    glUseProgram(getProgram());
+    useProgram(getProgram());
     current_shader_ = this;
   }
 
   void unbind() {
-    glUseProgram(0);
+    useProgram(0);
     current_shader_ = nullptr;
   }
 
@@ -97,8 +119,23 @@ class ShaderBase {
                                 mode);
   }
 
+  // 名前を引かずに uniform を設定するためのハンドル
+  // 取得したシェーダーがリンクし直されるまで有効
+  template <class T>
+  struct Uniform {
+    int slot = -1;
+    GLint location = -1;
+    bool isValid() const { return location >= 0; }
+  };
+
+  template <class T>
+  Uniform<T> getUniform(const std::string& name) const {
+    const int slot = findSlot(name);
+    return {slot, program_->slots_[slot].location};
+  }
+
   GLint getUniformLocation(const std::string& name) const {
-    return glGetUniformLocation(getProgram(), name.c_str());
+    return program_->slots_[findSlot(name)].location;
   }
 
   GLint getAttributeLocation(const std::string& name) const {
@@ -109,126 +146,162 @@ class ShaderBase {
     return glGetUniformBlockIndex(getProgram(), name.c_str());
   }
 
+  // 前回と同じ値ならドライバーを呼ばない
+  template <class T>
+  void setUniform(const Uniform<T>& u, const T& data) {
+    if (shouldUpdate(u, &data, 1)) uploadUniform(u.location, data);
+  }
+
+  void setUniform(const Uniform<glm::vec4>& u, const Color& data) {
+    setUniform(u, glm::vec4(data[0], data[1], data[2], data[3]));
+  }
+
   void setUniform1f(const std::string& name, GLfloat data) {
-    glUniform1f(getUniformLocation(name), data);
+    setUniform(getUniform<GLfloat>(name), data);
   }
 
   void setUniform1fv(const std::string& name, GLfloat* data, GLsizei count) {
-    glUniform1fv(getUniformLocation(name), count, data);
+    const auto u = getUniform<GLfloat>(name);
+    if (shouldUpdate(u, data, count)) glUniform1fv(u.location, count, data);
   }
 
   void setUniform2f(const std::string& name, const glm::vec2& data) {
-    glUniform2fv(getUniformLocation(name), 1, &data[0]);
+    setUniform(getUniform<glm::vec2>(name), data);
   }
 
   void setUniform2fv(const std::string& name, glm::vec2* data, GLsizei count) {
-    glUniform2fv(getUniformLocation(name), count, glm::value_ptr(data[0]));
+    const auto u = getUniform<glm::vec2>(name);
+    if (shouldUpdate(u, data, count))
+      glUniform2fv(u.location, count, glm::value_ptr(data[0]));
   }
 
   void setUniform3f(const std::string& name, const glm::vec3& data) {
-    glUniform3fv(getUniformLocation(name), 1, &data[0]);
+    setUniform(getUniform<glm::vec3>(name), data);
   }
 
   void setUniform3fv(const std::string& name, glm::vec3* data, GLsizei count) {
-    glUniform3fv(getUniformLocation(name), count, glm::value_ptr(data[0]));
+    const auto u = getUniform<glm::vec3>(name);
+    if (shouldUpdate(u, data, count))
+      glUniform3fv(u.location, count, glm::value_ptr(data[0]));
   }
 
   void setUniform4f(const std::string& name, const glm::vec4& data) {
-    glUniform4fv(getUniformLocation(name), 1, &data[0]);
+    setUniform(getUniform<glm::vec4>(name), data);
   }
 
   void setUniform4fv(const std::string& name, glm::vec4* data, GLsizei count) {
-    glUniform4fv(getUniformLocation(name), count, glm::value_ptr(data[0]));
+    const auto u = getUniform<glm::vec4>(name);
+    if (shouldUpdate(u, data, count))
+      glUniform4fv(u.location, count, glm::value_ptr(data[0]));
   }
 
   void setUniform4f(const std::string& name, const Color& data) {
-    glUniform4fv(getUniformLocation(name), 1, &data[0]);
+    setUniform(getUniform<glm::vec4>(name), data);
   }
 
   void setUniform1i(const std::string& name, GLint data) {
-    glUniform1i(getUniformLocation(name), data);
+    setUniform(getUniform<GLint>(name), data);
   }
 
   void setUniform1iv(const std::string& name, GLint* data, GLsizei count) {
-    glUniform1iv(getUniformLocation(name), count, data);
+    const auto u = getUniform<GLint>(name);
+    if (shouldUpdate(u, data, count)) glUniform1iv(u.location, count, data);
   }
 
   void setUniform2i(const std::string& name, const glm::ivec2& data) {
-    glUniform2iv(getUniformLocation(name), 1, &data[0]);
+    setUniform(getUniform<glm::ivec2>(name), data);
   }
 
   void setUniform2iv(const std::string& name, glm::ivec2* data, GLsizei count) {
-    glUniform2iv(getUniformLocation(name), count, glm::value_ptr(data[0]));
+    const auto u = getUniform<glm::ivec2>(name);
+    if (shouldUpdate(u, data, count))
+      glUniform2iv(u.location, count, glm::value_ptr(data[0]));
   }
 
   void setUniform3i(const std::string& name, const glm::ivec3& data) {
-    glUniform3iv(getUniformLocation(name), 1, &data[0]);
+    setUniform(getUniform<glm::ivec3>(name), data);
   }
 
   void setUniform3iv(const std::string& name, glm::ivec3* data, GLsizei count) {
-    glUniform3iv(getUniformLocation(name), count, glm::value_ptr(data[0]));
+    const auto u = getUniform<glm::ivec3>(name);
+    if (shouldUpdate(u, data, count))
+      glUniform3iv(u.location, count, glm::value_ptr(data[0]));
   }
 
   void setUniform4i(const std::string& name, const glm::ivec4& data) {
-    glUniform4iv(getUniformLocation(name), 1, &data[0]);
+    setUniform(getUniform<glm::ivec4>(name), data);
   }
 
   void setUniform4iv(const std::string& name, glm::ivec4* data, GLsizei count) {
-    glUniform4iv(getUniformLocation(name), count, glm::value_ptr(data[0]));
+    const auto u = getUniform<glm::ivec4>(name);
+    if (shouldUpdate(u, data, count))
+      glUniform4iv(u.location, count, glm::value_ptr(data[0]));
   }
 
   void setUniform1ui(const std::string& name, GLuint data) {
-    glUniform1ui(getUniformLocation(name), data);
+    setUniform(getUniform<GLuint>(name), data);
   }
 
   void setUniform1uiv(const std::string& name, GLuint* data, GLsizei count) {
-    glUniform1uiv(getUniformLocation(name), count, data);
+    const auto u = getUniform<GLuint>(name);
+    if (shouldUpdate(u, data, count)) glUniform1uiv(u.location, count, data);
   }
 
   void setUniform2ui(const std::string& name, const glm::uvec2& data) {
-    glUniform2uiv(getUniformLocation(name), 1, &data[0]);
+    setUniform(getUniform<glm::uvec2>(name), data);
   }
 
   void setUniform2uiv(const std::string& name, glm::uvec2* data,
                       GLsizei count) {
-    glUniform2uiv(getUniformLocation(name), count, glm::value_ptr(data[0]));
+    const auto u = getUniform<glm::uvec2>(name);
+    if (shouldUpdate(u, data, count))
+      glUniform2uiv(u.location, count, glm::value_ptr(data[0]));
   }
 
   void setUniform3ui(const std::string& name, const glm::uvec3& data) {
-    glUniform3uiv(getUniformLocation(name), 1, &data[0]);
+    setUniform(getUniform<glm::uvec3>(name), data);
   }
 
   void setUniform3uiv(const std::string& name, glm::uvec3* data,
                       GLsizei count) {
-    glUniform3uiv(getUniformLocation(name), count, glm::value_ptr(data[0]));
+    const auto u = getUniform<glm::uvec3>(name);
+    if (shouldUpdate(u, data, count))
+      glUniform3uiv(u.location, count, glm::value_ptr(data[0]));
   }
 
   void setUniform4ui(const std::string& name, const glm::uvec4& data) {
-    glUniform4uiv(getUniformLocation(name), 1, &data[0]);
+    setUniform(getUniform<glm::uvec4>(name), data);
   }
 
   void setUniform4uiv(const std::string& name, glm::uvec4* data,
                       GLsizei count) {
-    glUniform4uiv(getUniformLocation(name), count, glm::value_ptr(data[0]));
+    const auto u = getUniform<glm::uvec4>(name);
+    if (shouldUpdate(u, data, count))
+      glUniform4uiv(u.location, count, glm::value_ptr(data[0]));
   }
 
   void setUniformMatrix2f(const std::string& name, const glm::mat2& data) {
-    glUniformMatrix2fv(getUniformLocation(name), 1, GL_FALSE, &data[0][0]);
+    setUniform(getUniform<glm::mat2>(name), data);
   }
 
   void setUniformMatrix3f(const std::string& name, const glm::mat3& data) {
-    glUniformMatrix3fv(getUniformLocation(name), 1, GL_FALSE, &data[0][0]);
+    setUniform(getUniform<glm::mat3>(name), data);
   }
 
   void setUniformMatrix4f(const std::string& name, const glm::mat4& data) {
-    glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &data[0][0]);
+    setUniform(getUniform<glm::mat4>(name), data);
   }
 
   void setUniformTexture(const std::string& name, GLenum target, GLuint id,
                          int index) {
-    glActiveTexture(GL_TEXTURE0 + index);
-    glBindTexture(target, id);
-    setUniform1i(name, index);
+    setUniformTexture(getUniform<GLint>(name), target, id, index);
+  }
+
+  void setUniformTexture(const Uniform<GLint>& u, GLenum target, GLuint id,
+                         GLint index) {
+    activeTexture(GL_TEXTURE0 + index);
+    bindTexture(target, id);
+    setUniform(u, index);
   }
 
   void setUniformTexture(const std::string& name, const TextureBase& t,
@@ -247,6 +320,22 @@ class ShaderBase {
 
   GLuint getProgram() const { return program_->id_; }
 
+  // リンクするたびに変わる。ハンドルを保持している側はこれで古さを判断する
+  uint64_t getLinkId() const { return program_->link_id_; }
+
+  // resetUniformCounters() からドライバーに送った回数と省いた回数
+  static size_t getNumUniformUpdates() { return num_uniform_updates_; }
+  static size_t getNumUniformSkips() { return num_uniform_skips_; }
+  static void resetUniformCounters() {
+    num_uniform_updates_ = 0;
+    num_uniform_skips_ = 0;
+  }
+
+  bool hasUniformBlock(const std::string& name) const {
+    return glGetUniformBlockIndex(getProgram(), name.c_str()) !=
+           GL_INVALID_INDEX;
+  }
+
   bool isLinked() const {
     GLint b_linked = 0;
     glGetProgramiv(getProgram(), GL_LINK_STATUS, &b_linked);
@@ -257,6 +346,179 @@ class ShaderBase {
   ShaderBase() : program_(std::make_shared<ShaderProgram>()) {}
 
  private:
+  static inline uint64_t num_links_ = 0;
+  static inline size_t num_uniform_updates_ = 0;
+  static inline size_t num_uniform_skips_ = 0;
+
+  // リンクした時に有効な uniform を全て列挙して場所を引いておく
+  void buildUniformCache() {
+    auto& program = *program_;
+    program.link_id_ = ++num_links_;
+    program.slots_.assign(1, UniformSlot());
+    program.slot_indices_.clear();
+    program.values_.clear();
+
+    // 既定の uniform block は全てのシェーダーで同じバインディングポイントを使う
+    bindDefaultUniformBlock("FrameUniforms", FRAME_UNIFORMS_BINDING);
+    bindDefaultUniformBlock("DrawUniforms", DRAW_UNIFORMS_BINDING);
+
+    GLint count = 0, max_length = 0;
+    glGetProgramiv(getProgram(), GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(getProgram(), GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+    std::vector<GLchar> buffer(std::max(max_length, 1));
+
+    for (GLint i = 0; i < count; i++) {
+      GLsizei length = 0;
+      GLint size = 0;
+      GLenum type = 0;
+      glGetActiveUniform(getProgram(), i, buffer.size(), &length, &size, &type,
+                         buffer.data());
+      std::string name(buffer.data(), length);
+
+      // uniform block の中の変数は場所を持たない
+      const GLint location = glGetUniformLocation(getProgram(), name.c_str());
+      if (location < 0) continue;
+
+      const int index = addSlot(location, getUniformTypeSize(type) * size);
+      program.slot_indices_[name] = index;
+      // 配列は name[0] で返るので name でも引けるようにする
+      if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+        program.slot_indices_[name.substr(0, name.size() - 3)] = index;
+      }
+    }
+  }
+
+  void bindDefaultUniformBlock(const std::string& name, GLuint binding) const {
+    const GLuint index = glGetUniformBlockIndex(getProgram(), name.c_str());
+    if (index != GL_INVALID_INDEX) {
+      glUniformBlockBinding(getProgram(), index, binding);
+    }
+  }
+
+  int addSlot(GLint location, size_t size) const {
+    auto& program = *program_;
+    UniformSlot slot;
+    slot.location = location;
+    slot.offset = program.values_.size();
+    slot.size = size;
+    program.values_.resize(slot.offset + size);
+    program.slots_.push_back(slot);
+    return program.slots_.size() - 1;
+  }
+
+  // 列挙に無い名前 (配列の 2 番目以降など) はドライバーに聞いて覚えておく
+  int findSlot(const std::string& name) const {
+    auto& program = *program_;
+    auto it = program.slot_indices_.find(name);
+    if (it != program.slot_indices_.end()) return it->second;
+
+    const GLint location = glGetUniformLocation(getProgram(), name.c_str());
+    const int index = location < 0 ? 0 : addSlot(location, 0);
+    program.slot_indices_[name] = index;
+    return index;
+  }
+
+  template <class T, class U>
+  bool shouldUpdate(const Uniform<U>& u, const T* data, GLsizei count) {
+    if (!u.isValid()) return false;
+
+    auto& program = *program_;
+    auto& slot = program.slots_[u.slot];
+    const size_t size = sizeof(T) * count;
+    if (size <= slot.size) {
+      unsigned char* value = program.values_.data() + slot.offset;
+      if (slot.b_set && std::memcmp(value, data, size) == 0) {
+        num_uniform_skips_++;
+        return false;
+      }
+      std::memcpy(value, data, size);
+      slot.b_set = size == slot.size;
+    }
+    num_uniform_updates_++;
+    return true;
+  }
+
+  static size_t getUniformTypeSize(GLenum type) {
+    switch (type) {
+      case GL_FLOAT_VEC2:
+      case GL_INT_VEC2:
+      case GL_UNSIGNED_INT_VEC2:
+      case GL_BOOL_VEC2:
+        return 8;
+      case GL_FLOAT_VEC3:
+      case GL_INT_VEC3:
+      case GL_UNSIGNED_INT_VEC3:
+      case GL_BOOL_VEC3:
+        return 12;
+      case GL_FLOAT_VEC4:
+      case GL_INT_VEC4:
+      case GL_UNSIGNED_INT_VEC4:
+      case GL_BOOL_VEC4:
+      case GL_FLOAT_MAT2:
+        return 16;
+      case GL_FLOAT_MAT2x3:
+      case GL_FLOAT_MAT3x2:
+        return 24;
+      case GL_FLOAT_MAT2x4:
+      case GL_FLOAT_MAT4x2:
+        return 32;
+      case GL_FLOAT_MAT3:
+        return 36;
+      case GL_FLOAT_MAT3x4:
+      case GL_FLOAT_MAT4x3:
+        return 48;
+      case GL_FLOAT_MAT4:
+        return 64;
+      case GL_DOUBLE:
+      case GL_DOUBLE_VEC2:
+      case GL_DOUBLE_VEC3:
+      case GL_DOUBLE_VEC4:
+        return 0;
+      default:  // float, int, bool, sampler
+        return 4;
+    }
+  }
+
+  static void uploadUniform(GLint loc, GLfloat v) { glUniform1f(loc, v); }
+  static void uploadUniform(GLint loc, GLint v) { glUniform1i(loc, v); }
+  static void uploadUniform(GLint loc, GLuint v) { glUniform1ui(loc, v); }
+  static void uploadUniform(GLint loc, const glm::vec2& v) {
+    glUniform2fv(loc, 1, &v[0]);
+  }
+  static void uploadUniform(GLint loc, const glm::vec3& v) {
+    glUniform3fv(loc, 1, &v[0]);
+  }
+  static void uploadUniform(GLint loc, const glm::vec4& v) {
+    glUniform4fv(loc, 1, &v[0]);
+  }
+  static void uploadUniform(GLint loc, const glm::ivec2& v) {
+    glUniform2iv(loc, 1, &v[0]);
+  }
+  static void uploadUniform(GLint loc, const glm::ivec3& v) {
+    glUniform3iv(loc, 1, &v[0]);
+  }
+  static void uploadUniform(GLint loc, const glm::ivec4& v) {
+    glUniform4iv(loc, 1, &v[0]);
+  }
+  static void uploadUniform(GLint loc, const glm::uvec2& v) {
+    glUniform2uiv(loc, 1, &v[0]);
+  }
+  static void uploadUniform(GLint loc, const glm::uvec3& v) {
+    glUniform3uiv(loc, 1, &v[0]);
+  }
+  static void uploadUniform(GLint loc, const glm::uvec4& v) {
+    glUniform4uiv(loc, 1, &v[0]);
+  }
+  static void uploadUniform(GLint loc, const glm::mat2& v) {
+    glUniformMatrix2fv(loc, 1, GL_FALSE, &v[0][0]);
+  }
+  static void uploadUniform(GLint loc, const glm::mat3& v) {
+    glUniformMatrix3fv(loc, 1, GL_FALSE, &v[0][0]);
+  }
+  static void uploadUniform(GLint loc, const glm::mat4& v) {
+    glUniformMatrix4fv(loc, 1, GL_FALSE, &v[0][0]);
+  }
+
   std::string read(const std::string& filepath) const {
     std::ifstream ifs(filepath);
     if (!ifs)
@@ -0,0 +1,180 @@
+#pragma once
+#include "gl/Context.h"
+#include "system/Logger.h"
+#include "system/Noncopyable.h"
+
+namespace limas {
+namespace gl {
+
+// 毎フレーム書き換える頂点・インデックス・uniform 用のリングバッファ
+// フレームごとの領域をフェンスで守り、GPU が読み終わった領域だけを使い回す
+// ARB_buffer_storage があれば永続マップに直接書き込み、なければ CPU 側に
+// 書いてから非同期マップで送る
+class StreamBuffer : private Noncopyable {
+ public:
+  struct Range {
+    void* data = nullptr;  // ここに書き込む
+    GLintptr offset = 0;   // バッファ内の位置 (バイト)
+    GLsizeiptr size = 0;
+    bool isValid() const { return data != nullptr; }
+  };
+
+  StreamBuffer(GLsizeiptr region_size, int num_regions = DEFAULT_NUM_REGIONS)
+      : region_size_(region_size),
+        num_regions_(std::max(num_regions, 1)),
+        region_(0),
+        head_(0),
+        mapped_(nullptr),
+        fences_(num_regions_, nullptr),
+        num_bytes_(0),
+        num_stalls_(0) {
+    const GLsizeiptr size = region_size_ * num_regions_;
+    glGenBuffers(1, &id_);
+    // どのターゲットで使うかに関係なく GL_COPY_WRITE_BUFFER で確保する
+    glBindBuffer(GL_COPY_WRITE_BUFFER, id_);
+    if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+      const GLbitfield flags =
+          GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+      mapped_ = static_cast<unsigned char*>(
+          glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+      if (!mapped_) {
+        logger::error("StreamBuffer")
+            << "Failed to map buffer persistently" << logger::end();
+      }
+    } else {
+      glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+      staging_.resize(size);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
+  virtual ~StreamBuffer() {
+    for (auto& fence : fences_) {
+      if (fence) glDeleteSync(fence);
+    }
+    if (mapped_) {
+      glBindBuffer(GL_COPY_WRITE_BUFFER, id_);
+      glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &id_);
+    forgetBuffer(id_);
+  }
+
+  // size バイトを確保する。offset は alignment の倍数になる
+  // 今の領域に入らなければ次の領域に進み、GPU が使用中なら待つ
+  Range allocate(GLsizeiptr size, GLsizeiptr alignment = 1) {
+    if (size > region_size_) {
+      logger::error("StreamBuffer")
+          << size << " bytes exceed the region size " << region_size_
+          << logger::end();
+      return Range();
+    }
+
+    GLintptr offset = align(head_, alignment);
+    if (offset + size > region_size_) {
+      nextRegion();
+      offset = 0;
+    }
+    head_ = offset + size;
+    num_bytes_ += size;
+
+    Range range;
+    range.offset = region_ * region_size_ + offset;
+    range.size = size;
+    range.data = (mapped_ ? mapped_ : staging_.data()) + range.offset;
+    return range;
+  }
+
+  // data をコピーして確保した範囲を返す
+  Range write(const void* data, GLsizeiptr size, GLsizeiptr alignment = 1) {
+    Range range = allocate(size, alignment);
+    if (!range.isValid()) return range;
+    std::memcpy(range.data, data, size);
+    commit(range);
+    return range;
+  }
+
+  // 書き終えたら描画の前に呼ぶ。永続マップでは何もしない
+  void commit(const Range& range) {
+    if (mapped_ || !range.isValid()) return;
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, id_);
+    void* ptr = glMapBufferRange(
+        GL_COPY_WRITE_BUFFER, range.offset, range.size,
+        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+            GL_MAP_INVALIDATE_RANGE_BIT);
+    if (ptr) {
+      std::memcpy(ptr, range.data, range.size);
+      glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
+  // フレームの終わりに呼ぶ。今の領域にフェンスを置いて次の領域に進む
+  void endFrame() {
+    if (head_ > 0) nextRegion();
+  }
+
+  GLuint getId() const { return id_; }
+  bool isPersistent() const { return mapped_ != nullptr; }
+  GLsizeiptr getRegionSize() const { return region_size_; }
+  int getNumRegions() const { return num_regions_; }
+
+  // resetCounters() から確保したバイト数と GPU を待った回数
+  size_t getNumBytesAllocated() const { return num_bytes_; }
+  size_t getNumStalls() const { return num_stalls_; }
+  void resetCounters() {
+    num_bytes_ = 0;
+    num_stalls_ = 0;
+  }
+
+ private:
+  static constexpr int DEFAULT_NUM_REGIONS = 3;
+  static constexpr GLuint64 WAIT_TIMEOUT = 1000000;  // 1ms
+
+  static GLintptr align(GLintptr offset, GLsizeiptr alignment) {
+    if (alignment <= 1) return offset;
+    return (offset + alignment - 1) / alignment * alignment;
+  }
+
+  void nextRegion() {
+    if (fences_[region_]) glDeleteSync(fences_[region_]);
+    fences_[region_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    region_ = (region_ + 1) % num_regions_;
+    head_ = 0;
+
+    GLsync& fence = fences_[region_];
+    if (!fence) return;
+
+    GLbitfield flags = 0;
+    GLenum result = glClientWaitSync(fence, flags, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+      num_stalls_++;
+      flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+      do {
+        result = glClientWaitSync(fence, flags, WAIT_TIMEOUT);
+      } while (result == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+
+  GLuint id_;
+  const GLsizeiptr region_size_;
+  const int num_regions_;
+  int region_;
+  GLintptr head_;
+
+  unsigned char* mapped_;
+  std::vector<unsigned char> staging_;
+  std::vector<GLsync> fences_;
+
+  size_t num_bytes_;
+  size_t num_stalls_;
+};
+
+}  // namespace gl
+}  // namespace limas
@@ -0,0 +1,143 @@
+#pragma once
+#include "gl/PrimitiveBatch.h"
+#include "graphics/TextLayout.h"
+
+namespace limas {
+namespace gl {
+
+// 文字列ごとに 1 つの頂点バッファを作って 1 回で描画する
+// 同じフォント・文字列・色のレイアウトはキャッシュして使い回す
+// FontType は layout(text, quads) を持つフォント (BitmapFont, Font など)
+// getGeneration() を持つフォントは値が変わったら古いレイアウトを使わない
+class TextBatch {
+ public:
+  using Vertex = PrimitiveBatch::Vertex;
+
+  struct Layout {
+    Vao vao;
+    Vbo<Vertex> vbo;
+    GLsizei num_vertices = 0;
+    glm::vec2 size = glm::vec2(0);  // 文字が占める範囲
+    uint64_t last_used = 0;
+  };
+
+  explicit TextBatch(size_t capacity = DEFAULT_CAPACITY)
+      : capacity_(capacity), tick_(0), num_hits_(0), num_misses_(0) {}
+
+  template <class FontType>
+  const Layout& getLayout(FontType& font, const std::string& text,
+                          const glm::vec4& color = glm::vec4(1)) {
+    std::string key = makeKey(font, text, color);
+
+    tick_++;
+    auto it = layouts_.find(key);
+    if (it != layouts_.end()) {
+      num_hits_++;
+      it->second.last_used = tick_;
+      return it->second;
+    }
+    num_misses_++;
+
+    if (layouts_.size() >= capacity_) evict();
+
+    quads_.clear();
+    font.layout(text, quads_);
+    // 並べる途中でフォントのアトラスが詰め直されていることがある
+    if constexpr (requires { font.getGeneration(); }) {
+      key = makeKey(font, text, color);
+    }
+
+    Layout& layout = layouts_[key];
+    layout.last_used = tick_;
+    build(layout, color);
+    return layout;
+  }
+
+  void clear() { layouts_.clear(); }
+
+  size_t getNumCached() const { return layouts_.size(); }
+  size_t getCapacity() const { return capacity_; }
+  void setCapacity(size_t capacity) {
+    capacity_ = std::max<size_t>(capacity, 1);
+  }
+
+  // resetCounters() からキャッシュを使えた回数と作り直した回数
+  size_t getNumHits() const { return num_hits_; }
+  size_t getNumMisses() const { return num_misses_; }
+  void resetCounters() {
+    num_hits_ = 0;
+    num_misses_ = 0;
+  }
+
+ private:
+  static constexpr size_t DEFAULT_CAPACITY = 256;
+
+  template <class FontType>
+  static std::string makeKey(const FontType& font, const std::string& text,
+                             const glm::vec4& color) {
+    uint64_t generation = 0;
+    if constexpr (requires { font.getGeneration(); }) {
+      generation = font.getGeneration();
+    }
+
+    std::string key;
+    const void* font_ptr = &font;
+    key.reserve(sizeof(font_ptr) + sizeof(generation) + sizeof(color) +
+                text.size());
+    key.append(reinterpret_cast<const char*>(&font_ptr), sizeof(font_ptr));
+    key.append(reinterpret_cast<const char*>(&generation), sizeof(generation));
+    key.append(reinterpret_cast<const char*>(&color), sizeof(color));
+    key.append(text);
+    return key;
+  }
+
+  void build(Layout& layout, const glm::vec4& color) {
+    vertices_.clear();
+    glm::vec2 size(0);
+    for (const auto& q : quads_) {
+      const glm::vec2 p0(q.rect.x, q.rect.y);
+      const glm::vec2 p1 = p0 + glm::vec2(q.rect.z, q.rect.w);
+      const Vertex corners[4] = {
+          {glm::vec3(p0.x, p0.y, 0), color, {q.texcoord.x, q.texcoord.y}},
+          {glm::vec3(p1.x, p0.y, 0), color, {q.texcoord.z, q.texcoord.y}},
+          {glm::vec3(p1.x, p1.y, 0), color, {q.texcoord.z, q.texcoord.w}},
+          {glm::vec3(p0.x, p1.y, 0), color, {q.texcoord.x, q.texcoord.w}}};
+      for (int i : {0, 1, 2, 0, 2, 3}) vertices_.push_back(corners[i]);
+      size = glm::max(size, p1);
+    }
+
+    layout.num_vertices = vertices_.size();
+    layout.size = size;
+    if (vertices_.empty()) return;
+
+    layout.vbo.allocate(vertices_, GL_STATIC_DRAW);
+    const GLsizei stride = sizeof(Vertex);
+    layout.vao.bindVbo(layout.vbo.getId(), POSITION_ATTRIBUTE, 3, GL_FLOAT,
+                       GL_FALSE, stride, (void*)offsetof(Vertex, position));
+    layout.vao.bindVbo(layout.vbo.getId(), COLOR_ATTRIBUTE, 4, GL_FLOAT,
+                       GL_FALSE, stride, (void*)offsetof(Vertex, color));
+    layout.vao.bindVbo(layout.vbo.getId(), TEXCOORD_ATTRIBUTE, 2, GL_FLOAT,
+                       GL_FALSE, stride, (void*)offsetof(Vertex, texcoord));
+  }
+
+  // 一番長く使われていないレイアウトを捨てる
+  void evict() {
+    auto oldest = layouts_.begin();
+    for (auto it = layouts_.begin(); it != layouts_.end(); ++it) {
+      if (it->second.last_used < oldest->second.last_used) oldest = it;
+    }
+    if (oldest != layouts_.end()) layouts_.erase(oldest);
+  }
+
+  std::unordered_map<std::string, Layout> layouts_;
+  size_t capacity_;
+  uint64_t tick_;
+  size_t num_hits_;
+  size_t num_misses_;
+
+  TextLayout quads_;
+  std::vector<Vertex> vertices_;
+};
+
+}  // namespace gl
+}  // namespace limas
@@ -20,6 +20,11 @@ class Texture2D : public TextureBase {
     TextureBase::loadData(data, w, h, 0, x, y, 0);
   }
 
+  void loadCompressedData(const void* data, GLsizei size, GLsizei w = 0,
+                          GLsizei h = 0, GLsizei x = 0, GLsizei y = 0) {
+    TextureBase::loadCompressedData(data, size, w, h, x, y);
+  }
+
   glm::vec2 getSize() const { return glm::vec2(getWidth(), getHeight()); }
 };
 
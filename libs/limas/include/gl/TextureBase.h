@@ -65,8 +65,12 @@ class TextureBase {
       channels_ = getNumChannelsFromFormat(format_);
 
       glGenTextures(1, &id_);
-      glBindTexture(target_, id_);
-      if (target_ == GL_TEXTURE_1D)
+      bindTexture(target_, id_);
+      if (target_ == GL_TEXTURE_2D && isCompressedFormat(internal_format_))
+        glCompressedTexImage2D(
+            target_, 0, internal_format_, width_, height_, 0,
+            getCompressedImageSize(internal_format_, width_, height_), 0);
+      else if (target_ == GL_TEXTURE_1D)
         glTexImage1D(target_, 0, internal_format_, width_, 0, format_, type_,
                      0);
       else if (target_ == GL_TEXTURE_2D)
@@ -75,9 +79,12 @@ class TextureBase {
       else if (target_ == GL_TEXTURE_3D)
         glTexImage3D(target_, 0, internal_format_, width_, height_, depth_, 0,
                      format_, type_, 0);
-      glBindTexture(target_, 0);
+      bindTexture(target_, 0);
+    }
+    ~TextureData() {
+      glDeleteTextures(1, &id_);
+      forgetTexture(id_);
     }
-    ~TextureData() { glDeleteTextures(1, &id_); }
   };
 
   std::shared_ptr<TextureData> data_;
@@ -85,8 +92,8 @@ class TextureBase {
  public:
   virtual ~TextureBase() {}
 
-  void bind() const { glBindTexture(getTarget(), getId()); }
-  void unbind() const { glBindTexture(getTarget(), 0); }
+  void bind() const { bindTexture(getTarget(), getId()); }
+  void unbind() const { bindTexture(getTarget(), 0); }
 
   void setMinFilter(GLint filter) {
     bind();
@@ -139,6 +146,7 @@ class TextureBase {
   size_t getDepth() const { return data_->depth_; }
   size_t getNumChannels() const { return data_->channels_; }
   bool isAllocated() const { return data_ != nullptr; }
+  bool isCompressed() const { return isCompressedFormat(getInternalFormat()); }
 
  protected:
   TextureBase() {}
@@ -149,6 +157,8 @@ class TextureBase {
                 std::optional<GLenum> type = std::nullopt) {
     data_ = std::make_shared<TextureData>(target, width, height, depth,
                                           internal_format, format, type);
+    // バッファテクスチャはサンプラーの設定を持たない
+    if (target == GL_TEXTURE_BUFFER) return;
     setMinFilter(GL_NEAREST);
     setMagFilter(GL_NEAREST);
     setWrapS(GL_CLAMP_TO_EDGE);
@@ -171,6 +181,16 @@ class TextureBase {
                       getFormat(), getType(), data);
     unbind();
   }
+
+  // PBO がバインドされている時は data はバッファ内のオフセット
+  void loadCompressedData(const void* data, GLsizei size, GLsizei w = 0,
+                          GLsizei h = 0, GLsizei x = 0, GLsizei y = 0) {
+    bind();
+    glCompressedTexSubImage2D(getTarget(), 0, x, y, w == 0 ? getWidth() : w,
+                              h == 0 ? getHeight() : h, getInternalFormat(),
+                              size, data);
+    unbind();
+  }
 };
 
 }  // namespace gl
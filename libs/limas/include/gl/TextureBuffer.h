@@ -14,9 +14,7 @@ class TextureBuffer : public TextureBase {
     TextureBase::allocate(GL_TEXTURE_BUFFER, 1, 1, 1, internal_format);
 
     bind();
-    tbo.bind();
-    glTexBuffer(GL_TEXTURE_BUFFER, internal_format, tbo.getID());
-    tbo.unbind();
+    glTexBuffer(GL_TEXTURE_BUFFER, internal_format, tbo.getId());
     unbind();
   }
 };
@@ -10,13 +10,23 @@ class Ubo : public BufferObject<T> {
   Ubo() : BufferObject<T>(GL_UNIFORM_BUFFER) {}
 
   void bindBufferBase(GLuint index) const {
-    glBindBufferBase(GL_UNIFORM_BUFFER, index, BufferObject<T>::getID());
+    glBindBufferBase(GL_UNIFORM_BUFFER, index, BufferObject<T>::getId());
+    // 汎用のバインディングポイントも変わる
+    UniformBufferState::assume(BufferObject<T>::getId());
+  }
+
+  // offset と size はバイト単位
+  void bindBufferRange(GLuint index, GLintptr offset, GLsizeiptr size) const {
+    glBindBufferRange(GL_UNIFORM_BUFFER, index, BufferObject<T>::getId(),
+                      offset, size);
+    UniformBufferState::assume(BufferObject<T>::getId());
   }
 
   void unbindBufferBase(GLuint index) const {
-    glBindBufferBase(GL_UNIFORM_BUFFER, index, BufferObject<T>::getID());
+    glBindBufferBase(GL_UNIFORM_BUFFER, index, 0);
+    UniformBufferState::assume(0);
   }
 };
 
 }  // namespace gl
-}  // namespace limas
\ No newline at end of file
+}  // namespace limas
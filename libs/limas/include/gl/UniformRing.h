@@ -0,0 +1,55 @@
+#pragma once
+#include "gl/StreamBuffer.h"
+#include "system/Noncopyable.h"
+
+namespace limas {
+namespace gl {
+
+// 描画ごとの小さな uniform block を StreamBuffer に順に書き込み、
+// 書いた範囲をバインドする
+class UniformRing : private Noncopyable {
+ public:
+  explicit UniformRing(GLsizeiptr size = DEFAULT_SIZE)
+      : stream_(size), num_pushes_(0) {
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    alignment_ = std::max(alignment, 1);
+  }
+
+  // data を書き込んで binding に書いた範囲をバインドする
+  void push(GLuint binding, const void* data, GLsizeiptr size) {
+    const auto range = stream_.write(data, size, alignment_);
+    if (!range.isValid()) return;
+
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, stream_.getId(),
+                      range.offset, size);
+    // 汎用のバインディングポイントも変わる
+    UniformBufferState::assume(stream_.getId());
+    num_pushes_++;
+  }
+
+  // フレームの終わりに呼ぶ
+  void endFrame() { stream_.endFrame(); }
+
+  const StreamBuffer& getStreamBuffer() const { return stream_; }
+  GLint getAlignment() const { return alignment_; }
+
+  // resetCounters() からの書き込み回数と GPU を待った回数
+  size_t getNumPushes() const { return num_pushes_; }
+  size_t getNumStalls() const { return stream_.getNumStalls(); }
+  void resetCounters() {
+    num_pushes_ = 0;
+    stream_.resetCounters();
+  }
+
+ private:
+  static constexpr GLsizeiptr DEFAULT_SIZE = 1 << 20;
+
+  StreamBuffer stream_;
+  GLint alignment_;
+
+  size_t num_pushes_;
+};
+
+}  // namespace gl
+}  // namespace limas
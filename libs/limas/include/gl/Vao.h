@@ -1,5 +1,6 @@
 #pragma once
 #include "Ibo.h"
+#include "gl/Context.h"
 #include "Vbo.h"
 
 namespace limas {
@@ -10,7 +11,10 @@ class Vao {
   struct VaoData {
     GLuint id_;
     VaoData() { glGenVertexArrays(1, &id_); }
-    ~VaoData() { glDeleteVertexArrays(1, &id_); }
+    ~VaoData() {
+      glDeleteVertexArrays(1, &id_);
+      forgetVertexArray(id_);
+    }
   };
   std::shared_ptr<VaoData> data_;
 
@@ -18,17 +22,17 @@ class Vao {
   Vao() : data_(std::make_shared<VaoData>()), b_ibo_enabled_(false) {}
   virtual ~Vao() {}
 
-  void bind() const { glBindVertexArray(data_->id_); }
-  void unbind() const { glBindVertexArray(0); }
+  void bind() const { bindVertexArray(data_->id_); }
+  void unbind() const { bindVertexArray(0); }
 
   void bindVbo(GLuint id, GLuint location, GLint dim, GLenum type,
                GLboolean normalized, GLsizei stride, const void* offset = 0) {
     bind();
-    glBindBuffer(GL_ARRAY_BUFFER, id);
+    bindBuffer(GL_ARRAY_BUFFER, id);
     glEnableVertexAttribArray(location);
     glVertexAttribPointer(location, dim, type, GL_FALSE, stride, offset);
     unbind();
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    bindBuffer(GL_ARRAY_BUFFER, 0);
 
     enabled_attributes_.insert(location);
   }
@@ -22,10 +22,17 @@ class BaseVboMesh : public Drawable, public geom::BaseMesh<V, N, C, T> {
   }
 
  public:
-  BaseVboMesh() : Drawable(), geom::BaseMesh<V, N, C, T>() {}
+  BaseVboMesh()
+      : Drawable(),
+        geom::BaseMesh<V, N, C, T>(),
+        b_interleaved_(false),
+        interleaved_mask_(0) {}
 
   BaseVboMesh(const geom::BaseMesh<V, N, C, T>& mesh)
-      : Drawable(), geom::BaseMesh<V, N, C, T>() {
+      : Drawable(),
+        geom::BaseMesh<V, N, C, T>(),
+        b_interleaved_(false),
+        interleaved_mask_(0) {
     copyFromMesh(mesh);
   }
 
@@ -69,7 +76,68 @@ class BaseVboMesh : public Drawable, public geom::BaseMesh<V, N, C, T> {
   void disableTexCoords() { disableAttribute(TEXCOORD_ATTRIBUTE); }
   void disableIndices() { vao_.unbindIbo(); }
 
+  // 有効にすると頂点・法線・色・テクスチャ座標を頂点ごとに並べた
+  // 1 つのバッファにまとめる。次の update() から反映される
+  void setInterleaved(bool b_interleaved) {
+    if (b_interleaved_ == b_interleaved) return;
+    b_interleaved_ = b_interleaved;
+    if (!b_interleaved_) {
+      this->clearInterleavedAttributes();
+      interleaved_mask_ = 0;
+    }
+  }
+  bool isInterleaved() const { return b_interleaved_; }
+
+  // 1 頂点分を書き換えて updateDirty() で送る範囲に加える
+  void setVertex(size_t i, const V& v) {
+    this->vertices_[i] = v;
+    this->markDirty(POSITION_ATTRIBUTE, i);
+  }
+  void setNormal(size_t i, const N& n) {
+    this->normals_[i] = n;
+    this->markDirty(NORMAL_ATTRIBUTE, i);
+  }
+  void setColor(size_t i, const C& c) {
+    this->colors_[i] = c;
+    this->markDirty(COLOR_ATTRIBUTE, i);
+  }
+  void setTexCoord(size_t i, const T& t) {
+    this->texcoords_[i] = t;
+    this->markDirty(TEXCOORD_ATTRIBUTE, i);
+  }
+
+  // setVertex() などで書き換えた範囲だけを属性ごとに 1 回で送る
+  // getVertices() などから直接書き換えた時は markDirty() で範囲を伝える
+  void updateDirty() {
+    if (b_interleaved_) {
+      const DirtyRange range = this->takeDirtyRange();
+      if (range.isEmpty() || range.first >= this->vertices_.size()) return;
+      if (getInterleavedMask() != interleaved_mask_ ||
+          this->getNumInterleavedVertices() != this->vertices_.size()) {
+        updateInterleaved();
+        return;
+      }
+      const size_t count =
+          std::min(range.last, this->vertices_.size()) - range.first;
+      packInterleaved(this->getInterleavedAttributes(),
+                      this->getInterleavedStride(), range.first, count);
+      this->updateInterleavedAttributes(
+          interleaved_data_.data() + range.first * this->getInterleavedStride(),
+          range.first, count);
+      return;
+    }
+
+    updateDirtyAttribute(POSITION_ATTRIBUTE, this->vertices_, 3);
+    updateDirtyAttribute(NORMAL_ATTRIBUTE, this->normals_, 3);
+    updateDirtyAttribute(COLOR_ATTRIBUTE, this->colors_, 4);
+    updateDirtyAttribute(TEXCOORD_ATTRIBUTE, this->texcoords_, 2);
+  }
+
   void updateVertices() {
+    if (b_interleaved_) {
+      updateInterleaved();
+      return;
+    }
     if (this->vertices_.empty()) return;
     if (attributes_.find(POSITION_ATTRIBUTE) == attributes_.end()) {
       addAttribute(POSITION_ATTRIBUTE, this->vertices_, 3, GL_FLOAT);
@@ -79,6 +147,10 @@ class BaseVboMesh : public Drawable, public geom::BaseMesh<V, N, C, T> {
   }
 
   void updateNormals() {
+    if (b_interleaved_) {
+      updateInterleaved();
+      return;
+    }
     if (this->normals_.empty()) return;
     if (attributes_.find(NORMAL_ATTRIBUTE) == attributes_.end()) {
       addAttribute(NORMAL_ATTRIBUTE, this->normals_, 3, GL_FLOAT);
@@ -88,6 +160,10 @@ class BaseVboMesh : public Drawable, public geom::BaseMesh<V, N, C, T> {
   }
 
   void updateColors() {
+    if (b_interleaved_) {
+      updateInterleaved();
+      return;
+    }
     if (this->colors_.empty()) return;
     if (attributes_.find(COLOR_ATTRIBUTE) == attributes_.end()) {
       addAttribute(COLOR_ATTRIBUTE, this->colors_, 4, GL_FLOAT);
@@ -97,6 +173,10 @@ class BaseVboMesh : public Drawable, public geom::BaseMesh<V, N, C, T> {
   }
 
   void updateTexCoords() {
+    if (b_interleaved_) {
+      updateInterleaved();
+      return;
+    }
     if (this->texcoords_.empty()) return;
     if (attributes_.find(TEXCOORD_ATTRIBUTE) == attributes_.end()) {
       addAttribute(TEXCOORD_ATTRIBUTE, this->texcoords_, 2, GL_FLOAT);
@@ -108,10 +188,15 @@ class BaseVboMesh : public Drawable, public geom::BaseMesh<V, N, C, T> {
   void updateIndices() { this->Drawable::updateIndices(this->indices_); }
 
   void update() {
-    updateVertices();
-    updateNormals();
-    updateColors();
-    updateTexCoords();
+    this->clearDirty();
+    if (b_interleaved_) {
+      updateInterleaved();
+    } else {
+      updateVertices();
+      updateNormals();
+      updateColors();
+      updateTexCoords();
+    }
     updateIndices();
   }
 
@@ -141,6 +226,82 @@ class BaseVboMesh : public Drawable, public geom::BaseMesh<V, N, C, T> {
   bool isTexCoordEnabled() const {
     return isAttributeEnabled(TEXCOORD_ATTRIBUTE);
   }
+
+ private:
+  template <typename Type>
+  void updateDirtyAttribute(GLuint location, const std::vector<Type>& data,
+                            GLuint dim) {
+    const DirtyRange range = this->takeDirtyRange(location);
+    if (range.isEmpty() || data.empty()) return;
+    if (attributes_.find(location) == attributes_.end()) {
+      addAttribute(location, data, dim, GL_FLOAT);
+    } else {
+      updateAttribute(location, data, range.first, range.getCount());
+    }
+  }
+
+  // 頂点数と同じ数だけある属性をまとめる
+  unsigned int getInterleavedMask() const {
+    const size_t n = this->vertices_.size();
+    unsigned int mask = 0;
+    if (n == 0) return mask;
+    mask |= 1 << POSITION_ATTRIBUTE;
+    if (this->normals_.size() == n) mask |= 1 << NORMAL_ATTRIBUTE;
+    if (this->colors_.size() == n) mask |= 1 << COLOR_ATTRIBUTE;
+    if (this->texcoords_.size() == n) mask |= 1 << TEXCOORD_ATTRIBUTE;
+    return mask;
+  }
+
+  void updateInterleaved() {
+    this->clearDirty();
+    interleaved_mask_ = getInterleavedMask();
+    if (interleaved_mask_ == 0) return;
+
+    std::vector<InterleavedAttribute> layout;
+    GLsizei stride = 0;
+    auto add = [&](GLuint location, GLuint dim, GLsizei size) {
+      if (!(interleaved_mask_ & (1 << location))) return;
+      layout.push_back({location, dim, GL_FLOAT, stride});
+      stride += size;
+    };
+    add(POSITION_ATTRIBUTE, 3, sizeof(V));
+    add(NORMAL_ATTRIBUTE, 3, sizeof(N));
+    add(COLOR_ATTRIBUTE, 4, sizeof(C));
+    add(TEXCOORD_ATTRIBUTE, 2, sizeof(T));
+
+    const size_t n = this->vertices_.size();
+    packInterleaved(layout, stride, 0, n);
+    this->setInterleavedAttributes(layout, stride, interleaved_data_.data(),
+                                   n);
+  }
+
+  void packInterleaved(const std::vector<InterleavedAttribute>& layout,
+                       GLsizei stride, size_t first, size_t count) {
+    interleaved_data_.resize(this->vertices_.size() * stride);
+    for (size_t i = first; i < first + count; i++) {
+      unsigned char* dst = interleaved_data_.data() + i * stride;
+      for (const auto& a : layout) {
+        switch (a.location) {
+          case POSITION_ATTRIBUTE:
+            std::memcpy(dst + a.offset, &this->vertices_[i], sizeof(V));
+            break;
+          case NORMAL_ATTRIBUTE:
+            std::memcpy(dst + a.offset, &this->normals_[i], sizeof(N));
+            break;
+          case COLOR_ATTRIBUTE:
+            std::memcpy(dst + a.offset, &this->colors_[i], sizeof(C));
+            break;
+          case TEXCOORD_ATTRIBUTE:
+            std::memcpy(dst + a.offset, &this->texcoords_[i], sizeof(T));
+            break;
+        }
+      }
+    }
+  }
+
+  bool b_interleaved_;
+  unsigned int interleaved_mask_;
+  std::vector<unsigned char> interleaved_data_;
 };
 
 using VboMesh = BaseVboMesh<glm::vec3, glm::vec3, glm::vec4, glm::vec2>;
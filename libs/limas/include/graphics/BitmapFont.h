@@ -1,6 +1,7 @@
 #pragma once
 #include "geom/Mesh.h"
 #include "graphics/ImageIO.h"
+#include "graphics/TextLayout.h"
 #include "primitives/Rectangle.h"
 #include "system/Logger.h"
 #include "system/Singleton.h"
@@ -466,6 +467,26 @@ class BitmapFont {
     return meshes;
   }
 
+  // 改行を含む文字列を並べる。対応していない文字は空白として扱う
+  void layout(const std::string& text, TextLayout& quads) const {
+    const float tex_width = 1.0f / NUM_CHARS;
+    glm::vec2 pen(0);
+    for (char c : text) {
+      if (c == '\n') {
+        pen = glm::vec2(0, pen.y + getLineHeight());
+        continue;
+      }
+
+      auto it = word_map_.find(std::toupper((unsigned char)c));
+      if (it != word_map_.end() && c != ' ') {
+        float s = it->second / (float)NUM_CHARS;
+        quads.push_back({glm::vec4(pen, CHAR_WIDTH + CHAR_SPACE, CHAR_HEIGHT),
+                         glm::vec4(s, 0, s + tex_width, 1)});
+      }
+      pen.x += CHAR_WIDTH + CHAR_SPACE;
+    }
+  }
+
   bool isValid(const std::string& text) const {
     for (int i = 0; i < text.length(); i++) {
       auto c = text.at(i);
@@ -479,8 +500,10 @@ class BitmapFont {
   }
   size_t getCharacterWidth() const { return CHAR_WIDTH; }
   size_t getSpaceWidth() const { return CHAR_SPACE; }
+  size_t getLineHeight() const { return CHAR_HEIGHT * 2; }
 
   gl::Texture2D& getTexture() { return image_.getTexture(); }
+  const gl::Texture2D& getTexture() const { return image_.getTexture(); }
 
  protected:
   Image image_;
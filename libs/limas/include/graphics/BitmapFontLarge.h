@@ -1,6 +1,7 @@
 #pragma once
 #include "geom/Mesh.h"
 #include "graphics/ImageIO.h"
+#include "graphics/TextLayout.h"
 #include "primitives/Rectangle.h"
 #include "system/Logger.h"
 #include "system/Singleton.h"
@@ -387,6 +388,27 @@ class BitmapFontLarge {
     return meshes;
   }
 
+  // 改行を含む文字列を並べる。制御文字は空白として扱う
+  void layout(const std::string& text, TextLayout& quads) const {
+    const float tex_width = (float)CHAR_WIDTH / 256.0f;
+    const float tex_height = (float)CHAR_HEIGHT / 256.0f;
+    glm::vec2 pen(0);
+    for (char c : text) {
+      if (c == '\n') {
+        pen = glm::vec2(0, pen.y + CHAR_HEIGHT);
+        continue;
+      }
+
+      if (c > 32) {
+        float s = (float)(c % NUM_COLS) / NUM_COLS;
+        float t = (float)(c / NUM_COLS) / NUM_ROWS;
+        quads.push_back({glm::vec4(pen, CHAR_WIDTH, CHAR_HEIGHT),
+                         glm::vec4(s, t, s + tex_width, t + tex_height)});
+      }
+      pen.x += CHAR_WIDTH;
+    }
+  }
+
   size_t getSize(const std::string& text) const {
     return CHAR_WIDTH * text.length();
   }
@@ -394,6 +416,7 @@ class BitmapFontLarge {
   size_t getCharacterHeight() const { return CHAR_HEIGHT; }
 
   gl::Texture2D& getTexture() { return image_.getTexture(); }
+  const gl::Texture2D& getTexture() const { return image_.getTexture(); }
 
  protected:
   Image image_;
@@ -0,0 +1,277 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include "system/ThreadPool.h"
+
+namespace limas {
+
+// RGBA8 を 4x4 ブロック単位で DXT (BC1 / BC3 / BC4) に圧縮する
+// Hap の書き出しと圧縮テクスチャの読み込みで使う
+class DxtCompressor {
+ public:
+  enum class Format {
+    DXT1,         // RGB
+    DXT5,         // RGBA
+    YCOCG_DXT5,   // Hap Q (hap.frag でデコード)
+    RGTC1,        // R
+    RGTC1_ALPHA,  // A を R として格納する
+  };
+
+  DxtCompressor() = delete;
+
+  static GLenum getInternalFormat(Format format) {
+    switch (format) {
+      case Format::DXT1:
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+      case Format::DXT5:
+      case Format::YCOCG_DXT5:
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+      case Format::RGTC1:
+      case Format::RGTC1_ALPHA:
+      default:
+        return GL_COMPRESSED_RED_RGTC1;
+    }
+  }
+
+  static size_t getBlockSize(Format format) {
+    return format == Format::DXT1 || format == Format::RGTC1 ||
+                   format == Format::RGTC1_ALPHA
+               ? 8
+               : 16;
+  }
+
+  static size_t getCompressedSize(Format format, size_t width, size_t height) {
+    return ((width + 3) / 4) * ((height + 3) / 4) * getBlockSize(format);
+  }
+
+  // stride は 1 行のバイト数。負の値を渡すと下から読む (src は先頭行を指す)
+  // pool を渡すとブロック行ごとに並列に処理する
+  static void compress(const unsigned char* src, size_t width, size_t height,
+                       ptrdiff_t stride, Format format, unsigned char* dst,
+                       ThreadPool* pool = nullptr) {
+    const size_t blocks_x = (width + 3) / 4;
+    const size_t blocks_y = (height + 3) / 4;
+    const size_t block_size = getBlockSize(format);
+
+    auto compress_row = [&](size_t by) {
+      unsigned char block[64];
+      unsigned char* out = dst + by * blocks_x * block_size;
+      for (size_t bx = 0; bx < blocks_x; bx++) {
+        fetchBlock(src, width, height, stride, bx * 4, by * 4, block);
+        compressBlock(block, format, out);
+        out += block_size;
+      }
+    };
+
+    if (pool && pool->getNumThreads() > 0 && blocks_y > 1) {
+      pool->parallelFor(blocks_y, compress_row);
+    } else {
+      for (size_t by = 0; by < blocks_y; by++) compress_row(by);
+    }
+  }
+
+  static void compressBlock(unsigned char* block, Format format,
+                            unsigned char* dst) {
+    switch (format) {
+      case Format::DXT1:
+        compressColorBlock(block, dst);
+        break;
+      case Format::DXT5:
+        compressChannelBlock(block, 3, dst);
+        compressColorBlock(block, dst + 8);
+        break;
+      case Format::YCOCG_DXT5:
+        convertToYCoCg(block);
+        compressChannelBlock(block, 3, dst);
+        compressColorBlock(block, dst + 8);
+        break;
+      case Format::RGTC1:
+        compressChannelBlock(block, 0, dst);
+        break;
+      case Format::RGTC1_ALPHA:
+        compressChannelBlock(block, 3, dst);
+        break;
+    }
+  }
+
+ private:
+  // 端のブロックは最後の行と列を繰り返す
+  static void fetchBlock(const unsigned char* src, size_t width, size_t height,
+                         ptrdiff_t stride, size_t x, size_t y,
+                         unsigned char* block) {
+    for (size_t j = 0; j < 4; j++) {
+      const size_t sy = std::min(y + j, height - 1);
+      const unsigned char* row = src + (ptrdiff_t)sy * stride;
+      for (size_t i = 0; i < 4; i++) {
+        const size_t sx = std::min(x + i, width - 1);
+        std::memcpy(block + (j * 4 + i) * 4, row + sx * 4, 4);
+      }
+    }
+  }
+
+  // J.M.P. van Waveren, "Real-Time YCoCg-DXT Compression"
+  // R: Co, G: Cg, B: スケール, A: Y
+  static void convertToYCoCg(unsigned char* block) {
+    int co[16], cg[16];
+    int max_abs = 0;
+    for (int i = 0; i < 16; i++) {
+      int r = block[i * 4 + 0];
+      int g = block[i * 4 + 1];
+      int b = block[i * 4 + 2];
+      block[i * 4 + 3] = (unsigned char)((r + 2 * g + b + 2) >> 2);
+      co[i] = (2 * r - 2 * b + 2) >> 2;
+      cg[i] = (-r + 2 * g - b + 2) >> 2;
+      max_abs = std::max({max_abs, std::abs(co[i]), std::abs(cg[i])});
+    }
+
+    // 色差が小さいブロックは拡大して精度を稼ぐ
+    const int scale = max_abs < 32 ? 4 : max_abs < 64 ? 2 : 1;
+    for (int i = 0; i < 16; i++) {
+      block[i * 4 + 0] = (unsigned char)std::clamp(co[i] * scale + 128, 0, 255);
+      block[i * 4 + 1] = (unsigned char)std::clamp(cg[i] * scale + 128, 0, 255);
+      block[i * 4 + 2] = (unsigned char)((scale - 1) << 3);
+    }
+  }
+
+  static uint16_t packRGB565(const float* c) {
+    auto r = (int)std::lround(std::clamp(c[0], 0.f, 255.f) * 31.f / 255.f);
+    auto g = (int)std::lround(std::clamp(c[1], 0.f, 255.f) * 63.f / 255.f);
+    auto b = (int)std::lround(std::clamp(c[2], 0.f, 255.f) * 31.f / 255.f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+  }
+
+  static void unpackRGB565(uint16_t c, int* rgb) {
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+  }
+
+  // 主成分軸に沿った両端の色を端点にする 4 色モード
+  static void compressColorBlock(const unsigned char* block,
+                                 unsigned char* dst) {
+    float mean[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++)
+      for (int c = 0; c < 3; c++) mean[c] += block[i * 4 + c];
+    for (int c = 0; c < 3; c++) mean[c] /= 16.f;
+
+    float cov[6] = {0, 0, 0, 0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+      float r = block[i * 4 + 0] - mean[0];
+      float g = block[i * 4 + 1] - mean[1];
+      float b = block[i * 4 + 2] - mean[2];
+      cov[0] += r * r;
+      cov[1] += r * g;
+      cov[2] += r * b;
+      cov[3] += g * g;
+      cov[4] += g * b;
+      cov[5] += b * b;
+    }
+
+    float axis[3] = {1, 1, 1};
+    for (int k = 0; k < 8; k++) {
+      float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+      float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+      float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+      float m = std::max({std::abs(x), std::abs(y), std::abs(z)});
+      if (m == 0) break;
+      axis[0] = x / m;
+      axis[1] = y / m;
+      axis[2] = z / m;
+    }
+
+    float min_t = std::numeric_limits<float>::max();
+    float max_t = std::numeric_limits<float>::lowest();
+    for (int i = 0; i < 16; i++) {
+      float t = (block[i * 4 + 0] - mean[0]) * axis[0] +
+                (block[i * 4 + 1] - mean[1]) * axis[1] +
+                (block[i * 4 + 2] - mean[2]) * axis[2];
+      min_t = std::min(min_t, t);
+      max_t = std::max(max_t, t);
+    }
+
+    const float len2 =
+        axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    float hi[3], lo[3];
+    for (int c = 0; c < 3; c++) {
+      hi[c] = mean[c] + axis[c] * max_t / len2;
+      lo[c] = mean[c] + axis[c] * min_t / len2;
+    }
+
+    uint16_t c0 = packRGB565(hi);
+    uint16_t c1 = packRGB565(lo);
+    if (c0 < c1) std::swap(c0, c1);
+
+    uint32_t indices = 0;
+    if (c0 != c1) {
+      int palette[4][3];
+      unpackRGB565(c0, palette[0]);
+      unpackRGB565(c1, palette[1]);
+      for (int c = 0; c < 3; c++) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+      }
+
+      for (int i = 0; i < 16; i++) {
+        int best = 0, best_dist = std::numeric_limits<int>::max();
+        for (int p = 0; p < 4; p++) {
+          int dr = block[i * 4 + 0] - palette[p][0];
+          int dg = block[i * 4 + 1] - palette[p][1];
+          int db = block[i * 4 + 2] - palette[p][2];
+          int dist = dr * dr + dg * dg + db * db;
+          if (dist < best_dist) {
+            best_dist = dist;
+            best = p;
+          }
+        }
+        indices |= (uint32_t)best << (i * 2);
+      }
+    }
+
+    dst[0] = c0 & 0xff;
+    dst[1] = c0 >> 8;
+    dst[2] = c1 & 0xff;
+    dst[3] = c1 >> 8;
+    for (int i = 0; i < 4; i++) dst[4 + i] = (indices >> (i * 8)) & 0xff;
+  }
+
+  // DXT5 のアルファ / RGTC1 共通の 8 段階モード
+  static void compressChannelBlock(const unsigned char* block, int channel,
+                                   unsigned char* dst) {
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; i++) {
+      a0 = std::max<int>(a0, block[i * 4 + channel]);
+      a1 = std::min<int>(a1, block[i * 4 + channel]);
+    }
+
+    uint64_t indices = 0;
+    if (a0 != a1) {
+      int palette[8] = {a0, a1};
+      for (int p = 2; p < 8; p++)
+        palette[p] = ((8 - p) * a0 + (p - 1) * a1) / 7;
+
+      for (int i = 0; i < 16; i++) {
+        int v = block[i * 4 + channel];
+        int best = 0, best_dist = 256;
+        for (int p = 0; p < 8; p++) {
+          int dist = std::abs(v - palette[p]);
+          if (dist < best_dist) {
+            best_dist = dist;
+            best = p;
+          }
+        }
+        indices |= (uint64_t)best << (i * 3);
+      }
+    }
+
+    dst[0] = (unsigned char)a0;
+    dst[1] = (unsigned char)a1;
+    for (int i = 0; i < 6; i++) dst[2 + i] = (indices >> (i * 8)) & 0xff;
+  }
+};
+
+}  // namespace limas
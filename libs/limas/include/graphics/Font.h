@@ -6,6 +6,7 @@
 #include "gl/Renderer.h"
 #include "gl/Texture2D.h"
 #include "graphics/Pixels.h"
+#include "graphics/TextLayout.h"
 #include "primitives/Primitives.h"
 #include "system/Logger.h"
 #include "system/Singleton.h"
@@ -41,11 +42,12 @@ class Font {
     FT_Library lib_;
   };
 
-  FT_Library& getLibrary() {
+ public:
+  // GlyphAtlas などフォントを読む他のクラスとライブラリを共有する
+  static FT_Library& getLibrary() {
     return Singleton<LibraryManager>::getInstance().getLibrary();
   }
 
- public:
   struct UnitSize {
     int x_min, y_min;
     int x_max, y_max;
@@ -188,39 +190,58 @@ class Font {
     return true;
   }
 
-  geom::Mesh getMesh(const std::string& text, float x, float y,
-                     float spacing = 0) const {
-    std::vector<glm::vec3> vertices;
-    std::vector<glm::vec2> texcoords;
-    std::vector<GLuint> indices;
-
-    float x_offset = 0;
+  // 改行を含む文字列を並べる
+  void layout(const std::string& text, TextLayout& quads,
+              float spacing = 0) const {
+    const float tw = texture_.getWidth();
+    const float th = texture_.getHeight();
+    glm::vec2 pen(0);
 
     for (char c : text) {
+      if (c == '\n') {
+        pen = glm::vec2(0, pen.y + unit_size_.height);
+        continue;
+      }
+
       auto it = characters_.find(c);
       if (it == characters_.end()) continue;
 
       const auto& ch = it->second;
+      if (ch.width > 0 && ch.height > 0) {
+        float tl = (float)ch.x_offset / tw;
+        float tt = (float)ch.y_offset / th;
+        quads.push_back(
+            {glm::vec4(pen.x + ch.x_min, pen.y + ch.y_min - unit_size_.y_min,
+                       ch.width, ch.height),
+             glm::vec4(tl, tt, tl + ch.width / tw, tt + ch.height / th)});
+      }
+
+      pen.x += ch.advance_x + spacing;
+    }
+  }
+
+  geom::Mesh getMesh(const std::string& text, float x, float y,
+                     float spacing = 0) const {
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> texcoords;
+    std::vector<GLuint> indices;
+
+    TextLayout quads;
+    layout(text, quads, spacing);
+    for (const auto& q : quads) {
       int index_offset = vertices.size();
 
-      float dx = x + x_offset + ch.x_min;
-      float dy = y + ch.y_min - unit_size_.y_min;
+      float dx = x + q.rect.x;
+      float dy = y + q.rect.y;
       vertices.emplace_back(dx, dy, 0);
-      vertices.emplace_back(dx + ch.width, dy, 0);
-      vertices.emplace_back(dx + ch.width, dy + ch.height, 0);
-      vertices.emplace_back(dx, dy + ch.height, 0);
-
-      float tw = texture_.getWidth();
-      float th = texture_.getHeight();
-      float tl = (float)ch.x_offset / tw;
-      float tr = tl + (float)ch.width / tw;
-      float tt = (float)(ch.y_offset) / th;
-      float tb = tt + (float)ch.height / th;
-
-      texcoords.emplace_back(tl, tt);
-      texcoords.emplace_back(tr, tt);
-      texcoords.emplace_back(tr, tb);
-      texcoords.emplace_back(tl, tb);
+      vertices.emplace_back(dx + q.rect.z, dy, 0);
+      vertices.emplace_back(dx + q.rect.z, dy + q.rect.w, 0);
+      vertices.emplace_back(dx, dy + q.rect.w, 0);
+
+      texcoords.emplace_back(q.texcoord.x, q.texcoord.y);
+      texcoords.emplace_back(q.texcoord.z, q.texcoord.y);
+      texcoords.emplace_back(q.texcoord.z, q.texcoord.w);
+      texcoords.emplace_back(q.texcoord.x, q.texcoord.w);
 
       indices.push_back(index_offset + 0);
       indices.push_back(index_offset + 1);
@@ -228,8 +249,6 @@ class Font {
       indices.push_back(index_offset + 2);
       indices.push_back(index_offset + 3);
       indices.push_back(index_offset + 0);
-
-      x_offset += ch.advance_x + spacing;
     }
 
     geom::Mesh mesh;
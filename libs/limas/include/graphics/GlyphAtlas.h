@@ -0,0 +1,422 @@
+#pragma once
+#include "gl/Texture2D.h"
+#include "graphics/Font.h"
+#include "graphics/Pixels.h"
+#include "graphics/TextLayout.h"
+#include "imstb_rectpack.h"
+#include "system/Logger.h"
+#include "system/Noncopyable.h"
+
+namespace limas {
+
+// 使われた文字だけを FreeType でラスタライズしてアトラスに詰める
+// SDF にすると 1 枚のアトラスをどの大きさの文字にも使える
+// 一杯になったら長く使われていない文字を捨てて詰め直す
+class GlyphAtlas : private Noncopyable {
+ public:
+  struct Settings {
+    int pixel_size = 48;  // ラスタライズする大きさ
+    int spread = 8;       // SDF が距離を持つ範囲 (px)
+    bool b_sdf = true;
+    int width = 1024;
+    int height = 1024;
+  };
+
+  struct Glyph {
+    FT_UInt index = 0;
+    glm::ivec2 bearing = glm::ivec2(0);  // 原点から左上までの距離
+    glm::ivec2 size = glm::ivec2(0);
+    glm::ivec2 position = glm::ivec2(0);  // アトラス内の位置
+    float advance = 0;
+    uint64_t last_used = 0;
+    Pixels2D pixels;  // 詰め直す時に使う
+  };
+
+  GlyphAtlas()
+      : face_(nullptr),
+        ascender_(0),
+        line_height_(0),
+        tick_(0),
+        generation_(0),
+        num_rasterized_(0),
+        num_evictions_(0) {}
+
+  virtual ~GlyphAtlas() { unload(); }
+
+  bool load(const std::string& path) { return load(path, Settings()); }
+
+  bool load(const std::string& path, const Settings& settings) {
+    unload();
+    if (FT_New_Face(Font::getLibrary(), path.c_str(), 0, &face_)) {
+      logger::error("GlyphAtlas")
+          << "Failed to load font from " << path << logger::end();
+      face_ = nullptr;
+      return false;
+    }
+
+    settings_ = settings;
+    FT_Set_Pixel_Sizes(face_, 0, settings_.pixel_size);
+    ascender_ = face_->size->metrics.ascender / 64.0f;
+    line_height_ = face_->size->metrics.height / 64.0f;
+
+    texture_.allocate(settings_.width, settings_.height, GL_R8);
+    texture_.setMinFilter(GL_LINEAR);
+    texture_.setMagFilter(GL_LINEAR);
+    // 1 チャンネルのまま白の文字として読めるようにする
+    const GLint swizzle[] = {GL_ONE, GL_ONE, GL_ONE, GL_RED};
+    texture_.bind();
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    texture_.unbind();
+
+    clear();
+    return true;
+  }
+
+  void unload() {
+    if (face_) FT_Done_Face(face_);
+    face_ = nullptr;
+    glyphs_.clear();
+  }
+
+  bool isLoaded() const { return face_ != nullptr; }
+
+  // ラスタライズした文字を全て捨てる
+  void clear() {
+    if (!isLoaded()) return;
+    glyphs_.clear();
+    resetPacker();
+    Pixels2D pixels(settings_.width, settings_.height, 1);
+    upload(pixels, glm::ivec2(0));
+    generation_++;
+  }
+
+  // 改行を含む文字列を並べる。大きさは pixel_size 基準なので
+  // 描画する時に getScale() で拡大縮小する
+  void layout(const std::string& text, TextLayout& quads) {
+    if (!isLoaded()) return;
+
+    tick_++;
+    const uint64_t generation = generation_;
+    const size_t begin = quads.size();
+    layoutGlyphs(text, quads);
+
+    // 途中で詰め直したら先に並べた文字の texcoord が古いのでやり直す
+    if (generation != generation_) {
+      quads.resize(begin);
+      layoutGlyphs(text, quads);
+    }
+  }
+
+  // 必要ならラスタライズしてアトラスに追加する
+  const Glyph* getGlyph(char32_t c) {
+    if (!isLoaded()) return nullptr;
+
+    auto it = glyphs_.find(c);
+    if (it != glyphs_.end()) {
+      it->second.last_used = tick_;
+      return &it->second;
+    }
+
+    Glyph glyph;
+    if (!rasterize(c, glyph)) return nullptr;
+    glyph.last_used = tick_;
+
+    const bool b_empty = glyph.size.x == 0 || glyph.size.y == 0;
+    if (!b_empty && !pack(glyph)) {
+      logger::warn("GlyphAtlas")
+          << "No space for U+" << std::hex << (uint32_t)c << std::dec
+          << logger::end();
+      return nullptr;
+    }
+
+    auto& g = glyphs_[c] = std::move(glyph);
+    if (!b_empty) upload(g.pixels, g.position);
+    return &g;
+  }
+
+  // size の文字を描く時の拡大率
+  float getScale(float size) const { return size / settings_.pixel_size; }
+
+  bool isSdf() const { return settings_.b_sdf; }
+  const Settings& getSettings() const { return settings_; }
+  float getAscender() const { return ascender_; }
+  float getLineHeight() const { return line_height_; }
+
+  const gl::Texture2D& getTexture() const { return texture_; }
+  gl::Texture2D& getTexture() { return texture_; }
+
+  // 詰め直すたびに増える。texcoord を保持している側はこれで古さを判断する
+  uint64_t getGeneration() const { return generation_; }
+
+  size_t getNumGlyphs() const { return glyphs_.size(); }
+  size_t getNumRasterized() const { return num_rasterized_; }
+  size_t getNumEvictions() const { return num_evictions_; }
+
+ private:
+  static constexpr float FAR_DISTANCE = 1e20f;
+
+  void layoutGlyphs(const std::string& text, TextLayout& quads) {
+    const float tw = settings_.width;
+    const float th = settings_.height;
+    const bool b_kerning = FT_HAS_KERNING(face_);
+    glm::vec2 pen(0);
+    FT_UInt prev = 0;
+
+    for (size_t i = 0; i < text.size();) {
+      char32_t c = decodeUtf8(text, i);
+      if (c == '\n') {
+        pen = glm::vec2(0, pen.y + line_height_);
+        prev = 0;
+        continue;
+      }
+
+      const Glyph* g = getGlyph(c);
+      if (!g) continue;
+
+      if (b_kerning && prev) {
+        FT_Vector delta;
+        FT_Get_Kerning(face_, prev, g->index, FT_KERNING_DEFAULT, &delta);
+        pen.x += delta.x / 64.0f;
+      }
+      prev = g->index;
+
+      if (g->size.x > 0 && g->size.y > 0) {
+        const glm::vec2 t0 = glm::vec2(g->position) / glm::vec2(tw, th);
+        const glm::vec2 t1 =
+            glm::vec2(g->position + g->size) / glm::vec2(tw, th);
+        quads.push_back({glm::vec4(pen.x + g->bearing.x,
+                                   pen.y + ascender_ - g->bearing.y, g->size.x,
+                                   g->size.y),
+                         glm::vec4(t0, t1)});
+      }
+      pen.x += g->advance;
+    }
+  }
+
+  bool rasterize(char32_t c, Glyph& glyph) {
+    glyph.index = FT_Get_Char_Index(face_, c);
+    if (FT_Load_Glyph(face_, glyph.index, FT_LOAD_RENDER)) {
+      logger::warn("GlyphAtlas")
+          << "FT_Load_Glyph failed for U+" << std::hex << (uint32_t)c
+          << std::dec << logger::end();
+      return false;
+    }
+    num_rasterized_++;
+
+    FT_GlyphSlot slot = face_->glyph;
+    const FT_Bitmap& bitmap = slot->bitmap;
+    glyph.advance = slot->advance.x / 64.0f;
+    if (bitmap.width == 0 || bitmap.rows == 0) return true;
+
+    // 隣の文字がにじまないように周りに余白をつける
+    const int pad = settings_.b_sdf ? settings_.spread : 1;
+    const int w = bitmap.width + pad * 2;
+    const int h = bitmap.rows + pad * 2;
+    glyph.size = glm::ivec2(w, h);
+    glyph.bearing = glm::ivec2(slot->bitmap_left - pad, slot->bitmap_top + pad);
+
+    glyph.pixels.allocate(w, h, 1);
+    auto& dst = glyph.pixels.getData();
+    for (unsigned int y = 0; y < bitmap.rows; y++) {
+      const unsigned char* src = bitmap.buffer + y * bitmap.pitch;
+      std::copy(src, src + bitmap.width, &dst[(y + pad) * w + pad]);
+    }
+
+    if (settings_.b_sdf) toSdf(glyph.pixels);
+    return true;
+  }
+
+  // 被覆率を文字の輪郭からの距離に置き換える。0.5 が輪郭
+  void toSdf(Pixels2D& pixels) const {
+    const int w = pixels.getWidth();
+    const int h = pixels.getHeight();
+    auto& data = pixels.getData();
+
+    std::vector<float> outside(w * h), inside(w * h);
+    for (int i = 0; i < w * h; i++) {
+      const bool b_inside = data[i] >= 128;
+      outside[i] = b_inside ? 0 : FAR_DISTANCE;
+      inside[i] = b_inside ? FAR_DISTANCE : 0;
+    }
+    distanceTransform(outside, w, h);
+    distanceTransform(inside, w, h);
+
+    const float spread = settings_.spread;
+    for (int i = 0; i < w * h; i++) {
+      const float d = outside[i] > 0 ? std::sqrt(outside[i]) - 0.5f
+                                     : 0.5f - std::sqrt(inside[i]);
+      const float v = glm::clamp(0.5f - d / (spread * 2), 0.0f, 1.0f);
+      data[i] = static_cast<unsigned char>(v * 255 + 0.5f);
+    }
+  }
+
+  // Felzenszwalb の 2 乗距離変換。grid は 0 の画素からの距離の 2 乗になる
+  void distanceTransform(std::vector<float>& grid, int w, int h) const {
+    const int n = std::max(w, h);
+    std::vector<float> f(n), d(n), z(n + 1);
+    std::vector<int> v(n);
+
+    for (int x = 0; x < w; x++) {
+      for (int y = 0; y < h; y++) f[y] = grid[y * w + x];
+      distanceTransform1D(f.data(), d.data(), v.data(), z.data(), h);
+      for (int y = 0; y < h; y++) grid[y * w + x] = d[y];
+    }
+    for (int y = 0; y < h; y++) {
+      std::copy_n(&grid[y * w], w, f.begin());
+      distanceTransform1D(f.data(), d.data(), v.data(), z.data(), w);
+      std::copy_n(d.begin(), w, &grid[y * w]);
+    }
+  }
+
+  static void distanceTransform1D(const float* f, float* d, int* v, float* z,
+                                  int n) {
+    auto intersect = [&](int q, int r) {
+      return ((f[q] + q * q) - (f[r] + r * r)) / (2.0f * (q - r));
+    };
+
+    int k = 0;
+    v[0] = 0;
+    z[0] = -FAR_DISTANCE;
+    z[1] = FAR_DISTANCE;
+    for (int q = 1; q < n; q++) {
+      float s = intersect(q, v[k]);
+      while (s <= z[k]) {
+        k--;
+        s = intersect(q, v[k]);
+      }
+      k++;
+      v[k] = q;
+      z[k] = s;
+      z[k + 1] = FAR_DISTANCE;
+    }
+
+    k = 0;
+    for (int q = 0; q < n; q++) {
+      while (z[k + 1] < q) k++;
+      d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+    }
+  }
+
+  bool pack(Glyph& glyph) {
+    if (packRect(glyph)) return true;
+    evict();
+    return packRect(glyph);
+  }
+
+  bool packRect(Glyph& glyph) {
+    stbrp_rect rect = {};
+    rect.w = glyph.size.x;
+    rect.h = glyph.size.y;
+    stbrp_pack_rects(&packer_, &rect, 1);
+    if (!rect.was_packed) return false;
+    glyph.position = glm::ivec2(rect.x, rect.y);
+    return true;
+  }
+
+  void resetPacker() {
+    nodes_.resize(settings_.width);
+    stbrp_init_target(&packer_, settings_.width, settings_.height,
+                      nodes_.data(), nodes_.size());
+  }
+
+  // 今の layout() で使っている文字と、それ以外で新しい方の半分を残して
+  // 詰め直し、アトラス全体を送り直す
+  void evict() {
+    std::vector<std::pair<uint64_t, char32_t>> order;
+    order.reserve(glyphs_.size());
+    for (const auto& [c, g] : glyphs_) order.emplace_back(g.last_used, c);
+    std::sort(order.begin(), order.end(), std::greater<>());
+
+    size_t num_current = 0;
+    while (num_current < order.size() && order[num_current].first == tick_) {
+      num_current++;
+    }
+    const size_t num_keep = num_current + (order.size() - num_current) / 2;
+    for (size_t i = num_keep; i < order.size(); i++) {
+      glyphs_.erase(order[i].second);
+    }
+
+    std::vector<stbrp_rect> rects;
+    std::vector<char32_t> codes;
+    for (auto& [c, g] : glyphs_) {
+      if (g.size.x == 0 || g.size.y == 0) continue;
+      stbrp_rect rect = {};
+      rect.id = rects.size();
+      rect.w = g.size.x;
+      rect.h = g.size.y;
+      rects.push_back(rect);
+      codes.push_back(c);
+    }
+
+    resetPacker();
+    stbrp_pack_rects(&packer_, rects.data(), rects.size());
+
+    Pixels2D pixels(settings_.width, settings_.height, 1);
+    for (const auto& rect : rects) {
+      if (!rect.was_packed) {
+        glyphs_.erase(codes[rect.id]);
+        continue;
+      }
+      auto& g = glyphs_[codes[rect.id]];
+      g.position = glm::ivec2(rect.x, rect.y);
+      pixels.loadData(g.pixels.getData().data(), g.size.x, g.size.y, rect.x,
+                      rect.y);
+    }
+    upload(pixels, glm::ivec2(0));
+
+    generation_++;
+    num_evictions_++;
+  }
+
+  void upload(const Pixels2D& pixels, const glm::ivec2& position) {
+    // 1 チャンネルの行は 4 バイト境界に揃っていない
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    texture_.loadData(pixels.getData().data(), pixels.getWidth(),
+                      pixels.getHeight(), position.x, position.y);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  }
+
+  // 不正なバイト列は U+FFFD にする
+  static char32_t decodeUtf8(const std::string& text, size_t& i) {
+    const unsigned char c = text[i++];
+    if (c < 0x80) return c;
+
+    int length = 0;
+    char32_t code = 0;
+    if ((c & 0xe0) == 0xc0) {
+      length = 1;
+      code = c & 0x1f;
+    } else if ((c & 0xf0) == 0xe0) {
+      length = 2;
+      code = c & 0x0f;
+    } else if ((c & 0xf8) == 0xf0) {
+      length = 3;
+      code = c & 0x07;
+    } else {
+      return 0xfffd;
+    }
+
+    for (int n = 0; n < length; n++) {
+      if (i >= text.size() || (text[i] & 0xc0) != 0x80) return 0xfffd;
+      code = (code << 6) | (text[i++] & 0x3f);
+    }
+    return code;
+  }
+
+  FT_Face face_;
+  Settings settings_;
+  float ascender_;
+  float line_height_;
+
+  gl::Texture2D texture_;
+  stbrp_context packer_;
+  std::vector<stbrp_node> nodes_;
+  std::unordered_map<char32_t, Glyph> glyphs_;
+
+  uint64_t tick_;
+  uint64_t generation_;
+  size_t num_rasterized_;
+  size_t num_evictions_;
+};
+
+}  // namespace limas
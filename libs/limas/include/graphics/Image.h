@@ -66,6 +66,7 @@ class BaseImage {
   GLenum getInternalFormat() const { return tex_.getInternalFormat(); }
   size_t getNumChannels() const { return tex_.getNumChannels(); }
   gl::Texture2D& getTexture() { return tex_; }
+  const gl::Texture2D& getTexture() const { return tex_; }
   BasePixels2D<PixelType>& getPixels() { return pixels_; }
 
  protected:
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "graphics/DxtCompressor.h"
 #include "graphics/Image.h"
 #include "system/Exception.h"
 #include "system/Logger.h"
@@ -95,6 +96,26 @@ class ImageIO {
     return image;
   }
 
+  // 読み込み時に DXT / RGTC に圧縮してテクスチャを作る
+  // VRAM が 1/4 ~ 1/8 になり、アップロードも軽くなる
+  static gl::Texture2D loadCompressedTexture(const std::string& filepath,
+                                             DxtCompressor::Format format,
+                                             ThreadPool* pool = nullptr) {
+    auto pixels = loadPixels(filepath, 4);
+    const size_t width = pixels.getWidth();
+    const size_t height = pixels.getHeight();
+
+    std::vector<unsigned char> blocks(
+        DxtCompressor::getCompressedSize(format, width, height));
+    DxtCompressor::compress(pixels.getData().data(), width, height, width * 4,
+                            format, blocks.data(), pool);
+
+    gl::Texture2D tex;
+    tex.allocate(width, height, DxtCompressor::getInternalFormat(format));
+    tex.loadCompressedData(blocks.data(), blocks.size());
+    return tex;
+  }
+
   template <typename PixelType>
   static void savePixels(const std::string& filepath,
                          std::vector<PixelType>& pixels, size_t width,
@@ -0,0 +1,14 @@
+#pragma once
+
+namespace limas {
+
+// フォントが文字列を並べた結果の 1 文字分
+// rect は文字列の原点からの (x, y, 幅, 高さ)、texcoord は (s0, t0, s1, t1)
+struct GlyphQuad {
+  glm::vec4 rect;
+  glm::vec4 texcoord;
+};
+
+using TextLayout = std::vector<GlyphQuad>;
+
+}  // namespace limas
@@ -1,5 +1,6 @@
 #pragma once
 #include "math/Math.h"
+#include "utils/FrameClock.h"
 
 namespace limas {
 namespace math {
@@ -19,6 +20,7 @@ class Oscillator {
   double getPhase() const { return phase_; }
 
   virtual double get(float time) = 0;
+  double get() { return get(FrameClock::getElapsedInSeconds()); }
 
  protected:
   double amp_;
@@ -28,6 +30,7 @@ class Oscillator {
 
 class SineWave : public Oscillator {
  public:
+  using Oscillator::get;
   double get(float sec) {
     return amp_ * sin(math::twopi() * freq_ * sec + phase_);
   }
@@ -35,6 +38,7 @@ class SineWave : public Oscillator {
 
 class TriangleWave : public Oscillator {
  public:
+  using Oscillator::get;
   double get(float sec) {
     double period = 1.0 / freq_;
     double t = fmod(sec + phase_, period);
@@ -49,6 +53,7 @@ class TriangleWave : public Oscillator {
 
 class SquareWave : public Oscillator {
  public:
+  using Oscillator::get;
   double get(float sec) {
     double period = 1.0 / freq_;
     double t = fmod(sec + phase_, period);
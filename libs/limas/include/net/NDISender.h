@@ -72,7 +72,8 @@ class BaseNDISender {
   void unbind() { fbo_.unbind(); }
 
   void send() {
-    if (pbo_.readTo(&data_.getFront(), fbo_.getID(), 0)) {
+    // 非同期では数フレーム前の読み出しが終わっている時だけ送る
+    if (pbo_.readToPixels(&data_.getFront(), fbo_)) {
       send(data_.getFront().data());
       if (pbo_.isAsync()) data_.swap();
     }
@@ -81,7 +82,7 @@ class BaseNDISender {
   void send(T* data) {
     if (NDIlib_send_get_no_connections(ndi_send_, 0)) {
       ndi_video_frame_.p_data = (uint8_t*)data;
-      if (pbo_->isAsync()) {
+      if (pbo_.isAsync()) {
         NDIlib_send_send_video_async_v2(ndi_send_, &ndi_video_frame_);
       } else
         NDIlib_send_send_video_v2(ndi_send_, &ndi_video_frame_);
@@ -2,13 +2,19 @@
 #include "gl/Fbo.h"
 #include "gl/Shader.h"
 #include "gl/VboMesh.h"
+#include "pp/RenderGraph.h"
 #include "primitives/Rectangle.h"
 #include "type/ParameterGroup.h"
-#include "type/PingPong.h"
+#include "utils/FileSystem.h"
 
 namespace limas {
 namespace pp {
 
+// PostProcessing の入力。COLOR は描いた色、DEPTH は深度
+// パスが COLOR を書くと次のパスからはそれが COLOR になる
+inline const std::string COLOR = "color";
+inline const std::string DEPTH = "depth";
+
 class BasePass : public std::enable_shared_from_this<BasePass> {
  public:
   using Ptr = std::shared_ptr<BasePass>;
@@ -19,7 +25,32 @@ class BasePass : public std::enable_shared_from_this<BasePass> {
     return instance;
   }
 
-  virtual void apply(PingPong<gl::Fbo::Ptr>& fbos) = 0;
+  virtual ~BasePass() {}
+
+  // 読み書きするテクスチャを宣言する。既定では COLOR を読んで COLOR に書く
+  virtual void setup(PassBuilder& builder) {
+    builder.read(COLOR);
+    builder.write(COLOR);
+  }
+
+  virtual void execute(PassContext& context) = 0;
+
+  void setEnabled(bool b_enabled) {
+    if (b_enabled_ == b_enabled) return;
+    b_enabled_ = b_enabled;
+    invalidate();
+  }
+  bool isEnabled() const { return b_enabled_; }
+
+  // setup() の宣言が変わる時に呼ぶ。次のフレームでグラフを組み直す
+  void invalidate() { b_invalidated_ = true; }
+  bool takeInvalidated() {
+    const bool b_invalidated = b_invalidated_;
+    b_invalidated_ = false;
+    return b_invalidated;
+  }
+
+  const std::string& getName() const { return params_.getName(); }
 
   template <typename T>
   Ptr setParam(const std::string& name, const T& value) {
@@ -48,12 +79,18 @@ class BasePass : public std::enable_shared_from_this<BasePass> {
   void deserialize(const json& j) { params_.deserialize(j); }
 
  protected:
-  BasePass(const std::string& name) {
+  BasePass(const std::string& name)
+      : b_enabled_(true), b_invalidated_(false) {
     plane_ = prim::Rectangle(-1, -1, 2, 2);
     params_.setName(name);
   }
   void fill() const { plane_.draw(GL_TRIANGLE_FAN); }
 
+  static bool loadShader(gl::Shader& shader, const std::string& fragment) {
+    return shader.load(fs::getCommonResourcePath("shaders/thru.vert"),
+                       fs::getCommonResourcePath(fragment));
+  }
+
   ParameterGroup& getParams() { return params_; }
 
   template <typename T>
@@ -65,13 +102,15 @@ class BasePass : public std::enable_shared_from_this<BasePass> {
   Parameter<T>& addParam(const std::string& group, const std::string& name,
                          const T& value) {
     if (!params_.hasChild(group)) params_.addChild(group);
-    return params_.getChild(group).addParam<T>(group, value);
+    return params_.getChild(group).addParam<T>(name, value);
   }
 
  private:
   gl::VboMesh plane_;
   ParameterGroup params_;
+  bool b_enabled_;
+  bool b_invalidated_;
 };
 
 }  // namespace pp
-}  // namespace limas
\ No newline at end of file
+}  // namespace limas
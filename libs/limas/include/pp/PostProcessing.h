@@ -1,85 +1,324 @@
 #pragma once
+#include "gl/GpuProfiler.h"
 #include "pp/BasePass.h"
-#include "primitives/Rectangle.h"
+#include "pp/RenderGraph.h"
 
 namespace limas {
 
+// ポストエフェクトを小さなレンダーグラフとして実行する
+// パスは追加した順に並び、setup() で読み書きするテクスチャと形式・解像度を
+// 宣言する。無効なパスと、出力が最後まで使われないパスは実行しない
+// 途中のテクスチャは FboPool から借り、寿命が重ならなければ同じ FBO を使う
+// setProfiler() で gl::GpuProfiler を渡すと、パスごとに GPU の時間を測る
 class PostProcessing {
  public:
-  PostProcessing() {}
+  struct Timing {
+    std::string name;
+    double gpu_ms = 0;
+    bool b_culled = false;
+  };
+
+  PostProcessing()
+      : width_(0),
+        height_(0),
+        output_name_(pp::COLOR),
+        output_(0),
+        output_pool_index_(-1),
+        profiler_(nullptr),
+        b_dirty_(true) {}
 
   void setup(size_t width, size_t height) {
-    for (int i = 0; i < 2; i++) {
-      fbos_[i] = gl::Fbo::create(width, height);
-      fbos_[i]->attachColor(GL_RGBA8);
-      fbos_[i]->attachDepthAsTexture();
-      for (int j = 0; j < 2; j++) {
-        fbos_[i]->getTexture(j)->setMagFilter(GL_LINEAR);
-        fbos_[i]->getTexture(j)->setMinFilter(GL_LINEAR);
-        fbos_[i]->getTexture(j)->setWrapS(GL_CLAMP_TO_EDGE);
-        fbos_[i]->getTexture(j)->setWrapT(GL_CLAMP_TO_EDGE);
-      }
-      fbos_[i]->bind();
-      glClearColor(0, 0, 0, 0);
-      glClear(GL_COLOR_BUFFER_BIT);
-      fbos_[i]->unbind();
+    width_ = width;
+    height_ = height;
+    scene_fbo_.allocate(width, height);
+    scene_fbo_.attachColor(GL_RGBA8);
+    scene_fbo_.attachDepthAsTexture();
+    for (auto& tex : scene_fbo_.getTextures()) {
+      tex.setMagFilter(GL_LINEAR);
+      tex.setMinFilter(GL_LINEAR);
+      tex.setWrapS(GL_CLAMP_TO_EDGE);
+      tex.setWrapT(GL_CLAMP_TO_EDGE);
     }
+    scene_fbo_.bind();
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    scene_fbo_.unbind();
+
+    pool_.clear();
+    output_pool_index_ = -1;
+    b_dirty_ = true;
   }
 
   template <class T>
   pp::BasePass::Ptr addPass(const std::string& name) {
-    auto pass = pp::BasePass::create<T>(name, fbos_[0]->getWidth(),
-                                        fbos_[0]->getHeight());
-    auto it = passes_.find(name);
-    if (it == passes_.end()) {
-      passes_[name] = pass;
-    } else {
-      log::warn("PostProcessing") << name << " was already added" << log::end();
+    if (findPass(name) != passes_.end()) {
+      logger::warn("PostProcessing")
+          << name << " was already added" << logger::end();
+      return *findPass(name);
     }
+    auto pass = pp::BasePass::create<T>(name, width_, height_);
+    passes_.push_back(pass);
+    b_dirty_ = true;
     return pass;
   }
 
   pp::BasePass::Ptr getPass(const std::string& name) {
-    auto it = passes_.find(name);
-    if (it != passes_.end()) {
-      return it->second;
-    }
-    log::warn("PostProcessing") << name << " is not added" << log::end();
+    auto it = findPass(name);
+    if (it != passes_.end()) return *it;
+    logger::warn("PostProcessing") << name << " is not added" << logger::end();
     return nullptr;
   }
 
-  void bind() { fbos_.getFront()->bind(); }
+  void removePass(const std::string& name) {
+    auto it = findPass(name);
+    if (it == passes_.end()) return;
+    passes_.erase(it);
+    b_dirty_ = true;
+  }
+
+  // 最終的に getTexture() で返すテクスチャの名前。既定は COLOR
+  void setOutput(const std::string& name) {
+    output_name_ = name;
+    b_dirty_ = true;
+  }
+
+  void bind() { scene_fbo_.bind(); }
   void unbind() {
-    fbos_.getFront()->unbind();
-    fbos_.swap();
-    for (auto it = passes_.begin(); it != passes_.end(); ++it) {
-      it->second->apply(fbos_);
+    scene_fbo_.unbind();
+    for (auto& pass : passes_) {
+      if (pass->takeInvalidated()) b_dirty_ = true;
     }
+    if (b_dirty_) compile();
+    execute();
   }
 
+  // 最初の unbind() の前は確保していない空のテクスチャを返す
+  const gl::Texture2D& getTexture() const {
+    if (resources_.empty()) {
+      logger::error("PostProcessing")
+          << "getTexture() is called before unbind()" << logger::end();
+      static const gl::Texture2D empty;
+      return empty;
+    }
+    return getResourceTexture(output_);
+  }
+
+  // プロファイラに最後に届いたフレームの GPU の時間
+  // プロファイラがなければ時間は 0
+  std::vector<Timing> getTimings() const {
+    std::vector<Timing> timings;
+    for (const auto& step : steps_) {
+      Timing timing;
+      timing.name = step.pass->getName();
+      timing.b_culled = !step.b_live;
+      if (step.b_live && profiler_) {
+        timing.gpu_ms = profiler_->getZoneTimeInMs(timing.name);
+      }
+      timings.push_back(timing);
+    }
+    return timings;
+  }
+
+  double getGpuTimeMs() const {
+    double ms = 0;
+    for (const auto& timing : getTimings()) ms += timing.gpu_ms;
+    return ms;
+  }
+
+  size_t getNumPasses() const { return passes_.size(); }
+  size_t getNumCulledPasses() const {
+    size_t n = passes_.size();
+    for (const auto& step : steps_) n -= step.b_live;
+    return n;
+  }
+  size_t getNumFbos() const { return pool_.size(); }
+
+  // パスごとの GPU の時間をパスの名前の区間として記録する
+  void setProfiler(gl::GpuProfiler* profiler) { profiler_ = profiler; }
+  gl::GpuProfiler* getProfiler() const { return profiler_; }
+
   json serialize() const {
     json j;
-    for (auto it = passes_.begin(); it != passes_.end(); ++it) {
-      j[it->first] = it->second->serialize();
+    for (const auto& pass : passes_) {
+      j[pass->getName()] = pass->serialize();
     }
     return j;
   }
 
   void deserialize(const json& j) {
-    for (auto it = passes_.begin(); it != passes_.end(); ++it) {
-      if (j.contains(it->first))
-        it->second->deserialize(j[it->first]);
-      else
-        log::warn("PostProcessing")
-            << it->first + " is not contained in json" << log::end();
+    for (auto& pass : passes_) {
+      if (j.contains(pass->getName())) {
+        pass->deserialize(j[pass->getName()]);
+      } else {
+        logger::warn("PostProcessing")
+            << pass->getName() + " is not contained in json" << logger::end();
+      }
     }
   }
 
-  gl::Texture2D::Ptr& getTexture() { return fbos_.getBack()->getTexture(0); }
-
  private:
-  PingPong<gl::Fbo::Ptr> fbos_;
-  std::map<std::string, pp::BasePass::Ptr> passes_;
+  struct Resource {
+    pp::TextureDesc desc;
+    int producer = -1;  // -1 は入力
+    int last_use = -1;
+    int pool_index = -1;
+    const gl::Texture2D* imported = nullptr;
+  };
+
+  struct Step {
+    pp::BasePass::Ptr pass;
+    std::vector<std::pair<std::string, size_t>> reads;
+    std::vector<std::pair<std::string, size_t>> writes;
+    bool b_live = false;
+  };
+
+  auto findPass(const std::string& name) {
+    return std::find_if(
+        passes_.begin(), passes_.end(),
+        [&name](const pp::BasePass::Ptr& p) { return p->getName() == name; });
+  }
+
+  const gl::Texture2D& getResourceTexture(size_t i) const {
+    const Resource& res = resources_[i];
+    if (res.imported) return *res.imported;
+    return pool_.getFbo(res.pool_index).getTexture(0);
+  }
+
+  // 宣言を集めて版を振り、出力から逆にたどって要るパスと寿命を決める
+  void compile() {
+    resources_.clear();
+    steps_.clear();
+    std::map<std::string, size_t> latest;
+
+    auto import = [&](const std::string& name, const gl::Texture2D& tex) {
+      Resource res;
+      res.imported = &tex;
+      latest[name] = resources_.size();
+      resources_.push_back(res);
+    };
+    import(pp::COLOR, scene_fbo_.getTexture(0));
+    import(pp::DEPTH, scene_fbo_.getTexture(1));
+
+    for (auto& pass : passes_) {
+      if (!pass->isEnabled()) continue;
+      pp::PassBuilder builder;
+      pass->setup(builder);
+
+      Step step;
+      step.pass = pass;
+      bool b_valid = true;
+      for (const auto& name : builder.getReads()) {
+        auto it = latest.find(name);
+        if (it == latest.end()) {
+          logger::warn("PostProcessing") << pass->getName() << " reads "
+                                         << name << " which nobody writes"
+                                         << logger::end();
+          b_valid = false;
+          break;
+        }
+        step.reads.emplace_back(name, it->second);
+      }
+      if (!b_valid) continue;
+
+      for (const auto& [name, desc] : builder.getWrites()) {
+        Resource res;
+        res.desc = desc;
+        res.producer = steps_.size();
+        step.writes.emplace_back(name, resources_.size());
+        resources_.push_back(res);
+      }
+      for (const auto& [name, i] : step.writes) latest[name] = i;
+      steps_.push_back(step);
+    }
+
+    auto it = latest.find(output_name_);
+    if (it == latest.end()) {
+      logger::warn("PostProcessing")
+          << output_name_ << " is not written by any pass" << logger::end();
+      it = latest.find(pp::COLOR);
+    }
+    output_ = it->second;
+
+    std::vector<bool> b_needed(resources_.size(), false);
+    b_needed[output_] = true;
+    for (int i = steps_.size() - 1; i >= 0; i--) {
+      Step& step = steps_[i];
+      for (const auto& write : step.writes) {
+        step.b_live |= b_needed[write.second];
+      }
+      if (!step.b_live) continue;
+      for (const auto& read : step.reads) b_needed[read.second] = true;
+    }
+
+    for (int i = 0; i < (int)steps_.size(); i++) {
+      if (!steps_[i].b_live) continue;
+      for (const auto& read : steps_[i].reads) {
+        resources_[read.second].last_use = i;
+      }
+      for (const auto& write : steps_[i].writes) {
+        auto& res = resources_[write.second];
+        res.last_use = std::max(res.last_use, i);
+      }
+    }
+    // 出力は次のフレームまで持つ
+    resources_[output_].last_use = steps_.size();
+
+    b_dirty_ = false;
+  }
+
+  void execute() {
+    if (output_pool_index_ >= 0) pool_.release(output_pool_index_);
+    output_pool_index_ = -1;
+
+    for (int i = 0; i < (int)steps_.size(); i++) {
+      Step& step = steps_[i];
+      if (!step.b_live) continue;
+
+      // 読むテクスチャを返す前に書き込み先を借りるので同じ FBO にはならない
+      pp::PassContext context(pool_, width_, height_);
+      for (const auto& [name, r] : step.writes) {
+        auto& res = resources_[r];
+        res.pool_index = pool_.acquire(context.getScaledWidth(res.desc.scale),
+                                       context.getScaledHeight(res.desc.scale),
+                                       res.desc.internal_format);
+        context.addTarget(name, pool_.getFbo(res.pool_index));
+      }
+      for (const auto& [name, r] : step.reads) {
+        context.addTexture(name, getResourceTexture(r));
+      }
+
+      {
+        gl::GpuProfiler::Scope scope(profiler_, step.pass->getName());
+        step.pass->execute(context);
+      }
+
+      for (const auto& read : step.reads) releaseIfLast(read.second, i);
+      for (const auto& write : step.writes) releaseIfLast(write.second, i);
+    }
+
+    output_pool_index_ = resources_[output_].pool_index;
+    pool_.endFrame();
+  }
+
+  void releaseIfLast(size_t r, int step) {
+    auto& res = resources_[r];
+    if (res.imported || res.last_use != step || res.pool_index < 0) return;
+    pool_.release(res.pool_index);
+  }
+
+  size_t width_;
+  size_t height_;
+  gl::Fbo scene_fbo_;
+  std::vector<pp::BasePass::Ptr> passes_;
+
+  std::string output_name_;
+  std::vector<Resource> resources_;
+  std::vector<Step> steps_;
+  size_t output_;
+  int output_pool_index_;
+  mutable pp::FboPool pool_;
+  gl::GpuProfiler* profiler_;
+  bool b_dirty_;
 };
 
-}  // namespace limas
\ No newline at end of file
+}  // namespace limas
@@ -0,0 +1,164 @@
+#pragma once
+#include "gl/Fbo.h"
+#include "system/Logger.h"
+
+namespace limas {
+namespace pp {
+
+// パスが書き出すテクスチャ。scale は PostProcessing の解像度に対する比
+struct TextureDesc {
+  GLenum internal_format = GL_RGBA8;
+  float scale = 1.0f;
+};
+
+// 大きさと形式ごとに FBO を持っておき、返されたものを次の要求に回す
+// 寿命の重ならないテクスチャは同じ FBO を使うことになる
+class FboPool {
+ public:
+  FboPool() : frame_(0) {}
+
+  size_t acquire(GLsizei width, GLsizei height, GLenum internal_format) {
+    for (size_t i = 0; i < entries_.size(); i++) {
+      auto& e = *entries_[i];
+      if (!e.b_used && e.width == width && e.height == height &&
+          e.internal_format == internal_format) {
+        e.b_used = true;
+        e.last_frame = frame_;
+        return i;
+      }
+    }
+
+    auto e = std::make_unique<Entry>();
+    e->width = width;
+    e->height = height;
+    e->internal_format = internal_format;
+    e->fbo.allocate(width, height);
+    auto& tex = e->fbo.attachColor(internal_format);
+    tex.setMinFilter(GL_LINEAR);
+    tex.setMagFilter(GL_LINEAR);
+    tex.setWrapS(GL_CLAMP_TO_EDGE);
+    tex.setWrapT(GL_CLAMP_TO_EDGE);
+    e->b_used = true;
+    e->last_frame = frame_;
+    entries_.push_back(std::move(e));
+    return entries_.size() - 1;
+  }
+
+  void release(size_t i) { entries_[i]->b_used = false; }
+
+  gl::Fbo& getFbo(size_t i) { return entries_[i]->fbo; }
+
+  // フレームの終わりに呼ぶ。しばらく使われていない FBO を捨てる
+  // 使用中の番号が変わらないように末尾からだけ捨てる
+  void endFrame(size_t max_unused_frames = 3) {
+    while (!entries_.empty()) {
+      const auto& e = *entries_.back();
+      if (e.b_used || frame_ - e.last_frame <= max_unused_frames) break;
+      entries_.pop_back();
+    }
+    frame_++;
+  }
+
+  void clear() { entries_.clear(); }
+  size_t size() const { return entries_.size(); }
+
+ private:
+  struct Entry {
+    gl::Fbo fbo;
+    GLsizei width = 0;
+    GLsizei height = 0;
+    GLenum internal_format = GL_RGBA8;
+    bool b_used = false;
+    uint64_t last_frame = 0;
+  };
+
+  std::vector<std::unique_ptr<Entry>> entries_;
+  uint64_t frame_;
+};
+
+// BasePass::setup() でパスが読み書きするテクスチャを宣言する
+// read() はその名前の最新の版を読み、write() は新しい版を作る
+class PassBuilder {
+ public:
+  void read(const std::string& name) { reads_.push_back(name); }
+  void write(const std::string& name, const TextureDesc& desc = {}) {
+    writes_.emplace_back(name, desc);
+  }
+
+  const std::vector<std::string>& getReads() const { return reads_; }
+  const std::vector<std::pair<std::string, TextureDesc>>& getWrites() const {
+    return writes_;
+  }
+
+ private:
+  std::vector<std::string> reads_;
+  std::vector<std::pair<std::string, TextureDesc>> writes_;
+};
+
+// BasePass::execute() に渡す。宣言したテクスチャと書き込み先を引く
+class PassContext {
+ public:
+  PassContext(FboPool& pool, GLsizei width, GLsizei height)
+      : pool_(pool), width_(width), height_(height) {}
+
+  ~PassContext() {
+    for (auto i : temporaries_) pool_.release(i);
+  }
+
+  // 宣言していない名前には確保していない空のテクスチャを返す
+  const gl::Texture2D& getTexture(const std::string& name) const {
+    for (const auto& [n, tex] : textures_) {
+      if (n == name) return *tex;
+    }
+    logger::error("PassContext")
+        << name << " is not declared as an input" << logger::end();
+    static const gl::Texture2D empty;
+    return empty;
+  }
+
+  // 宣言していない名前には作業用の FBO を返すので、書いても捨てられる
+  gl::Fbo& getTarget(const std::string& name) {
+    for (auto& [n, fbo] : targets_) {
+      if (n == name) return *fbo;
+    }
+    logger::error("PassContext")
+        << name << " is not declared as an output" << logger::end();
+    return getTemporary(TextureDesc());
+  }
+
+  // パスの中だけで使う作業用の FBO。パスが終わると返す
+  gl::Fbo& getTemporary(const TextureDesc& desc) {
+    const size_t i = pool_.acquire(getScaledWidth(desc.scale),
+                                   getScaledHeight(desc.scale),
+                                   desc.internal_format);
+    temporaries_.push_back(i);
+    return pool_.getFbo(i);
+  }
+
+  GLsizei getWidth() const { return width_; }
+  GLsizei getHeight() const { return height_; }
+  GLsizei getScaledWidth(float scale) const {
+    return std::max<GLsizei>(1, std::lround(width_ * scale));
+  }
+  GLsizei getScaledHeight(float scale) const {
+    return std::max<GLsizei>(1, std::lround(height_ * scale));
+  }
+
+  void addTexture(const std::string& name, const gl::Texture2D& tex) {
+    textures_.emplace_back(name, &tex);
+  }
+  void addTarget(const std::string& name, gl::Fbo& fbo) {
+    targets_.emplace_back(name, &fbo);
+  }
+
+ private:
+  FboPool& pool_;
+  GLsizei width_;
+  GLsizei height_;
+  std::vector<std::pair<std::string, const gl::Texture2D*>> textures_;
+  std::vector<std::pair<std::string, gl::Fbo*>> targets_;
+  std::vector<size_t> temporaries_;
+};
+
+}  // namespace pp
+}  // namespace limas
@@ -0,0 +1,98 @@
+#pragma once
+#include "gl/Context.h"
+#include "pp/BasePass.h"
+
+namespace limas {
+namespace pp {
+
+// Call of Duty: Advanced Warfare の bloom
+// 13 点で 1/2 ずつ縮め、3x3 の tent で戻しながら 1 つ上の段に足していく
+// 最初の段で明るい所だけを残し、Karis average でちらつきを抑える
+// 段が小さくなるので手間は広がりによらずほぼ一定
+class Bloom : public BasePass {
+ public:
+  Bloom(const std::string& name, size_t width, size_t height)
+      : BasePass(name) {
+    loadShader(down_shader_, "shaders/pp/bloom_down.frag");
+    loadShader(up_shader_, "shaders/pp/bloom_up.frag");
+    loadShader(composite_shader_, "shaders/pp/bloom.frag");
+
+    addParam<int>("iterations", 6);
+    addParam<float>("threshold", 0.8f);
+    addParam<float>("knee", 0.5f);
+    addParam<float>("radius", 1.0f);
+    addParam<float>("intensity", 0.5f);
+  }
+
+  virtual void execute(PassContext& context) override {
+    const int n = std::clamp(getParam<int>("iterations"), 1, MAX_ITERATIONS);
+
+    gl::BlendState blend;
+    gl::BlendFuncSeparateState blend_func;
+    blend.push();
+    blend_func.push();
+    gl::BlendState::set(false);
+
+    std::vector<gl::Fbo*> mips;
+    const gl::Texture2D* src = &context.getTexture(COLOR);
+    for (int i = 0; i < n; i++) {
+      auto& dst = context.getTemporary({GL_RGBA16F, 1.0f / (2 << i)});
+      dst.bind();
+      down_shader_.bind();
+      down_shader_.setUniformTexture("u_tex", *src, 0);
+      down_shader_.setUniform2f("u_texel", glm::vec2(1.0) / getSize(*src));
+      down_shader_.setUniform1i("u_prefilter", i == 0);
+      down_shader_.setUniform1f("u_threshold", getParam<float>("threshold"));
+      down_shader_.setUniform1f("u_knee", getParam<float>("knee"));
+      fill();
+      down_shader_.unbind();
+      dst.unbind();
+      mips.push_back(&dst);
+      src = &dst.getTexture(0);
+    }
+
+    gl::BlendState::set(true);
+    gl::BlendFuncSeparateState::set(GL_ONE, GL_ONE);
+    for (int i = n - 1; i > 0; i--) {
+      const auto& tex = mips[i]->getTexture(0);
+      mips[i - 1]->bind();
+      up_shader_.bind();
+      up_shader_.setUniformTexture("u_tex", tex, 0);
+      up_shader_.setUniform2f("u_texel", glm::vec2(1.0) / getSize(tex));
+      up_shader_.setUniform1f("u_radius", getParam<float>("radius"));
+      fill();
+      up_shader_.unbind();
+      mips[i - 1]->unbind();
+    }
+    gl::BlendState::set(false);
+
+    auto& fbo = context.getTarget(COLOR);
+    fbo.bind();
+    composite_shader_.bind();
+    composite_shader_.setUniformTexture("u_tex", context.getTexture(COLOR), 0);
+    composite_shader_.setUniformTexture("u_bloom_tex", mips[0]->getTexture(0),
+                                        1);
+    composite_shader_.setUniform1f("u_intensity",
+                                   getParam<float>("intensity"));
+    fill();
+    composite_shader_.unbind();
+    fbo.unbind();
+
+    blend_func.pop();
+    blend.pop();
+  }
+
+ protected:
+  static constexpr int MAX_ITERATIONS = 8;
+
+  static glm::vec2 getSize(const gl::Texture2D& tex) {
+    return glm::vec2(tex.getWidth(), tex.getHeight());
+  }
+
+  gl::Shader down_shader_;
+  gl::Shader up_shader_;
+  gl::Shader composite_shader_;
+};
+
+}  // namespace pp
+}  // namespace limas
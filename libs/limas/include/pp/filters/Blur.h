@@ -8,48 +8,53 @@ template <int ITERATIONS = 5>
 class Blur : public BasePass {
  public:
   Blur(const std::string& name, size_t width, size_t height) : BasePass(name) {
-    shader_ = gl::Shader::create();
-    shader_->loadVertex(fs::getCommonResourcesPath() + "shaders/thru.vert");
     switch (ITERATIONS) {
       case 5:
-        shader_->loadFragment(fs::getCommonResourcesPath() +
-                              "shaders/pp/blur5.frag");
+        loadShader(shader_, "shaders/pp/blur5.frag");
         break;
       case 9:
-        shader_->loadFragment(fs::getCommonResourcesPath() +
-                              "shaders/pp/blur9.frag");
+        loadShader(shader_, "shaders/pp/blur9.frag");
         break;
       case 13:
-        shader_->loadFragment(fs::getCommonResourcesPath() +
-                              "shaders/pp/blur13.frag");
+        loadShader(shader_, "shaders/pp/blur13.frag");
         break;
       default:
-        log::error("Blur") << "unsupported iterations" << log::end();
+        logger::error("Blur") << "unsupported iterations" << logger::end();
         break;
     }
-    shader_->link();
 
     addParam<float>("scale", 0.5);
   }
 
-  virtual void apply(PingPong<gl::Fbo::Ptr>& fbos) override {
+  // 途中は作業用の FBO を交互に使い、最後だけ出力に書く
+  virtual void execute(PassContext& context) override {
+    const gl::Texture2D* src = &context.getTexture(COLOR);
+    gl::Fbo* temps[2] = {nullptr, nullptr};
     for (int i = 0; i < ITERATIONS; i++) {
+      gl::Fbo* dst;
+      if (i == ITERATIONS - 1) {
+        dst = &context.getTarget(COLOR);
+      } else {
+        if (!temps[i % 2]) temps[i % 2] = &context.getTemporary(TextureDesc());
+        dst = temps[i % 2];
+      }
+
       float radius = (ITERATIONS - i - 1) * getParam<float>("scale");
-      fbos.getFront()->bind();
-      shader_->bind();
-      shader_->setUniformTexture("u_tex", fbos.getBack()->getTextures()[0], 0);
-      shader_->setUniform2f("u_res", fbos.getFront()->getSize());
-      shader_->setUniform2f(
+      dst->bind();
+      shader_.bind();
+      shader_.setUniformTexture("u_tex", *src, 0);
+      shader_.setUniform2f("u_res", dst->getSize());
+      shader_.setUniform2f(
           "u_dir", i % 2 == 0 ? glm::vec2(radius, 0) : glm::vec2(0, radius));
       fill();
-      shader_->unbind();
-      fbos.getFront()->unbind();
-      fbos.swap();
+      shader_.unbind();
+      dst->unbind();
+      src = &dst->getTexture(0);
     }
   }
 
  protected:
-  gl::Shader::Ptr shader_;
+  gl::Shader shader_;
 };
 
 using Blur5 = Blur<5>;
@@ -57,4 +62,4 @@ using Blur9 = Blur<9>;
 using Blur13 = Blur<13>;
 
 }  // namespace pp
-}  // namespace limas
\ No newline at end of file
+}  // namespace limas
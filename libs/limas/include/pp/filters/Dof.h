@@ -1,6 +1,5 @@
 #pragma once
 #include "pp/BasePass.h"
-#include "pp/Gaussian.h"
 
 namespace limas {
 namespace pp {
@@ -8,11 +7,7 @@ namespace pp {
 class Dof : public BasePass {
  public:
   Dof(const std::string& name, size_t width, size_t height) : BasePass(name) {
-    dof_shader_ = gl::Shader::create();
-    dof_shader_->loadVertex(fs::getCommonResourcesPath() + "shaders/thru.vert");
-    dof_shader_->loadFragment(fs::getCommonResourcesPath() +
-                              "shaders/pp/dof.frag");
-    dof_shader_->link();
+    loadShader(dof_shader_, "shaders/pp/dof.frag");
 
     auto cam = getParams().addChild("cam");
     cam.addParam<float>("near", 0.1);
@@ -44,63 +39,65 @@ class Dof : public BasePass {
     manual_dof.addParam<float>("far_dist", 1);
   }
 
-  virtual void apply(PingPong<gl::Fbo::Ptr>& fbos) override {
-    fbos.getFront()->bind();
-    dof_shader_->bind();
-    dof_shader_->setUniformTexture("u_color_tex",
-                                   fbos.getBack()->getTextures()[0], 0);
-    dof_shader_->setUniformTexture("u_depth_tex",
-                                   fbos.getBack()->getTextures()[1], 1);
-    dof_shader_->setUniform2f("u_res", fbos.getFront()->getSize());
+  virtual void setup(PassBuilder& builder) override {
+    builder.read(COLOR);
+    builder.read(DEPTH);
+    builder.write(COLOR);
+  }
+
+  virtual void execute(PassContext& context) override {
+    auto& fbo = context.getTarget(COLOR);
+    fbo.bind();
+    dof_shader_.bind();
+    dof_shader_.setUniformTexture("u_color_tex", context.getTexture(COLOR), 0);
+    dof_shader_.setUniformTexture("u_depth_tex", context.getTexture(DEPTH), 1);
+    dof_shader_.setUniform2f("u_res", fbo.getSize());
 
     auto cam = getParams().getChild("cam");
-    dof_shader_->setUniform1f("u_near", cam.getValue<float>("near"));
-    dof_shader_->setUniform1f("u_far", cam.getValue<float>("far"));
+    dof_shader_.setUniform1f("u_near", cam.getValue<float>("near"));
+    dof_shader_.setUniform1f("u_far", cam.getValue<float>("far"));
 
     auto blur = getParams().getChild("blur");
-    dof_shader_->setUniform1f("u_blur.size", blur.getValue<float>("size"));
-    dof_shader_->setUniform1f("u_blur.falloff",
-                              blur.getValue<float>("falloff"));
+    dof_shader_.setUniform1f("u_blur.size", blur.getValue<float>("size"));
+    dof_shader_.setUniform1f("u_blur.falloff", blur.getValue<float>("falloff"));
 
     auto focus = getParams().getChild("focus");
-    dof_shader_->setUniform1f("u_focus.depth", focus.getValue<float>("depth"));
-    dof_shader_->setUniform1f("u_focus.length",
-                              focus.getValue<float>("length"));
-    dof_shader_->setUniform1f("u_focus.fstop", focus.getValue<float>("fstop"));
-    dof_shader_->setUniform1f("u_focus.coc", focus.getValue<float>("coc"));
+    dof_shader_.setUniform1f("u_focus.depth", focus.getValue<float>("depth"));
+    dof_shader_.setUniform1f("u_focus.length", focus.getValue<float>("length"));
+    dof_shader_.setUniform1f("u_focus.fstop", focus.getValue<float>("fstop"));
+    dof_shader_.setUniform1f("u_focus.coc", focus.getValue<float>("coc"));
 
     auto depth_blur = getParams().getChild("depth_blur");
-    dof_shader_->setUniform1i("u_depth_blur.enable",
-                              depth_blur.getValue<bool>("enable"));
-    dof_shader_->setUniform1f("u_depth_blur.size",
-                              depth_blur.getValue<float>("size"));
+    dof_shader_.setUniform1i("u_depth_blur.enable",
+                             depth_blur.getValue<bool>("enable"));
+    dof_shader_.setUniform1f("u_depth_blur.size",
+                             depth_blur.getValue<float>("size"));
 
     auto autofocus = getParams().getChild("autofocus");
-    dof_shader_->setUniform1i("u_autofocus.enable",
-                              autofocus.getValue<bool>("enable"));
-    dof_shader_->setUniform2f("u_autofocus.center",
-                              autofocus.getValue<glm::vec2>("center"));
+    dof_shader_.setUniform1i("u_autofocus.enable",
+                             autofocus.getValue<bool>("enable"));
+    dof_shader_.setUniform2f("u_autofocus.center",
+                             autofocus.getValue<glm::vec2>("center"));
 
     auto manual_dof = getParams().getChild("manual_dof");
-    dof_shader_->setUniform1i("u_manual_dof.enable",
-                              manual_dof.getValue<bool>("enable"));
-    dof_shader_->setUniform1f("u_manual_dof.near_start",
-                              manual_dof.getValue<float>("near_start"));
-    dof_shader_->setUniform1f("u_manual_dof.near_dist",
-                              manual_dof.getValue<float>("near_dist"));
-    dof_shader_->setUniform1f("u_manual_dof.far_start",
-                              manual_dof.getValue<float>("far_start"));
-    dof_shader_->setUniform1f("u_manual_dof.far_dist",
-                              manual_dof.getValue<float>("far_dist"));
+    dof_shader_.setUniform1i("u_manual_dof.enable",
+                             manual_dof.getValue<bool>("enable"));
+    dof_shader_.setUniform1f("u_manual_dof.near_start",
+                             manual_dof.getValue<float>("near_start"));
+    dof_shader_.setUniform1f("u_manual_dof.near_dist",
+                             manual_dof.getValue<float>("near_dist"));
+    dof_shader_.setUniform1f("u_manual_dof.far_start",
+                             manual_dof.getValue<float>("far_start"));
+    dof_shader_.setUniform1f("u_manual_dof.far_dist",
+                             manual_dof.getValue<float>("far_dist"));
 
     fill();
-    dof_shader_->unbind();
-    fbos.getFront()->unbind();
-    fbos.swap();
+    dof_shader_.unbind();
+    fbo.unbind();
   }
 
  protected:
-  gl::Shader::Ptr dof_shader_;
+  gl::Shader dof_shader_;
 };
 
 }  // namespace pp
@@ -0,0 +1,67 @@
+#pragma once
+#include "gl/Context.h"
+#include "pp/BasePass.h"
+
+namespace limas {
+namespace pp {
+
+// dual filter (Kawase) のぼかし
+// 1/2 ずつ縮めてから同じ段数で戻す。半径は段数で決まり、段が小さくなるので
+// 手間はほぼ画面 1 枚分で半径によらない
+class DualKawase : public BasePass {
+ public:
+  DualKawase(const std::string& name, size_t width, size_t height)
+      : BasePass(name) {
+    loadShader(down_shader_, "shaders/pp/kawase_down.frag");
+    loadShader(up_shader_, "shaders/pp/kawase_up.frag");
+
+    addParam<int>("iterations", 4);
+    addParam<float>("offset", 1.0f);
+  }
+
+  virtual void execute(PassContext& context) override {
+    const int n = std::clamp(getParam<int>("iterations"), 1, MAX_ITERATIONS);
+    const float offset = getParam<float>("offset");
+
+    gl::BlendState blend;
+    blend.push();
+    gl::BlendState::set(false);
+
+    std::vector<gl::Fbo*> mips;
+    const gl::Texture2D* src = &context.getTexture(COLOR);
+    for (int i = 0; i < n; i++) {
+      auto& dst = context.getTemporary({GL_RGBA16F, 1.0f / (2 << i)});
+      draw(down_shader_, *src, dst, offset);
+      mips.push_back(&dst);
+      src = &dst.getTexture(0);
+    }
+
+    for (int i = n - 1; i >= 0; i--) {
+      gl::Fbo& dst = i == 0 ? context.getTarget(COLOR) : *mips[i - 1];
+      draw(up_shader_, mips[i]->getTexture(0), dst, offset);
+    }
+
+    blend.pop();
+  }
+
+ protected:
+  static constexpr int MAX_ITERATIONS = 8;
+
+  void draw(gl::Shader& shader, const gl::Texture2D& src, gl::Fbo& dst,
+            float offset) {
+    dst.bind();
+    shader.bind();
+    shader.setUniformTexture("u_tex", src, 0);
+    shader.setUniform2f("u_res", dst.getSize());
+    shader.setUniform1f("u_offset", offset);
+    fill();
+    shader.unbind();
+    dst.unbind();
+  }
+
+  gl::Shader down_shader_;
+  gl::Shader up_shader_;
+};
+
+}  // namespace pp
+}  // namespace limas
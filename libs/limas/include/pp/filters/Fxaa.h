@@ -7,27 +7,23 @@ namespace pp {
 class Fxaa : public BasePass {
  public:
   Fxaa(const std::string& name, size_t width, size_t height) : BasePass(name) {
-    shader_ = gl::Shader::create();
-    shader_->loadVertex(fs::getCommonResourcesPath() + "shaders/thru.vert");
-    shader_->loadFragment(fs::getCommonResourcesPath() +
-                          "shaders/pp/fxaa.frag");
-    shader_->link();
+    loadShader(shader_, "shaders/pp/fxaa.frag");
   }
 
-  virtual void apply(PingPong<gl::Fbo::Ptr>& fbos) override {
-    fbos.getFront()->bind();
-    shader_->bind();
-    shader_->setUniformTexture("u_tex", fbos.getBack()->getTexture(0), 0);
-    shader_->setUniform2f("u_res", fbos.getFront()->getSize());
+  virtual void execute(PassContext& context) override {
+    auto& fbo = context.getTarget(COLOR);
+    fbo.bind();
+    shader_.bind();
+    shader_.setUniformTexture("u_tex", context.getTexture(COLOR), 0);
+    shader_.setUniform2f("u_res", fbo.getSize());
     fill();
-    shader_->unbind();
-    fbos.getFront()->unbind();
-    fbos.swap();
+    shader_.unbind();
+    fbo.unbind();
   }
 
  protected:
-  gl::Shader::Ptr shader_;
+  gl::Shader shader_;
 };
 
 }  // namespace pp
-}  // namespace limas
\ No newline at end of file
+}  // namespace limas
@@ -8,53 +8,40 @@ class Gaussian : public BasePass {
  public:
   Gaussian(const std::string& name, size_t width, size_t height)
       : BasePass(name) {
-    blur_shader_ = gl::Shader::create();
-    blur_shader_->loadVertex(fs::getCommonResourcesPath() +
-                             "shaders/thru.vert");
-    blur_shader_->loadFragment(fs::getCommonResourcesPath() +
-                               "shaders/pp/gaussian.frag");
-    blur_shader_->link();
-
-    blur_fbo_ = gl::Fbo::create(width, height);
-    blur_fbo_->attachColor(GL_RGBA8);
-    blur_fbo_->getTexture(0)->setMagFilter(GL_LINEAR);
-    blur_fbo_->getTexture(0)->setMinFilter(GL_LINEAR);
-    blur_fbo_->getTexture(0)->setWrapS(GL_CLAMP_TO_EDGE);
-    blur_fbo_->getTexture(0)->setWrapT(GL_CLAMP_TO_EDGE);
+    loadShader(blur_shader_, "shaders/pp/gaussian.frag");
 
     addParam<int>("radius", 6);  // kernel-size = 2 * radius + 1
     addParam<float>("sigma", 3);
   }
 
-  virtual void apply(PingPong<gl::Fbo::Ptr>& fbos) {
+  virtual void execute(PassContext& context) override {
     auto weights = computeGaussianWeights(getParam<int>("radius"),
                                           getParam<float>("sigma"));
+    auto& blur_fbo = context.getTemporary(TextureDesc());
+    auto& fbo = context.getTarget(COLOR);
 
-    blur_fbo_->bind();
+    blur_fbo.bind();
     glClearColor(0, 0, 0, 0);
     glClear(GL_COLOR_BUFFER_BIT);
-    blur_shader_->bind();
-    blur_shader_->setUniformTexture("u_tex", fbos.getBack()->getTextures()[0],
-                                    0);
-    blur_shader_->setUniform1i("u_horizontal", 0);
-    blur_shader_->setUniform2f("u_res_inv",
-                               glm::vec2(1.0) / blur_fbo_->getSize());
-    blur_shader_->setUniform1i("u_radius", getParam<int>("radius"));
-    blur_shader_->setUniform1fv("u_weights", weights.data(), weights.size());
+    blur_shader_.bind();
+    blur_shader_.setUniformTexture("u_tex", context.getTexture(COLOR), 0);
+    blur_shader_.setUniform1i("u_horizontal", 0);
+    blur_shader_.setUniform2f("u_res_inv", glm::vec2(1.0) / blur_fbo.getSize());
+    blur_shader_.setUniform1i("u_radius", getParam<int>("radius"));
+    blur_shader_.setUniform1fv("u_weights", weights.data(), weights.size());
     fill();
-    blur_shader_->unbind();
-    blur_fbo_->unbind();
+    blur_shader_.unbind();
+    blur_fbo.unbind();
 
-    fbos.getFront()->bind();
+    fbo.bind();
     glClearColor(0, 0, 0, 0);
     glClear(GL_COLOR_BUFFER_BIT);
-    blur_shader_->bind();
-    blur_shader_->setUniformTexture("u_tex", blur_fbo_->getTextures()[0], 0);
-    blur_shader_->setUniform1i("u_horizontal", 1);
+    blur_shader_.bind();
+    blur_shader_.setUniformTexture("u_tex", blur_fbo.getTexture(0), 0);
+    blur_shader_.setUniform1i("u_horizontal", 1);
     fill();
-    blur_shader_->unbind();
-    fbos.getFront()->unbind();
-    fbos.swap();
+    blur_shader_.unbind();
+    fbo.unbind();
   }
 
  protected:
@@ -81,8 +68,7 @@ class Gaussian : public BasePass {
     return weights;
   }
 
-  gl::Shader::Ptr blur_shader_;
-  gl::Fbo::Ptr blur_fbo_;
+  gl::Shader blur_shader_;
 };
 
 }  // namespace pp
@@ -4,30 +4,66 @@
 namespace limas {
 namespace pp {
 
+// AO は半分の解像度で求め、拡大して色に掛ける
+// AO のテクスチャは AO の名前で後のパスからも読める
 class SSAO : public BasePass {
  public:
+  inline static const std::string AO = "ao";
+
   SSAO(const std::string& name, size_t width, size_t height) : BasePass(name) {
-    shader_ = gl::Shader::create();
-    shader_->loadVertex(fs::getCommonResourcesPath() + "shaders/thru.vert");
-    shader_->loadFragment(fs::getCommonResourcesPath() +
-                          "shaders/pp/ssao.frag");
-    shader_->link();
+    loadShader(shader_, "shaders/pp/ssao.frag");
+    loadShader(composite_shader_, "shaders/pp/ssao_composite.frag");
+
+    addParam<float>("cam", "near", 0.1f);
+    addParam<float>("cam", "far", 100.0f);
+    addParam<float>("clamp", 0.125f);
+    addParam<float>("lum_influence", 0.7f);
+    addParam<bool>("only_ao", false);
+  }
+
+  virtual void setup(PassBuilder& builder) override {
+    builder.read(COLOR);
+    builder.read(DEPTH);
+    builder.write(AO, {GL_R8, AO_SCALE});
+    builder.write(COLOR);
   }
 
-  virtual void apply(PingPong<gl::Fbo::Ptr>& fbos) override {
-    fbos.getFront()->bind();
-    shader_->bind();
-    shader_->setUniformTexture("u_tex", fbos.getBack()->getTextures()[0], 0);
-    shader_->setUniform2f("u_res", fbos.getFront()->getSize());
+  virtual void execute(PassContext& context) override {
+    auto& ao = context.getTarget(AO);
+    ao.bind();
+    shader_.bind();
+    shader_.setUniformTexture("u_depth_tex", context.getTexture(DEPTH), 0);
+    // サンプルの広がりは元の解像度の texel で決める
+    shader_.setUniform2f("u_res",
+                         glm::vec2(context.getWidth(), context.getHeight()));
+    shader_.setUniform1f("u_cam_near", getParam<float>("cam", "near"));
+    shader_.setUniform1f("u_cam_far", getParam<float>("cam", "far"));
+    shader_.setUniform1f("u_ao_clamp", getParam<float>("clamp"));
+    shader_.setUniform1i("u_fog_enabled", 0);
     fill();
-    shader_->unbind();
-    fbos.getFront()->unbind();
-    fbos.swap();
+    shader_.unbind();
+    ao.unbind();
+
+    auto& fbo = context.getTarget(COLOR);
+    fbo.bind();
+    composite_shader_.bind();
+    composite_shader_.setUniformTexture("u_col_tex", context.getTexture(COLOR),
+                                        0);
+    composite_shader_.setUniformTexture("u_ao_tex", ao.getTexture(), 1);
+    composite_shader_.setUniform1f("u_lum_influence",
+                                   getParam<float>("lum_influence"));
+    composite_shader_.setUniform1i("u_only_ao", getParam<bool>("only_ao"));
+    fill();
+    composite_shader_.unbind();
+    fbo.unbind();
   }
 
  protected:
-  gl::Shader::Ptr shader_;
+  static constexpr float AO_SCALE = 0.5f;
+
+  gl::Shader shader_;
+  gl::Shader composite_shader_;
 };
 
 }  // namespace pp
-}  // namespace limas
\ No newline at end of file
+}  // namespace limas
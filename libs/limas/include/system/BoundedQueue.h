@@ -0,0 +1,107 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+#include "system/Noncopyable.h"
+
+namespace limas {
+
+// 容量付きのスレッドセーフなキュー
+// close() 後は push が失敗し、pop は残りを取り出し終えると false を返す
+template <typename T>
+class BoundedQueue : private Noncopyable {
+ public:
+  explicit BoundedQueue(size_t capacity = 1)
+      : capacity_(capacity), b_closed_(false) {}
+
+  void setCapacity(size_t capacity) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      capacity_ = std::max<size_t>(capacity, 1);
+    }
+    not_full_.notify_all();
+  }
+
+  bool push(T value) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock,
+                   [this] { return queue_.size() < capacity_ || b_closed_; });
+    if (b_closed_) return false;
+    queue_.push_back(std::move(value));
+    lock.unlock();
+    not_empty_.notify_one();
+    return true;
+  }
+
+  bool tryPush(T value) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (b_closed_ || queue_.size() >= capacity_) return false;
+    queue_.push_back(std::move(value));
+    lock.unlock();
+    not_empty_.notify_one();
+    return true;
+  }
+
+  bool pop(T& value) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return !queue_.empty() || b_closed_; });
+    if (queue_.empty()) return false;
+    value = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    not_full_.notify_one();
+    return true;
+  }
+
+  bool tryPop(T& value) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (queue_.empty()) return false;
+    value = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    not_full_.notify_one();
+    return true;
+  }
+
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      b_closed_ = true;
+    }
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+
+  void reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.clear();
+    b_closed_ = false;
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+  }
+
+  size_t getCapacity() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return capacity_;
+  }
+
+  bool isClosed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return b_closed_;
+  }
+
+ private:
+  std::deque<T> queue_;
+  size_t capacity_;
+  bool b_closed_;
+  mutable std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+};
+
+}  // namespace limas
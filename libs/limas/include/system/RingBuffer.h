@@ -0,0 +1,92 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "system/Noncopyable.h"
+
+namespace limas {
+
+// 書き込み 1 スレッド・読み出し 1 スレッド用のロックフリーなリングバッファ
+// allocate() / clear() は両方のスレッドが止まっている時に呼ぶ
+template <typename T>
+class RingBuffer : private Noncopyable {
+ public:
+  explicit RingBuffer(size_t capacity = 0) { allocate(capacity); }
+
+  // 容量は 2 のべき乗に切り上げる
+  void allocate(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+    buffer_.assign(capacity ? size : 0, T());
+    mask_ = buffer_.empty() ? 0 : size - 1;
+    clear();
+  }
+
+  void clear() {
+    head_.store(0, std::memory_order_relaxed);
+    tail_.store(0, std::memory_order_relaxed);
+  }
+
+  // 書き込めた数を返す (溢れた分は捨てる)
+  size_t write(const T* data, size_t count) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    const size_t head = head_.load(std::memory_order_acquire);
+    count = std::min(count, buffer_.size() - (tail - head));
+    if (count == 0) return 0;
+
+    const size_t begin = tail & mask_;
+    const size_t first = std::min(count, buffer_.size() - begin);
+    std::copy(data, data + first, buffer_.begin() + begin);
+    std::copy(data + first, data + count, buffer_.begin());
+
+    tail_.store(tail + count, std::memory_order_release);
+    return count;
+  }
+
+  // 読み出せた数を返す
+  size_t read(T* data, size_t count) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    const size_t tail = tail_.load(std::memory_order_acquire);
+    count = std::min(count, tail - head);
+    if (count == 0) return 0;
+
+    const size_t begin = head & mask_;
+    const size_t first = std::min(count, buffer_.size() - begin);
+    std::copy(buffer_.begin() + begin, buffer_.begin() + begin + first, data);
+    std::copy(buffer_.begin(), buffer_.begin() + (count - first),
+              data + first);
+
+    head_.store(head + count, std::memory_order_release);
+    return count;
+  }
+
+  // 読み出し側で古いデータを読み飛ばす
+  size_t skip(size_t count) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    const size_t tail = tail_.load(std::memory_order_acquire);
+    count = std::min(count, tail - head);
+    head_.store(head + count, std::memory_order_release);
+    return count;
+  }
+
+  size_t getReadAvailable() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+
+  size_t getWriteAvailable() const {
+    return buffer_.size() - getReadAvailable();
+  }
+
+  size_t getCapacity() const { return buffer_.size(); }
+
+ private:
+  std::vector<T> buffer_;
+  size_t mask_;
+  // 偽共有を避けるため別のキャッシュラインに置く
+  alignas(64) std::atomic<size_t> head_;
+  alignas(64) std::atomic<size_t> tail_;
+};
+
+}  // namespace limas
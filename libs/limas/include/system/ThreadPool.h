@@ -46,6 +46,40 @@ class ThreadPool : private Noncopyable {
     threads_.clear();
   }
 
+  // func(0) ... func(count - 1) を並列に実行し、すべて終わるまで待つ
+  // 呼び出し元のスレッドも処理に参加する
+  template <typename F>
+  void parallelFor(size_t count, F&& func) {
+    if (count == 0) return;
+
+    struct State {
+      std::atomic<size_t> next{0};
+      std::atomic<size_t> done{0};
+      std::mutex mutex;
+      std::condition_variable cv;
+    };
+    auto state = std::make_shared<State>();
+
+    auto work = [state, count, &func]() {
+      size_t i;
+      while ((i = state->next.fetch_add(1)) < count) {
+        func(i);
+        if (state->done.fetch_add(1) + 1 == count) {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          state->cv.notify_all();
+        }
+      }
+    };
+
+    size_t num_helpers = std::min(count - 1, threads_.size());
+    for (size_t i = 0; i < num_helpers; i++) enqueue(work);
+    work();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [&] { return state->done.load() == count; });
+  }
+
+  size_t getNumThreads() const { return threads_.size(); }
   bool isRunning() const { return !b_should_stop_; }
 
  private:
@@ -79,7 +113,7 @@ class ThreadPool : private Noncopyable {
           try {
             task();
           } catch (const std::exception& e) {
-            log::error("ThreadPool") << e.what() << log::end();
+            logger::error("ThreadPool") << e.what() << logger::end();
           }
         }
       });
@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+#include "system/Noncopyable.h"
+
+namespace limas {
+
+// 1 スレッドが書いた最新の値を別の 1 スレッドがロックせずに受け取る
+// 書き込み側は getWriteBuffer() に書いて publish()、
+// 読み出し側は update() してから getReadBuffer() を読む
+template <typename T>
+class TripleBuffer : private Noncopyable {
+ public:
+  TripleBuffer() : write_index_(0), middle_(1), read_index_(2) {}
+
+  // スレッドを動かす前にすべてのバッファを初期化する
+  void fill(const T& value) {
+    for (auto& buffer : buffers_) buffer = value;
+  }
+
+  T& getWriteBuffer() { return buffers_[write_index_]; }
+
+  void publish() {
+    uint8_t dirty = write_index_ | DIRTY;
+    write_index_ =
+        middle_.exchange(dirty, std::memory_order_acq_rel) & INDEX_MASK;
+  }
+
+  // 新しい値があれば true
+  bool update() {
+    if (!(middle_.load(std::memory_order_relaxed) & DIRTY)) return false;
+    read_index_ =
+        middle_.exchange(read_index_, std::memory_order_acq_rel) & INDEX_MASK;
+    return true;
+  }
+
+  const T& getReadBuffer() const { return buffers_[read_index_]; }
+
+ private:
+  static constexpr uint8_t INDEX_MASK = 0x3;
+  static constexpr uint8_t DIRTY = 0x4;
+
+  T buffers_[3];
+  uint8_t write_index_;
+  alignas(64) std::atomic<uint8_t> middle_;
+  alignas(64) uint8_t read_index_;
+};
+
+}  // namespace limas
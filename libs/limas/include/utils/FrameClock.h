@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+
+namespace limas {
+
+// アプリ全体で共有する時計
+// 通常は steady_clock と同じ速さで進むが、仮想モードでは setTime() で
+// 与えられた時刻で止まる (オフラインレンダリング用)
+class FrameClock {
+ public:
+  using duration = std::chrono::nanoseconds;
+  using rep = duration::rep;
+  using period = duration::period;
+  using time_point = std::chrono::time_point<FrameClock>;
+  static constexpr bool is_steady = true;
+
+  static time_point now() {
+    if (b_virtual_.load(std::memory_order_acquire))
+      return time_point(duration(virtual_now_.load()));
+    return time_point(getRealTime() + duration(offset_.load()));
+  }
+
+  // 切り替えの前後で時刻が連続するようにする
+  static void setVirtual(bool b_virtual) {
+    if (b_virtual == isVirtual()) return;
+    if (b_virtual) {
+      virtual_now_ = now().time_since_epoch().count();
+      b_virtual_.store(true, std::memory_order_release);
+    } else {
+      offset_ = virtual_now_.load() - getRealTime().count();
+      b_virtual_.store(false, std::memory_order_release);
+    }
+  }
+
+  static bool isVirtual() { return b_virtual_.load(std::memory_order_acquire); }
+
+  static void setTime(time_point t) {
+    virtual_now_ = t.time_since_epoch().count();
+  }
+
+  static void advance(duration step) { virtual_now_ += step.count(); }
+
+  static double getElapsedInSeconds() {
+    return std::chrono::duration<double>(now().time_since_epoch() - origin_)
+        .count();
+  }
+
+ private:
+  static duration getRealTime() {
+    return std::chrono::duration_cast<duration>(
+        std::chrono::steady_clock::now().time_since_epoch());
+  }
+
+  static inline std::atomic<bool> b_virtual_{false};
+  static inline std::atomic<rep> virtual_now_{0};
+  static inline std::atomic<rep> offset_{0};
+  static inline const duration origin_ = getRealTime();
+};
+
+}  // namespace limas
@@ -18,7 +18,7 @@ class Stats {
   };
 
  public:
-  Stats() : frame_time_({0, 0, 0}), last_time_({0, 0, 0}) {}
+  Stats() : frame_time_({0, 0, 0}), last_time_({0, 0, 0}), gpu_time_(0) {}
 
   void begin() {
     if (!stopwatch_.isRunning())
@@ -51,6 +51,11 @@ class Stats {
   }
   double getMemoryUsageInMb() const { return _getMemoryUsageInMb(); }
 
+  // GL は非同期なので wall time には GPU の時間が入らない
+  // gl::GpuProfiler で測った数フレーム前の GPU の時間を一緒に持つ
+  void setGpuTimeInMs(double ms) { gpu_time_ = ms; }
+  double getGpuTimeInMs() const { return gpu_time_; }
+
  protected:
 #ifdef __APPLE__
   std::pair<double, double> getCpuTime() {
@@ -85,6 +90,7 @@ class Stats {
 
   TimeInfo frame_time_;
   TimeInfo last_time_;
+  double gpu_time_;
   PreciseStopwatch stopwatch_;
 };
 
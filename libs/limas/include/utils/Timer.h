@@ -1,4 +1,5 @@
 #pragma once
+#include "utils/FrameClock.h"
 #include "utils/Stopwatch.h"
 
 namespace limas {
@@ -150,7 +151,7 @@ class BaseTimer {
   uint32_t counter_ = 0;
 };
 
-using Timer = BaseTimer<std::chrono::system_clock>;
+using Timer = BaseTimer<FrameClock>;
 using PreciseTimer = BaseTimer<std::chrono::high_resolution_clock>;
 using Steadyimer = BaseTimer<std::chrono::steady_clock>;
 
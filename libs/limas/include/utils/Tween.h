@@ -90,7 +90,7 @@ class BaseTween : public BaseTimer<Clock> {
   uint32_t count_ = 0;
 };
 
-using Tween = BaseTween<std::chrono::system_clock>;
+using Tween = BaseTween<FrameClock>;
 using PreciseTween = BaseTween<std::chrono::high_resolution_clock>;
 using SteadyTween = BaseTween<std::chrono::steady_clock>;
 }  // namespace limas
\ No newline at end of file
@@ -1,79 +1,101 @@
 #pragma once
 
-#include <dispatch/dispatch.h>
-
 extern "C" {
 #include "hap.h"
-#include "libavcodec/avcodec.h"
-#include "libavdevice/avdevice.h"
-#include "libavfilter/avfilter.h"
 #include "libavformat/avformat.h"
 #include "libavutil/avutil.h"
-#include "libavutil/imgutils.h"
-#include "libavutil/pixdesc.h"
-#include "libswscale/swscale.h"
 }
 
 #include "gl/Fbo.h"
+#include "gl/Pbo.h"
 #include "gl/Shader.h"
 #include "gl/Texture2D.h"
 #include "gl/VboMesh.h"
-#include "graphics/Pixels.h"
 #include "primitives/Rectangle.h"
 #include "system/Thread.h"
-#include "utils/Stopwatch.h"
+#include "system/ThreadPool.h"
+#include "utils/FileSystem.h"
+#include "utils/FrameClock.h"
+#include "video/PlaybackClock.h"
 
 namespace limas {
 class HapVideoPlayer : public Thread {
+  static constexpr int MAX_TEXTURES = 2;
+
   static int roundUpToMultipleOf4(int n) {
     if (0 != (n & 3)) n = (n + 3) & ~3;
     return n;
   }
 
-  static bool frameMatchesStream(unsigned int frame, uint32_t stream) {
+  static bool frameMatchesStream(unsigned int frame, uint32_t stream,
+                                 unsigned int index) {
     switch (stream) {
       case MKTAG('H', 'a', 'p', '1'):
-        if (frame == HapTextureFormat_RGB_DXT1) return true;
-        break;
+        return frame == HapTextureFormat_RGB_DXT1;
       case MKTAG('H', 'a', 'p', '5'):
-        if (frame == HapTextureFormat_RGBA_DXT5) return true;
-        break;
+        return frame == HapTextureFormat_RGBA_DXT5;
       case MKTAG('H', 'a', 'p', 'Y'):
-        if (frame == HapTextureFormat_YCoCg_DXT5) return true;
+        return frame == HapTextureFormat_YCoCg_DXT5;
+      case MKTAG('H', 'a', 'p', 'M'):
+        return frame == (index == 0 ? HapTextureFormat_YCoCg_DXT5
+                                    : HapTextureFormat_A_RGTC1);
+      case MKTAG('H', 'a', 'p', 'A'):
+        return frame == HapTextureFormat_A_RGTC1;
       default:
         break;
     }
     return false;
   }
 
-  static void doDecode(HapDecodeWorkFunction function, void *p, unsigned int count, void *info) {
-    dispatch_apply(count, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) {
-      function(p, i);
-    });
+  static GLenum getInternalFormat(unsigned int hap_format) {
+    switch (hap_format) {
+      case HapTextureFormat_RGB_DXT1:
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+      case HapTextureFormat_A_RGTC1:
+        return GL_COMPRESSED_RED_RGTC1;
+      case HapTextureFormat_RGBA_DXT5:
+      case HapTextureFormat_YCoCg_DXT5:
+      default:
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    }
+  }
+
+  // 複数のプレイヤーで共有する
+  static ThreadPool &getDecodePool() {
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+  }
+
+  static void doDecode(HapDecodeWorkFunction function, void *p,
+                       unsigned int count, void *info) {
+    auto pool = static_cast<ThreadPool *>(info);
+    pool->parallelFor(count, [&](size_t i) { function(p, i); });
   }
 
   struct Context {
-    int width;
-    int height;
-    int buffer_size;  //
-
-    AVFormatContext *format_context;
-    AVCodecContext *codec_context;
-    SwsContext *sws_context;
-
-    int stream_index;
-    double time_base;
-    double frame_rate;
-    double duration;
+    int width = 0;
+    int height = 0;
+    uint32_t codec_tag = 0;
+
+    AVFormatContext *format_context = nullptr;
+
+    int stream_index = -1;
+    double time_base = 0;
+    double frame_rate = 0;
+    double duration = 0;
+
+    unsigned int tex_count = 0;
+    std::array<unsigned int, MAX_TEXTURES> tex_formats = {};
   };
   Context context_;
 
   struct DecodedFrame {
-    std::vector<char> buffer;
-    int64_t pts;
+    std::array<std::vector<char>, MAX_TEXTURES> buffers;
+    std::array<size_t, MAX_TEXTURES> sizes = {};
+    int64_t pts = 0;
   };
+  std::vector<DecodedFrame> frame_buffers_;
   std::deque<DecodedFrame *> frame_queues_;
-  DecodedFrame *last_frame_;
 
   struct VideoState {
     VideoState()
@@ -81,163 +103,186 @@ class HapVideoPlayer : public Thread {
           b_loaded(false),
           b_playing(false),
           b_loop(true),
-          speed(1),
+          b_eof(false),
           b_request_seek(false),
-          seek_time(0),
-          offset_time(0) {}
+          seek_time(0) {}
 
     bool b_new_frame;
     bool b_loaded;
     bool b_playing;
     bool b_loop;
-    float speed;
+    bool b_eof;
     bool b_request_seek;
-    double seek_time;    // seconds
-    double offset_time;  // seconds
+    double seek_time;  // seconds
   };
   VideoState state_;
 
-  gl::Fbo::Ptr fbo_;
-  gl::Texture2D::Ptr tex_;
-  gl::Shader::Ptr shader_;
+  std::array<gl::Texture2D, MAX_TEXTURES> textures_;
+  gl::PboUnpacker pbo_;
+
+  gl::Fbo fbo_;
+  gl::Shader shader_;
   gl::VboMesh plane_;
 
-  PreciseStopwatch stopwatch_;
+  PlaybackClock::Ptr clock_;
+  bool b_own_clock_;
+  PlaybackStats stats_;
+  std::atomic<double> presentation_time_;
+  double last_time_;
+  double last_pts_;
+
+  static constexpr double MAX_CLOCK_JUMP = 1.0;
+  static constexpr double PTS_EPSILON = 1e-6;
 
  public:
-  HapVideoPlayer() {
+  HapVideoPlayer()
+      : clock_(SystemClock::create()),
+        b_own_clock_(true),
+        presentation_time_(0),
+        last_time_(0),
+        last_pts_(-std::numeric_limits<double>::infinity()) {
     plane_ = prim::Rectangle(-1, -1, 2, 2);
-    shader_ = gl::Shader::create(fs::getCommonResourcesPath() + "shaders/thru.vert",
-                                 fs::getCommonResourcesPath() + "shaders/hap.frag");
+    shader_.load(fs::getCommonResourcePath("shaders/thru.vert"),
+                 fs::getCommonResourcePath("shaders/hap.frag"));
   }
   virtual ~HapVideoPlayer() { close(); }
 
   void close() {
     stopThread();
 
-    if (context_.sws_context) sws_freeContext(context_.sws_context);
-    if (context_.codec_context) avcodec_free_context(&context_.codec_context);
-    if (context_.codec_context) avcodec_close(context_.codec_context);
-    if (context_.format_context) avformat_free_context(context_.format_context);
+    if (context_.format_context)
+      avformat_close_input(&context_.format_context);
+    context_ = Context();
+
+    pbo_.release();
 
     state_ = VideoState();
     frame_queues_.clear();
-    stopwatch_.reset();
+    frame_buffers_.clear();
+    if (b_own_clock_) {
+      clock_->stop();
+      clock_->seek(0);
+    }
+    stats_.reset();
+    presentation_time_ = 0;
+    last_time_ = 0;
+    last_pts_ = -std::numeric_limits<double>::infinity();
   }
 
-  bool load(const std::string &filename, size_t thread_count = 8) {
+  bool load(const std::string &filename, size_t num_buffers = 4) {
     close();
 
     do {
-      if (!(context_.format_context = avformat_alloc_context())) {
-        log::error("VideoPlayer") << "Couldn't create AVFormatContext" << log::end();
-        break;
-      }
-
-      if (avformat_open_input(&context_.format_context, filename.c_str(), nullptr, nullptr) != 0) {
-        log::error("VideoPlayer") << "Couldn't open video file" << log::end();
+      if (avformat_open_input(&context_.format_context, filename.c_str(),
+                              nullptr, nullptr) != 0) {
+        logger::error("HapVideoPlayer")
+            << "Couldn't open video file" << logger::end();
         break;
       }
 
       if (avformat_find_stream_info(context_.format_context, nullptr) < 0) {
-        log::error("VideoPlayer") << "Couldn't retrieve stream info" << log::end();
+        logger::error("HapVideoPlayer")
+            << "Couldn't retrieve stream info" << logger::end();
         break;
       }
 
       av_dump_format(context_.format_context, 0, filename.c_str(), 0);
 
-      AVCodec *codec;
-      AVCodecParameters *codec_param;
-      context_.stream_index = -1;
       for (int i = 0; i < context_.format_context->nb_streams; i++) {
-        codec_param = context_.format_context->streams[i]->codecpar;
-        codec = const_cast<AVCodec *>(avcodec_find_decoder(codec_param->codec_id));
-        if (!codec) continue;
-
+        AVStream *stream = context_.format_context->streams[i];
+        AVCodecParameters *codec_param = stream->codecpar;
         if (codec_param->codec_type == AVMEDIA_TYPE_VIDEO &&
             codec_param->codec_id == AV_CODEC_ID_HAP) {
           context_.stream_index = i;
+          context_.codec_tag = codec_param->codec_tag;
           context_.width = roundUpToMultipleOf4(codec_param->width);
           context_.height = roundUpToMultipleOf4(codec_param->height);
-          context_.time_base = av_q2d(context_.format_context->streams[i]->time_base);
-          context_.frame_rate = av_q2d(context_.format_context->streams[i]->r_frame_rate);
-          context_.duration = context_.format_context->duration / AV_TIME_BASE;
+          context_.time_base = av_q2d(stream->time_base);
+          context_.frame_rate = av_q2d(stream->r_frame_rate);
+          context_.duration =
+              context_.format_context->duration / (double)AV_TIME_BASE;
           break;
         }
       }
 
       if (context_.stream_index == -1) {
-        log::error("VideoPlayer") << "Couldn't find video stream" << log::end();
-        break;
-      }
-
-      if (!(context_.codec_context = avcodec_alloc_context3(codec))) {
-        log::error("VideoPlayer") << "Couldn't create AVCodecContext" << log::end();
-        break;
-      }
-      context_.codec_context->thread_count = thread_count;
-
-      if (avcodec_parameters_to_context(context_.codec_context, codec_param) < 0) {
-        log::error("VideoPlayer") << "Couldn't initialize AVCodecContext" << log::end();
+        logger::error("HapVideoPlayer")
+            << "Couldn't find video stream" << logger::end();
         break;
       }
 
-      if (avcodec_open2(context_.codec_context, codec, nullptr) < 0) {
-        log::error("VideoPlayer") << "Couldn't open codec" << log::end();
-        break;
-      }
-
-      context_.buffer_size = context_.width * context_.height;
-      GLenum internal_format = GL_RGBA8;
-      switch (context_.codec_context->codec_tag) {
+      switch (context_.codec_tag) {
         case MKTAG('H', 'a', 'p', '1'):
-          internal_format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
-          context_.buffer_size = context_.width * context_.height * 0.5;
+          context_.tex_count = 1;
+          context_.tex_formats[0] = HapTextureFormat_RGB_DXT1;
           break;
-
         case MKTAG('H', 'a', 'p', '5'):
+          context_.tex_count = 1;
+          context_.tex_formats[0] = HapTextureFormat_RGBA_DXT5;
+          break;
         case MKTAG('H', 'a', 'p', 'Y'):
-          internal_format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+          context_.tex_count = 1;
+          context_.tex_formats[0] = HapTextureFormat_YCoCg_DXT5;
           break;
-
         case MKTAG('H', 'a', 'p', 'M'):
-          // TODO: HapM
+          context_.tex_count = 2;
+          context_.tex_formats[0] = HapTextureFormat_YCoCg_DXT5;
+          context_.tex_formats[1] = HapTextureFormat_A_RGTC1;
+          break;
+        case MKTAG('H', 'a', 'p', 'A'):
+          context_.tex_count = 1;
+          context_.tex_formats[0] = HapTextureFormat_A_RGTC1;
           break;
-
         default:
           break;
       }
 
-      tex_ = gl::Texture2D::create(context_.width, context_.height, internal_format, GL_BGRA,
-                                   GL_UNSIGNED_INT_8_8_8_8_REV);
+      if (context_.tex_count == 0) {
+        logger::error("HapVideoPlayer")
+            << "Unsupported Hap variant" << logger::end();
+        break;
+      }
+
+      size_t max_size = 0;
+      std::array<size_t, MAX_TEXTURES> sizes = {};
+      for (int i = 0; i < context_.tex_count; i++) {
+        GLenum internal_format = getInternalFormat(context_.tex_formats[i]);
+        textures_[i].allocate(context_.width, context_.height,
+                              internal_format);
+        textures_[i].setMinFilter(GL_LINEAR);
+        textures_[i].setMagFilter(GL_LINEAR);
+        sizes[i] = gl::getCompressedImageSize(internal_format, context_.width,
+                                              context_.height);
+        max_size = std::max(max_size, sizes[i]);
+      }
+
+      frame_buffers_.resize(std::max<size_t>(num_buffers, 2));
+      for (auto &frame : frame_buffers_) {
+        for (int i = 0; i < context_.tex_count; i++)
+          frame.buffers[i].resize(sizes[i]);
+      }
 
-#if 1
-      tex_->bind();
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_STORAGE_HINT_APPLE, GL_STORAGE_SHARED_APPLE);
-      tex_->unbind();
-#endif
+      // orphaning: GPU が読み終わるのを待たずに新しい領域に書く
+      pbo_.allocateBytes(max_size, 1);
 
-      fbo_ = gl::Fbo::create(context_.width, context_.height);
-      fbo_->attachColor(GL_RGBA8);
-      fbo_->bind();
+      fbo_.allocate(context_.width, context_.height);
+      fbo_.attachColor(GL_RGBA8);
+      fbo_.bind();
       glClearColor(0, 0, 0, 0);
       glClear(GL_COLOR_BUFFER_BIT);
-      fbo_->unbind();
-
-      shader_->bind();
-      shader_->setUniform1i("u_YCoCg", internal_format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
-      shader_->unbind();
-
-      // int num_buffers = context_.frame_rate / 10.0;
-      // frame_buffers_.resize(num_buffers);
-      // for (int i = 0; i < frame_buffers_.size(); i++) {
-      //   DecodedFrame *frame = new DecodedFrame();
-      //   frame->buffer.resize(buffer_size);
-      //   frame_buffers_[i] = frame;
-      // }
+      fbo_.unbind();
+
+      bool b_ycocg = context_.tex_formats[0] == HapTextureFormat_YCoCg_DXT5;
+      shader_.bind();
+      shader_.setUniform1i("u_YCoCg", b_ycocg);
+      shader_.setUniform1i("u_has_alpha_tex", context_.tex_count > 1);
+      shader_.setUniform1i("u_alpha_only", context_.codec_tag ==
+                                               MKTAG('H', 'a', 'p', 'A'));
+      shader_.unbind();
+
       state_.b_loaded = true;
 
-      startThread();
+      startThread([this]() { this->threadedFunction(); });
 
       return true;
     } while (false);
@@ -250,64 +295,89 @@ class HapVideoPlayer : public Thread {
   void update() {
     if (!state_.b_loaded) return;
 
-    double current_time = getTime();
-    if (state_.b_loop && current_time > context_.duration) {
-      seekTime(0);
-      play();
-      return;
-    }
+    const double time = getTime();
+    const double frame_duration = getFrameDuration();
+    presentation_time_ = time;
 
-    DecodedFrame *frame;
+    // ループ・外部タイムコードのジャンプ・共有している時計のシークに追従する
+    if (time < last_time_ - frame_duration * 0.5 ||
+        time > last_time_ + MAX_CLOCK_JUMP) {
+      requestSeek(time);
+    }
+    last_time_ = time;
 
-    {
-      auto locker = getLock();
-      while (frame_queues_.size()) {
+    auto locker = getLock();
+    DecodedFrame *frame = nullptr;
+    while (true) {
+      // pts が時計を越えていない最新のフレームを選ぶ
+      while (!frame_queues_.empty() &&
+             getPts(*frame_queues_.front()) <= time + PTS_EPSILON) {
+        if (frame) stats_.addDropped();
         frame = frame_queues_.front();
-        if (current_time > (frame->pts * context_.time_base)) {
-          frame_queues_.pop_front();
-          notify();
-        } else {
-          break;
-        }
+        frame_queues_.pop_front();
       }
-      if (frame_queues_.empty()) return;
+
+      // 仮想時間で動いている時は表示すべきフレームが来るまで待つ
+      double shown_pts = frame ? getPts(*frame) : last_pts_;
+      if (!frame_queues_.empty() || !FrameClock::isVirtual() ||
+          !state_.b_playing || state_.b_eof || !isThreadRunning() ||
+          shown_pts + frame_duration > time + PTS_EPSILON)
+        break;
+
+      cv_.notify_all();
+      waitFor(locker, [this] {
+        return !frame_queues_.empty() || !state_.b_playing || state_.b_eof;
+      });
     }
 
-    if (frame != last_frame_) {
-      tex_->bind();
-      glPixelStorei(GL_UNPACK_CLIENT_STORAGE_APPLE, GL_TRUE);
-      glTextureRangeAPPLE(GL_TEXTURE_2D, frame->buffer.size(), frame->buffer.data());
-      glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tex_->getWidth(), tex_->getHeight(),
-                                tex_->getInternalFormat(),
-                                static_cast<GLsizei>(frame->buffer.size()), frame->buffer.data());
-      glPixelStorei(GL_UNPACK_CLIENT_STORAGE_APPLE, GL_FALSE);
-      tex_->unbind();
-
-      fbo_->bind();
-      shader_->bind();
-      shader_->setUniformTexture("u_tex", *tex_, 0);
+    if (!state_.b_loop && state_.b_eof && frame_queues_.empty() &&
+        time >= getDuration()) {
+      state_.b_playing = false;
+      if (b_own_clock_) clock_->stop();
+    }
+    bool b_playing = state_.b_playing;
+
+    state_.b_new_frame = frame != nullptr;
+    if (frame) {
+      // アップロードが終わるまではデコーダに上書きされない
+      for (int i = 0; i < context_.tex_count; i++) upload(i, *frame);
+      stats_.addPresented(time, getPts(*frame), frame_duration);
+      last_pts_ = getPts(*frame);
+    }
+    locker.unlock();
+    cv_.notify_all();
+
+    if (frame) {
+      fbo_.bind();
+      shader_.bind();
+      shader_.setUniformTexture("u_tex", textures_[0], 0);
+      if (context_.tex_count > 1)
+        shader_.setUniformTexture("u_tex_alpha", textures_[1], 1);
       plane_.draw(GL_TRIANGLE_FAN);
-      shader_->unbind();
-      fbo_->unbind();
-
-      last_frame_ = frame;
-      state_.b_new_frame = true;
-    } else {
-      state_.b_new_frame = false;
+      shader_.unbind();
+      fbo_.unbind();
     }
+    if (b_playing) stats_.tick(time, getFrameRate(), state_.b_new_frame);
   }
 
+  // 他の時計に従っている時は時計を動かさず、表示だけを止めたり再開したりする
+  // 時計の再生・停止・シーク・速度は親のプレイヤーか時計側で操作する
   void play() {
-    stopwatch_.start();
+    if (b_own_clock_) {
+      clock_->start();
+    } else {
+      // 止めている間に親の時計は進んでいるので、今の時刻から読み直す
+      requestSeek(getTime());
+    }
     {
       auto locker = getLock();
       state_.b_playing = true;
-      notify();
+      cv_.notify_all();
     }
   }
 
   void pause() {
-    stopwatch_.stop();
+    if (b_own_clock_) clock_->stop();
     {
       auto locker = getLock();
       state_.b_playing = false;
@@ -318,26 +388,19 @@ class HapVideoPlayer : public Thread {
   bool isLoop() const { return state_.b_loop; }
 
   void setSpeed(float speed) {
-    state_.offset_time = getTime();
-    state_.speed = speed;
-    stopwatch_.restart();
+    if (b_own_clock_) clock_->setSpeed(speed);
   }
-  float getSpeed() const { return state_.speed; }
+  float getSpeed() const { return clock_->getSpeed(); }
 
   void seekTime(double seconds) {
-    stopwatch_.restart();
-    {
-      auto locker = getLock();
-      state_.b_request_seek = true;
-      state_.seek_time = seconds;
-      state_.offset_time = seconds;
-      frame_queues_.clear();
-      notify();
-    }
+    if (!b_own_clock_) return;
+    clock_->seek(seconds);
+    last_time_ = seconds;
+    requestSeek(seconds);
   }
 
   void seekFrame(int64_t frame) {
-    double seconds = frame * getFrameRate();
+    double seconds = frame / getFrameRate();
     seekTime(seconds);
   }
 
@@ -346,8 +409,26 @@ class HapVideoPlayer : public Thread {
     seekTime(seconds);
   }
 
-  const gl::Texture2D::Ptr &getTexture() const { return fbo_->getTexture(0); }
-  gl::Texture2D::Ptr &getTexture() { return fbo_->getTexture(0); }
+  // 他のプレイヤーの時計や外部タイムコードに従わせる
+  void setClock(const PlaybackClock::Ptr &clock) {
+    clock_ = clock ? clock : SystemClock::create();
+    b_own_clock_ = !clock;
+    last_time_ = getTime();
+    requestSeek(last_time_);
+  }
+  const PlaybackClock::Ptr &getClock() const { return clock_; }
+
+  PlaybackStats::Counters getCounters() const { return stats_.getCounters(); }
+  void resetCounters() { stats_.reset(); }
+
+  const gl::Texture2D &getTexture() const { return fbo_.getTexture(0); }
+  gl::Texture2D &getTexture() { return fbo_.getTexture(0); }
+
+  // デコード済みの圧縮テクスチャ (HapM は 0: YCoCg, 1: アルファ)
+  const gl::Texture2D &getCompressedTexture(int index = 0) const {
+    return textures_.at(index);
+  }
+  unsigned int getNumCompressedTextures() const { return context_.tex_count; }
 
   bool isFrameNew() const { return state_.b_new_frame; }
   size_t getWidth() const { return context_.width; }
@@ -363,87 +444,168 @@ class HapVideoPlayer : public Thread {
     return state_.b_playing;
   }
 
-  double getTime() { return stopwatch_.getElapsedInSeconds() * state_.speed + state_.offset_time; }
-  double getPosition() { return getTime() / getDuration(); }
+  // ループ中は時計の時刻を尺で折り返す
+  double getTime() const {
+    double time = clock_->getTime();
+    if (state_.b_loop && getDuration() > 0) {
+      time = std::fmod(time, getDuration());
+      if (time < 0) time += getDuration();
+    }
+    return time;
+  }
+  double getPosition() const { return getTime() / getDuration(); }
 
  private:
+  double getFrameDuration() const {
+    return context_.frame_rate > 0 ? 1.0 / context_.frame_rate : 0.0;
+  }
+
+  double getPts(const DecodedFrame &frame) const {
+    return frame.pts * context_.time_base;
+  }
+
+  void requestSeek(double seconds) {
+    auto locker = getLock();
+    state_.b_request_seek = true;
+    state_.seek_time = seconds;
+    frame_queues_.clear();
+    last_pts_ = -std::numeric_limits<double>::infinity();
+    stats_.resync();
+    cv_.notify_all();
+  }
+
+  void upload(int index, const DecodedFrame &frame) {
+    const size_t size = frame.sizes[index];
+    const bool b_written = pbo_.write(
+        size,
+        [&](void *ptr) {
+          std::memcpy(ptr, frame.buffers[index].data(), size);
+        },
+        [&] {
+          textures_[index].loadCompressedData(nullptr,
+                                              static_cast<GLsizei>(size));
+        });
+    if (!b_written) {
+      logger::error("HapVideoPlayer")
+          << "Couldn't map the upload buffer" << logger::end();
+    }
+  }
+
   void waitForPlaying() {
     auto locker = getLock();
-    waitFor(locker, [this] { return state_.b_playing; });
+    waitFor(locker, [this] {
+      return (state_.b_playing && !state_.b_eof) || state_.b_request_seek;
+    });
   }
 
-  void waitForSeek() {
+  bool waitForSeek(double &seek_target) {
     auto locker = getLock();
-    if (state_.b_request_seek) {
-      state_.b_request_seek = false;
+    if (!state_.b_request_seek) return false;
+    state_.b_request_seek = false;
+    state_.b_eof = false;
+    seek_target = state_.seek_time;
+
+    int64_t pts = state_.seek_time / context_.time_base;
+    int ret = av_seek_frame(context_.format_context, context_.stream_index,
+                            pts, AVSEEK_FLAG_BACKWARD);
+    if (ret < 0)
+      logger::error("av_seek_frame") << av_err2str(ret) << logger::end();
+    return true;
+  }
 
-      int64_t pts = state_.seek_time / context_.time_base;
-      int ret = av_seek_frame(context_.format_context, context_.stream_index, pts, AVSEEK_FLAG_ANY);
-      if (ret < 0) {
-        log::error("av_seek_frame") << av_err2str(ret) << log::end();
-        return;
-      }
+  // すべてキーフレームなので、表示に間に合わないパケットはデコードせずに捨てる
+  // オフラインレンダリング中とシーク直後はすべてデコードする
+  bool isLate(const AVPacket *packet, double seek_target) const {
+    double pts = packet->pts * context_.time_base;
+    if (pts + getFrameDuration() <= seek_target) return true;
+    return !FrameClock::isVirtual() &&
+           pts + getFrameDuration() <= presentation_time_;
+  }
 
-      avcodec_flush_buffers(context_.codec_context);
+  bool decode(const AVPacket *packet, DecodedFrame &frame) {
+    unsigned int tex_count;
+    unsigned int hap_result =
+        HapGetFrameTextureCount(packet->data, packet->size, &tex_count);
+    if (hap_result != HapResult_No_Error || tex_count != context_.tex_count)
+      return false;
+
+    for (unsigned int i = 0; i < tex_count; i++) {
+      unsigned int tex_format;
+      hap_result = HapGetFrameTextureFormat(packet->data, packet->size, i,
+                                            &tex_format);
+      if (hap_result != HapResult_No_Error ||
+          !frameMatchesStream(tex_format, context_.codec_tag, i))
+        return false;
+
+      unsigned long bytes_used;
+      hap_result =
+          HapDecode(packet->data, packet->size, i, doDecode, &getDecodePool(),
+                    frame.buffers[i].data(),
+                    static_cast<unsigned long>(frame.buffers[i].size()),
+                    &bytes_used, &tex_format);
+      if (hap_result != HapResult_No_Error) return false;
+      frame.sizes[i] = bytes_used;
+    }
+    frame.pts = packet->pts;
+    return true;
+  }
+
+  void decodeToQueue(const AVPacket *packet, size_t &index) {
+    {
+      // 表示待ちのフレームを上書きしないように空きを待つ
+      auto locker = getLock();
+      waitFor(locker, [&] {
+        return frame_queues_.size() < frame_buffers_.size() ||
+               state_.b_request_seek;
+      });
+      if (state_.b_request_seek || !isThreadRunning()) return;
+    }
+
+    auto &frame = frame_buffers_[index];
+    if (!decode(packet, frame)) {
+      logger::warn("HapVideoPlayer") << "Invalid frame" << logger::end();
+      return;
+    }
+
+    auto locker = getLock();
+    if (!state_.b_request_seek) {
+      frame_queues_.push_back(&frame);
+      index = (index + 1) % frame_buffers_.size();
+      cv_.notify_all();
     }
   }
 
   void threadedFunction() {
     AVPacket *packet = av_packet_alloc();
     if (!packet) {
-      log::error("VideoPlayer") << "Couldn't allocate packet" << log::end();
+      logger::error("HapVideoPlayer")
+          << "Couldn't allocate packet" << logger::end();
       return;
     }
 
-    int num_buffers = context_.frame_rate / 10.0;
-    std::vector<DecodedFrame> frame_buffers_(num_buffers);
-    for (int i = 0; i < frame_buffers_.size(); i++) {
-      frame_buffers_[i].buffer.resize(context_.buffer_size);
-    }
-
-    int current_frame_index_ = 0;
+    size_t current_frame_index = 0;
+    double seek_target = -std::numeric_limits<double>::infinity();
 
     while (isThreadRunning()) {
       waitForPlaying();
-      waitForSeek();
+      if (!isThreadRunning()) break;
+      waitForSeek(seek_target);
 
       int ret = av_read_frame(context_.format_context, packet);
       if (ret < 0) {
         auto locker = getLock();
-        if (frame_queues_.empty()) state_.b_playing = false;
+        if (!state_.b_request_seek) state_.b_eof = true;
+        cv_.notify_all();
         continue;
       }
 
       if (packet->stream_index == context_.stream_index) {
-        unsigned int tex_count;
-        unsigned int hap_result = HapGetFrameTextureCount(packet->data, packet->size, &tex_count);
-        if (hap_result == HapResult_No_Error && tex_count == 1) {  // TODO: Hap Q+A
-          unsigned int tex_format;
-          hap_result = HapGetFrameTextureFormat(packet->data, packet->size, 0, &tex_format);
-          if (hap_result == HapResult_No_Error &&
-              !frameMatchesStream(tex_format, context_.codec_context->codec_tag)) {
-            hap_result = HapResult_Bad_Frame;
-          }
-
-          if (hap_result == HapResult_No_Error) {
-            auto &frame = frame_buffers_[current_frame_index_];
-
-            unsigned long bytes_used;
-            hap_result = HapDecode(
-                packet->data, packet->size, 0, doDecode, NULL, frame.buffer.data(),
-                static_cast<unsigned long>(frame.buffer.size()), &bytes_used, &tex_format);
-            frame.pts = packet->pts;
-
-            {
-              auto locker = getLock();
-              waitFor(locker, [&] { return frame_queues_.size() <= frame_buffers_.size(); });
-              frame_queues_.push_back(&frame);
-              current_frame_index_++;
-              current_frame_index_ %= frame_buffers_.size();
-            }
-          } else {
-            log::warn("VideoPlayer") << "Invalid frame" << log::end();
-          }
+        if (isLate(packet, seek_target)) {
+          if (packet->pts * context_.time_base >= seek_target)
+            stats_.addDropped();
+        } else {
+          seek_target = -std::numeric_limits<double>::infinity();
+          decodeToQueue(packet, current_frame_index);
         }
       }
 
@@ -454,4 +616,4 @@ class HapVideoPlayer : public Thread {
   }
 };
 
-}  // namespace limas
\ No newline at end of file
+}  // namespace limas
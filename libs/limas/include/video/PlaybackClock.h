@@ -0,0 +1,167 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "utils/FrameClock.h"
+#include "utils/Stopwatch.h"
+
+namespace limas {
+
+// プレイヤーがフレームを選ぶ基準になる時計 (秒)
+// 同じ時計を複数のプレイヤーに渡すと同期して再生される
+class PlaybackClock {
+ public:
+  using Ptr = std::shared_ptr<PlaybackClock>;
+
+  virtual ~PlaybackClock() {}
+
+  virtual double getTime() const = 0;
+
+  // 外部から駆動される時計では何もしない
+  virtual void start() {}
+  virtual void stop() {}
+  virtual void seek(double seconds) {}
+  virtual void setSpeed(float speed) {}
+  virtual float getSpeed() const { return 1.0f; }
+};
+
+// FrameClock で進む時計。オフラインレンダリング中は仮想時間に従う
+class SystemClock : public PlaybackClock {
+ public:
+  SystemClock() : speed_(1.0f), offset_(0.0) {}
+
+  static Ptr create() { return std::make_shared<SystemClock>(); }
+
+  double getTime() const override {
+    return stopwatch_.getElapsedInSeconds() * speed_ + offset_;
+  }
+
+  void start() override { stopwatch_.start(); }
+  void stop() override { stopwatch_.stop(); }
+
+  void seek(double seconds) override {
+    offset_ = seconds;
+    restart();
+  }
+
+  void setSpeed(float speed) override {
+    offset_ = getTime();
+    speed_ = speed;
+    restart();
+  }
+  float getSpeed() const override { return speed_; }
+
+  bool isRunning() const { return stopwatch_.isRunning(); }
+
+ private:
+  // 経過時間を捨てて、動いていた場合はそこから再開する
+  void restart() {
+    bool b_running = stopwatch_.isRunning();
+    stopwatch_.reset();
+    if (b_running) stopwatch_.start();
+  }
+
+  BaseStopwatch<FrameClock> stopwatch_;
+  float speed_;
+  double offset_;
+};
+
+// 外部のタイムコード (LTC / MTC / OSC など) で駆動される時計
+// setTime() は別スレッドから呼んでもよい
+class ExternalClock : public PlaybackClock {
+ public:
+  ExternalClock()
+      : time_(0.0), b_interpolate_(true), max_extrapolation_(0.5) {}
+
+  static std::shared_ptr<ExternalClock> create() {
+    return std::make_shared<ExternalClock>();
+  }
+
+  void setTime(double seconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    time_ = seconds;
+    received_at_ = FrameClock::now();
+  }
+
+  // タイムコードの更新間隔の間を FrameClock で補間する
+  // max_extrapolation 秒以上更新が無ければ止まっているとみなす
+  void setInterpolation(bool b_interpolate, double max_extrapolation = 0.5) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    b_interpolate_ = b_interpolate;
+    max_extrapolation_ = max_extrapolation;
+  }
+
+  double getTime() const override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!b_interpolate_) return time_;
+    double elapsed =
+        std::chrono::duration<double>(FrameClock::now() - received_at_)
+            .count();
+    return time_ + std::clamp(elapsed, 0.0, max_extrapolation_);
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  double time_;
+  FrameClock::time_point received_at_;
+  bool b_interpolate_;
+  double max_extrapolation_;
+};
+
+// 表示したフレームの遅延・ドロップ・重複を数える
+class PlaybackStats {
+ public:
+  struct Counters {
+    uint64_t presented = 0;
+    uint64_t late = 0;        // 表示期間を過ぎてから表示した
+    uint64_t dropped = 0;     // デコードしなかった / 表示せずに捨てた
+    uint64_t duplicated = 0;  // 次のフレームが間に合わず同じフレームを続けた
+  };
+
+  PlaybackStats() { reset(); }
+
+  void reset() {
+    presented_ = 0;
+    late_ = 0;
+    dropped_ = 0;
+    duplicated_ = 0;
+    last_slot_ = -1;
+  }
+
+  // シークなどで時計が飛んだ時に呼ぶ
+  void resync() { last_slot_ = -1; }
+
+  void addDropped(uint64_t count = 1) { dropped_ += count; }
+
+  void addPresented(double time, double pts, double frame_duration) {
+    presented_++;
+    if (time - pts >= frame_duration) late_++;
+  }
+
+  // 毎フレーム呼ぶ。時計が次のフレームの区間に入ったのに新しいフレームが
+  // 無ければ重複とみなす
+  void tick(double time, double frame_rate, bool b_new_frame) {
+    int64_t slot = (int64_t)std::floor(time * frame_rate + 1e-6);
+    if (!b_new_frame && last_slot_ >= 0 && slot > last_slot_) duplicated_++;
+    last_slot_ = slot;
+  }
+
+  Counters getCounters() const {
+    Counters counters;
+    counters.presented = presented_.load();
+    counters.late = late_.load();
+    counters.dropped = dropped_.load();
+    counters.duplicated = duplicated_.load();
+    return counters;
+  }
+
+ private:
+  std::atomic<uint64_t> presented_;
+  std::atomic<uint64_t> late_;
+  std::atomic<uint64_t> dropped_;
+  std::atomic<uint64_t> duplicated_;
+  int64_t last_slot_;
+};
+
+}  // namespace limas
@@ -0,0 +1,245 @@
+#pragma once
+
+extern "C" {
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+#include "libswscale/swscale.h"
+}
+
+#include "gl/Texture2D.h"
+#include "graphics/Pixels.h"
+#include "system/Noncopyable.h"
+
+namespace limas {
+
+// VideoPlayer・VideoGrabber・VideoThumbnailer が共有する映像ストリームの
+// デコードと RGB への変換
+// デマックスとフレームの受け渡しは使う側が行う
+// send() と receive() はデコードスレッド、upload() はメインスレッドから呼ぶ
+class VideoDecoder : private Noncopyable {
+ public:
+  struct Settings {
+    // 0 なら自動
+    int thread_count = 0;
+    int thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    bool b_low_delay = false;
+    // H.264 は VideoToolbox があれば使う
+    bool b_hardware = false;
+    // 0 でなければ、対応するコーデックではこの大きさを下回らない範囲で
+    // 縮小してデコードする (lowres)
+    int min_width = 0;
+    int min_height = 0;
+    AVDiscard skip_frame = AVDISCARD_DEFAULT;
+    bool b_skip_loop_filter = false;
+    // false ならテクスチャを作らない。GL のないスレッドで開く時に使う
+    bool b_texture = true;
+  };
+
+  VideoDecoder()
+      : codec_context_(nullptr),
+        sws_context_(nullptr),
+        b_texture_(true),
+        stream_index_(-1),
+        width_(0),
+        height_(0),
+        time_base_(0),
+        frame_rate_(0) {}
+  virtual ~VideoDecoder() { close(); }
+
+  void close() {
+    if (sws_context_) {
+      sws_freeContext(sws_context_);
+      sws_context_ = nullptr;
+    }
+    if (codec_context_) avcodec_free_context(&codec_context_);
+    stream_index_ = -1;
+    width_ = height_ = 0;
+    time_base_ = frame_rate_ = 0;
+  }
+
+  // format_context の一番良い映像ストリームのデコーダを開く
+  bool open(AVFormatContext *format_context, const Settings &settings,
+            const std::string &name = "VideoDecoder") {
+    close();
+
+    int index = av_find_best_stream(format_context, AVMEDIA_TYPE_VIDEO, -1, -1,
+                                    nullptr, 0);
+    if (index < 0) {
+      logger::error(name) << "Couldn't find video stream" << logger::end();
+      return false;
+    }
+
+    AVStream *stream = format_context->streams[index];
+    AVCodecParameters *codec_param = stream->codecpar;
+    const AVCodec *codec = avcodec_find_decoder(codec_param->codec_id);
+    if (!codec) {
+      logger::error(name) << "Couldn't find decoder" << logger::end();
+      return false;
+    }
+    if (settings.b_hardware && codec->id == AV_CODEC_ID_H264) {
+      const AVCodec *hw = avcodec_find_decoder_by_name("h264_videotoolbox");
+      if (hw) codec = hw;
+    }
+
+    if (!(codec_context_ = avcodec_alloc_context3(codec))) {
+      logger::error(name) << "Couldn't create AVCodecContext" << logger::end();
+      return false;
+    }
+
+    if (avcodec_parameters_to_context(codec_context_, codec_param) < 0) {
+      logger::error(name)
+          << "Couldn't initialize AVCodecContext" << logger::end();
+      close();
+      return false;
+    }
+
+    if (settings.b_low_delay) codec_context_->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    codec_context_->thread_type = settings.thread_type;
+    codec_context_->thread_count = settings.thread_count;
+    codec_context_->lowres = getLowres(codec, codec_param, settings);
+    codec_context_->skip_frame = settings.skip_frame;
+    if (settings.b_skip_loop_filter)
+      codec_context_->skip_loop_filter = AVDISCARD_ALL;
+
+    if (avcodec_open2(codec_context_, codec, nullptr) < 0) {
+      logger::error(name) << "Couldn't open codec" << logger::end();
+      close();
+      return false;
+    }
+
+    stream_index_ = index;
+    width_ = codec_param->width;
+    height_ = codec_param->height;
+    time_base_ = av_q2d(stream->time_base);
+    AVRational rate = stream->avg_frame_rate.num ? stream->avg_frame_rate
+                                                 : stream->r_frame_rate;
+    frame_rate_ = rate.den ? av_q2d(rate) : 0.0;
+
+    // テクスチャを使わない時は upload() か scale() まで確保しない
+    b_texture_ = settings.b_texture;
+    if (b_texture_) allocate(width_, height_);
+    return true;
+  }
+
+  bool isOpen() const { return codec_context_ != nullptr; }
+
+  // nullptr を送るとデコーダに残っているフレームを出し切る
+  int send(const AVPacket *packet) {
+    int ret = avcodec_send_packet(codec_context_, packet);
+    if (ret < 0 && ret != AVERROR_EOF)
+      logger::error("avcodec_send_packet") << av_err2str(ret) << logger::end();
+    return ret;
+  }
+
+  // EAGAIN と EOF 以外の失敗はログに出す
+  int receive(AVFrame *frame) {
+    int ret = avcodec_receive_frame(codec_context_, frame);
+    if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+      logger::error("avcodec_receive_frame")
+          << av_err2str(ret) << logger::end();
+    }
+    return ret;
+  }
+
+  void flush() { avcodec_flush_buffers(codec_context_); }
+
+  void setSkipFrame(AVDiscard discard) { codec_context_->skip_frame = discard; }
+
+  // RGB に変換してテクスチャに送る。大きさが変わったら確保し直す
+  bool upload(const AVFrame *frame) {
+    if (frame->width != (int)pixels_.getWidth() ||
+        frame->height != (int)pixels_.getHeight()) {
+      allocate(frame->width, frame->height);
+    }
+    if (!convert(frame, frame->width, frame->height, AV_PIX_FMT_RGB24,
+                 SWS_FAST_BILINEAR, pixels_))
+      return false;
+    if (b_texture_) tex_.loadData(&pixels_.getData()[0]);
+    return true;
+  }
+
+  // width x height の RGBA に縮小して pixels に書く
+  bool scale(const AVFrame *frame, int width, int height, Pixels2D &pixels) {
+    pixels.allocate(width, height, 4);
+    return convert(frame, width, height, AV_PIX_FMT_RGBA, SWS_AREA, pixels);
+  }
+
+  double getPts(const AVFrame *frame) const {
+    return frame->best_effort_timestamp * time_base_;
+  }
+
+  double getFrameDuration() const {
+    return frame_rate_ > 0 ? 1.0 / frame_rate_ : 0.0;
+  }
+
+  const Pixels2D &getPixels() const { return pixels_; }
+  const gl::Texture2D &getTexture() const { return tex_; }
+  gl::Texture2D &getTexture() { return tex_; }
+
+  int getStreamIndex() const { return stream_index_; }
+  int getWidth() const { return width_; }
+  int getHeight() const { return height_; }
+  double getTimeBase() const { return time_base_; }
+  double getFrameRate() const { return frame_rate_; }
+  AVCodecContext *getCodecContext() const { return codec_context_; }
+
+ private:
+  // 縮小しても min_width x min_height を下回らない一番大きい lowres
+  static int getLowres(const AVCodec *codec,
+                       const AVCodecParameters *codec_param,
+                       const Settings &settings) {
+    if (settings.min_width <= 0 && settings.min_height <= 0) return 0;
+    int lowres = 0;
+    while (lowres < codec->max_lowres &&
+           (codec_param->width >> (lowres + 1)) >= settings.min_width &&
+           (codec_param->height >> (lowres + 1)) >= settings.min_height)
+      lowres++;
+    return lowres;
+  }
+
+  // 大きさや形式が変わっても sws_getCachedContext が作り直す
+  bool convert(const AVFrame *frame, int width, int height,
+               AVPixelFormat format, int flags, Pixels2D &pixels) {
+    sws_context_ = sws_getCachedContext(
+        sws_context_, frame->width, frame->height,
+        (AVPixelFormat)frame->format, width, height, format, flags, nullptr,
+        nullptr, nullptr);
+    if (!sws_context_) {
+      logger::error("VideoDecoder")
+          << "Couldn't get sws context" << logger::end();
+      return false;
+    }
+
+    int linesize[4] = {
+        static_cast<int>(pixels.getNumChannels() * pixels.getWidth()), 0, 0,
+        0};
+    uint8_t *data[4] = {&pixels.getData()[0], 0, 0, 0};
+    return sws_scale(sws_context_, frame->data, frame->linesize, 0,
+                     frame->height, data, linesize) > 0;
+  }
+
+  void allocate(int width, int height) {
+    if (width <= 0 || height <= 0) return;
+    if (b_texture_) {
+      tex_.allocate(width, height, GL_RGB8);
+      tex_.setMinFilter(GL_LINEAR);
+      tex_.setMagFilter(GL_LINEAR);
+    }
+    pixels_.allocate(width, height, 3);
+  }
+
+  AVCodecContext *codec_context_;
+  SwsContext *sws_context_;
+  bool b_texture_;
+
+  int stream_index_;
+  int width_;
+  int height_;
+  double time_base_;
+  double frame_rate_;
+
+  gl::Texture2D tex_;
+  Pixels2D pixels_;
+};
+
+}  // namespace limas
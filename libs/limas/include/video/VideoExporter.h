@@ -1,11 +1,12 @@
 #pragma once
 
 extern "C" {
+#include "hap.h"
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 // #include <libavutil/imgutils.h>
-// #include <libavutil/pixdesc.h>
 #include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
 #include <libswscale/swscale.h>
 }
 
@@ -14,39 +15,171 @@ extern "C" {
 #include "gl/Shader.h"
 #include "gl/Texture2D.h"
 #include "gl/VboMesh.h"
+#include "graphics/DxtCompressor.h"
 #include "graphics/ImageIO.h"
 #include "primitives/Primitives.h"
+#include "system/BoundedQueue.h"
 #include "system/Logger.h"
+#include "system/Thread.h"
+#include "system/ThreadPool.h"
+#include "utils/FrameClock.h"
 #include "utils/Stopwatch.h"
 
 namespace limas {
 class VideoExporter {
-#define ENCODE_HEVC 0
+ public:
+  // エンコードが追いつかない時のフレームの扱い
+  enum class QueuePolicy { BLOCK, DROP_NEWEST, DROP_OLDEST };
+
+  enum class Codec {
+    PRORES_422,
+    PRORES_4444,
+    H264,
+    H265,
+    FFV1,
+    MJPEG,
+    HAP,
+    HAP_ALPHA,
+    HAP_Q,
+    HAP_Q_ALPHA,
+    RAW
+  };
+
+  enum class Container { MOV, MP4, MKV };
+
+  struct Settings {
+    Codec codec = Codec::PRORES_4444;
+    Container container = Container::MOV;
+    int crf = 18;                   // H264 / H265
+    std::string preset = "medium";  // H264 / H265
+    std::string tune = "";          // H264 / H265
+    int quality = 2;                // MJPEG (2-31)
+    int chunks = 1;                 // HAP (並列デコード用の分割数)
+    int64_t bit_rate = 0;           // 0: codec default
+    int threads = 0;                // 0: auto
+  };
+
+  struct Counters {
+    size_t queue_depth = 0;
+    size_t readback_depth = 0;
+    uint64_t captured_frames = 0;
+    uint64_t encoded_frames = 0;
+    uint64_t dropped_frames = 0;
+    uint64_t bytes_written = 0;
+    float encode_fps = 0;
+  };
+
+  static std::string getExtension(Container container) {
+    switch (container) {
+      case Container::MP4:
+        return ".mp4";
+      case Container::MKV:
+        return ".mkv";
+      case Container::MOV:
+      default:
+        return ".mov";
+    }
+  }
+
+ private:
+  struct RawFrame {
+    std::vector<unsigned char> data;
+    int64_t pts = 0;
+    bool b_rgba = false;  // write() から来たフレームは read_format_ ではない
+  };
+
   gl::Fbo fbo_;
   gl::PboPacker pbo_;
-  std::vector<unsigned char> pixel_data_;
 
   struct Context {
-    AVStream *stream;
-    AVFormatContext *format_context;
-    AVCodecContext *codec_context;
-    AVFrame *frame;
-    AVFrame *yuv_frame;
-    SwsContext *sws_context;
-    uint32_t frame_index;
+    AVStream *stream = nullptr;
+    AVFormatContext *format_context = nullptr;
+    AVCodecContext *codec_context = nullptr;
+    SwsContext *sws_context = nullptr;
+    AVRational time_base = {0, 1};
   };
   Context context_;
+  Settings settings_;
+  GLenum read_format_;
+
+  // render thread -> (PBO ring) -> converter -> encoder
+  gl::PboReader readback_;
+  std::deque<int64_t> readback_pts_;
+  size_t frame_bytes_;
+
+  std::vector<std::unique_ptr<RawFrame>> raw_pool_;
+  BoundedQueue<RawFrame *> free_raw_frames_;
+  BoundedQueue<RawFrame *> raw_frames_;
+
+  std::vector<AVFrame *> av_pool_;
+  BoundedQueue<AVFrame *> free_av_frames_;
+  BoundedQueue<AVFrame *> encode_frames_;
+
+  Thread converter_;
+  Thread encoder_;
+
+  // HAP は FFmpeg を通さずに DXT 圧縮 + Snappy で直接パケットを作る
+  std::vector<DxtCompressor::Format> hap_formats_;
+  std::vector<std::vector<unsigned char>> hap_textures_;
+  std::vector<unsigned char> hap_packet_;
+  std::unique_ptr<ThreadPool> hap_pool_;  // DXT 圧縮を分ける
+
+  size_t readback_depth_;
+  size_t queue_capacity_;
+  QueuePolicy policy_;
+
+  int64_t capture_index_;
+  std::atomic<uint64_t> captured_frames_;
+  std::atomic<uint64_t> encoded_frames_;
+  std::atomic<uint64_t> dropped_frames_;
+  std::atomic<uint64_t> bytes_written_;
+  std::atomic<float> encode_fps_;
+  std::chrono::steady_clock::time_point fps_window_begin_;
+  uint64_t fps_window_frames_;
 
   bool is_setup_;
   bool is_exporting_;
   bool b_vflip_;
 
+  static constexpr size_t NUM_ENCODE_FRAMES = 3;
+
  public:
-  VideoExporter() : is_setup_(false), is_exporting_(false), b_vflip_(true) {}
+  VideoExporter()
+      : read_format_(GL_RGBA),
+        frame_bytes_(0),
+        readback_depth_(3),
+        queue_capacity_(8),
+        policy_(QueuePolicy::DROP_NEWEST),
+        capture_index_(0),
+        captured_frames_(0),
+        encoded_frames_(0),
+        dropped_frames_(0),
+        bytes_written_(0),
+        encode_fps_(0),
+        fps_window_frames_(0),
+        is_setup_(false),
+        is_exporting_(false),
+        b_vflip_(true) {}
   ~VideoExporter() { stop(); }
 
+  // allocate() より前に呼ぶ
+  void setReadbackDepth(size_t depth) {
+    readback_depth_ = std::max<size_t>(depth, 1);
+  }
+  void setQueueCapacity(size_t capacity) {
+    queue_capacity_ = std::max<size_t>(capacity, 1);
+  }
+  void setQueuePolicy(QueuePolicy policy) { policy_ = policy; }
+  QueuePolicy getQueuePolicy() const { return policy_; }
+
   bool allocate(size_t width, size_t height, float fps) {
+    return allocate(width, height, fps, Settings());
+  }
+
+  bool allocate(size_t width, size_t height, float fps,
+                const Settings &settings) {
     stop();
+    settings_ = settings;
 
     do {
       fbo_.allocate(width, height);
@@ -57,22 +190,26 @@ class VideoExporter {
 
       pbo_.allocate(fbo_.getWidth(), fbo_.getHeight(),
                     fbo_.getTextures()[0].getInternalFormat());
-      // pbo_->enableAsync();
 
-      pixel_data_.resize(width * height * 4);
+      frame_bytes_ = width * height * 4;
 
-      avformat_alloc_output_context2(&context_.format_context, nullptr, "mov",
-                                     nullptr);  // filepath.c_str());
-      if (!context_.format_context) {
-        logger::error("VideoExporter")
-            << "Couldn't allocate format context" << logger::end();
-        break;
+      readback_.allocate(frame_bytes_, readback_depth_);
+      readback_pts_.clear();
+
+      raw_pool_.resize(queue_capacity_);
+      for (auto &frame : raw_pool_) {
+        frame = std::make_unique<RawFrame>();
+        frame->data.resize(frame_bytes_);
       }
+      free_raw_frames_.setCapacity(queue_capacity_);
+      raw_frames_.setCapacity(queue_capacity_);
 
-      const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_PRORES);
-      if (!codec) {
+      avformat_alloc_output_context2(&context_.format_context, nullptr,
+                                     getFormatName(settings_.container),
+                                     nullptr);
+      if (!context_.format_context) {
         logger::error("VideoExporter")
-            << "Couldn't find condec" << logger::end();
+            << "Couldn't allocate format context" << logger::end();
         break;
       }
 
@@ -80,87 +217,16 @@ class VideoExporter {
                 avformat_new_stream(context_.format_context, nullptr))) {
         logger::error("VideoExporter")
             << "Couldn't create strean" << logger::end();
-        return false;
+        break;
       }
       context_.stream->id = (int)(context_.format_context->nb_streams - 1);
       context_.stream->time_base = av_d2q(1.0 / fps, 120);
 
-      if (!(context_.codec_context = avcodec_alloc_context3(codec))) {
-        logger::error("VideoExporter")
-            << "Couldn't allocate condec context" << logger::end();
-        break;
-      }
-      context_.codec_context->width = width;
-      context_.codec_context->height = height;
-      context_.codec_context->time_base = context_.stream->time_base;
-      context_.codec_context->pix_fmt = AV_PIX_FMT_YUV444P10;
-      context_.codec_context->codec_id = AV_CODEC_ID_PRORES;
-      context_.codec_context->profile = FF_PROFILE_PRORES_4444;
-
-      // generate global header when the format requires it
-      if (context_.format_context->oformat->flags & AVFMT_GLOBALHEADER) {
-        context_.format_context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
-      }
-
-      AVDictionary *codec_options = nullptr;
-      //   av_dict_set(&codec_options, "codec", "prores_ks4", 0);
+      context_.time_base = context_.stream->time_base;
 
-      if (avcodec_open2(context_.codec_context, codec, &codec_options) < 0) {
-        logger::error("VideoExporter")
-            << "Couldn't open codec" << logger::end();
+      if (isHap() ? !openHapEncoder(width, height) : !openCodec(width, height))
         break;
-      }
-
-      if (!(context_.frame = av_frame_alloc())) {
-        logger::error("VideoExporter")
-            << "Couldn't allocate frame" << logger::end();
-        break;
-      }
-      context_.frame->format = context_.codec_context->pix_fmt;
-      context_.frame->width = context_.codec_context->width;
-      context_.frame->height = context_.codec_context->height;
-
-      if (av_frame_get_buffer(context_.frame, 32) < 0) {
-        logger::error("VideoExporter")
-            << "Couldn't allocate frame data" << logger::end();
-        break;
-      }
 
-      if (avcodec_parameters_from_context(context_.stream->codecpar,
-                                          context_.codec_context) < 0) {
-        logger::error("VideoExporter")
-            << "Couldn't copy the stream parameter" << logger::end();
-        break;
-      }
-
-      if (!(context_.sws_context = sws_getContext(
-                context_.codec_context->width, context_.codec_context->height,
-                AV_PIX_FMT_RGBA, context_.codec_context->width,
-                context_.codec_context->height, context_.codec_context->pix_fmt,
-                SWS_BILINEAR, nullptr, nullptr, nullptr))) {
-        logger::error("VideoExporter")
-            << "Couldn't get sws context" << logger::end();
-        break;
-      }
-
-      // if (avio_open(&context_.format_context->pb, filepath.c_str(),
-      //               AVIO_FLAG_WRITE) != 0) {
-      //   logger::error("VideoExporter")
-      //       << "Couldn't open " << filepath << logger::end();
-      //   break;
-      // }
-
-      // if (avformat_write_header(context_.format_context, nullptr) < 0) {
-      //   logger::error("VideoExporter") << "Couldn't write" << logger::end();
-      //   if (avio_close(context_.format_context->pb) != 0)
-      //     logger::error("VideoExporter")
-      //         << "Couldn't close file" << logger::end();
-      //   break;
-      // }
-
-      // av_dump_format(context_.format_context, 0, filepath.c_str(), 1);
-
-      context_.frame_index = 0;
       is_setup_ = true;
       is_exporting_ = false;
       return true;
@@ -171,22 +237,25 @@ class VideoExporter {
   }
 
   void stop() {
-    if (is_setup_) {
-      avcodec_send_frame(context_.codec_context, nullptr);
-
-      flush();
+    if (is_exporting_) finish();
 
-      av_write_trailer(context_.format_context);
+    readback_.release();
+    readback_pts_.clear();
 
-      if (avio_close(context_.format_context->pb) != 0)
-        logger::error("VideoExporter")
-            << "failed to close file" << logger::end();
+    for (auto &frame : av_pool_) {
+      if (frame) av_frame_free(&frame);
     }
+    av_pool_.clear();
+    raw_pool_.clear();
+    hap_formats_.clear();
+    hap_textures_.clear();
+    hap_packet_.clear();
+    hap_pool_.reset();
 
     if (context_.sws_context) sws_freeContext(context_.sws_context);
-    if (context_.frame) av_frame_free(&context_.frame);
     if (context_.codec_context) avcodec_free_context(&context_.codec_context);
     if (context_.format_context) avformat_free_context(context_.format_context);
+    context_ = Context();
 
     is_setup_ = false;
     is_exporting_ = false;
@@ -196,49 +265,28 @@ class VideoExporter {
   void unbind() {
     fbo_.unbind();
 
-    if (is_setup_ && is_exporting_ && pbo_.readToPixels(&pixel_data_, fbo_)) {
-      write(pixel_data_.data());
+    if (is_setup_ && is_exporting_) {
+      readback();
+      while (collect(false)) {
+      }
     }
   }
 
+  // RGBA のピクセルを直接パイプラインに渡す
   void write(const unsigned char *data) {
-    auto ret = av_frame_make_writable(context_.frame);
-    if (ret < 0) {
-      std::cout << "frame is not writable" << std::endl;
-      return;
-    }
-
-    // flip vertically
-    if (b_vflip_) {
-      const int width = context_.codec_context->width;
-      const int height = context_.codec_context->height;
-      const int bytes_per_pixel = 4;
-      const unsigned char *flipped_data =
-          data + (height - 1) * width * bytes_per_pixel;
-
-      const int flipped_linesize[1] = {-width * bytes_per_pixel};
-
-      sws_scale(context_.sws_context, &flipped_data, flipped_linesize, 0,
-                height, context_.frame->data, context_.frame->linesize);
-    } else {
-      const int in_linesize[1] = {context_.codec_context->width * 4};
-      sws_scale(context_.sws_context, &data, in_linesize, 0,
-                context_.codec_context->height, context_.frame->data,
-                context_.frame->linesize);
-    }
+    if (!is_exporting_) return;
+    captured_frames_++;
+    submit(data, capture_index_++, false, true);
+  }
 
-    context_.frame->pts = context_.frame_index++;
-    ret = avcodec_send_frame(context_.codec_context, context_.frame);
-    if (ret < 0) {
+  void start(const std::string &filepath) {
+    if (!is_setup_) {
       logger::error("VideoExporter")
-          << "Error sending a frame for encoding" << logger::end();
+          << "VideoExporter is not set up" << logger::end();
       return;
     }
+    if (is_exporting_) return;
 
-    flush();
-  }
-
-  void start(const std::string &filepath) {
     if (avio_open(&context_.format_context->pb, filepath.c_str(),
                   AVIO_FLAG_WRITE) != 0) {
       logger::error("VideoExporter")
@@ -248,18 +296,59 @@ class VideoExporter {
 
     if (avformat_write_header(context_.format_context, nullptr) < 0) {
       logger::error("VideoExporter") << "Couldn't write" << logger::end();
-      avio_close(context_.format_context->pb);
+      avio_closep(&context_.format_context->pb);
       return;
     }
 
     av_dump_format(context_.format_context, 0, filepath.c_str(), 1);
 
-    context_.frame_index = 0;
+    free_raw_frames_.reset();
+    raw_frames_.reset();
+    for (auto &frame : raw_pool_) free_raw_frames_.push(frame.get());
+
+    free_av_frames_.reset();
+    encode_frames_.reset();
+    for (auto frame : av_pool_) free_av_frames_.push(frame);
+
+    capture_index_ = 0;
+    captured_frames_ = 0;
+    encoded_frames_ = 0;
+    dropped_frames_ = 0;
+    bytes_written_ = 0;
+    encode_fps_ = 0;
+    fps_window_begin_ = std::chrono::steady_clock::now();
+    fps_window_frames_ = 0;
+
+    if (isHap()) {
+      encoder_.startThread([this]() { hapEncodeLoop(); });
+    } else {
+      converter_.startThread([this]() { convertLoop(); });
+      encoder_.startThread([this]() { encodeLoop(); });
+    }
+
     is_exporting_ = true;
   }
 
-  uint32_t getRecordedFrameCount() const { return context_.frame_index; }
+  uint32_t getRecordedFrameCount() const { return encoded_frames_.load(); }
+  uint64_t getDroppedFrameCount() const { return dropped_frames_.load(); }
+  size_t getQueueDepth() const {
+    return raw_frames_.size() + encode_frames_.size();
+  }
+  float getEncodeFps() const { return encode_fps_.load(); }
+
+  Counters getCounters() const {
+    Counters counters;
+    counters.queue_depth = getQueueDepth();
+    counters.readback_depth = readback_.getNumPending();
+    counters.captured_frames = captured_frames_.load();
+    counters.encoded_frames = encoded_frames_.load();
+    counters.dropped_frames = dropped_frames_.load();
+    counters.bytes_written = bytes_written_.load();
+    counters.encode_fps = encode_fps_.load();
+    return counters;
+  }
 
+  const Settings &getSettings() const { return settings_; }
   void setVFlip(bool b_vflip) { b_vflip_ = b_vflip; }
   bool isExporting() const { return is_exporting_; }
   bool isVFlip() const { return b_vflip_; }
@@ -292,6 +381,551 @@ class VideoExporter {
   }
 
  private:
+#pragma mark CODEC
+
+  static const char *getFormatName(Container container) {
+    switch (container) {
+      case Container::MP4:
+        return "mp4";
+      case Container::MKV:
+        return "matroska";
+      case Container::MOV:
+      default:
+        return "mov";
+    }
+  }
+
+  static const AVCodec *findEncoder(Codec codec) {
+    switch (codec) {
+      case Codec::H264:
+        return avcodec_find_encoder_by_name("libx264");
+      case Codec::H265:
+        return avcodec_find_encoder_by_name("libx265");
+      case Codec::FFV1:
+        return avcodec_find_encoder(AV_CODEC_ID_FFV1);
+      case Codec::MJPEG:
+        return avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+      case Codec::RAW:
+        return avcodec_find_encoder(AV_CODEC_ID_RAWVIDEO);
+      case Codec::PRORES_422:
+      case Codec::PRORES_4444:
+      default: {
+        const AVCodec *codec = avcodec_find_encoder_by_name("prores_ks");
+        return codec ? codec : avcodec_find_encoder(AV_CODEC_ID_PRORES);
+      }
+    }
+  }
+
+  // 先頭ほど優先度が高い
+  static std::vector<AVPixelFormat> getPreferredPixelFormats(Codec codec) {
+    switch (codec) {
+      case Codec::PRORES_422:
+        return {AV_PIX_FMT_YUV422P10};
+      case Codec::H264:
+      case Codec::H265:
+        return {AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV444P};
+      case Codec::FFV1:
+        return {AV_PIX_FMT_BGRA, AV_PIX_FMT_GBRP, AV_PIX_FMT_YUV444P};
+      case Codec::MJPEG:
+        return {AV_PIX_FMT_YUVJ420P, AV_PIX_FMT_YUV420P};
+      case Codec::RAW:
+        return {AV_PIX_FMT_RGBA, AV_PIX_FMT_BGRA};
+      case Codec::PRORES_4444:
+      default:
+        return {AV_PIX_FMT_YUV444P10, AV_PIX_FMT_YUVA444P10};
+    }
+  }
+
+  AVPixelFormat negotiatePixelFormat(const AVCodec *codec) const {
+    auto preferred = getPreferredPixelFormats(settings_.codec);
+    if (!codec->pix_fmts) return preferred.front();
+
+    for (auto fmt : preferred) {
+      for (auto p = codec->pix_fmts; *p != AV_PIX_FMT_NONE; p++) {
+        if (*p == fmt) return fmt;
+      }
+    }
+    return avcodec_find_best_pix_fmt_of_list(codec->pix_fmts, AV_PIX_FMT_RGBA,
+                                             1, nullptr);
+  }
+
+  static bool isYUV(AVPixelFormat pix_fmt) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+    return desc && !(desc->flags & AV_PIX_FMT_FLAG_RGB) &&
+           desc->nb_components >= 3;
+  }
+
+  void setCodecOptions(AVDictionary **options) {
+    switch (settings_.codec) {
+      case Codec::PRORES_422:
+        context_.codec_context->profile = FF_PROFILE_PRORES_STANDARD;
+        break;
+      case Codec::PRORES_4444:
+        context_.codec_context->profile = FF_PROFILE_PRORES_4444;
+        break;
+      case Codec::H264:
+      case Codec::H265:
+        av_dict_set_int(options, "crf", settings_.crf, 0);
+        av_dict_set(options, "preset", settings_.preset.c_str(), 0);
+        if (!settings_.tune.empty())
+          av_dict_set(options, "tune", settings_.tune.c_str(), 0);
+        if (settings_.codec == Codec::H265)
+          av_dict_set(options, "x265-params", "log-level=error", 0);
+        break;
+      case Codec::FFV1:
+        context_.codec_context->level = 3;
+        av_dict_set(options, "slicecrc", "1", 0);
+        break;
+      case Codec::MJPEG:
+        context_.codec_context->flags |= AV_CODEC_FLAG_QSCALE;
+        context_.codec_context->global_quality =
+            FF_QP2LAMBDA * std::clamp(settings_.quality, 2, 31);
+        break;
+      default:
+        break;
+    }
+  }
+
+  bool canMux(AVCodecID codec_id) const {
+    if (avformat_query_codec(context_.format_context->oformat, codec_id,
+                             FF_COMPLIANCE_NORMAL) == 1)
+      return true;
+    logger::error("VideoExporter")
+        << avcodec_get_name(codec_id) << " can't be muxed into "
+        << context_.format_context->oformat->name << logger::end();
+    return false;
+  }
+
+  bool openCodec(size_t width, size_t height) {
+    const AVCodec *codec = findEncoder(settings_.codec);
+    if (!codec) {
+      logger::error("VideoExporter")
+          << "Couldn't find condec" << logger::end();
+      return false;
+    }
+
+    if (!canMux(codec->id)) return false;
+
+    if (!(context_.codec_context = avcodec_alloc_context3(codec))) {
+      logger::error("VideoExporter")
+          << "Couldn't allocate condec context" << logger::end();
+      return false;
+    }
+    context_.codec_context->width = width;
+    context_.codec_context->height = height;
+    context_.codec_context->time_base = context_.time_base;
+    context_.codec_context->pix_fmt = negotiatePixelFormat(codec);
+    context_.codec_context->thread_count = settings_.threads;
+    if (settings_.bit_rate > 0)
+      context_.codec_context->bit_rate = settings_.bit_rate;
+
+    if (isYUV(context_.codec_context->pix_fmt)) {
+      context_.codec_context->colorspace = AVCOL_SPC_BT709;
+      context_.codec_context->color_primaries = AVCOL_PRI_BT709;
+      context_.codec_context->color_trc = AVCOL_TRC_BT709;
+      context_.codec_context->color_range =
+          settings_.codec == Codec::MJPEG ? AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG;
+    }
+
+    // mp4 / mov の HEVC は hvc1 でないと QuickTime で再生できない
+    if (settings_.codec == Codec::H265 &&
+        settings_.container != Container::MKV) {
+      context_.codec_context->codec_tag = MKTAG('h', 'v', 'c', '1');
+    }
+
+    // generate global header when the format requires it
+    if (context_.format_context->oformat->flags & AVFMT_GLOBALHEADER) {
+      context_.codec_context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    AVDictionary *codec_options = nullptr;
+    setCodecOptions(&codec_options);
+
+    int ret = avcodec_open2(context_.codec_context, codec, &codec_options);
+    av_dict_free(&codec_options);
+    if (ret < 0) {
+      logger::error("VideoExporter")
+          << "Couldn't open codec" << logger::end();
+      return false;
+    }
+
+    av_pool_.resize(NUM_ENCODE_FRAMES, nullptr);
+    for (auto &frame : av_pool_) {
+      if (!(frame = av_frame_alloc())) break;
+      frame->format = context_.codec_context->pix_fmt;
+      frame->width = context_.codec_context->width;
+      frame->height = context_.codec_context->height;
+      if (av_frame_get_buffer(frame, 32) < 0) {
+        av_frame_free(&frame);
+        break;
+      }
+    }
+    if (std::find(av_pool_.begin(), av_pool_.end(), nullptr) !=
+        av_pool_.end()) {
+      logger::error("VideoExporter")
+          << "Couldn't allocate frame data" << logger::end();
+      return false;
+    }
+    free_av_frames_.setCapacity(NUM_ENCODE_FRAMES);
+    encode_frames_.setCapacity(NUM_ENCODE_FRAMES);
+
+    if (avcodec_parameters_from_context(context_.stream->codecpar,
+                                        context_.codec_context) < 0) {
+      logger::error("VideoExporter")
+          << "Couldn't copy the stream parameter" << logger::end();
+      return false;
+    }
+
+    // RGBA / BGRA を受け付けるコーデックには変換せずにそのまま渡す
+    auto pix_fmt = context_.codec_context->pix_fmt;
+    if (pix_fmt == AV_PIX_FMT_RGBA || pix_fmt == AV_PIX_FMT_BGRA) {
+      read_format_ = pix_fmt == AV_PIX_FMT_BGRA ? GL_BGRA : GL_RGBA;
+    } else {
+      read_format_ = GL_RGBA;
+      if (!(context_.sws_context = sws_getContext(
+                context_.codec_context->width,
+                context_.codec_context->height, AV_PIX_FMT_RGBA,
+                context_.codec_context->width,
+                context_.codec_context->height, pix_fmt, SWS_BILINEAR,
+                nullptr, nullptr, nullptr))) {
+        logger::error("VideoExporter")
+            << "Couldn't get sws context" << logger::end();
+        return false;
+      }
+
+      if (isYUV(pix_fmt)) {
+        const int *coefficients = sws_getCoefficients(SWS_CS_ITU709);
+        int full_range =
+            context_.codec_context->color_range == AVCOL_RANGE_JPEG;
+        sws_setColorspaceDetails(context_.sws_context, coefficients, 1,
+                                 coefficients, full_range, 0, 1 << 16,
+                                 1 << 16);
+      }
+    }
+
+    return true;
+  }
+
+  bool isHap() const {
+    return settings_.codec == Codec::HAP ||
+           settings_.codec == Codec::HAP_ALPHA ||
+           settings_.codec == Codec::HAP_Q ||
+           settings_.codec == Codec::HAP_Q_ALPHA;
+  }
+
+  static unsigned int getHapTextureFormat(DxtCompressor::Format format) {
+    switch (format) {
+      case DxtCompressor::Format::DXT1:
+        return HapTextureFormat_RGB_DXT1;
+      case DxtCompressor::Format::DXT5:
+        return HapTextureFormat_RGBA_DXT5;
+      case DxtCompressor::Format::YCOCG_DXT5:
+        return HapTextureFormat_YCoCg_DXT5;
+      default:
+        return HapTextureFormat_A_RGTC1;
+    }
+  }
+
+  bool openHapEncoder(size_t width, size_t height) {
+    if (!canMux(AV_CODEC_ID_HAP)) return false;
+
+    uint32_t tag;
+    switch (settings_.codec) {
+      case Codec::HAP_ALPHA:
+        hap_formats_ = {DxtCompressor::Format::DXT5};
+        tag = MKTAG('H', 'a', 'p', '5');
+        break;
+      case Codec::HAP_Q:
+        hap_formats_ = {DxtCompressor::Format::YCOCG_DXT5};
+        tag = MKTAG('H', 'a', 'p', 'Y');
+        break;
+      case Codec::HAP_Q_ALPHA:
+        hap_formats_ = {DxtCompressor::Format::YCOCG_DXT5,
+                        DxtCompressor::Format::RGTC1_ALPHA};
+        tag = MKTAG('H', 'a', 'p', 'M');
+        break;
+      case Codec::HAP:
+      default:
+        hap_formats_ = {DxtCompressor::Format::DXT1};
+        tag = MKTAG('H', 'a', 'p', '1');
+        break;
+    }
+
+    // settings_.threads が 0 なら全てのコアを使う
+    const size_t num_threads =
+        settings_.threads > 0
+            ? settings_.threads
+            : std::max(1u, std::thread::hardware_concurrency());
+    hap_pool_ = std::make_unique<ThreadPool>(num_threads);
+
+    hap_textures_.resize(hap_formats_.size());
+    for (size_t i = 0; i < hap_formats_.size(); i++) {
+      hap_textures_[i].resize(
+          DxtCompressor::getCompressedSize(hap_formats_[i], width, height));
+    }
+
+    unsigned long lengths[2];
+    unsigned int formats[2];
+    unsigned int chunks[2];
+    for (size_t i = 0; i < hap_formats_.size(); i++) {
+      lengths[i] = hap_textures_[i].size();
+      formats[i] = getHapTextureFormat(hap_formats_[i]);
+      chunks[i] = std::clamp(settings_.chunks, 1, 64);
+    }
+    hap_packet_.resize(
+        HapMaxEncodedLength(hap_formats_.size(), lengths, formats, chunks));
+
+    auto codecpar = context_.stream->codecpar;
+    codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    codecpar->codec_id = AV_CODEC_ID_HAP;
+    codecpar->codec_tag = tag;
+    codecpar->width = width;
+    codecpar->height = height;
+    codecpar->format = AV_PIX_FMT_RGBA;
+
+    read_format_ = GL_RGBA;
+    return true;
+  }
+
+#pragma mark READBACK
+
+  void readback() {
+    // リングが埋まっていたら一番古い読み出しを待つ
+    if (readback_.isFull()) collect(true);
+
+    if (!readback_.readPixels(fbo_.getId(), 0, 0, 0, fbo_.getWidth(),
+                              fbo_.getHeight(), read_format_,
+                              GL_UNSIGNED_BYTE)) {
+      return;
+    }
+    readback_pts_.push_back(capture_index_++);
+    captured_frames_++;
+  }
+
+  // マップした PBO から直接キューのフレームにコピーする
+  bool collect(bool b_wait, bool b_block = false) {
+    if (readback_.getNumPending() == 0) return false;
+
+    const auto view = b_wait ? readback_.map() : readback_.tryMap();
+    if (!view.isValid()) {
+      // まだ終わっていなければ積んだ数は変わらない
+      if (readback_.getNumPending() == readback_pts_.size()) return false;
+      readback_pts_.pop_front();
+      dropped_frames_++;
+      return true;
+    }
+
+    const int64_t pts = readback_pts_.front();
+    readback_pts_.pop_front();
+    submit(static_cast<const unsigned char *>(view.data), pts, b_block,
+           false);
+    readback_.unmap();
+    return true;
+  }
+
+  void submit(const unsigned char *data, int64_t pts, bool b_block,
+              bool b_rgba) {
+    RawFrame *frame = nullptr;
+    if (!free_raw_frames_.tryPop(frame)) {
+      // オフラインレンダリング中は取りこぼさないように待つ
+      if (b_block || policy_ == QueuePolicy::BLOCK || FrameClock::isVirtual()) {
+        if (!free_raw_frames_.pop(frame)) return;
+      } else if (policy_ == QueuePolicy::DROP_OLDEST &&
+                 raw_frames_.tryPop(frame)) {
+        dropped_frames_++;
+      } else {
+        dropped_frames_++;
+        return;
+      }
+    }
+
+    std::copy(data, data + frame_bytes_, frame->data.begin());
+    frame->pts = pts;
+    frame->b_rgba = b_rgba;
+    raw_frames_.push(frame);
+  }
+
+  void finish() {
+    while (collect(true, true)) {
+    }
+
+    raw_frames_.close();
+    converter_.stopThread();
+    encode_frames_.close();
+    encoder_.stopThread();
+
+    if (context_.codec_context) {
+      avcodec_send_frame(context_.codec_context, nullptr);
+      flush();
+    }
+
+    av_write_trailer(context_.format_context);
+    if (avio_closep(&context_.format_context->pb) != 0)
+      logger::error("VideoExporter")
+          << "failed to close file" << logger::end();
+
+    is_exporting_ = false;
+  }
+
+#pragma mark WORKERS
+
+  void convertLoop() {
+    RawFrame *raw = nullptr;
+    while (raw_frames_.pop(raw)) {
+      AVFrame *frame = nullptr;
+      free_av_frames_.pop(frame);
+
+      if (av_frame_make_writable(frame) < 0) {
+        logger::error("VideoExporter")
+            << "frame is not writable" << logger::end();
+        free_av_frames_.push(frame);
+        free_raw_frames_.push(raw);
+        dropped_frames_++;
+        continue;
+      }
+
+      convert(raw->data.data(), frame,
+              raw->b_rgba && read_format_ == GL_BGRA);
+      frame->pts = raw->pts;
+      free_raw_frames_.push(raw);
+      encode_frames_.push(frame);
+    }
+  }
+
+  void encodeLoop() {
+    AVFrame *frame = nullptr;
+    while (encode_frames_.pop(frame)) {
+      int ret = avcodec_send_frame(context_.codec_context, frame);
+      free_av_frames_.push(frame);
+      if (ret < 0) {
+        logger::error("VideoExporter")
+            << "Error sending a frame for encoding" << logger::end();
+        dropped_frames_++;
+        continue;
+      }
+
+      flush();
+      countEncodedFrame();
+    }
+  }
+
+  void hapEncodeLoop() {
+    const size_t width = getWidth();
+    const size_t height = getHeight();
+    const ptrdiff_t stride = width * 4;
+
+    const void *buffers[2];
+    unsigned long lengths[2];
+    unsigned int formats[2];
+    unsigned int compressors[2];
+    unsigned int chunks[2];
+    for (size_t i = 0; i < hap_formats_.size(); i++) {
+      buffers[i] = hap_textures_[i].data();
+      lengths[i] = hap_textures_[i].size();
+      formats[i] = getHapTextureFormat(hap_formats_[i]);
+      compressors[i] = HapCompressorSnappy;
+      chunks[i] = std::clamp(settings_.chunks, 1, 64);
+    }
+
+    RawFrame *raw = nullptr;
+    while (raw_frames_.pop(raw)) {
+      const unsigned char *src =
+          b_vflip_ ? raw->data.data() + (height - 1) * stride
+                   : raw->data.data();
+      for (size_t i = 0; i < hap_formats_.size(); i++) {
+        DxtCompressor::compress(src, width, height, b_vflip_ ? -stride : stride,
+                                hap_formats_[i], hap_textures_[i].data(),
+                                hap_pool_.get());
+      }
+      const int64_t pts = raw->pts;
+      free_raw_frames_.push(raw);
+
+      unsigned long used = 0;
+      if (HapEncode(hap_formats_.size(), buffers, lengths, formats,
+                    compressors, chunks, hap_packet_.data(),
+                    hap_packet_.size(), &used) != HapResult_No_Error) {
+        logger::error("VideoExporter")
+            << "Error encoding a hap frame" << logger::end();
+        dropped_frames_++;
+        continue;
+      }
+
+      AVPacket *packet = av_packet_alloc();
+      if (av_new_packet(packet, used) < 0) {
+        av_packet_free(&packet);
+        dropped_frames_++;
+        continue;
+      }
+      std::copy(hap_packet_.begin(), hap_packet_.begin() + used, packet->data);
+      packet->pts = packet->dts = pts;
+      packet->duration = 1;
+      packet->flags |= AV_PKT_FLAG_KEY;
+
+      bool b_written = writePacket(packet);
+      av_packet_free(&packet);
+      if (!b_written) {
+        dropped_frames_++;
+        continue;
+      }
+      countEncodedFrame();
+    }
+  }
+
+  void countEncodedFrame() {
+    encoded_frames_++;
+    fps_window_frames_++;
+
+    auto now = std::chrono::steady_clock::now();
+    double elapsed =
+        std::chrono::duration<double>(now - fps_window_begin_).count();
+    if (elapsed >= 1.0) {
+      encode_fps_ = fps_window_frames_ / elapsed;
+      fps_window_begin_ = now;
+      fps_window_frames_ = 0;
+    }
+  }
+
+  // b_swap_rb は RGBA を BGRA のコーデックに渡す時
+  void convert(const unsigned char *data, AVFrame *frame, bool b_swap_rb) {
+    const int width = frame->width;
+    const int height = frame->height;
+    const int bytes_per_pixel = 4;
+
+    if (!context_.sws_context) {
+      const int row_bytes = width * bytes_per_pixel;
+      for (int y = 0; y < height; y++) {
+        const unsigned char *src =
+            data + (b_vflip_ ? height - 1 - y : y) * row_bytes;
+        unsigned char *dst = frame->data[0] + y * frame->linesize[0];
+        if (!b_swap_rb) {
+          std::copy(src, src + row_bytes, dst);
+          continue;
+        }
+        for (int x = 0; x < row_bytes; x += bytes_per_pixel) {
+          dst[x] = src[x + 2];
+          dst[x + 1] = src[x + 1];
+          dst[x + 2] = src[x];
+          dst[x + 3] = src[x + 3];
+        }
+      }
+      return;
+    }
+
+    // flip vertically
+    if (b_vflip_) {
+      const unsigned char *flipped_data =
+          data + (height - 1) * width * bytes_per_pixel;
+      const int flipped_linesize[1] = {-width * bytes_per_pixel};
+
+      sws_scale(context_.sws_context, &flipped_data, flipped_linesize, 0,
+                height, frame->data, frame->linesize);
+    } else {
+      const int in_linesize[1] = {width * bytes_per_pixel};
+      sws_scale(context_.sws_context, &data, in_linesize, 0, height,
+                frame->data, frame->linesize);
+    }
+  }
+
   bool flush() {
     int ret;
     do {
@@ -306,20 +940,26 @@ class VideoExporter {
         return false;
       }
 
-      av_packet_rescale_ts(&packet, context_.codec_context->time_base,
-                           context_.stream->time_base);
-      packet.stream_index = context_.stream->index;
-
-      ret = av_interleaved_write_frame(context_.format_context, &packet);
+      bool b_written = writePacket(&packet);
       av_packet_unref(&packet);
-      if (ret < 0) {
-        logger::error("VideoExporter")
-            << "Error while writing output packet" << logger::end();
-        return false;
-      }
+      if (!b_written) return false;
     } while (ret >= 0);
 
     return true;
   }
+
+  bool writePacket(AVPacket *packet) {
+    av_packet_rescale_ts(packet, context_.time_base,
+                         context_.stream->time_base);
+    packet->stream_index = context_.stream->index;
+    bytes_written_ += packet->size;
+
+    if (av_interleaved_write_frame(context_.format_context, packet) < 0) {
+      logger::error("VideoExporter")
+          << "Error while writing output packet" << logger::end();
+      return false;
+    }
+    return true;
+  }
 };
-}  // namespace limas
\ No newline at end of file
+}  // namespace limas
@@ -0,0 +1,387 @@
+#pragma once
+
+extern "C" {
+#include "libavcodec/avcodec.h"
+#include "libavdevice/avdevice.h"
+#include "libavformat/avformat.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/time.h"
+}
+
+#include "gl/Texture2D.h"
+#include "graphics/Pixels.h"
+#include "system/Thread.h"
+#include "video/PlaybackClock.h"
+#include "video/VideoDecoder.h"
+
+namespace limas {
+
+// libavdevice でカメラやキャプチャカードから取り込む
+// 常に最新のフレームだけを表示し、間に合わなかったフレームは捨てる
+//
+// 例:
+//   grabber.setup("/dev/video0");  // Linux は v4l2、macOS は avfoundation
+//   // ハードウェア無しで試す時は lavfi のテストパターンを使う
+//   VideoGrabber::Settings s;
+//   s.format = "lavfi";
+//   s.b_realtime = true;
+//   grabber.setup("testsrc=size=1280x720:rate=60", s);
+class VideoGrabber : public Thread {
+ public:
+  struct Settings {
+#if defined(__APPLE__)
+    std::string format = "avfoundation";
+#elif defined(_WIN32)
+    std::string format = "dshow";
+#else
+    std::string format = "v4l2";
+#endif
+    // 0 ならデバイスの既定値
+    int width = 0;
+    int height = 0;
+    double frame_rate = 0;
+    // デバイスから受け取る形式 (例: v4l2 の "mjpeg")
+    std::string input_format;
+    // 表示中・表示待ち・デコード中の分
+    int num_buffers = 3;
+    // pts に合わせて読む。lavfi のように要求した分だけ即座に
+    // フレームを返す入力をデバイスのように扱う時に使う
+    bool b_realtime = false;
+  };
+
+  // 時刻は av_gettime_relative() のマイクロ秒
+  struct FrameInfo {
+    double pts = 0;           // ストリームのタイムスタンプ (秒)
+    int64_t read_time = 0;    // パケットを受け取った時刻
+    int64_t upload_time = 0;  // テクスチャに転送し終えた時刻
+  };
+
+ private:
+  AVFormatContext *format_context_;
+  VideoDecoder decoder_;
+
+  struct Slot {
+    AVFrame *frame = nullptr;
+    FrameInfo info;
+  };
+
+  std::vector<AVFrame *> frame_buffers_;
+  std::vector<AVFrame *> free_frames_;
+  std::deque<Slot> frame_queues_;
+  AVFrame *shown_frame_;
+
+  Settings settings_;
+  FrameInfo frame_info_;
+  PlaybackStats stats_;
+  std::atomic<bool> b_interrupt_;
+  bool b_loaded_;
+  bool b_new_frame_;
+
+ public:
+  VideoGrabber()
+      : format_context_(nullptr),
+        shown_frame_(nullptr),
+        b_interrupt_(false),
+        b_loaded_(false),
+        b_new_frame_(false) {}
+  virtual ~VideoGrabber() { close(); }
+
+  // 入力デバイスの一覧 (v4l2 なら /dev/video* など)
+  static std::vector<std::string> listDevices(const std::string &format) {
+    registerDevices();
+    std::vector<std::string> names;
+
+    const AVInputFormat *input_format = av_find_input_format(format.c_str());
+    if (!input_format) {
+      logger::error("VideoGrabber")
+          << "Unknown input format " << format << logger::end();
+      return names;
+    }
+
+    AVDeviceInfoList *list = nullptr;
+    if (avdevice_list_input_sources(input_format, nullptr, nullptr, &list) <
+        0)
+      return names;
+    for (int i = 0; i < list->nb_devices; i++)
+      names.push_back(list->devices[i]->device_name);
+    avdevice_free_list_devices(&list);
+    return names;
+  }
+
+  void close() {
+    b_interrupt_ = true;
+    stopThread();
+    b_interrupt_ = false;
+
+    decoder_.close();
+    if (format_context_) avformat_close_input(&format_context_);
+
+    for (auto &f : frame_buffers_) av_frame_free(&f);
+    frame_buffers_.clear();
+    free_frames_.clear();
+    frame_queues_.clear();
+    shown_frame_ = nullptr;
+
+    frame_info_ = FrameInfo();
+    stats_.reset();
+    b_loaded_ = false;
+    b_new_frame_ = false;
+  }
+
+  bool setup(const std::string &device) { return setup(device, Settings()); }
+
+  bool setup(const std::string &device, const Settings &settings) {
+    close();
+    registerDevices();
+    settings_ = settings;
+
+    const AVInputFormat *input_format =
+        av_find_input_format(settings_.format.c_str());
+    if (!input_format) {
+      logger::error("VideoGrabber")
+          << "Unknown input format " << settings_.format << logger::end();
+      return false;
+    }
+
+    if (!(format_context_ = avformat_alloc_context())) {
+      logger::error("VideoGrabber")
+          << "Couldn't create AVFormatContext" << logger::end();
+      return false;
+    }
+    // close() の時にブロックしている読み込みを抜けられるようにする
+    format_context_->interrupt_callback.callback = interrupt;
+    format_context_->interrupt_callback.opaque = this;
+
+    AVDictionary *options = nullptr;
+    if (settings_.width > 0 && settings_.height > 0) {
+      std::string size = std::to_string(settings_.width) + "x" +
+                         std::to_string(settings_.height);
+      av_dict_set(&options, "video_size", size.c_str(), 0);
+    }
+    if (settings_.frame_rate > 0) {
+      av_dict_set(&options, "framerate",
+                  std::to_string(settings_.frame_rate).c_str(), 0);
+    }
+    if (!settings_.input_format.empty()) {
+      av_dict_set(&options, settings_.format == "v4l2" ? "input_format"
+                                                       : "pixel_format",
+                  settings_.input_format.c_str(), 0);
+    }
+    // バッファリングせず、ストリーム情報の解析も最小限にする
+    av_dict_set(&options, "fflags", "nobuffer", 0);
+    av_dict_set(&options, "probesize", "32", 0);
+    av_dict_set(&options, "analyzeduration", "0", 0);
+    // v4l2 のタイムスタンプを壁時計に揃える
+    if (settings_.format == "v4l2")
+      av_dict_set(&options, "timestamps", "abs", 0);
+
+    int ret = avformat_open_input(&format_context_, device.c_str(),
+                                  input_format, &options);
+    av_dict_free(&options);
+    if (ret != 0) {
+      logger::error("VideoGrabber")
+          << "Couldn't open " << device << ": " << av_err2str(ret)
+          << logger::end();
+      return false;
+    }
+    format_context_->flags |= AVFMT_FLAG_NOBUFFER;
+
+    if (avformat_find_stream_info(format_context_, nullptr) < 0) {
+      logger::error("VideoGrabber")
+          << "Couldn't retrieve stream info" << logger::end();
+      close();
+      return false;
+    }
+
+    av_dump_format(format_context_, 0, device.c_str(), 0);
+
+    // フレームスレッドは遅延が増えるのでスライススレッドだけ使う
+    VideoDecoder::Settings decoder_settings;
+    decoder_settings.thread_type = FF_THREAD_SLICE;
+    decoder_settings.b_low_delay = true;
+    if (!decoder_.open(format_context_, decoder_settings, "VideoGrabber")) {
+      close();
+      return false;
+    }
+
+    for (int i = 0; i < std::max(settings_.num_buffers, 3); i++) {
+      AVFrame *frame = av_frame_alloc();
+      if (!frame) {
+        logger::error("VideoGrabber")
+            << "Couldn't allocate frame" << logger::end();
+        close();
+        return false;
+      }
+      frame_buffers_.push_back(frame);
+    }
+    free_frames_ = frame_buffers_;
+
+    b_loaded_ = true;
+
+    startThread([this]() { this->threadedFunction(); });
+
+    return true;
+  }
+
+  void update() {
+    if (!b_loaded_) return;
+
+    Slot slot;
+    {
+      auto locker = getLock();
+      // 最新のフレームだけを使い、それより古いものは捨てる
+      while (frame_queues_.size() > 1) {
+        free_frames_.push_back(frame_queues_.front().frame);
+        frame_queues_.pop_front();
+        stats_.addDropped();
+      }
+      if (!frame_queues_.empty()) {
+        slot = frame_queues_.front();
+        frame_queues_.pop_front();
+        if (shown_frame_) free_frames_.push_back(shown_frame_);
+        shown_frame_ = slot.frame;
+      }
+    }
+
+    b_new_frame_ = slot.frame != nullptr;
+    if (!slot.frame) return;
+
+    decoder_.upload(slot.frame);
+    frame_info_ = slot.info;
+    frame_info_.upload_time = av_gettime_relative();
+    stats_.addPresented(frame_info_.upload_time * 1e-6,
+                        frame_info_.read_time * 1e-6, getFrameDuration());
+  }
+
+  const Pixels2D &getPixels() const { return decoder_.getPixels(); }
+  const gl::Texture2D &getTexture() const { return decoder_.getTexture(); }
+  gl::Texture2D &getTexture() { return decoder_.getTexture(); }
+  bool isFrameNew() const { return b_new_frame_; }
+  bool isLoaded() const { return b_loaded_; }
+  size_t getWidth() const { return getPixels().getWidth(); }
+  size_t getHeight() const { return getPixels().getHeight(); }
+  double getFrameRate() const { return decoder_.getFrameRate(); }
+
+  // 最後に表示したフレームのタイムスタンプ
+  const FrameInfo &getFrameInfo() const { return frame_info_; }
+
+  // パケットを受け取ってからテクスチャに転送し終えるまで (秒)
+  double getLatency() const {
+    return (frame_info_.upload_time - frame_info_.read_time) * 1e-6;
+  }
+
+  // late はパケットの受け取りから転送まで 1 フレーム以上かかった数
+  PlaybackStats::Counters getCounters() const { return stats_.getCounters(); }
+  void resetCounters() { stats_.reset(); }
+
+ private:
+  static void registerDevices() {
+    static std::once_flag flag;
+    std::call_once(flag, [] { avdevice_register_all(); });
+  }
+
+  static int interrupt(void *opaque) {
+    return static_cast<VideoGrabber *>(opaque)->b_interrupt_.load() ? 1 : 0;
+  }
+
+  double getFrameDuration() const { return decoder_.getFrameDuration(); }
+
+  // 空きが無ければ表示待ちの一番古いフレームを捨てて使う
+  AVFrame *acquireFrame() {
+    auto locker = getLock();
+    if (free_frames_.empty()) {
+      if (frame_queues_.empty()) return nullptr;
+      free_frames_.push_back(frame_queues_.front().frame);
+      frame_queues_.pop_front();
+      stats_.addDropped();
+    }
+    AVFrame *frame = free_frames_.back();
+    free_frames_.pop_back();
+    return frame;
+  }
+
+  void releaseFrame(AVFrame *frame) {
+    auto locker = getLock();
+    free_frames_.push_back(frame);
+  }
+
+  // b_realtime の時は最初のフレームからの pts の経過に合わせて待つ
+  void pace(double pts, double &first_pts, int64_t &start_time) {
+    int64_t now = av_gettime_relative();
+    double wait = std::isfinite(first_pts)
+                      ? (start_time - now) * 1e-6 + (pts - first_pts)
+                      : std::numeric_limits<double>::infinity();
+    // 最初のフレームや 1 秒以上ずれた時は基準を取り直す
+    if (std::abs(wait) > 1.0) {
+      first_pts = pts;
+      start_time = now;
+      return;
+    }
+    if (wait > 0) av_usleep((unsigned)(wait * 1e6));
+  }
+
+  void receiveFrames(int64_t read_time, double &first_pts,
+                     int64_t &start_time) {
+    while (isThreadRunning()) {
+      AVFrame *frame = acquireFrame();
+      if (!frame) return;
+
+      if (decoder_.receive(frame) < 0) {
+        releaseFrame(frame);
+        return;
+      }
+
+      Slot slot;
+      slot.frame = frame;
+      slot.info.pts = decoder_.getPts(frame);
+      if (settings_.b_realtime) {
+        pace(slot.info.pts, first_pts, start_time);
+        slot.info.read_time = av_gettime_relative();
+      } else {
+        slot.info.read_time = read_time;
+      }
+
+      {
+        auto locker = getLock();
+        frame_queues_.push_back(slot);
+      }
+    }
+  }
+
+  void threadedFunction() {
+    AVPacket *packet = av_packet_alloc();
+    if (!packet) {
+      logger::error("VideoGrabber")
+          << "Couldn't allocate packet" << logger::end();
+      return;
+    }
+
+    double first_pts = std::numeric_limits<double>::quiet_NaN();
+    int64_t start_time = 0;
+
+    while (isThreadRunning()) {
+      int ret = av_read_frame(format_context_, packet);
+      if (ret == AVERROR(EAGAIN)) {
+        sleepFor(1);
+        continue;
+      }
+      if (ret < 0) {
+        if (isThreadRunning())
+          logger::error("av_read_frame") << av_err2str(ret) << logger::end();
+        break;
+      }
+      int64_t read_time = av_gettime_relative();
+
+      if (packet->stream_index == decoder_.getStreamIndex() &&
+          decoder_.send(packet) >= 0) {
+        receiveFrames(read_time, first_pts, start_time);
+      }
+
+      av_packet_unref(packet);
+    }
+
+    av_packet_free(&packet);
+  }
+};
+
+}  // namespace limas
@@ -5,7 +5,6 @@ extern "C" {
 #include "libavformat/avformat.h"
 #include "libavutil/imgutils.h"
 #include "libavutil/pixdesc.h"
-#include "libswscale/swscale.h"
 }
 
 #include "gl/Fbo.h"
@@ -13,157 +12,102 @@ extern "C" {
 #include "gl/Texture2D.h"
 #include "graphics/Pixels.h"
 #include "system/Thread.h"
-#include "utils/Stopwatch.h"
+#include "utils/FrameClock.h"
+#include "video/PlaybackClock.h"
+#include "video/VideoDecoder.h"
 
 namespace limas {
 class VideoPlayer : public Thread {
-  struct Context {
-    int width;
-    int height;
-
-    AVFormatContext *format_context = nullptr;
-    AVCodecContext *codec_context = nullptr;
-    SwsContext *sws_context = nullptr;
-
-    int stream_index = -1;
-    double time_base = 0.0;
-    double frame_rate = 0.0;
-    double duration = 0.0;
-  } context_;
+  AVFormatContext *format_context_;
+  VideoDecoder decoder_;
+  double duration_;
 
   std::deque<AVFrame *> frame_queues_;
-  AVFrame *last_frame_ = nullptr;
   struct VideoState {
     bool b_new_frame = false;
     bool b_loaded = false;
     bool b_playing = false;
     bool b_loop = true;
-    float speed = 1.0f;
+    bool b_eof = false;
     bool b_request_seek = false;
     double seek_time = 0.0;
-    double offset_time = 0.0;
   } state_;
 
-  gl::Texture2D tex_;
-  Pixels2D pixels_;
-  PreciseStopwatch stopwatch_;
+  PlaybackClock::Ptr clock_;
+  bool b_own_clock_;
+  PlaybackStats stats_;
+  // デコードスレッドが遅れを判断するための現在の表示時刻
+  std::atomic<double> presentation_time_;
+  double last_time_;
+  double last_pts_;
+
+  // これ以上時計が進んだらデコードを待たずにシークする (秒)
+  static constexpr double MAX_CLOCK_JUMP = 1.0;
+  static constexpr double PTS_EPSILON = 1e-6;
+  // 表示中と次にデコードするフレームの分
+  static constexpr int NUM_RESERVED_FRAMES = 2;
+  // デコードがこのフレーム数以上遅れたら非参照フレームを省く
+  static constexpr double MAX_DECODE_LAG = 2.0;
 
  public:
-  VideoPlayer() {}
+  VideoPlayer()
+      : format_context_(nullptr),
+        duration_(0),
+        clock_(SystemClock::create()),
+        b_own_clock_(true),
+        presentation_time_(0),
+        last_time_(0),
+        last_pts_(-std::numeric_limits<double>::infinity()) {}
   virtual ~VideoPlayer() { close(); }
 
   void close() {
     stopThread();
 
-    if (context_.sws_context) {
-      sws_freeContext(context_.sws_context);
-      context_.sws_context = nullptr;
-    }
-    if (context_.codec_context) {
-      avcodec_free_context(&context_.codec_context);
-      context_.codec_context = nullptr;
-    }
-    if (context_.format_context) {
-      avformat_close_input(&context_.format_context);
-      context_.format_context = nullptr;
-    }
+    decoder_.close();
+    if (format_context_) avformat_close_input(&format_context_);
+    duration_ = 0;
 
     state_ = VideoState();
     frame_queues_.clear();
-    stopwatch_.reset();
+    if (b_own_clock_) {
+      clock_->stop();
+      clock_->seek(0);
+    }
+    stats_.reset();
+    presentation_time_ = 0;
+    last_time_ = 0;
+    last_pts_ = -std::numeric_limits<double>::infinity();
   }
 
   bool load(const std::string &filename, size_t thread_count = 8) {
     close();
 
-    if (!(context_.format_context = avformat_alloc_context())) {
+    if (!(format_context_ = avformat_alloc_context())) {
       logger::error("VideoPlayer")
           << "Couldn't create AVFormatContext" << logger::end();
       return false;
     }
 
-    if (avformat_open_input(&context_.format_context, filename.c_str(), nullptr,
+    if (avformat_open_input(&format_context_, filename.c_str(), nullptr,
                             nullptr) != 0) {
       logger::error("VideoPlayer")
           << "Couldn't open " << filename << logger::end();
       return false;
     }
 
-    if (avformat_find_stream_info(context_.format_context, nullptr) < 0) {
+    if (avformat_find_stream_info(format_context_, nullptr) < 0) {
       logger::error("VideoPlayer")
           << "Couldn't retrieve stream info" << logger::end();
       return false;
     }
 
-    av_dump_format(context_.format_context, 0, filename.c_str(), 0);
-
-    const AVCodec *codec = nullptr;
-    AVCodecParameters *codec_param = nullptr;
-
-    for (unsigned int i = 0; i < context_.format_context->nb_streams; i++) {
-      codec_param = context_.format_context->streams[i]->codecpar;
-      codec = avcodec_find_decoder(codec_param->codec_id);
-
-      if (codec && codec_param->codec_type == AVMEDIA_TYPE_VIDEO) {
-        // H.264の場合、VideoToolboxを優先
-        if (std::string(codec->name) == "h264" &&
-            avcodec_find_decoder_by_name("h264_videotoolbox")) {
-          codec = avcodec_find_decoder_by_name("h264_videotoolbox");
-        }
-
-        context_.stream_index = i;
-        context_.width = codec_param->width;
-        context_.height = codec_param->height;
-        context_.time_base =
-            av_q2d(context_.format_context->streams[i]->time_base);
-        context_.frame_rate =
-            av_q2d(context_.format_context->streams[i]->r_frame_rate);
-        context_.duration = context_.format_context->duration / AV_TIME_BASE;
-        break;
-      }
-    }
-
-    if (context_.stream_index == -1) {
-      logger::error("VideoPlayer")
-          << "Couldn't find video stream" << logger::end();
-      return false;
-    }
-
-    if (!(context_.codec_context = avcodec_alloc_context3(codec))) {
-      logger::error("VideoPlayer")
-          << "Couldn't create AVCodecContext" << logger::end();
-      return false;
-    }
-
-    context_.codec_context->thread_count = thread_count;
-
-    if (avcodec_parameters_to_context(context_.codec_context, codec_param) <
-        0) {
-      logger::error("VideoPlayer")
-          << "Couldn't initialize AVCodecContext" << logger::end();
-      return false;
-    }
-
-    if (avcodec_open2(context_.codec_context, codec, nullptr) < 0) {
-      logger::error("VideoPlayer") << "Couldn't open codec" << logger::end();
-      return false;
-    }
-
-    if (!(context_.sws_context = sws_getContext(
-              context_.width, context_.height, context_.codec_context->pix_fmt,
-              context_.width, context_.height, AV_PIX_FMT_RGB24,
-              SWS_FAST_BILINEAR,  // SWS_BICUBIC,
-              nullptr, nullptr, nullptr))) {
-      logger::error("VideoPlayer")
-          << "Couldn't get sws context" << logger::end();
-      return false;
-    }
+    av_dump_format(format_context_, 0, filename.c_str(), 0);
 
-    tex_.allocate(context_.width, context_.height, GL_RGB8);
-    tex_.setMinFilter(GL_LINEAR);
-    tex_.setMagFilter(GL_LINEAR);
-
-    pixels_.allocate(context_.width, context_.height, 3);
+    VideoDecoder::Settings settings;
+    settings.thread_count = thread_count;
+    settings.b_hardware = true;
+    if (!decoder_.open(format_context_, settings, "VideoPlayer")) return false;
+    duration_ = format_context_->duration / (double)AV_TIME_BASE;
 
     state_.b_loaded = true;
 
@@ -175,50 +119,68 @@ class VideoPlayer : public Thread {
   void update() {
     if (!state_.b_loaded) return;
 
-    double current_time = getTime();
-    if (state_.b_loop && current_time > context_.duration) {
-      seekTime(0);
-      play();
-      return;
-    }
+    const double time = getTime();
+    const double frame_duration = getFrameDuration();
+    presentation_time_ = time;
 
-    AVFrame *frame;
+    // ループ・外部タイムコードのジャンプ・共有している時計のシークに追従する
+    if (time < last_time_ - frame_duration * 0.5 ||
+        time > last_time_ + MAX_CLOCK_JUMP) {
+      requestSeek(time);
+    }
+    last_time_ = time;
 
+    AVFrame *frame = nullptr;
     {
-      bool b_should_notify = false;
       auto locker = getLock();
-      while (frame_queues_.size()) {
-        frame = frame_queues_.front();
-        if (current_time > (frame->pts * context_.time_base)) {
+      while (true) {
+        // pts が時計を越えていない最新のフレームを選ぶ
+        while (!frame_queues_.empty() &&
+               getPts(frame_queues_.front()) <= time + PTS_EPSILON) {
+          if (frame) stats_.addDropped();
+          frame = frame_queues_.front();
           frame_queues_.pop_front();
-          b_should_notify = true;
-        } else {
-          break;
         }
-      }
-      if (b_should_notify) notify();
-      if (frame_queues_.empty()) return;
-    }
 
-    if (frame != last_frame_) {
-      int size[4] = {
-          static_cast<int>(pixels_.getNumChannels() * pixels_.getWidth()), 0, 0,
-          0};
-      uint8_t *data[4] = {&pixels_.getData()[0], 0, 0, 0};
+        // 仮想時間で動いている時は表示すべきフレームが来るまで待つ
+        double shown_pts = frame ? getPts(frame) : last_pts_;
+        if (!frame_queues_.empty() || !FrameClock::isVirtual() ||
+            !state_.b_playing || state_.b_eof || !isThreadRunning() ||
+            shown_pts + frame_duration > time + PTS_EPSILON)
+          break;
 
-      if (sws_scale(context_.sws_context, frame->data, frame->linesize, 0,
-                    pixels_.getHeight(), data, size) > 0) {
-        tex_.loadData(&pixels_.getData()[0]);
+        cv_.notify_all();
+        waitFor(locker, [this] {
+          return !frame_queues_.empty() || !state_.b_playing || state_.b_eof;
+        });
       }
-      last_frame_ = frame;
-      state_.b_new_frame = true;
-    } else {
-      state_.b_new_frame = false;
+
+      if (!state_.b_loop && state_.b_eof && frame_queues_.empty() &&
+          time >= getDuration()) {
+        state_.b_playing = false;
+        if (b_own_clock_) clock_->stop();
+      }
+    }
+    cv_.notify_all();
+
+    state_.b_new_frame = frame != nullptr;
+    if (frame) {
+      stats_.addPresented(time, getPts(frame), frame_duration);
+      last_pts_ = getPts(frame);
+      decoder_.upload(frame);
     }
+    if (isPlaying()) stats_.tick(time, getFrameRate(), state_.b_new_frame);
   }
 
+  // 他の時計に従っている時は時計を動かさず、表示だけを止めたり再開したりする
+  // 時計の再生・停止・シーク・速度は親のプレイヤーか時計側で操作する
   void play() {
-    stopwatch_.start();
+    if (b_own_clock_) {
+      clock_->start();
+    } else {
+      // 止めている間に親の時計は進んでいるので、今の時刻から読み直す
+      requestSeek(getTime());
+    }
     {
       auto locker = getLock();
       state_.b_playing = true;
@@ -227,7 +189,7 @@ class VideoPlayer : public Thread {
   }
 
   void pause() {
-    stopwatch_.stop();
+    if (b_own_clock_) clock_->stop();
     {
       auto locker = getLock();
       state_.b_playing = false;
@@ -238,26 +200,19 @@ class VideoPlayer : public Thread {
   bool isLoop() const { return state_.b_loop; }
 
   void setSpeed(float speed) {
-    state_.offset_time = getTime();
-    state_.speed = speed;
-    stopwatch_.restart();
+    if (b_own_clock_) clock_->setSpeed(speed);
   }
-  float getSpeed() const { return state_.speed; }
+  float getSpeed() const { return clock_->getSpeed(); }
 
   void seekTime(double seconds) {
-    stopwatch_.restart();
-    {
-      auto locker = getLock();
-      state_.b_request_seek = true;
-      state_.seek_time = seconds;
-      state_.offset_time = seconds;
-      frame_queues_.clear();
-      notify();
-    }
+    if (!b_own_clock_) return;
+    clock_->seek(seconds);
+    last_time_ = seconds;
+    requestSeek(seconds);
   }
 
   void seekFrame(int64_t frame) {
-    double seconds = frame * getFrameRate();
+    double seconds = frame / getFrameRate();
     seekTime(seconds);
   }
 
@@ -266,14 +221,27 @@ class VideoPlayer : public Thread {
     seekTime(seconds);
   }
 
-  const Pixels2D &getPixels() const { return pixels_; }
-  const gl::Texture2D &getTexture() const { return tex_; }
-  gl::Texture2D &getTexture() { return tex_; }
+  // 他のプレイヤーの時計や外部タイムコードに従わせる
+  // 例: player_b.setClock(player_a.getClock());
+  void setClock(const PlaybackClock::Ptr &clock) {
+    clock_ = clock ? clock : SystemClock::create();
+    b_own_clock_ = !clock;
+    last_time_ = getTime();
+    requestSeek(last_time_);
+  }
+  const PlaybackClock::Ptr &getClock() const { return clock_; }
+
+  PlaybackStats::Counters getCounters() const { return stats_.getCounters(); }
+  void resetCounters() { stats_.reset(); }
+
+  const Pixels2D &getPixels() const { return decoder_.getPixels(); }
+  const gl::Texture2D &getTexture() const { return decoder_.getTexture(); }
+  gl::Texture2D &getTexture() { return decoder_.getTexture(); }
   bool isFrameNew() const { return state_.b_new_frame; }
-  size_t getWidth() const { return context_.width; }
-  size_t getHeight() const { return context_.height; }
-  double getDuration() const { return context_.duration; }
-  double getFrameRate() const { return context_.frame_rate; }
+  size_t getWidth() const { return decoder_.getWidth(); }
+  size_t getHeight() const { return decoder_.getHeight(); }
+  double getDuration() const { return duration_; }
+  double getFrameRate() const { return decoder_.getFrameRate(); }
   uint64_t getNumFrames() const { return getDuration() * getFrameRate(); }
 
   bool isLoaded() const { return state_.b_loaded; }
@@ -283,33 +251,106 @@ class VideoPlayer : public Thread {
     return state_.b_playing;
   }
 
-  double getTime() {
-    return stopwatch_.getElapsedInSeconds() * state_.speed + state_.offset_time;
+  // ループ中は時計の時刻を尺で折り返す
+  double getTime() const {
+    double time = clock_->getTime();
+    if (state_.b_loop && getDuration() > 0) {
+      time = std::fmod(time, getDuration());
+      if (time < 0) time += getDuration();
+    }
+    return time;
   }
 
-  double getPosition() { return getTime() / getDuration(); }
+  double getPosition() const { return getTime() / getDuration(); }
 
- protected:
  private:
+  double getFrameDuration() const { return decoder_.getFrameDuration(); }
+
+  double getPts(const AVFrame *frame) const { return decoder_.getPts(frame); }
+
+  void requestSeek(double seconds) {
+    auto locker = getLock();
+    state_.b_request_seek = true;
+    state_.seek_time = seconds;
+    frame_queues_.clear();
+    last_pts_ = -std::numeric_limits<double>::infinity();
+    stats_.resync();
+    notify();
+  }
+
   void waitForPlaying() {
     auto locker = getLock();
-    waitFor(locker, [this] { return state_.b_playing; });
+    waitFor(locker, [this] {
+      return (state_.b_playing && !state_.b_eof) || state_.b_request_seek;
+    });
   }
 
-  void waitForSeek() {
+  bool waitForSeek(double &seek_target) {
     auto locker = getLock();
-    if (state_.b_request_seek) {
-      state_.b_request_seek = false;
+    if (!state_.b_request_seek) return false;
+    state_.b_request_seek = false;
+    state_.b_eof = false;
+    seek_target = state_.seek_time;
+
+    // 手前のキーフレームから読み直して、シーク先より前は表示せずに捨てる
+    int64_t pts = state_.seek_time / decoder_.getTimeBase();
+    int ret = av_seek_frame(format_context_, decoder_.getStreamIndex(), pts,
+                            AVSEEK_FLAG_BACKWARD);
+    if (ret < 0)
+      logger::error("av_seek_frame") << av_err2str(ret) << logger::end();
+
+    decoder_.flush();
+    return true;
+  }
 
-      int64_t pts = state_.seek_time / context_.time_base;
-      int ret = av_seek_frame(context_.format_context, context_.stream_index,
-                              pts, AVSEEK_FLAG_ANY);
-      if (ret < 0) {
-        logger::error("av_seek_frame") << av_err2str(ret) << logger::end();
-        return;
+  // 表示に間に合っていない時は参照されないフレームのデコードを省く
+  // オフラインレンダリング中はすべてのフレームをデコードする
+  void updateSkipFrame(double last_decoded_pts) {
+    bool b_behind = !FrameClock::isVirtual() &&
+                    std::isfinite(last_decoded_pts) &&
+                    presentation_time_ - last_decoded_pts >
+                        MAX_DECODE_LAG * getFrameDuration();
+    decoder_.setSkipFrame(b_behind ? AVDISCARD_NONREF : AVDISCARD_DEFAULT);
+  }
+
+  void receiveFrames(std::vector<AVFrame *> &frame_buffers, size_t &index,
+                     double &seek_target, double &last_decoded_pts) {
+    while (true) {
+      {
+        // 表示待ちと表示中のフレームを上書きしないように空きを待つ
+        auto locker = getLock();
+        waitFor(locker, [&] {
+          return frame_queues_.size() + NUM_RESERVED_FRAMES <=
+                     frame_buffers.size() ||
+                 state_.b_request_seek;
+        });
+        if (state_.b_request_seek || !isThreadRunning()) return;
       }
 
-      avcodec_flush_buffers(context_.codec_context);
+      AVFrame *frame = frame_buffers[index];
+      av_frame_unref(frame);
+
+      if (decoder_.receive(frame) < 0) return;
+
+      double pts = getPts(frame);
+      if (pts + getFrameDuration() <= seek_target) continue;
+      seek_target = -std::numeric_limits<double>::infinity();
+
+      // pts が飛んでいればデコードを省いたフレームがある
+      if (std::isfinite(last_decoded_pts)) {
+        long skipped = std::lround((pts - last_decoded_pts) * getFrameRate());
+        if (skipped > 1) stats_.addDropped(skipped - 1);
+      }
+      last_decoded_pts = pts;
+
+      {
+        auto locker = getLock();
+        if (state_.b_request_seek) return;
+        frame_queues_.push_back(frame);
+      }
+      cv_.notify_all();
+
+      index = (index + 1) % frame_buffers.size();
     }
   }
 
@@ -322,12 +363,11 @@ class VideoPlayer : public Thread {
     }
 
     std::vector<AVFrame *> frame_buffers;
-    int num_buffers = context_.frame_rate / 10.0;
+    int num_buffers =
+        std::max(NUM_RESERVED_FRAMES + 2, (int)(getFrameRate() / 10.0));
     for (int i = 0; i < num_buffers; i++) {
       AVFrame *frame = av_frame_alloc();
-      if (!av_image_alloc(frame->data, frame->linesize, context_.width,
-                          context_.height, context_.codec_context->pix_fmt,
-                          1)) {
+      if (!frame) {
         logger::error("VideoPlayer")
             << "Couldn't allocate frame" << logger::end();
         continue;
@@ -335,50 +375,34 @@ class VideoPlayer : public Thread {
       frame_buffers.push_back(frame);
     }
 
-    int current_frame_index_ = 0;
+    size_t current_frame_index = 0;
+    double seek_target = -std::numeric_limits<double>::infinity();
+    double last_decoded_pts = -std::numeric_limits<double>::infinity();
 
     while (isThreadRunning()) {
       waitForPlaying();
-      waitForSeek();
+      if (!isThreadRunning()) break;
+      if (waitForSeek(seek_target))
+        last_decoded_pts = -std::numeric_limits<double>::infinity();
 
-      int ret = av_read_frame(context_.format_context, packet);
+      int ret = av_read_frame(format_context_, packet);
       if (ret < 0) {
+        // デコーダに残っているフレームを出し切ってからシークを待つ
+        decoder_.send(nullptr);
+        receiveFrames(frame_buffers, current_frame_index, seek_target,
+                      last_decoded_pts);
+
         auto locker = getLock();
-        if (frame_queues_.empty()) state_.b_playing = false;
+        if (!state_.b_request_seek) state_.b_eof = true;
+        cv_.notify_all();
         continue;
       }
 
-      if (packet->stream_index == context_.stream_index) {
-        ret = avcodec_send_packet(context_.codec_context, packet);
-        if (ret < 0) {
-          logger::error("avcodec_send_packet")
-              << av_err2str(ret) << logger::end();
-          continue;
-        }
-
-        while (ret >= 0) {
-          AVFrame *frame = frame_buffers[current_frame_index_];
-
-          av_frame_unref(frame);
-
-          ret = avcodec_receive_frame(context_.codec_context, frame);
-          if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            break;
-          } else if (ret < 0) {
-            logger::error("avcodec_receive_frame")
-                << av_err2str(ret) << logger::end();
-          }
-
-          {
-            auto locker = getLock();
-            waitFor(locker, [&] {
-              return frame_queues_.size() <= frame_buffers.size();
-            });
-            frame_queues_.push_back(frame);
-          }
-
-          current_frame_index_++;
-          current_frame_index_ %= frame_buffers.size();
+      if (packet->stream_index == decoder_.getStreamIndex()) {
+        updateSkipFrame(last_decoded_pts);
+        if (decoder_.send(packet) >= 0) {
+          receiveFrames(frame_buffers, current_frame_index, seek_target,
+                        last_decoded_pts);
         }
       }
 
@@ -0,0 +1,299 @@
+#pragma once
+
+extern "C" {
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+}
+
+#include "gl/Texture2D.h"
+#include "graphics/Pixels.h"
+#include "system/ThreadPool.h"
+#include "video/VideoDecoder.h"
+
+namespace limas {
+
+// 動画のサムネイルをまとめて作る
+// キーフレームだけを低解像度でデコードし、ファイルごとに並列に処理する
+//
+// 例:
+//   VideoThumbnailer thumbnailer;
+//   auto results = thumbnailer.generate(filepaths);
+//   auto sheet = VideoThumbnailer::makeContactSheet(results[0], 4);
+//   VideoThumbnailer::loadTexture(tex, sheet);
+class VideoThumbnailer : private Noncopyable {
+ public:
+  struct Settings {
+    // この大きさに収まるように縮小する (0 なら制限しない)
+    int width = 256;
+    int height = 0;
+    // 尺を等分した位置から取り出す枚数
+    // 1 枚の時は position (0 - 1) の位置から取る
+    int num_thumbnails = 1;
+    double position = 0.1;
+    // false なら指定した時刻のフレームまでデコードする
+    bool b_keyframes_only = true;
+  };
+
+  struct Thumbnail {
+    double time = 0;  // 秒
+    Pixels2D pixels;  // RGBA
+  };
+
+  struct ContactSheet {
+    Pixels2D pixels;                // RGBA
+    std::vector<glm::vec4> rects;  // サムネイルごとの x, y, 幅, 高さ
+  };
+
+  using Callback = std::function<void(const std::string &filepath,
+                                      std::vector<Thumbnail> &thumbnails)>;
+
+  explicit VideoThumbnailer(
+      size_t num_threads = std::max(1u, std::thread::hardware_concurrency()))
+      : pool_(num_threads) {}
+
+  // 1 ファイル分。デコードはスレッドを使わずに行う
+  static std::vector<Thumbnail> generate(const std::string &filepath) {
+    return generate(filepath, Settings());
+  }
+
+  static std::vector<Thumbnail> generate(const std::string &filepath,
+                                         const Settings &settings) {
+    std::vector<Thumbnail> thumbnails;
+    Decoder decoder;
+    if (!decoder.open(filepath, settings)) return thumbnails;
+
+    for (double time : decoder.getTimes(settings)) {
+      Thumbnail thumbnail;
+      if (decoder.decode(time, settings, thumbnail))
+        thumbnails.push_back(std::move(thumbnail));
+    }
+    return thumbnails;
+  }
+
+  // 複数ファイルを並列に処理して、すべて終わるまで待つ
+  // 開けなかったファイルは空になる
+  std::vector<std::vector<Thumbnail>> generate(
+      const std::vector<std::string> &filepaths) {
+    return generate(filepaths, Settings());
+  }
+
+  std::vector<std::vector<Thumbnail>> generate(
+      const std::vector<std::string> &filepaths, const Settings &settings) {
+    std::vector<std::vector<Thumbnail>> results(filepaths.size());
+    pool_.parallelFor(filepaths.size(), [&](size_t i) {
+      results[i] = generate(filepaths[i], settings);
+    });
+    return results;
+  }
+
+  // 待たずに処理する。callback はワーカースレッドから呼ばれる
+  void enqueue(const std::string &filepath, const Callback &callback) {
+    enqueue(filepath, Settings(), callback);
+  }
+
+  void enqueue(const std::string &filepath, const Settings &settings,
+               const Callback &callback) {
+    pool_.enqueue([filepath, settings, callback]() {
+      auto thumbnails = generate(filepath, settings);
+      callback(filepath, thumbnails);
+    });
+  }
+
+  // サムネイルを columns 列に並べた 1 枚の画像を作る
+  static ContactSheet makeContactSheet(
+      const std::vector<Thumbnail> &thumbnails, size_t columns,
+      size_t spacing = 0) {
+    ContactSheet sheet;
+    if (thumbnails.empty()) return sheet;
+
+    size_t cell_width = 0, cell_height = 0;
+    for (auto &t : thumbnails) {
+      cell_width = std::max(cell_width, t.pixels.getWidth());
+      cell_height = std::max(cell_height, t.pixels.getHeight());
+    }
+    columns = std::clamp<size_t>(columns, 1, thumbnails.size());
+    size_t rows = (thumbnails.size() + columns - 1) / columns;
+
+    sheet.pixels.allocate(columns * cell_width + (columns - 1) * spacing,
+                          rows * cell_height + (rows - 1) * spacing, 4);
+    sheet.pixels.clear();
+
+    const size_t stride = sheet.pixels.getWidth() * 4;
+    for (size_t i = 0; i < thumbnails.size(); i++) {
+      const auto &src = thumbnails[i].pixels;
+      size_t x = (i % columns) * (cell_width + spacing);
+      size_t y = (i / columns) * (cell_height + spacing);
+
+      const size_t row_bytes = src.getWidth() * 4;
+      for (size_t row = 0; row < src.getHeight(); row++) {
+        std::copy_n(src.getData().data() + row * row_bytes, row_bytes,
+                    sheet.pixels.getData().data() + (y + row) * stride + x * 4);
+      }
+      sheet.rects.emplace_back(x, y, src.getWidth(), src.getHeight());
+    }
+    return sheet;
+  }
+
+  static void loadTexture(gl::Texture2D &tex, const ContactSheet &sheet) {
+    const auto &pixels = sheet.pixels;
+    if (pixels.getWidth() == 0 || pixels.getHeight() == 0) return;
+    if (tex.getWidth() != pixels.getWidth() ||
+        tex.getHeight() != pixels.getHeight()) {
+      tex.allocate(pixels.getWidth(), pixels.getHeight(), GL_RGBA8);
+      tex.setMinFilter(GL_LINEAR);
+      tex.setMagFilter(GL_LINEAR);
+    }
+    tex.loadData(pixels.getData().data());
+  }
+
+  size_t getNumThreads() const { return pool_.getNumThreads(); }
+
+ private:
+  // 1 ファイル分のデマックス。デコードと縮小は VideoDecoder に任せる
+  class Decoder : private Noncopyable {
+   public:
+    Decoder() {}
+    ~Decoder() {
+      decoder_.close();
+      if (format_context_) avformat_close_input(&format_context_);
+      av_frame_free(&frame_);
+      av_packet_free(&packet_);
+    }
+
+    bool open(const std::string &filepath, const Settings &settings) {
+      if (avformat_open_input(&format_context_, filepath.c_str(), nullptr,
+                              nullptr) != 0) {
+        logger::error("VideoThumbnailer")
+            << "Couldn't open " << filepath << logger::end();
+        return false;
+      }
+
+      if (avformat_find_stream_info(format_context_, nullptr) < 0) {
+        logger::error("VideoThumbnailer")
+            << "Couldn't retrieve stream info " << filepath << logger::end();
+        return false;
+      }
+
+      // 出力の大きさを決めるために、開く前にストリームの大きさを読む
+      const int index = av_find_best_stream(format_context_, AVMEDIA_TYPE_VIDEO,
+                                            -1, -1, nullptr, 0);
+      if (index < 0) {
+        logger::error("VideoThumbnailer")
+            << "Couldn't find video stream " << filepath << logger::end();
+        return false;
+      }
+      const AVCodecParameters *codec_param =
+          format_context_->streams[index]->codecpar;
+      size_ = getOutputSize(codec_param->width, codec_param->height, settings);
+      if (size_.x == 0) {
+        logger::error("VideoThumbnailer")
+            << "Unknown frame size " << filepath << logger::end();
+        return false;
+      }
+
+      // ファイル単位で並列にするのでデコーダ自体はスレッドを使わない
+      // 出力より小さくならない範囲で、対応していれば縮小してデコードする
+      VideoDecoder::Settings decoder_settings;
+      decoder_settings.thread_count = 1;
+      decoder_settings.min_width = size_.x;
+      decoder_settings.min_height = size_.y;
+      decoder_settings.b_skip_loop_filter = true;
+      if (settings.b_keyframes_only)
+        decoder_settings.skip_frame = AVDISCARD_NONKEY;
+      // ワーカースレッドには GL のコンテキストがない
+      decoder_settings.b_texture = false;
+      if (!decoder_.open(format_context_, decoder_settings,
+                         "VideoThumbnailer"))
+        return false;
+
+      AVStream *stream = format_context_->streams[decoder_.getStreamIndex()];
+      if (format_context_->duration > 0)
+        duration_ = format_context_->duration / (double)AV_TIME_BASE;
+      else if (stream->duration > 0)
+        duration_ = stream->duration * decoder_.getTimeBase();
+
+      frame_ = av_frame_alloc();
+      packet_ = av_packet_alloc();
+      return frame_ && packet_;
+    }
+
+    std::vector<double> getTimes(const Settings &settings) const {
+      std::vector<double> times;
+      int count = std::max(settings.num_thumbnails, 1);
+      if (count == 1) {
+        times.push_back(duration_ * std::clamp(settings.position, 0.0, 1.0));
+      } else {
+        for (int i = 0; i < count; i++)
+          times.push_back(duration_ * (i + 0.5) / count);
+      }
+      return times;
+    }
+
+    bool decode(double time, const Settings &settings, Thumbnail &thumbnail) {
+      // time より前の一番近いキーフレームに飛ぶ
+      const int stream_index = decoder_.getStreamIndex();
+      const double time_base = decoder_.getTimeBase();
+      int64_t ts = time / time_base;
+      if (av_seek_frame(format_context_, stream_index, ts,
+                        AVSEEK_FLAG_BACKWARD) < 0)
+        av_seek_frame(format_context_, stream_index, 0, AVSEEK_FLAG_BACKWARD);
+      decoder_.flush();
+
+      bool b_draining = false;
+      for (int i = 0; i < MAX_PACKETS;) {
+        int ret = decoder_.receive(frame_);
+        if (ret == 0) {
+          double pts = decoder_.getPts(frame_);
+          if (settings.b_keyframes_only || pts >= time - time_base) {
+            thumbnail.time = pts;
+            return decoder_.scale(frame_, size_.x, size_.y, thumbnail.pixels);
+          }
+          continue;
+        }
+        if (ret != AVERROR(EAGAIN) || b_draining) return false;
+
+        if (av_read_frame(format_context_, packet_) < 0) {
+          decoder_.send(nullptr);
+          b_draining = true;
+          continue;
+        }
+        if (packet_->stream_index == stream_index) {
+          decoder_.send(packet_);
+          i++;
+        }
+        av_packet_unref(packet_);
+      }
+      return false;
+    }
+
+   private:
+    // 読み込むパケット数の上限 (キーフレームが極端に少ないファイル対策)
+    static constexpr int MAX_PACKETS = 1024;
+
+    // 縦横比を保って Settings の大きさに収める
+    // 大きさの分からないファイルでは 0
+    static glm::ivec2 getOutputSize(int width, int height,
+                                    const Settings &settings) {
+      if (width <= 0 || height <= 0) return glm::ivec2(0);
+      double scale = 1.0;
+      if (settings.width > 0)
+        scale = std::min(scale, (double)settings.width / width);
+      if (settings.height > 0)
+        scale = std::min(scale, (double)settings.height / height);
+      return glm::ivec2(std::max(1, (int)std::lround(width * scale)),
+                        std::max(1, (int)std::lround(height * scale)));
+    }
+
+    AVFormatContext *format_context_ = nullptr;
+    VideoDecoder decoder_;
+    AVFrame *frame_ = nullptr;
+    AVPacket *packet_ = nullptr;
+
+    glm::ivec2 size_ = glm::ivec2(0);
+    double duration_ = 0;
+  };
+
+  ThreadPool pool_;
+};
+
+}  // namespace limas
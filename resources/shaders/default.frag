@@ -1,10 +1,10 @@
 #version 400
+#resource "uniforms.glsl"
 
 in vec4 v_color; 
 in vec2 v_texcoord;
 out vec4 o_color;
 
-uniform bool USE_TEX; 
 uniform sampler2D TEX;
 
 void main() {
@@ -1,5 +1,6 @@
 #version 400
 #resource "utils.glsl"
+#resource "uniforms.glsl"
 
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
@@ -13,14 +14,6 @@ layout(location = 7) in vec4 instance_color;
 out vec4 v_color;
 out vec2 v_texcoord;
 
-uniform mat4 MVP_MAT;
-uniform mat4 TEX_MAT; 
-uniform vec4 COLOR;
-uniform bool HAS_COLOR;
-uniform bool HAS_NORMAL;
-uniform bool HAS_TEXCOORD;
-uniform bool INSTANCED;
-
 void main() {
     v_color = COLOR;
     v_texcoord = (TEX_MAT * vec4(texcoord, 0, 1)).xy;
@@ -4,12 +4,20 @@ in vec2 v_texcoord;
 out vec4 f_color;
 
 uniform sampler2D u_tex;
+uniform sampler2D u_tex_alpha;
 uniform bool u_YCoCg;
+uniform bool u_has_alpha_tex;
+uniform bool u_alpha_only;
 
 const vec4 offsets = vec4(-0.50196078431373, -0.50196078431373, 0.0, 0.0);
 
 void main() {
     vec4 col = texture(u_tex, v_texcoord);
+    if (u_alpha_only) {
+        f_color = vec4(1.0, 1.0, 1.0, col.r);
+        return;
+    }
+
     if (u_YCoCg) {
         col += offsets;
         float scale = ( col.z * ( 255.0 / 8.0 ) ) + 1.0;
@@ -20,4 +28,8 @@ void main() {
     } else {
         f_color = col;
     }
-}
\ No newline at end of file
+
+    if (u_has_alpha_tex) {
+        f_color.a = texture(u_tex_alpha, v_texcoord).r;
+    }
+}
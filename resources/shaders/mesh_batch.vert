@@ -0,0 +1,32 @@
+#version 400
+#resource "uniforms.glsl"
+
+// gl/MeshBatch.h の頂点。描画ごとの行列と色は DRAW_DATA から読む
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec4 color;
+layout(location = 3) in vec2 texcoord;
+layout(location = 8) in float draw_id;
+
+// 1 描画につき 5 texel (model 行列の 4 列と色)
+uniform samplerBuffer DRAW_DATA;
+
+out vec4 v_color;
+out vec2 v_texcoord;
+
+void main() {
+    int base = int(draw_id) * 5;
+    mat4 model_mat = mat4(texelFetch(DRAW_DATA, base + 0),
+                          texelFetch(DRAW_DATA, base + 1),
+                          texelFetch(DRAW_DATA, base + 2),
+                          texelFetch(DRAW_DATA, base + 3));
+
+    v_color = COLOR * texelFetch(DRAW_DATA, base + 4);
+    v_texcoord = (TEX_MAT * vec4(texcoord, 0, 1)).xy;
+
+    if (HAS_COLOR) {
+        v_color *= color;
+    }
+
+    gl_Position = MVP_MAT * model_mat * vec4(position, 1);
+}
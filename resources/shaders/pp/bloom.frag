@@ -0,0 +1,14 @@
+#version 330 core
+
+uniform sampler2D u_tex;
+uniform sampler2D u_bloom_tex;
+uniform float u_intensity;
+
+in vec2 v_texcoord;
+out vec4 f_color;
+
+void main() {
+  vec4 color = texture(u_tex, v_texcoord);
+  vec3 bloom = texture(u_bloom_tex, v_texcoord).rgb;
+  f_color = vec4(color.rgb + bloom * u_intensity, color.a);
+}
@@ -0,0 +1,64 @@
+#version 330 core
+
+uniform sampler2D u_tex;
+uniform vec2 u_texel;  // 読む側の 1 texel
+uniform int u_prefilter;
+uniform float u_threshold;
+uniform float u_knee;
+
+in vec2 v_texcoord;
+out vec4 f_color;
+
+float luma(vec3 c) { return dot(c, vec3(0.2126, 0.7152, 0.0722)); }
+
+// 明るい 1 点がちらつかないように明るいまとまりほど重みを下げる
+// (Karis average)
+void karis(vec3 a, vec3 b, vec3 c, vec3 d, float weight, inout vec4 sum) {
+  vec3 avg = (a + b + c + d) * 0.25;
+  float w = weight / (1.0 + luma(avg));
+  sum += vec4(avg * w, w);
+}
+
+vec3 threshold(vec3 c) {
+  float brightness = max(c.r, max(c.g, c.b));
+  float soft = clamp(brightness - u_threshold + u_knee, 0.0, 2.0 * u_knee);
+  soft = soft * soft / (4.0 * u_knee + 1e-5);
+  float contrib = max(soft, brightness - u_threshold);
+  return c * contrib / max(brightness, 1e-5);
+}
+
+// Call of Duty の 13 点の縮小
+void main() {
+  vec2 uv = v_texcoord;
+  vec2 t = u_texel;
+  vec3 a = texture(u_tex, uv + t * vec2(-2.0, 2.0)).rgb;
+  vec3 b = texture(u_tex, uv + t * vec2(0.0, 2.0)).rgb;
+  vec3 c = texture(u_tex, uv + t * vec2(2.0, 2.0)).rgb;
+  vec3 d = texture(u_tex, uv + t * vec2(-2.0, 0.0)).rgb;
+  vec3 e = texture(u_tex, uv).rgb;
+  vec3 f = texture(u_tex, uv + t * vec2(2.0, 0.0)).rgb;
+  vec3 g = texture(u_tex, uv + t * vec2(-2.0, -2.0)).rgb;
+  vec3 h = texture(u_tex, uv + t * vec2(0.0, -2.0)).rgb;
+  vec3 i = texture(u_tex, uv + t * vec2(2.0, -2.0)).rgb;
+  vec3 j = texture(u_tex, uv + t * vec2(-1.0, 1.0)).rgb;
+  vec3 k = texture(u_tex, uv + t * vec2(1.0, 1.0)).rgb;
+  vec3 l = texture(u_tex, uv + t * vec2(-1.0, -1.0)).rgb;
+  vec3 m = texture(u_tex, uv + t * vec2(1.0, -1.0)).rgb;
+
+  vec3 color;
+  if (u_prefilter != 0) {
+    vec4 sum = vec4(0.0);
+    karis(j, k, l, m, 0.5, sum);
+    karis(a, b, d, e, 0.125, sum);
+    karis(b, c, e, f, 0.125, sum);
+    karis(d, e, g, h, 0.125, sum);
+    karis(e, f, h, i, 0.125, sum);
+    color = threshold(sum.rgb / sum.w);
+  } else {
+    color = e * 0.125;
+    color += (a + c + g + i) * 0.03125;
+    color += (b + d + f + h) * 0.0625;
+    color += (j + k + l + m) * 0.125;
+  }
+  f_color = vec4(max(color, vec3(0.0)), 1.0);
+}
@@ -0,0 +1,24 @@
+#version 330 core
+
+uniform sampler2D u_tex;
+uniform vec2 u_texel;  // 読む側の 1 texel
+uniform float u_radius;
+
+in vec2 v_texcoord;
+out vec4 f_color;
+
+// 3x3 の tent で拡大する。加算で 1 つ上の段に足す
+void main() {
+  vec2 uv = v_texcoord;
+  vec2 t = u_texel * u_radius;
+  vec3 sum = texture(u_tex, uv).rgb * 4.0;
+  sum += texture(u_tex, uv + vec2(-t.x, 0.0)).rgb * 2.0;
+  sum += texture(u_tex, uv + vec2(t.x, 0.0)).rgb * 2.0;
+  sum += texture(u_tex, uv + vec2(0.0, -t.y)).rgb * 2.0;
+  sum += texture(u_tex, uv + vec2(0.0, t.y)).rgb * 2.0;
+  sum += texture(u_tex, uv + vec2(-t.x, -t.y)).rgb;
+  sum += texture(u_tex, uv + vec2(t.x, -t.y)).rgb;
+  sum += texture(u_tex, uv + vec2(-t.x, t.y)).rgb;
+  sum += texture(u_tex, uv + vec2(t.x, t.y)).rgb;
+  f_color = vec4(sum / 16.0, 1.0);
+}
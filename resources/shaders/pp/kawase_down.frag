@@ -0,0 +1,20 @@
+#version 330 core
+
+uniform sampler2D u_tex;
+uniform vec2 u_res;
+uniform float u_offset;
+
+in vec2 v_texcoord;
+out vec4 f_color;
+
+// dual filter の縮小側。中心と斜め 4 点の 5 回で 1/2 にする
+void main() {
+  vec2 uv = v_texcoord;
+  vec2 hp = 0.5 / u_res * u_offset;
+  vec4 sum = texture(u_tex, uv) * 4.0;
+  sum += texture(u_tex, uv - hp);
+  sum += texture(u_tex, uv + hp);
+  sum += texture(u_tex, uv + vec2(hp.x, -hp.y));
+  sum += texture(u_tex, uv - vec2(hp.x, -hp.y));
+  f_color = sum / 8.0;
+}
@@ -0,0 +1,23 @@
+#version 330 core
+
+uniform sampler2D u_tex;
+uniform vec2 u_res;
+uniform float u_offset;
+
+in vec2 v_texcoord;
+out vec4 f_color;
+
+// dual filter の拡大側。周りの 8 点で 2 倍にする
+void main() {
+  vec2 uv = v_texcoord;
+  vec2 hp = 0.5 / u_res * u_offset;
+  vec4 sum = texture(u_tex, uv + vec2(-hp.x * 2.0, 0.0));
+  sum += texture(u_tex, uv + vec2(-hp.x, hp.y)) * 2.0;
+  sum += texture(u_tex, uv + vec2(0.0, hp.y * 2.0));
+  sum += texture(u_tex, uv + vec2(hp.x, hp.y)) * 2.0;
+  sum += texture(u_tex, uv + vec2(hp.x * 2.0, 0.0));
+  sum += texture(u_tex, uv + vec2(hp.x, -hp.y)) * 2.0;
+  sum += texture(u_tex, uv + vec2(0.0, -hp.y * 2.0));
+  sum += texture(u_tex, uv + vec2(-hp.x, -hp.y)) * 2.0;
+  f_color = sum / 12.0;
+}
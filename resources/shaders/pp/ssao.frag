@@ -8,9 +8,8 @@ const float EULER = 2.718281828459045;
 in vec2 v_texcoord;
 out vec4 f_color;
 
-uniform sampler2D u_col_tex;
 uniform sampler2D u_depth_tex;
-uniform vec2 u_res;			// texture width, height
+uniform vec2 u_res;			// full resolution width, height (not the AO target)
 
 uniform float u_cam_near;
 uniform float u_cam_far;
@@ -19,12 +18,9 @@ uniform float u_fog_near;
 uniform float u_fog_far;
 
 uniform bool u_fog_enabled;		// attenuate AO with linear fog
-uniform bool u_only_ao; 		// use only ambient occlusion pass?
 
 uniform float u_ao_clamp; 		// depth clamp - reduces haloing at screen edges
 
-uniform float u_lum_influence;  // how much luminance affects occlusion
-
 // user variables
 
 const int AO_SAMPLES = 8; 		// ao sample count
@@ -36,9 +32,6 @@ const float NOISE_AMOUNT = 0.0003; // dithering amount
 const float DIFF_AREA = 0.4; 		// self-shadowing reduction
 const float G_DISPLACE = 0.4; 	// gauss bell center
 
-const vec3 AO_COLOR = vec3( 1.0, 0.7, 0.5 );
-//const vec3 AO_COLOR = vec3( 1.0, 1.0, 1.0 );,
-
 
 // RGBA depth
 
@@ -137,13 +130,6 @@ void main() {
     if ( u_fog_enabled ) {
         ao = mix( ao, 1.0, doFog() );
     }
-    vec3 color = texture2D( u_col_tex, v_texcoord ).rgb;
-    vec3 lumcoeff = vec3( 0.299, 0.587, 0.114 );
-    float lum = dot( color.rgb, lumcoeff );
-    vec3 luminance = vec3( lum );
-    vec3 final = vec3( color * mix( vec3( ao ), vec3( 1.0 ), luminance * u_lum_influence ) );
-    if (u_only_ao) {
-        final = AO_COLOR * vec3( mix( vec3( ao ), vec3( 1.0 ), luminance * u_lum_influence ) );
-    }
-    f_color = vec4( final, 1.0 );
+    // only the occlusion term; ssao_composite.frag applies it to the color
+    f_color = vec4( vec3( ao ), 1.0 );
 }
@@ -0,0 +1,20 @@
+#version 330 core
+
+uniform sampler2D u_col_tex;
+uniform sampler2D u_ao_tex;  // 縮小して求めた AO
+uniform float u_lum_influence;
+uniform bool u_only_ao;
+
+in vec2 v_texcoord;
+out vec4 f_color;
+
+const vec3 AO_COLOR = vec3(1.0, 0.7, 0.5);
+
+// AO を線形補間で拡大して色に掛ける。明るいところほど弱める
+void main() {
+  vec3 color = texture(u_col_tex, v_texcoord).rgb;
+  float ao = texture(u_ao_tex, v_texcoord).r;
+  float lum = dot(color, vec3(0.299, 0.587, 0.114));
+  vec3 occlusion = mix(vec3(ao), vec3(1.0), lum * u_lum_influence);
+  f_color = vec4(u_only_ao ? AO_COLOR * occlusion : color * occlusion, 1.0);
+}
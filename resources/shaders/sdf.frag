@@ -0,0 +1,15 @@
+#version 400
+
+in vec4 v_color; 
+in vec2 v_texcoord;
+out vec4 o_color;
+
+uniform sampler2D TEX;
+
+// アルファに輪郭からの距離が入っている。0.5 が輪郭
+void main() {
+    float d = texture(TEX, v_texcoord).a;
+    float w = fwidth(d);
+    float alpha = smoothstep(0.5 - w, 0.5 + w, d);
+    o_color = vec4(v_color.rgb, v_color.a * alpha);
+}
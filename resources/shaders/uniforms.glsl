@@ -0,0 +1,17 @@
+// Renderer が書き込む既定の uniform (gl/Renderer.h の FrameUniforms, DrawUniforms)
+layout(std140) uniform FrameUniforms {
+    vec2 RESOLUTION;
+    float TIME;
+    int FRAME;
+};
+
+layout(std140) uniform DrawUniforms {
+    mat4 MVP_MAT;
+    mat4 TEX_MAT;
+    vec4 COLOR;
+    bool USE_TEX;
+    bool HAS_COLOR;
+    bool HAS_NORMAL;
+    bool HAS_TEXCOORD;
+    bool INSTANCED;
+};
@@ -115,7 +115,7 @@ find_package(ZLIB REQUIRED)
 find_package(CGAL REQUIRED)
 
 find_package(PkgConfig REQUIRED)
-pkg_check_modules(FFMPEG REQUIRED IMPORTED_TARGET libavcodec libavformat libavutil libswscale libswresample libavfilter)
+pkg_check_modules(FFMPEG REQUIRED IMPORTED_TARGET libavcodec libavformat libavutil libswscale libswresample libavfilter libavdevice)
 # pkg_check_modules(LIBXML2 REQUIRED IMPORTED_TARGET libxml-2.0)
 
 set(CORE_HEADERS
@@ -237,9 +237,11 @@ set(CORE_DEFINITIONS
     STB_IMAGE_STATIC
     STB_IMAGE_RESIZE_STATIC
     STB_IMAGE_WRITE_STATIC
+    STBRP_STATIC
     STB_IMAGE_IMPLEMENTATION
     STB_IMAGE_RESIZE_IMPLEMENTATION
     STB_IMAGE_WRITE_IMPLEMENTATION
+    STB_RECT_PACK_IMPLEMENTATION
     IMGUI_IMPL_OPENGL_LOADER_CUSTOM
     # TINYGLTF_NO_INCLUDE_STB_IMAGE
     # TINYGLTF_NO_INCLUDE_STB_IMAGE_WRITE
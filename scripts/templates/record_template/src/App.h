@@ -10,11 +10,16 @@ class App : public BaseApp {
  public:
   using BaseApp::BaseApp;
 
+  static constexpr float FPS = 30;
+  static constexpr float DURATION = 10;  // オフラインレンダリングの長さ (秒)
+
   VideoExporter exporter_;
 
   void setup() {
-    setFPS(30);
-    exporter_.allocate(getWidth(), getHeight(), 30);
+    setFPS(FPS);
+    exporter_.allocate(getWidth(), getHeight(), FPS);
+
+    if (isOfflineRendering()) startRecording();
   }
 
   void draw() {
@@ -27,6 +32,11 @@ class App : public BaseApp {
     gl::popMatrix();
     exporter_.unbind();
 
+    if (isOfflineRendering() && getFrameNumber() + 1 >= FPS * DURATION) {
+      exporter_.stop();
+      exit();
+    }
+
     gl::setColor(1, 1, 1, 1);
     gl::pushMatrix();
     gl::setOrthoView(getWidth(), getHeight());
@@ -40,7 +50,7 @@ class App : public BaseApp {
 
   void keyPressed(const KeyEventArgs &e) {
     if (e.key == 'r') {
-      exporter_.start(fs::getAssetPath() + util::getTimestamp() + ".mov");
+      startRecording();
     } else if (e.key == 'q') {
       exporter_.stop();
       exit();
@@ -64,6 +74,12 @@ class App : public BaseApp {
   void windowClosed(const EventArgs &e) {}
 
   void fileDropped(const FileDropEventArgs &e) {}
+
+  void startRecording() {
+    exporter_.start(fs::getAssetPath() + utils::getTimestamp() +
+                    VideoExporter::getExtension(
+                        exporter_.getSettings().container));
+  }
 };
 
 }  // namespace limas
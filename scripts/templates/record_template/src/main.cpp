@@ -1,7 +1,17 @@
 #include "App.h"
 #include "app/AppUtils.h"
 
-int main() {
+// --offline: 1/fps 刻みの仮想時間で待たずに書き出す
+// --headless: ウィンドウを表示せずにオフラインで書き出す
+int main(int argc, char* argv[]) {
+  bool b_offline = false;
+  bool b_headless = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--offline") b_offline = true;
+    if (arg == "--headless") b_offline = b_headless = true;
+  }
+
   limas::Window::Settings settings;
   settings.x = 0;
   settings.y = 0;
@@ -11,7 +21,7 @@ int main() {
   settings.major = 4;
   settings.minor = 1;
   settings.resizable = true;
-  settings.visible = true;
+  settings.visible = !b_headless;
   settings.decorated = true;
   settings.floating = false;
   settings.transparent = false;
@@ -26,6 +36,7 @@ int main() {
 
   auto& app = limas::app::getPtr();
   app = std::make_shared<limas::App>(settings);
+  app->setOfflineRendering(b_offline);
   app->run();
 
   return 0;